@@ -79,6 +79,7 @@
 #include <algorithm>
 #include <cstdarg>
 #include <queue>
+#include <set>
 
 using namespace llvm;
 
@@ -111,10 +112,10 @@ class SoftBoundCETSPass: public ModulePass {
   
   Function* m_call_dereference_func;
   
-  /* Function Type of the function that loads the base and bound for
-   * a given pointer 
+  /* Function that returns the address of the trie entry holding the
+   * metadata of a given pointer; the metadata is loaded from it inline
    */
-  Function* m_load_base_bound_func;
+  Function* m_metadata_entry_func;
 
   /* Function Type of the function that stores the base and bound
    * for a given pointer
@@ -190,6 +191,32 @@ class SoftBoundCETSPass: public ModulePass {
   StringMap<bool> m_func_transformed;
   
   StringMap<Value*> m_func_global_lock;
+
+  /* Functions with local linkage that are only called directly. The
+   * metadata of their pointer arguments is passed in extra arguments
+   * and the metadata of a returned pointer is returned along with it,
+   * instead of going through the shadow stack.
+   */
+  std::set<Function*> m_register_metadata_funcs;
+
+  /* Placeholders for the metadata of the pointer arguments of those
+   * functions, in the order of the extra arguments
+   */
+  std::map<Function*, SmallVector<Value*, 8> > m_register_metadata_args;
+
+  /* Metadata returned by each return instruction of those functions */
+  std::map<ReturnInst*, SmallVector<Value*, 4> > m_register_metadata_rets;
+
+  /* Metadata passed at each call to those functions, and the
+   * placeholders for the metadata of the returned pointer
+   */
+  std::map<CallInst*, SmallVector<Value*, 8> > m_register_metadata_calls;
+  std::map<CallInst*, SmallVector<Value*, 4> > m_register_metadata_call_rets;
+
+  /* Whether a function may free memory, directly or through the
+   * functions that it calls
+   */
+  std::map<Function*, bool> m_func_may_free;
   
   /* Boolean indicating whether bitcode generated is for 64bit or 32bit */
   bool m_is_64_bit;
@@ -249,6 +276,9 @@ class SoftBoundCETSPass: public ModulePass {
   bool optimizeTemporalChecks(Instruction*, std::map<Value*, int>&, std::map<Value*,int>&);
   bool bbTemporalCheckElimination(Instruction*, std::map<Value*, int>&);
   bool funcTemporalCheckElimination(Instruction*, std::map<Value*, int>&);
+  void computeMayFreeSummaries(Module&);
+  bool isKnownNoFree(Function*);
+  bool isTemporalCheckBarrier(Instruction*);
   bool optimizeGlobalAndStackVariableChecks(Instruction*);
   bool checkLoadStoreSourceIsGEP(Instruction*, Value*);
   void addMemcopyCheck(CallInst*);
@@ -349,6 +379,10 @@ class SoftBoundCETSPass: public ModulePass {
   void introduceShadowStackStores(Value*, Instruction*, int);
   void introduceShadowStackDeallocation(CallInst*, Instruction*);
   int getNumPointerArgsAndReturn(CallInst*);
+  void identifyRegisterMetadataFuncs(Module&);
+  void getMetadataOperands(Value*, Instruction*, SmallVectorImpl<Value*>&);
+  void getMetadataPlaceholders(Value*, SmallVectorImpl<Value*>&);
+  void passMetadataInRegisters(Function*);
 
   void checkIfRetTypePtr(Function*, bool &);
   Instruction* getReturnInst(Function*, int);
@@ -66,5 +66,71 @@ struct InsertBaggyBoundsChecks : public ModulePass {
     void callClonedFunction(Function * F, Function * NewF);
 };
 
+//
+// Pass: InlineBBChecks
+//
+// Description:
+//  This pass replaces calls to the baggy bounds run-time checks with inline
+//  code that performs the size table lookup and bounds comparison.  The
+//  run-time check is only called when the inline check fails.
+//
+struct InlineBBChecks : public ModulePass {
+  public:
+    static char ID;
+    InlineBBChecks () : ModulePass (ID) { }
+    const char *getPassName() const { return "Inline BaggyBounds Checks"; }
+    virtual bool runOnModule(Module &M);
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      // Required passes
+      AU.addRequired<DataLayout>();
+    };
+
+  protected:
+    // Pointers to required passes
+    DataLayout * TD;
+
+    // The global variable holding the address of the size table
+    Constant * SizeTable;
+
+    // Protected methods
+    Function * createInlineBodyFor (Function * F, bool isGEPCheck,
+                                    bool hasLength, bool isTagged);
+    bool inlineChecks (Function * F, bool isGEPCheck, bool hasLength,
+                       bool isTagged);
+};
+
+//
+// Pass: LowerBaggyTags
+//
+// Description:
+//  This pass prepares code for the tagged pointer mode of baggy bounds
+//  checking.  It replaces the run-time checks and allocators with versions
+//  that understand pointer tags, and it strips the tags from pointers before
+//  they are dereferenced, compared, converted to integers, or passed to
+//  external code.  It must run after all checks are inserted and before
+//  InlineBBChecks.
+//
+struct LowerBaggyTags : public ModulePass {
+  public:
+    static char ID;
+    LowerBaggyTags () : ModulePass (ID) { }
+    const char *getPassName() const { return "Lower BaggyBounds Pointer Tags"; }
+    virtual bool runOnModule(Module &M);
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      // Required passes
+      AU.addRequired<DataLayout>();
+    };
+
+  protected:
+    // Pointers to required passes
+    DataLayout * TD;
+
+    // Protected methods
+    bool renameRuntimeFunctions (Module & M);
+    bool stripTags (Function & F);
+    Value * stripTag (Value * Ptr, Instruction * InsertPt);
+    Constant * stripTag (Constant * C);
+};
+
 }
 #endif
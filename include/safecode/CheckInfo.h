@@ -15,9 +15,16 @@
 #ifndef _SC_CHECKINFO_H_
 #define _SC_CHECKINFO_H_
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
 #include "llvm/Support/CallSite.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cstring>
+#include <utility>
+#include <vector>
 
 using namespace llvm;
 
@@ -170,5 +177,154 @@ findRuntimeCheck (const Function * F) {
   return 0;
 }
 
+//
+// Function: findCompleteCheck()
+//
+// Description:
+//  Find the table entry of the complete version of a run-time check.
+//
+static inline const struct CheckInfo &
+findCompleteCheck (const struct CheckInfo & Info) {
+  for (unsigned index = 0; index < numChecks; ++index) {
+    if (!strcmp (RuntimeChecks[index].name, Info.completeName))
+      return RuntimeChecks[index];
+  }
+
+  llvm_unreachable ("Run-time check without a complete version!");
+}
+
+//
+// Class: RuntimeCheckRegistry
+//
+// Description:
+//  This class maps the functions of a module that implement run-time checks
+//  to their entries in the RuntimeChecks table.  It is built with one symbol
+//  table lookup per entry; afterwards, a call can be classified by its callee
+//  in constant time instead of by comparing names against the table.
+//
+class RuntimeCheckRegistry {
+  public:
+    // A direct call to a run-time check and the check that it calls
+    typedef std::pair<CallInst *, const CheckInfo *> CheckCall;
+
+    RuntimeCheckRegistry () {
+      clear ();
+    }
+
+    explicit RuntimeCheckRegistry (Module & M) {
+      build (M);
+    }
+
+    //
+    // Method: build()
+    //
+    // Description:
+    //  Find the functions in the module that implement run-time checks.
+    //
+    void build (Module & M) {
+      clear ();
+      for (unsigned index = 0; index < numChecks; ++index) {
+        if (Function * F = M.getFunction (RuntimeChecks[index].name))
+          add (F, RuntimeChecks[index]);
+      }
+    }
+
+    //
+    // Method: add()
+    //
+    // Description:
+    //  Record a function implementing a run-time check.  Passes that add a
+    //  check function to the module after building the registry use this to
+    //  keep it up to date.
+    //
+    void add (Function * F, const CheckInfo & Info) {
+      Functions[&Info - RuntimeChecks] = F;
+      Checks[F] = &Info;
+    }
+
+    //
+    // Method: find()
+    //
+    // Return value:
+    //  NULL - The function is not a run-time check.
+    //  Otherwise, a pointer to the run-time check's entry is returned.
+    //
+    const CheckInfo * find (const Function * F) const {
+      DenseMap<const Function *, const CheckInfo *>::const_iterator i;
+      i = Checks.find (F);
+      return (i != Checks.end()) ? i->second : 0;
+    }
+
+    bool isRuntimeCheck (const Function * F) const {
+      return Checks.count (F);
+    }
+
+    //
+    // Method: findCall()
+    //
+    // Description:
+    //  Determine whether the instruction is a direct call to a run-time check,
+    //  looking through casts of the callee.
+    //
+    const CheckInfo * findCall (const Instruction * I) const {
+      if (const CallInst * CI = dyn_cast<CallInst>(I)) {
+        const Value * CV = CI->getCalledValue()->stripPointerCasts();
+        if (const Function * F = dyn_cast<Function>(CV))
+          return find (F);
+      }
+
+      return 0;
+    }
+
+    //
+    // Method: getFunction()
+    //
+    // Return value:
+    //  The function implementing the run-time check, or NULL if the module
+    //  does not contain it.
+    //
+    Function * getFunction (const CheckInfo & Info) const {
+      return Functions[&Info - RuntimeChecks];
+    }
+
+    //
+    // Method: findCalls()
+    //
+    // Description:
+    //  Collect the direct calls to all run-time checks in the module in one
+    //  walk over the uses of the check functions.  Calls are listed in the
+    //  order of the RuntimeChecks table.
+    //
+    void findCalls (std::vector<CheckCall> & Calls) const {
+      for (unsigned index = 0; index < numChecks; ++index) {
+        Function * F = Functions[index];
+        if (!F)
+          continue;
+
+        Value::use_iterator UI = F->use_begin();
+        Value::use_iterator  E = F->use_end();
+        for (; UI != E; ++UI) {
+          if (CallInst * CI = dyn_cast<CallInst>(*UI)) {
+            if (CI->getCalledValue()->stripPointerCasts() == F)
+              Calls.push_back (CheckCall (CI, &RuntimeChecks[index]));
+          }
+        }
+      }
+    }
+
+  private:
+    // The check implemented by each function
+    DenseMap<const Function *, const CheckInfo *> Checks;
+
+    // The function implementing each entry of RuntimeChecks
+    Function * Functions[numChecks];
+
+    void clear (void) {
+      Checks.clear ();
+      for (unsigned index = 0; index < numChecks; ++index)
+        Functions[index] = 0;
+    }
+};
+
 }
 #endif
@@ -19,6 +19,8 @@
 #include "dsa/DataStructure.h"
 #include "dsa/DSGraph.h"
 
+#include "safecode/CheckInfo.h"
+
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Pass.h"
 
@@ -50,7 +52,7 @@ struct CompleteChecks : public ModulePass {
   protected:
     // Protected methods
     DSNodeHandle getDSNodeHandle (const Value * V, const Function * F);
-    void makeComplete (Module & M, const struct CheckInfo & CheckInfo);
+    void makeComplete (Module & M, RuntimeCheckRegistry & Checks);
     void makeCStdLibCallsComplete(Function *, unsigned, bool);
     void makeFSParameterCallsComplete(Module &M);
     void fixupCFIChecks (Module & M, std::string name);
@@ -15,13 +15,17 @@
 #define SAFECODE_OPTIMIZECHECKS_H
 
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/Analysis/Dominators.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 
 #include "safecode/CheckInfo.h"
 #include "safecode/AllocatorInfo.h"
 
+#include <map>
+
 namespace llvm {
 
 //
@@ -33,8 +37,10 @@ namespace llvm {
 //
 struct OptimizeChecks : public ModulePass {
   private:
+    // The run-time check functions of the module being optimized
+    RuntimeCheckRegistry Checks;
+
     // Private methods
-    bool processFunction (Module & M, const struct CheckInfo & Info);
     bool onlyUsedInCompares (Value * Val);
 
   public:
@@ -75,6 +81,89 @@ struct GlobalRegisterOpt : public ModulePass {
     }
 };
 
+//
+// Pass: ReuseObjectBounds
+//
+// Description:
+//  This pass finds run-time checks on pointers derived from the same base
+//  pointer.  When one such check dominates others and no memory can be freed
+//  in between, the object's bounds are looked up once before the dominating
+//  check and the checks are replaced with inline comparisons against them.
+//  The original run-time check is only called when a comparison fails.
+//
+struct ReuseObjectBounds : public ModulePass {
+  private:
+    // The run-time function that returns the bounds of an object
+    Function * GetBounds;
+
+    // Inline versions of the checks that compare against known bounds
+    std::map<Function *, Function *> BoundedChecks;
+
+    // Private methods
+    bool processFunction (Function & F);
+    bool mayFreeBetween (Instruction * From, Instruction * To);
+    Function * getBoundedCheck (Function * F, const struct CheckInfo & Info);
+
+  public:
+    static char ID;
+    ReuseObjectBounds() : ModulePass(ID) {}
+    virtual bool runOnModule (Module & M);
+
+    const char *getPassName() const {
+      return "Reuse Object Bounds in Dominated Run-time Checks";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<DataLayout>();
+      AU.addRequired<DominatorTree>();
+    }
+};
+
+//
+// Pass: SampleChecks
+//
+// Description:
+//  This pass lets a program run its run-time checks on a sample of calls.  It
+//  makes an unchecked copy of each function containing checks and adds code to
+//  the entry of the original function that asks the run-time, on each call,
+//  whether the checked or the unchecked version runs.  The unchecked copy
+//  keeps the bounds checks of pointer arithmetic so that out of bounds
+//  pointers are still rewritten.  See safecode/Runtime/Sampling.h for how the
+//  run-time decides.
+//
+struct SampleChecks : public ModulePass {
+  private:
+    // The thread-local countdown to the next sampled call
+    GlobalVariable * Countdown;
+
+    // The run-time function that decides whether a sampled call is checked
+    Function * SampleHit;
+
+    // The run-time check functions of the module
+    RuntimeCheckRegistry Checks;
+
+    // Functions of checks not described in CheckInfo.h that are also removed
+    SmallPtrSet<Function *, 4> OtherChecks;
+
+    // Private methods
+    bool isSampledCheck (Function * F);
+    bool hasChecks (Function & F);
+    Function * createUncheckedVersion (Function & F);
+    void addDispatch (Function & F, Function * Unchecked);
+
+  public:
+    static char ID;
+    SampleChecks() : ModulePass(ID) {}
+    virtual bool runOnModule (Module & M);
+
+    const char *getPassName() const {
+      return "Sample SAFECode Run-time Checks";
+    }
+};
+
+// Create a pass that inlines the fast load/store checks
+ModulePass * createInlineFastChecksPass (void);
+
 }
 
 #endif
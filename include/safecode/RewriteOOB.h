@@ -16,10 +16,14 @@
 #define REWRITEOOB_H
 
 #include "llvm/Analysis/Dominators.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "safecode/CheckInfo.h"
 
+#include <map>
+#include <vector>
+
 namespace llvm {
 
 //
@@ -30,12 +34,32 @@ namespace llvm {
 //  rewriting.  This involves modifying all uses of a checked pointer to use
 //  the return value of the run-time check.
 //
+//  Pointers that are compared or cast to integers are converted back to their
+//  original values with an inline test against the rewrite pointer range; the
+//  run-time is only called for pointers within the range.
+//
 class RewriteOOB : public ModulePass {
   private:
     // Private methods
     bool processFunction (Module & M, const struct CheckInfo & Check);
     bool addGetActualValues (Module & M);
     void addGetActualValue (Instruction *SCI, unsigned operand);
+    Function * createInlineBodyFor (Function * GetActualValue);
+    bool isKnownNotRewritten (Value * Ptr);
+    bool isAlreadyTranslated (Value * Ptr, Instruction * I, Value *& Actual);
+
+    // Data layout of the target
+    const DataLayout * TD;
+
+    // The inline version of getActualValue()
+    Function * GetActualValueInline;
+
+    // Calls to the inline getActualValue() added to the current function,
+    // indexed by the pointer that they translate
+    std::map<Value *, std::vector<CallInst *> > Translated;
+
+    // Dominator tree of the current function, or NULL if not yet computed
+    DominatorTree * DT;
 
   public:
     static char ID;
@@ -45,6 +69,7 @@ class RewriteOOB : public ModulePass {
     virtual void getAnalysisUsage(AnalysisUsage &AU) const {
       // We require Dominator information
       AU.addRequired<DominatorTree>();
+      AU.addRequired<DataLayout>();
     }
 };
 
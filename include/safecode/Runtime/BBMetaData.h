@@ -1,9 +1,37 @@
 #ifndef _BBMETADATA_H_
 #define _BBMETADATA_H_
 
+#include <stdint.h>
+
 struct BBMetaData {
   unsigned int size;
   void *pool;
 };
 
+//
+// Tagged pointer mode (x86-64 only): the binary logarithm of the aligned size
+// of a memory object is kept in the upper bits of pointers to the object.  A
+// tag of zero means that the pointer is untagged and its object must be found
+// in the baggy bounds size table.
+//
+#define BB_TAG_SHIFT 58
+#define BB_ADDR_MASK ((((uintptr_t) 1) << BB_TAG_SHIFT) - 1)
+
+#if defined(__x86_64__)
+static inline unsigned
+bb_tagof (uintptr_t p) {
+  return (unsigned) (p >> BB_TAG_SHIFT);
+}
+
+static inline uintptr_t
+bb_untag (uintptr_t p) {
+  return p & BB_ADDR_MASK;
+}
+
+static inline uintptr_t
+bb_tag (uintptr_t p, unsigned e) {
+  return bb_untag (p) | (((uintptr_t) e) << BB_TAG_SHIFT);
+}
+#endif
+
 #endif
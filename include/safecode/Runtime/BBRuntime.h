@@ -161,6 +161,26 @@ extern "C" {
   void * bb_boundscheckui_debug (PPOOL, void * S, void * D, TAG, SRC_INFO);
   void * bb_boundscheck_debug (PPOOL, void * S, void * D, TAG, SRC_INFO);
 
+#if defined(__x86_64__)
+  // Tagged pointer mode: sizes are kept in the upper bits of the pointers
+  void * __sc_bb_tagged_poolalloc (PPOOL, unsigned NumBytes);
+  void * __sc_bb_tagged_src_poolalloc (PPOOL, unsigned NumBytes, TAG, SRC_INFO);
+  void * __sc_bb_tagged_poolcalloc (PPOOL, unsigned Number, unsigned NumBytes, TAG);
+  void * __sc_bb_tagged_src_poolcalloc (PPOOL,
+                                        unsigned Number, unsigned NumBytes,
+                                        TAG, SRC_INFO);
+  void * __sc_bb_tagged_poolrealloc (PPOOL, void *Node, unsigned NumBytes);
+  void * __sc_bb_tagged_poolrealloc_debug (PPOOL, void *Node, unsigned NumBytes,
+                                           TAG, SRC_INFO);
+  void __sc_bb_tagged_poolfree (PPOOL, void *Node);
+  void __sc_bb_tagged_src_poolfree (PPOOL, void *Node, TAG, SRC_INFO);
+
+  void bb_tagged_poolcheck (PPOOL, void *Node);
+  void bb_tagged_poolcheck_debug (PPOOL, void * Node, unsigned length, TAG, SRC_INFO);
+  void * bb_tagged_boundscheck (PPOOL, void * Source, void * Dest);
+  void * bb_tagged_boundscheck_debug (PPOOL, void * S, void * D, TAG, SRC_INFO);
+#endif
+
 #ifdef _GNU_SOURCE
   void * bb_pool_mempcpy(PPOOL dstPool, PPOOL srcPool, void *dst, const void *src, size_t n);
 #endif
@@ -0,0 +1,143 @@
+//===- MetadataBudget.h - Run-time metadata memory budgets ------*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the accounting of the memory used by the run-time's own
+// metadata and the budgets that limit it.
+//
+// Budgets are set at run-time with the SAFECODE_METADATA_BUDGET environment
+// variable, which holds a comma separated list of <kind>=<size> entries.  A
+// size may end in K, M, or G.  A size without a kind limits the total.  The
+// kinds are:
+//
+//   splay     - Nodes of the object, out of bounds, and dangling pointer
+//               splay trees.
+//   debuginfo - Allocation and free records of heap objects.
+//   shadow    - Shadow mappings made for dangling pointer detection.  These
+//               are counted at their virtual size.
+//   rewrite   - Maps describing rewritten out of bounds pointers.  Entries
+//               are kept for the rest of the execution so that faults on
+//               rewritten pointers can be reported, so this limits how many
+//               pointers are rewritten.  The OOB splay tree nodes that also
+//               describe them are counted as splay nodes and are released
+//               when their pool is destroyed.
+//   total     - The sum of all of the above.
+//
+// For example, SAFECODE_METADATA_BUDGET=64M,shadow=1G.  The SoftBound run-time
+// reads the same variable but only accounts for its metadata trie: it accepts
+// "trie", and the total limits the trie alone.
+//
+// When a budget is exceeded, a message is printed and the run-time degrades
+// for the rest of the execution:
+//
+//   splay, debuginfo, shadow - New heap objects are no longer remapped to
+//                              shadow pages, so dangling pointers to them are
+//                              not detected, and the cache of pre-made shadow
+//                              pages is released.  Objects that are already
+//                              shadowed keep their protection.
+//   rewrite                  - Out of bounds pointers are no longer rewritten.
+//   total                    - All of the above.
+//
+// When SAFECODE_METADATA_BUDGET is not set, nothing is counted and each
+// accounting call is a single well-predicted branch.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_METADATABUDGET_H_
+#define _SC_METADATABUDGET_H_
+
+#include <stddef.h>
+
+//
+// Enum: SCMetadataKind
+//
+// Description:
+//  The kinds of metadata that the run-time accounts for.
+//
+enum SCMetadataKind {
+  SC_MD_SPLAY_NODES,
+  SC_MD_DEBUG_INFO,
+  SC_MD_SHADOW_PAGES,
+  SC_MD_REWRITE_MAPS,
+  SC_MD_NUM_KINDS
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Non-zero if metadata is being counted
+extern int __sc_md_enabled;
+
+// Bytes of metadata of each kind and in total.  These are signed because
+// metadata allocated before counting starts may be released afterwards.
+extern long __sc_md_bytes[SC_MD_NUM_KINDS];
+extern long __sc_md_total;
+
+// Budget of each kind and of the total in bytes; zero means unlimited
+extern long __sc_md_budget[SC_MD_NUM_KINDS];
+extern long __sc_md_total_budget;
+
+// Bit mask of the kinds of metadata whose budget has been exceeded
+extern volatile unsigned __sc_md_degraded;
+
+// Read the budgets from the SAFECODE_METADATA_BUDGET environment variable
+void __sc_md_init (void);
+
+// Record that the budget for a kind of metadata, or the total, was exceeded
+void __sc_md_exceeded (enum SCMetadataKind kind);
+
+#ifdef __cplusplus
+}
+#endif
+
+//
+// Function: sc_md_charge()
+//
+// Description:
+//  Account for the allocation of metadata of the specified kind and note if
+//  that exceeds a budget.
+//
+static inline void
+sc_md_charge (enum SCMetadataKind kind, size_t bytes) {
+  if (__builtin_expect (__sc_md_enabled, 0)) {
+    long used = __sync_add_and_fetch (&__sc_md_bytes[kind], (long) bytes);
+    long total = __sync_add_and_fetch (&__sc_md_total, (long) bytes);
+    if ((__sc_md_budget[kind] && (used > __sc_md_budget[kind])) ||
+        (__sc_md_total_budget && (total > __sc_md_total_budget)))
+      __sc_md_exceeded (kind);
+  }
+}
+
+//
+// Function: sc_md_release()
+//
+// Description:
+//  Account for the deallocation of metadata of the specified kind.
+//
+static inline void
+sc_md_release (enum SCMetadataKind kind, size_t bytes) {
+  if (__builtin_expect (__sc_md_enabled, 0)) {
+    __sync_sub_and_fetch (&__sc_md_bytes[kind], (long) bytes);
+    __sync_sub_and_fetch (&__sc_md_total, (long) bytes);
+  }
+}
+
+//
+// Function: sc_md_degraded()
+//
+// Description:
+//  Determine whether the run-time should degrade its handling of the specified
+//  kind of metadata because a budget was exceeded.
+//
+static inline int
+sc_md_degraded (enum SCMetadataKind kind) {
+  return __builtin_expect ((__sc_md_degraded >> kind) & 1, 0);
+}
+
+#endif
@@ -0,0 +1,63 @@
+//===- Sampling.h - Sampled checking of duplicated functions ----*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the run-time interface used by code compiled with sampled
+// checking (see the SampleChecks pass), which the debug and baggy bounds
+// run-times provide.  Each instrumented function has a checked and an
+// unchecked version, and every call to the function decides which one to
+// run:
+//
+//   if (__sc_sample_countdown != 0) {
+//     --__sc_sample_countdown;
+//     run the unchecked version
+//   } else if (__sc_sample_hit ()) {
+//     run the checked version
+//   } else {
+//     run the unchecked version
+//   }
+//
+// The countdown is per-thread, so the common case is a load, a compare, and a
+// store of thread-local memory.  __sc_sample_hit() counts the checked entry
+// and picks the next countdown at random so that the calls that are checked
+// do not follow the period of the program's own call patterns.
+//
+// The rate is set at run-time with the SAFECODE_SAMPLE_RATE environment
+// variable, which holds the fraction of calls to check, either as a decimal
+// (0.01) or as a ratio (1/100).  The default is 1/100.  A rate of 1 checks
+// every call and a rate of 0 checks none.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_SAMPLING_H_
+#define _SC_SAMPLING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of calls that the calling thread runs unchecked before the next one
+// that may be checked
+extern __thread unsigned __sc_sample_countdown;
+
+// Decide whether the current call is checked and pick the next countdown.
+// Returns non-zero if the checked version should be run.
+unsigned __sc_sample_hit (void);
+
+// Set and get the fraction of calls that are checked
+void __sc_sample_set_rate (double rate);
+double __sc_sample_get_rate (void);
+
+// Return the number of calls that ran the checked version in all threads
+unsigned long __sc_sample_get_hits (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
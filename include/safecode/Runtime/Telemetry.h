@@ -0,0 +1,164 @@
+//===- Telemetry.h - Run-time statistics counters ---------------*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the statistics counters kept by the debug and baggy bounds
+// run-times and the layout of the statistics page through which they are
+// published.
+//
+// Counting is enabled at run-time with the SAFECODE_STATS environment
+// variable, which holds a comma separated list of:
+//
+//   shm     - Publish the counters in the file safecode-stats.<pid> in the
+//             directory named by SAFECODE_STATS_DIR (/dev/shm on Linux and
+//             /tmp elsewhere by default) so that scstat can read them while
+//             the program runs.
+//   signal  - Print the counters to standard error when the program receives
+//             SIGUSR2.
+//   exit    - Print the counters to standard error when the program exits.
+//
+// Any other non-empty value just enables counting.  When SAFECODE_STATS is
+// not set, each counter update is a single well-predicted branch.
+//
+// Each thread updates its own row of counters in the page.  Since a row has a
+// single writer, it is updated with relaxed atomic loads and stores and needs
+// no locked read-modify-write; readers sum the rows with atomic loads.
+// Threads beyond the number of rows share the first row and update it with
+// atomic additions.  Rows are never reused, so the counts of threads that
+// have exited are kept.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_TELEMETRY_H_
+#define _SC_TELEMETRY_H_
+
+#include <stdint.h>
+
+// Magic number and version identifying a statistics page
+#define SC_STATS_MAGIC   0x53435354
+#define SC_STATS_VERSION 1
+
+// Number of rows of counters in the statistics page
+#define SC_STATS_MAX_THREADS 64
+
+// Default directory and format of the name of the file holding the page
+#if defined(__linux__)
+#define SC_STATS_DEFAULT_DIR "/dev/shm"
+#else
+#define SC_STATS_DEFAULT_DIR "/tmp"
+#endif
+#define SC_STATS_FILE_FORMAT "%s/safecode-stats.%d"
+
+//
+// Enum: SCStatCounter
+//
+// Description:
+//  The counters kept by the run-time.  The sum of the splay tree depths
+//  divided by the number of lookups gives the average depth; the number of
+//  live objects is the number of registrations minus unregistrations.
+//
+enum SCStatCounter {
+  SC_STAT_LOADSTORE_CHECKS,
+  SC_STAT_BOUNDS_CHECKS,
+  SC_STAT_EXACT_CHECKS,
+  SC_STAT_FUNC_CHECKS,
+  SC_STAT_REGISTRATIONS,
+  SC_STAT_UNREGISTRATIONS,
+  SC_STAT_CACHE_HITS,
+  SC_STAT_CACHE_MISSES,
+  SC_STAT_SPLAY_LOOKUPS,
+  SC_STAT_SPLAY_DEPTH,
+  SC_STAT_REWRITES,
+  SC_STAT_VIOLATIONS,
+  SC_STAT_NUM_COUNTERS
+};
+
+// Names of the counters, indexed by SCStatCounter
+static const char * const SCStatNames[SC_STAT_NUM_COUNTERS] = {
+  "loadstore_checks",
+  "bounds_checks",
+  "exact_checks",
+  "func_checks",
+  "registrations",
+  "unregistrations",
+  "cache_hits",
+  "cache_misses",
+  "splay_lookups",
+  "splay_depth",
+  "rewrites",
+  "violations"
+};
+
+//
+// Structure: SCStatsPage
+//
+// Description:
+//  The layout of the statistics page.  Row 0 of the counters is shared by
+//  all threads that do not have a row of their own.
+//
+struct SCStatsPage {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numCounters;
+  uint32_t numRows;
+  int32_t  pid;
+  uint32_t rowsInUse;
+  char     runtime[16];
+  uint64_t counters[SC_STATS_MAX_THREADS][SC_STAT_NUM_COUNTERS];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Non-zero if the counters should be updated
+extern int __sc_stats_enabled;
+
+// The row of counters shared by threads without a row of their own
+extern uint64_t * __sc_stats_shared_row;
+
+// Initialize the counters from the SAFECODE_STATS environment variable
+void __sc_stats_init (const char * runtime);
+
+// Return the row of counters for the calling thread
+uint64_t * __sc_stats_row (void);
+
+// Add the counters of all threads and write them to a file descriptor
+void __sc_stats_dump (int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+// The row of counters of the calling thread, or null if not yet assigned
+extern __thread uint64_t * __sc_stats_thread_row;
+
+//
+// Function: sc_stat_add()
+//
+// Description:
+//  Add the specified amount to a counter if counting is enabled.
+//
+static inline void
+sc_stat_add (enum SCStatCounter counter, uint64_t amount) {
+  if (__builtin_expect (__sc_stats_enabled, 0)) {
+    uint64_t * row = __sc_stats_thread_row;
+    if (!row)
+      row = __sc_stats_row ();
+    if (row == __sc_stats_shared_row) {
+      __atomic_fetch_add (&row[counter], amount, __ATOMIC_RELAXED);
+    } else {
+      uint64_t value = __atomic_load_n (&row[counter], __ATOMIC_RELAXED);
+      __atomic_store_n (&row[counter], value + amount, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+#define SC_STAT(counter) sc_stat_add (counter, 1)
+
+#endif
@@ -49,6 +49,7 @@ struct SAFECodeConfiguration {
   bool svaEnabled();
   bool terminateOnErrors();
   bool rewriteOOB();
+  bool bbTaggedPointers();
 
   PATy          getPAType();
   DSATy         calculateDSAType();
@@ -23,6 +23,7 @@
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/InstIterator.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/IR/TypeBuilder.h"
@@ -30,6 +31,7 @@
 #include "llvm/IR/IRBuilder.h"
 
 #include "safecode/BaggyBoundsChecks.h"
+#include "safecode/SAFECodeConfig.h"
 #include "safecode/Runtime/BBMetaData.h"
 
 #include <iostream>
@@ -247,6 +249,32 @@ InsertBaggyBoundsChecks::adjustGlobalValue (GlobalValue * V) {
   Value *Zero = ConstantInt::getSigned(Int32Type, 0);
   Value *idx1[2] = {Zero, Zero};
   Constant *init = ConstantExpr::getGetElementPtr(GV_new, idx1, 2);
+
+  //
+  // In tagged pointer mode, uses of the global see a pointer tagged with the
+  // size of the padded object.
+  //
+  if (NAMESPACE_SC::SCConfig.bbTaggedPointers()) {
+    Type * IntPtrTy = TD->getIntPtrType (GV->getContext());
+    Constant * Tag = ConstantInt::get (IntPtrTy, ((uint64_t) size) << BB_TAG_SHIFT);
+    Constant * Int = ConstantExpr::getPtrToInt (init, IntPtrTy);
+    init = ConstantExpr::getIntToPtr (ConstantExpr::getAdd (Int, Tag),
+                                      init->getType());
+  }
+
+  //
+  // An alias must refer to a global value (possibly through a cast), not to
+  // the constant expression above, so point the aliases of the global at the
+  // start of the new object.  Pointers obtained through an alias are not
+  // tagged; checks on them use the size table.
+  //
+  Module * M = GV->getParent();
+  for (Module::alias_iterator GA = M->alias_begin(); GA != M->alias_end();
+       ++GA) {
+    if (GA->getAliasee()->stripPointerCasts() == GV)
+      GA->setAliasee (ConstantExpr::getBitCast (GV_new, GA->getType()));
+  }
+
   GV->replaceAllUsesWith(init);
   GV->eraseFromParent();
 
@@ -329,6 +357,18 @@ InsertBaggyBoundsChecks::adjustAlloca (AllocaInst * AI) {
                                                 idx1,
                                                 Twine(""),
                                                 AI);
+
+  //
+  // In tagged pointer mode, uses of the alloca see a pointer tagged with the
+  // size of the padded object.
+  //
+  if (NAMESPACE_SC::SCConfig.bbTaggedPointers()) {
+    Type * IntPtrTy = TD->getIntPtrType (AI->getContext());
+    Value * Tag = ConstantInt::get (IntPtrTy, ((uint64_t) size) << BB_TAG_SHIFT);
+    Value * Int = new PtrToIntInst (init, IntPtrTy, "", AI);
+    Value * Tagged = BinaryOperator::Create (Instruction::Or, Int, Tag, "", AI);
+    init = new IntToPtrInst (Tagged, init->getType(), "tagged", AI);
+  }
   AI->replaceAllUsesWith(init);
   AI->removeFromParent(); 
   AI_new->setName(AI->getName());
@@ -1028,6 +1068,14 @@ bool
 InsertBaggyBoundsChecks::runOnModule (Module & M) {
   // Get prerequisite analysis results
   TD = &getAnalysis<DataLayout>();
+
+  //
+  // Pointer tags are only supported on 64-bit targets.
+  //
+  if (NAMESPACE_SC::SCConfig.bbTaggedPointers() &&
+      (TD->getPointerSizeInBits() != 64)) {
+    report_fatal_error ("Baggy bounds tagged pointers require a 64-bit target");
+  }
   //
   // Align and pad global variables.
   //
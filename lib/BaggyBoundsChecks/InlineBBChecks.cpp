@@ -0,0 +1,351 @@
+//===- InlineBBChecks.cpp - Inline baggy bounds run-time checks ----------- --//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass lowers calls to the baggy bounds run-time checks into inline code.
+// The inline code loads the binary logarithm of the object's allocation size
+// from the baggy bounds size table (or, in tagged pointer mode, reads it from
+// the pointer tag) and compares the pointers against the bounds of the
+// object.  The run-time check is only called when the inline
+// check fails; the run-time then reports the error or rewrites the
+// out-of-bounds pointer.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "inline-bbchecks"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "safecode/BaggyBoundsChecks.h"
+#include "safecode/Runtime/BBMetaData.h"
+
+#include <vector>
+
+namespace {
+  STATISTIC (InlinedGEPChecks, "Number of baggy bounds GEP checks inlined");
+  STATISTIC (InlinedLSChecks,  "Number of baggy bounds load/store checks inlined");
+}
+
+//
+// The binary logarithm of the size of a slot in the baggy bounds table.  This
+// must match the value used by the baggy bounds run-time.
+//
+static const unsigned SLOT_SIZE = 4;
+
+//
+// Structure: BBCheckEntry
+//
+// Description:
+//  This structure describes a baggy bounds run-time check that can be lowered
+//  into inline code.
+//
+struct BBCheckEntry {
+  // The name of the run-time check
+  const char * name;
+
+  // Flags whether the check is a GEP check (as opposed to a load/store check)
+  bool isGEPCheck;
+
+  // Flags whether the third argument is the length of the memory access
+  bool hasLength;
+
+  // Flags whether the check reads the object size from the pointer tag
+  bool isTagged;
+};
+
+static const struct BBCheckEntry BBChecks[] = {
+  {"bb_poolcheck",                false, false, false},
+  {"bb_poolcheckui",              false, false, false},
+  {"bb_poolcheck_debug",          false, true,  false},
+  {"bb_poolcheckui_debug",        false, true,  false},
+  {"bb_boundscheck",              true,  false, false},
+  {"bb_boundscheckui",            true,  false, false},
+  {"bb_boundscheck_debug",        true,  false, false},
+  {"bb_boundscheckui_debug",      true,  false, false},
+  {"bb_tagged_poolcheck",         false, false, true},
+  {"bb_tagged_poolcheck_debug",   false, true,  true},
+  {"bb_tagged_boundscheck",       true,  false, true},
+  {"bb_tagged_boundscheck_debug", true,  false, true}
+};
+
+namespace llvm {
+
+// Identifier variable for the pass
+char InlineBBChecks::ID = 0;
+
+// Register the pass
+static RegisterPass<InlineBBChecks> X ("inline-bbchecks",
+                                       "Inline baggy bounds run-time checks");
+
+//
+// Method: createInlineBodyFor()
+//
+// Description:
+//  Create an internal function with the same signature as the specified
+//  run-time check.  The new function performs the check inline and calls the
+//  run-time check only if the inline check fails.
+//
+// Inputs:
+//  F          - The run-time check function.
+//  isGEPCheck - Flags whether F is a GEP check or a load/store check.
+//  hasLength  - Flags whether the third argument of F is the access length.
+//  isTagged   - Flags whether F reads the object size from the pointer tag.
+//
+// Return value:
+//  A pointer to the new function is returned.
+//
+Function *
+InlineBBChecks::createInlineBodyFor (Function * F,
+                                     bool isGEPCheck,
+                                     bool hasLength,
+                                     bool isTagged) {
+  LLVMContext & Context = F->getContext();
+  Function * InlineF = Function::Create (F->getFunctionType(),
+                                         GlobalValue::InternalLinkage,
+                                         F->getName() + ".inline",
+                                         F->getParent());
+
+  //
+  // Create the basic blocks.  The entry block performs the table lookup and
+  // determines whether both pointers lie within the same aligned allocation.
+  // The meta block compares the pointers against the object's real size.  The
+  // slow block calls into the run-time.
+  //
+  BasicBlock * EntryBB = BasicBlock::Create (Context, "entry", InlineF);
+  BasicBlock * MetaBB  = BasicBlock::Create (Context, "meta",  InlineF);
+  BasicBlock * PassBB  = BasicBlock::Create (Context, "pass",  InlineF);
+  BasicBlock * SlowBB  = BasicBlock::Create (Context, "slow",  InlineF);
+
+  //
+  // Get the arguments of the check.
+  //
+  std::vector<Value *> args;
+  for (Function::arg_iterator arg = InlineF->arg_begin();
+       arg != InlineF->arg_end();
+       ++arg) {
+    args.push_back (arg);
+  }
+
+  Type * IntPtrTy = TD->getIntPtrType (Context);
+  Type * Int32Type = Type::getInt32Ty (Context);
+  MDNode * Unlikely = MDBuilder(Context).createBranchWeights (2000, 1);
+
+  //
+  // Find the first and last byte checked.  For a GEP check, these are the
+  // source and result pointers; for a load/store check, they are the first
+  // and last byte accessed.
+  //
+  IRBuilder<> Builder (EntryBB);
+  Value * Source = Builder.CreatePtrToInt (args[1], IntPtrTy, "source");
+  Value * Dest = 0;
+  if (isGEPCheck) {
+    Dest = Builder.CreatePtrToInt (args[2], IntPtrTy, "dest");
+  } else if (hasLength) {
+    Value * Length = Builder.CreateZExtOrBitCast (args[2], IntPtrTy, "len");
+    Dest = Builder.CreateAdd (Source, Length);
+    Dest = Builder.CreateSub (Dest, ConstantInt::get (IntPtrTy, 1), "last");
+  } else {
+    Dest = Source;
+  }
+
+  //
+  // Find the binary logarithm of the object's aligned size.  In tagged
+  // pointer mode, it is in the upper bits of the pointer; otherwise, load it
+  // from the size table.
+  //
+  Value * E = 0;
+  Value * Addr = Source;
+  Value * DestAddr = Dest;
+  if (isTagged) {
+    E = Builder.CreateLShr (Source, BB_TAG_SHIFT, "e");
+    Constant * Mask = ConstantInt::get (IntPtrTy,
+                                        (((uint64_t) 1) << BB_TAG_SHIFT) - 1);
+    Addr = Builder.CreateAnd (Source, Mask);
+    DestAddr = Builder.CreateAnd (Dest, Mask);
+  } else {
+    Value * Table = Builder.CreateLoad (SizeTable, "table");
+    Value * Index = Builder.CreateLShr (Source, SLOT_SIZE, "index");
+    Value * Entry = Builder.CreateGEP (Table, Index);
+    E = Builder.CreateZExt (Builder.CreateLoad (Entry), IntPtrTy, "e");
+  }
+
+  //
+  // The pointers are within the same aligned allocation if they only differ
+  // in the low e bits; in tagged pointer mode, this also ensures that both
+  // pointers have the same tag.  A size of zero means that the object is not
+  // registered (or the pointer is untagged), and the run-time must decide
+  // what to do.
+  //
+  Value * Diff = Builder.CreateXor (Source, Dest);
+  Value * Same = Builder.CreateICmpEQ (Builder.CreateLShr (Diff, E),
+                                       ConstantInt::get (IntPtrTy, 0));
+  Value * Registered = Builder.CreateICmpNE (E,
+                                             ConstantInt::get (IntPtrTy, 0));
+  Builder.CreateCondBr (Builder.CreateAnd (Same, Registered),
+                        MetaBB,
+                        SlowBB,
+                        Unlikely);
+
+  //
+  // Pointers into the padding of the allocation are not within the object.
+  // Read the object's real size from the metadata at the end of the aligned
+  // allocation and compare both pointers against it.
+  //
+  Builder.SetInsertPoint (MetaBB);
+  Value * AllocSize = Builder.CreateShl (ConstantInt::get (IntPtrTy, 1), E);
+  Value * Begin = Builder.CreateAnd (Addr, Builder.CreateNeg (AllocSize),
+                                     "begin");
+  Value * MetaAddr = Builder.CreateAdd (Begin, AllocSize);
+  MetaAddr = Builder.CreateSub (MetaAddr,
+                                ConstantInt::get (IntPtrTy,
+                                                  sizeof (BBMetaData)));
+  Value * SizePtr = Builder.CreateIntToPtr (MetaAddr,
+                                            Int32Type->getPointerTo());
+  Value * Size = Builder.CreateZExt (Builder.CreateLoad (SizePtr, "size"),
+                                     IntPtrTy);
+  Value * SourceIn = Builder.CreateICmpULT (Builder.CreateSub (Addr, Begin),
+                                            Size);
+  Value * DestIn = Builder.CreateICmpULT (Builder.CreateSub (DestAddr, Begin),
+                                          Size);
+  Builder.CreateCondBr (Builder.CreateAnd (SourceIn, DestIn),
+                        PassBB,
+                        SlowBB,
+                        Unlikely);
+
+  //
+  // The check passed.  A GEP check returns the result pointer unmodified.
+  //
+  Builder.SetInsertPoint (PassBB);
+  if (isGEPCheck)
+    Builder.CreateRet (args[2]);
+  else
+    Builder.CreateRetVoid ();
+
+  //
+  // The check failed inline.  Let the run-time do the precise check, report
+  // the error, or rewrite the out-of-bounds pointer.
+  //
+  Builder.SetInsertPoint (SlowBB);
+  CallInst * CI = Builder.CreateCall (F, args);
+  if (isGEPCheck)
+    Builder.CreateRet (CI);
+  else
+    Builder.CreateRetVoid ();
+
+  return InlineF;
+}
+
+//
+// Method: inlineChecks()
+//
+// Description:
+//  Replace all calls to the specified run-time check with inline code.
+//
+// Inputs:
+//  F - A pointer to the run-time check.  This pointer can be NULL.
+//
+// Return value:
+//  true  - One or more calls to the check were inlined.
+//  false - No calls to the check were inlined.
+//
+bool
+InlineBBChecks::inlineChecks (Function * F,
+                              bool isGEPCheck,
+                              bool hasLength,
+                              bool isTagged) {
+  //
+  // If the run-time check is not used, do nothing.
+  //
+  if (!F) return false;
+
+  //
+  // Find all direct calls to the run-time check.
+  //
+  std::vector<CallInst *> CallsToInline;
+  for (Value::use_iterator FU = F->use_begin(); FU != F->use_end(); ++FU) {
+    if (CallInst * CI = dyn_cast<CallInst>(*FU))
+      if (CI->getCalledValue()->stripPointerCasts() == F)
+        CallsToInline.push_back (CI);
+  }
+
+  if (CallsToInline.empty())
+    return false;
+
+  if (isGEPCheck)
+    InlinedGEPChecks += CallsToInline.size();
+  else
+    InlinedLSChecks += CallsToInline.size();
+
+  //
+  // Redirect each call to the inline version of the check and inline it.
+  //
+  Function * InlineF = createInlineBodyFor (F, isGEPCheck, hasLength, isTagged);
+  InlineFunctionInfo IFI (0, TD);
+  for (unsigned index = 0; index < CallsToInline.size(); ++index) {
+    CallsToInline[index]->setCalledFunction (InlineF);
+    InlineFunction (CallsToInline[index], IFI);
+  }
+
+  //
+  // Remove the inline version of the check if all of its calls were inlined.
+  //
+  if (InlineF->use_empty())
+    InlineF->eraseFromParent();
+
+  return true;
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Entry point for this LLVM pass.
+//
+// Return value:
+//  true  - The module was modified.
+//  false - The module was not modified.
+//
+bool
+InlineBBChecks::runOnModule (Module & M) {
+  // Get prerequisite analysis results
+  TD = &getAnalysis<DataLayout>();
+
+  //
+  // Get a reference to the size table used by the run-time.
+  //
+  Type * Int8PtrTy = Type::getInt8PtrTy (M.getContext());
+  SizeTable = M.getOrInsertGlobal ("__baggybounds_size_table_begin",
+                                   Int8PtrTy);
+
+  bool modified = false;
+  for (unsigned index = 0; index < sizeof (BBChecks) / sizeof (BBChecks[0]);
+       ++index) {
+    modified |= inlineChecks (M.getFunction (BBChecks[index].name),
+                              BBChecks[index].isGEPCheck,
+                              BBChecks[index].hasLength,
+                              BBChecks[index].isTagged);
+  }
+
+  //
+  // Remove the size table declaration if nothing was inlined.
+  //
+  if (GlobalVariable * GV = dyn_cast<GlobalVariable>(SizeTable))
+    if (GV->isDeclaration() && GV->use_empty())
+      GV->eraseFromParent();
+
+  return modified;
+}
+
+}
@@ -0,0 +1,316 @@
+//===- TaggedPointers.cpp - Lower baggy bounds pointer tags --------------- --//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass prepares code for the tagged pointer mode of baggy bounds
+// checking.  In this mode, pointers to padded memory objects carry the binary
+// logarithm of the object's aligned size in their upper bits.  The pass
+// replaces the run-time checks and allocators with versions that read the
+// size from the tag, and it strips tags from pointers before the hardware or
+// external code can see them.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "baggy-lower-tags"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/InstIterator.h"
+
+#include "safecode/BaggyBoundsChecks.h"
+#include "safecode/Runtime/BBMetaData.h"
+
+#include <utility>
+#include <vector>
+
+namespace {
+  STATISTIC (Stripped, "Number of pointer tags stripped");
+  STATISTIC (Renamed,  "Number of run-time functions replaced");
+}
+
+//
+// Table mapping the baggy bounds run-time functions to their tagged pointer
+// equivalents.
+//
+static const char * TaggedFunctions[][2] = {
+  {"bb_poolcheck",              "bb_tagged_poolcheck"},
+  {"bb_poolcheckui",            "bb_tagged_poolcheck"},
+  {"bb_poolcheck_debug",        "bb_tagged_poolcheck_debug"},
+  {"bb_poolcheckui_debug",      "bb_tagged_poolcheck_debug"},
+  {"bb_boundscheck",            "bb_tagged_boundscheck"},
+  {"bb_boundscheckui",          "bb_tagged_boundscheck"},
+  {"bb_boundscheck_debug",      "bb_tagged_boundscheck_debug"},
+  {"bb_boundscheckui_debug",    "bb_tagged_boundscheck_debug"},
+  {"__sc_bb_poolalloc",         "__sc_bb_tagged_poolalloc"},
+  {"__sc_bb_src_poolalloc",     "__sc_bb_tagged_src_poolalloc"},
+  {"__sc_bb_poolcalloc",        "__sc_bb_tagged_poolcalloc"},
+  {"__sc_bb_src_poolcalloc",    "__sc_bb_tagged_src_poolcalloc"},
+  {"__sc_bb_poolrealloc",       "__sc_bb_tagged_poolrealloc"},
+  {"__sc_bb_poolrealloc_debug", "__sc_bb_tagged_poolrealloc_debug"},
+  {"__sc_bb_poolfree",          "__sc_bb_tagged_poolfree"},
+  {"__sc_bb_src_poolfree",      "__sc_bb_tagged_src_poolfree"}
+};
+
+//
+// Run-time checks that only compare pointers to the same object.  Since such
+// pointers carry the same tag, these checks work on tagged pointers.
+//
+static const char * TagNeutralFunctions[] = {
+  "bb_exactcheck2",
+  "bb_exactcheck2_debug",
+  "exactcheck2",
+  "exactcheck2_debug",
+  "fastlscheck",
+  "fastlscheck_debug"
+};
+
+//
+// Function: isTagAware()
+//
+// Description:
+//  Determine whether the specified external function may be given tagged
+//  pointers.
+//
+static bool
+isTagAware (Function * F) {
+  StringRef Name = F->getName();
+  if (Name.startswith ("bb_tagged_") || Name.startswith ("__sc_bb_tagged_"))
+    return true;
+
+  for (unsigned index = 0;
+       index < sizeof (TagNeutralFunctions) / sizeof (TagNeutralFunctions[0]);
+       ++index) {
+    if (Name == TagNeutralFunctions[index])
+      return true;
+  }
+
+  return false;
+}
+
+namespace llvm {
+
+// Identifier variable for the pass
+char LowerBaggyTags::ID = 0;
+
+// Register the pass
+static RegisterPass<LowerBaggyTags> X ("baggy-lower-tags",
+                                       "Lower baggy bounds pointer tags");
+
+//
+// Method: renameRuntimeFunctions()
+//
+// Description:
+//  Replace uses of the baggy bounds run-time checks and allocators with their
+//  tagged pointer equivalents.
+//
+bool
+LowerBaggyTags::renameRuntimeFunctions (Module & M) {
+  bool modified = false;
+  for (unsigned index = 0;
+       index < sizeof (TaggedFunctions) / sizeof (TaggedFunctions[0]);
+       ++index) {
+    Function * F = M.getFunction (TaggedFunctions[index][0]);
+    if (!F) continue;
+
+    Constant * NewF = M.getOrInsertFunction (TaggedFunctions[index][1],
+                                             F->getFunctionType());
+    F->replaceAllUsesWith (ConstantExpr::getBitCast (NewF, F->getType()));
+    if (F->isDeclaration())
+      F->eraseFromParent();
+
+    ++Renamed;
+    modified = true;
+  }
+
+  return modified;
+}
+
+//
+// Method: stripTag()
+//
+// Description:
+//  Remove the tag from a constant pointer expression.  Tagged constants are
+//  created by the baggy bounds transform for padded global variables.
+//
+// Return value:
+//  The constant expression without the tag is returned.  Constants that are
+//  not tagged are returned unchanged.
+//
+Constant *
+LowerBaggyTags::stripTag (Constant * C) {
+  ConstantExpr * CE = dyn_cast<ConstantExpr>(C);
+  if (!CE) return C;
+
+  switch (CE->getOpcode()) {
+    case Instruction::IntToPtr: {
+      //
+      // Look for inttoptr (add (ptrtoint P), Tag).
+      //
+      ConstantExpr * Add = dyn_cast<ConstantExpr>(CE->getOperand(0));
+      if (!Add || (Add->getOpcode() != Instruction::Add)) return C;
+      ConstantExpr * Int = dyn_cast<ConstantExpr>(Add->getOperand(0));
+      ConstantInt * Tag = dyn_cast<ConstantInt>(Add->getOperand(1));
+      if (!Int || (Int->getOpcode() != Instruction::PtrToInt) || !Tag)
+        return C;
+      if ((Tag->getZExtValue() >> BB_TAG_SHIFT) == 0)
+        return C;
+      return ConstantExpr::getPointerCast (Int->getOperand(0), CE->getType());
+    }
+
+    case Instruction::BitCast:
+      return ConstantExpr::getBitCast (stripTag (CE->getOperand(0)),
+                                       CE->getType());
+
+    case Instruction::GetElementPtr: {
+      std::vector<Constant *> Indices;
+      for (unsigned index = 1; index < CE->getNumOperands(); ++index)
+        Indices.push_back (CE->getOperand(index));
+      return ConstantExpr::getGetElementPtr (stripTag (CE->getOperand(0)),
+                                             Indices,
+                                             cast<GEPOperator>(CE)->isInBounds());
+    }
+
+    default:
+      return C;
+  }
+}
+
+//
+// Method: stripTag()
+//
+// Description:
+//  Insert code before the specified instruction that removes the tag from the
+//  specified pointer.
+//
+// Return value:
+//  The pointer without the tag is returned.
+//
+Value *
+LowerBaggyTags::stripTag (Value * Ptr, Instruction * InsertPt) {
+  if (Constant * C = dyn_cast<Constant>(Ptr))
+    return stripTag (C);
+
+  //
+  // Pointers to allocas are never tagged; the baggy bounds transform only
+  // tags the pointer to the original object within a padded alloca.
+  //
+  if (isa<AllocaInst>(Ptr->stripPointerCasts()))
+    return Ptr;
+
+  Type * IntPtrTy = TD->getIntPtrType (Ptr->getContext());
+  Constant * Mask = ConstantInt::get (IntPtrTy,
+                                      (((uint64_t) 1) << BB_TAG_SHIFT) - 1);
+  Value * Int = new PtrToIntInst (Ptr, IntPtrTy, "", InsertPt);
+  Value * Untagged = BinaryOperator::Create (Instruction::And,
+                                             Int,
+                                             Mask,
+                                             "",
+                                             InsertPt);
+  ++Stripped;
+  return new IntToPtrInst (Untagged,
+                           Ptr->getType(),
+                           Ptr->getName() + ".untagged",
+                           InsertPt);
+}
+
+//
+// Method: stripTags()
+//
+// Description:
+//  Strip the tags from all pointers in the function that are dereferenced,
+//  compared, converted to integers, or passed to external code.
+//
+bool
+LowerBaggyTags::stripTags (Function & F) {
+  //
+  // Find all of the pointer operands that need their tags stripped.  Collect
+  // them first so that we do not visit the instructions we insert.
+  //
+  std::vector<std::pair<Instruction *, unsigned> > Worklist;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    Instruction * Inst = &*I;
+    if (isa<LoadInst>(Inst)) {
+      Worklist.push_back (std::make_pair (Inst, 0u));
+    } else if (StoreInst * SI = dyn_cast<StoreInst>(Inst)) {
+      Worklist.push_back (std::make_pair (Inst, SI->getPointerOperandIndex()));
+    } else if (isa<AtomicRMWInst>(Inst) || isa<AtomicCmpXchgInst>(Inst)) {
+      Worklist.push_back (std::make_pair (Inst, 0u));
+    } else if (isa<PtrToIntInst>(Inst)) {
+      Worklist.push_back (std::make_pair (Inst, 0u));
+    } else if (ICmpInst * CI = dyn_cast<ICmpInst>(Inst)) {
+      if (isa<PointerType>(CI->getOperand(0)->getType())) {
+        Worklist.push_back (std::make_pair (Inst, 0u));
+        Worklist.push_back (std::make_pair (Inst, 1u));
+      }
+    } else if (isa<CallInst>(Inst) || isa<InvokeInst>(Inst)) {
+      //
+      // Functions defined in this module understand tagged pointers, as do
+      // the tagged pointer run-time functions.  Everything else (including
+      // indirect calls, which may call external code) gets untagged pointers.
+      //
+      CallSite CS(Inst);
+      Function * Callee = CS.getCalledFunction();
+      if (Callee && !(Callee->isDeclaration())) continue;
+      if (Callee && isTagAware (Callee)) continue;
+      if (isa<DbgInfoIntrinsic>(Inst)) continue;
+
+      //
+      // The arguments of both calls and invokes are their first operands.
+      //
+      for (unsigned index = 0; index < CS.arg_size(); ++index) {
+        if (isa<PointerType>(CS.getArgument(index)->getType()))
+          Worklist.push_back (std::make_pair (Inst, index));
+      }
+    }
+  }
+
+  //
+  // Strip the tags.
+  //
+  for (unsigned index = 0; index < Worklist.size(); ++index) {
+    Instruction * I = Worklist[index].first;
+    unsigned OpNo = Worklist[index].second;
+    Value * Untagged = stripTag (I->getOperand (OpNo), I);
+    if (Untagged != I->getOperand (OpNo))
+      I->setOperand (OpNo, Untagged);
+  }
+
+  return !Worklist.empty();
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Entry point for this LLVM pass.
+//
+// Return value:
+//  true  - The module was modified.
+//  false - The module was not modified.
+//
+bool
+LowerBaggyTags::runOnModule (Module & M) {
+  // Get prerequisite analysis results
+  TD = &getAnalysis<DataLayout>();
+
+  bool modified = renameRuntimeFunctions (M);
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (!(F->isDeclaration()))
+      modified |= stripTags (*F);
+  }
+
+  return modified;
+}
+
+}
@@ -111,6 +111,14 @@ ADD_STATISTIC_FOR(recvfrom);
 ADD_STATISTIC_FOR(write);
 ADD_STATISTIC_FOR(send);
 ADD_STATISTIC_FOR(sendto);
+ADD_STATISTIC_FOR(readv);
+ADD_STATISTIC_FOR(writev);
+ADD_STATISTIC_FOR(preadv);
+ADD_STATISTIC_FOR(pwritev);
+ADD_STATISTIC_FOR(recvmsg);
+ADD_STATISTIC_FOR(sendmsg);
+ADD_STATISTIC_FOR(recvmmsg);
+ADD_STATISTIC_FOR(sendmmsg);
 ADD_STATISTIC_FOR(readdir_r);
 ADD_STATISTIC_FOR(readlink);
 ADD_STATISTIC_FOR(realpath);
@@ -516,6 +524,38 @@ StringTransform::runOnModule (Module & M) {
     M, SendTo, PoolSendTo, st_xform_sendto, 2u, 1u, 3u, 4u, 5u, 6u
   );
 
+  // Vectored and batched I/O system calls.  The pool argument is for the
+  // iovec or message header array; the buffers that the array describes are
+  // checked by the run-time.
+  SourceFunction Readv    = { "readv", SSizeTTy, 3 };
+  SourceFunction Writev   = { "writev", SSizeTTy, 3 };
+  SourceFunction Preadv   = { "preadv", SSizeTTy, 4 };
+  SourceFunction Pwritev  = { "pwritev", SSizeTTy, 4 };
+  SourceFunction RecvMsg  = { "recvmsg", SSizeTTy, 3 };
+  SourceFunction SendMsg  = { "sendmsg", SSizeTTy, 3 };
+  SourceFunction RecvMMsg = { "recvmmsg", Int32Ty, 5 };
+  SourceFunction SendMMsg = { "sendmmsg", Int32Ty, 4 };
+  DestFunction PoolReadv    = { "pool_readv", 3, 1 };
+  DestFunction PoolWritev   = { "pool_writev", 3, 1 };
+  DestFunction PoolPreadv   = { "pool_preadv", 4, 1 };
+  DestFunction PoolPwritev  = { "pool_pwritev", 4, 1 };
+  DestFunction PoolRecvMsg  = { "pool_recvmsg", 3, 1 };
+  DestFunction PoolSendMsg  = { "pool_sendmsg", 3, 1 };
+  DestFunction PoolRecvMMsg = { "pool_recvmmsg", 5, 1 };
+  DestFunction PoolSendMMsg = { "pool_sendmmsg", 4, 1 };
+  chgd |= vtransform(M, Readv, PoolReadv, st_xform_readv, 2u, 1u, 3u);
+  chgd |= vtransform(M, Writev, PoolWritev, st_xform_writev, 2u, 1u, 3u);
+  chgd |= vtransform(M, Preadv, PoolPreadv, st_xform_preadv, 2u, 1u, 3u, 4u);
+  chgd |= vtransform(M, Pwritev, PoolPwritev, st_xform_pwritev, 2u, 1u, 3u, 4u);
+  chgd |= vtransform(M, RecvMsg, PoolRecvMsg, st_xform_recvmsg, 2u, 1u, 3u);
+  chgd |= vtransform(M, SendMsg, PoolSendMsg, st_xform_sendmsg, 2u, 1u, 3u);
+  chgd |= vtransform(
+    M, RecvMMsg, PoolRecvMMsg, st_xform_recvmmsg, 2u, 1u, 3u, 4u, 5u
+  );
+  chgd |= vtransform(
+    M, SendMMsg, PoolSendMMsg, st_xform_sendmmsg, 2u, 1u, 3u, 4u
+  );
+
   // realpath() on Darwin
   SourceFunction DarwinRealpath = 
     { "\01_realpath$DARWIN_EXTSN", VoidPtrTy, 2 };
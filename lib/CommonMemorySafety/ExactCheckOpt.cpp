@@ -15,6 +15,7 @@
 #define DEBUG_TYPE "exactcheck-opt"
 
 #include "CommonMemorySafetyPasses.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
@@ -52,16 +53,19 @@ namespace {
     // The set of allocas that are known to be alive to the end of the function.
     SmallSet <AllocaInst*, 32> FunctionScopedAllocas;
 
+    // The function implementing the fast version of each check.
+    DenseMap <CheckInfoType*, Function*> FastFunctions;
+
     void findFunctionScopedAllocas(Module &M);
     bool isSimpleMemoryObject(Value *V) const;
     PtrSizePair getPtrAndSize(Value *V, Type *SizeTy,
                               std::map <Value*, PtrSizePair> &M);
 
     bool optimizeCheck(CallInst *CI, CheckInfoType* Info);
-    Type* getSizeType(CheckInfoType *Info, Module &M);
+    Type* getSizeType(CheckInfoType *Info);
     void createFastCheck(CheckInfoType* Info, CallInst *CI, Value *ObjPtr,
                               Value *ObjSize);
-    void optimizeAll(Module &M, CheckInfoType* Check, Statistic *StatsVar);
+    void optimizeAll(Module &M);
 
   public:
     static char ID;
@@ -137,17 +141,7 @@ bool ExactCheckOpt::runOnModule(Module &M) {
   M.getFunction("exactcheck2")->addFnAttr (Attribute::ReadNone);
   M.getFunction("fastlscheck")->addFnAttr (Attribute::ReadNone);
 
-  CheckInfoListType CheckInfoList = MSCI->getCheckInfoList();
-  for (size_t i = 0, N = CheckInfoList.size(); i < N; ++i) {
-    CheckInfoType* Info = CheckInfoList[i];
-    if (Info->IsFastCheck || !Info->FastVersionInfo)
-      continue;
-
-    if (Info->isMemoryCheck())
-      optimizeAll(M, Info, &MemoryChecksConverted);
-    else if(Info->isGEPCheck())
-      optimizeAll(M, Info, &GEPChecksConverted);
-  }
+  optimizeAll(M);
 
   return true; // assume that something was changed in the module
 }
@@ -301,8 +295,7 @@ bool ExactCheckOpt::optimizeCheck(CallInst *CI, CheckInfoType *Info) {
   // * anything else -> the corresponding size and pointer on the path
   std::map <Value*, PtrSizePair> M;
 
-  Module &Mod = *CI->getParent()->getParent()->getParent();
-  Type *SizeTy = getSizeType(Info, Mod);
+  Type *SizeTy = getSizeType(Info);
 
   // Add non-instruction non-constant allocation object pointers to the front
   // of the function's entry block.
@@ -370,9 +363,9 @@ bool ExactCheckOpt::optimizeCheck(CallInst *CI, CheckInfoType *Info) {
 /// getSizeType - return the integer type being used to represent the size of
 /// the memory object. This may be different from the system's size_t.
 ///
-Type* ExactCheckOpt::getSizeType(CheckInfoType *Info, Module &M) {
+Type* ExactCheckOpt::getSizeType(CheckInfoType *Info) {
   CheckInfoType *FastInfo = Info->FastVersionInfo;
-  Function *FastFn = FastInfo->getFunction(M);
+  Function *FastFn = FastFunctions.lookup(Info);
   assert(FastFn && "The fast check function should be defined.");
   return FastFn->getFunctionType()->getParamType(FastInfo->ObjSizeArgNo);
 }
@@ -382,11 +375,9 @@ Type* ExactCheckOpt::getSizeType(CheckInfoType *Info, Module &M) {
 ///
 void ExactCheckOpt::createFastCheck(CheckInfoType* Info, CallInst *CI,
                                     Value *ObjPtr, Value *ObjSize) {
-  Module &M = *CI->getParent()->getParent()->getParent();
-
   // Get a pointer to the fast check function.
   CheckInfoType *FastInfo = Info->FastVersionInfo;
-  Function *FastFn = FastInfo->getFunction(M);
+  Function *FastFn = FastFunctions.lookup(Info);
   assert(FastFn && "The fast check function should be defined.");
 
   // Copy the old arguments to preserve extra arguments in fixed positions.
@@ -417,29 +408,52 @@ void ExactCheckOpt::createFastCheck(CheckInfoType* Info, CallInst *CI,
     CI->replaceAllUsesWith(FastCI);
 }
 
-/// optimizeAllChecks - try to replace every check of the given type with
-/// its fast version.
+/// optimizeAll - try to replace every check that has a fast version with
+/// the fast version. The check functions are looked up once, and all of their
+/// calls are converted in a single pass.
 ///
-void ExactCheckOpt::optimizeAll(Module &M, CheckInfoType *Info,
-                                Statistic *Stats) {
-  Function *CheckFn = Info->getFunction(M);
-  // Early return in case the regular check function doesn't exist
-  if (!CheckFn)
-    return;
+void ExactCheckOpt::optimizeAll(Module &M) {
+  typedef std::pair <CallInst*, CheckInfoType*> CheckCall;
+  SmallVector <CheckCall, 64> Calls;
+
+  FastFunctions.clear();
+  CheckInfoListType CheckInfoList = MSCI->getCheckInfoList();
+  for (size_t i = 0, N = CheckInfoList.size(); i < N; ++i) {
+    CheckInfoType* Info = CheckInfoList[i];
+    if (Info->IsFastCheck || !Info->FastVersionInfo)
+      continue;
+    if (!Info->isMemoryCheck() && !Info->isGEPCheck())
+      continue;
+
+    // Skip the checks whose regular function doesn't exist.
+    Function *CheckFn = Info->getFunction(M);
+    if (!CheckFn)
+      continue;
+
+    FastFunctions[Info] = Info->FastVersionInfo->getFunction(M);
+    for (Value::use_iterator UI = CheckFn->use_begin(), E = CheckFn->use_end();
+         UI != E;
+         ++UI) {
+      if (CallInst *CI = dyn_cast<CallInst>(*UI))
+        Calls.push_back(CheckCall(CI, Info));
+    }
+  }
 
   SmallVector <CallInst*, 64> Converted;
   // Convert the checks that can be safely converted.
-  for (Value::use_iterator UI = CheckFn->use_begin(), E = CheckFn->use_end();
-        UI != E;
-        ++UI) {
-    if (CallInst *CI = dyn_cast<CallInst>(*UI)) {
-      if (optimizeCheck(CI, Info))
-        Converted.push_back(CI);
-    }
+  for (size_t i = 0, N = Calls.size(); i < N; ++i) {
+    CheckInfoType *Info = Calls[i].second;
+    if (!optimizeCheck(Calls[i].first, Info))
+      continue;
+
+    Converted.push_back(Calls[i].first);
+    if (Info->isMemoryCheck())
+      ++MemoryChecksConverted;
+    else
+      ++GEPChecksConverted;
   }
 
   // Erase the regular versions of the converted checks.
   for (size_t i = 0, num = Converted.size(); i < num; ++i)
     Converted[i]->eraseFromParent();
-  *Stats += Converted.size();
 }
@@ -312,9 +312,8 @@ DebugInstrument::transformFunction (Function * F, GetSourceInfo & SI) {
   //
   // Check to see if the debug version of the function already exists.
   //
-  bool hadToCreateFunction = true;
-  if (F->getParent()->getFunction(F->getName().str() + "_debug"))
-    hadToCreateFunction = false;
+  std::string funcdebugname = F->getName().str() + "_debug";
+  bool hadToCreateFunction = !(F->getParent()->getFunction (funcdebugname));
 
   //
   // Create the expected type of the debug version. Note: For functions that
@@ -324,7 +323,6 @@ DebugInstrument::transformFunction (Function * F, GetSourceInfo & SI) {
   FunctionType * DebugFuncType = FunctionType::get (FuncType->getReturnType(),
                                                     ParamTypes,
                                                     F->isVarArg());
-  std::string funcdebugname = F->getName().str() + "_debug";
   Constant * FDebug = F->getParent()->getOrInsertFunction (funcdebugname,
                                                            DebugFuncType);
 
@@ -521,6 +519,14 @@ DebugInstrument::runOnModule (Module &M) {
   transformFunction (M.getFunction ("pool_write"), LInfo);
   transformFunction (M.getFunction ("pool_send"), LInfo);
   transformFunction (M.getFunction ("pool_sendto"), LInfo);
+  transformFunction (M.getFunction ("pool_readv"), LInfo);
+  transformFunction (M.getFunction ("pool_writev"), LInfo);
+  transformFunction (M.getFunction ("pool_preadv"), LInfo);
+  transformFunction (M.getFunction ("pool_pwritev"), LInfo);
+  transformFunction (M.getFunction ("pool_recvmsg"), LInfo);
+  transformFunction (M.getFunction ("pool_sendmsg"), LInfo);
+  transformFunction (M.getFunction ("pool_recvmmsg"), LInfo);
+  transformFunction (M.getFunction ("pool_sendmmsg"), LInfo);
   transformFunction (M.getFunction ("pool_readdir_r"), LInfo);
   transformFunction (M.getFunction ("pool_readlink"), LInfo);
   transformFunction (M.getFunction ("pool_realpath"), LInfo);
@@ -37,6 +37,25 @@ namespace {
   STATISTIC (CompLSChecks, "Complete Load/Store Checks");
 }
 
+//
+// CStdLib functions that SAFECode transforms but that are not yet listed in
+// poolalloc's run-time check table.  Each entry gives the name of the pool_*
+// function and its number of initial pool arguments.
+//
+static const struct {
+  const char * Function;
+  unsigned PoolArgc;
+} LocalCStdLibEntries[] = {
+  {"pool_readv",    1},
+  {"pool_writev",   1},
+  {"pool_preadv",   1},
+  {"pool_pwritev",  1},
+  {"pool_recvmsg",  1},
+  {"pool_sendmsg",  1},
+  {"pool_recvmmsg", 1},
+  {"pool_sendmmsg", 1}
+};
+
 //
 // Method: getDSNodeHandle()
 //
@@ -246,67 +265,50 @@ CompleteChecks::makeCStdLibCallsComplete (Function *F,
 //
 // Description:
 //  Find run-time checks on memory objects for which we have complete analysis
-//  information and change them into complete functions.
+//  information and change them into complete functions.  All incomplete
+//  checks are handled in a single walk over the calls to run-time checks.
 //
 // Inputs:
-//  M         - A reference to the module to modify.
-//  CheckInfo - Information about the run-time check.
+//  M      - A reference to the module to modify.
+//  Checks - The run-time check functions of the module.
 //
 // Outputs:
-//  M - The module is modified so that incomplete checks are changed to
-//      complete checks if necessary.
+//  M      - The module is modified so that incomplete checks are changed to
+//           complete checks if necessary.
+//  Checks - Complete checks added to the module are recorded.
 //
 void
-CompleteChecks::makeComplete (Module & M, const struct CheckInfo & CheckInfo) {
-  //
-  // Get the run-time checking functions.
+CompleteChecks::makeComplete (Module & M, RuntimeCheckRegistry & Checks) {
   //
-  Function * Complete   = M.getFunction (CheckInfo.completeName);
-  Function * Incomplete = M.getFunction (CheckInfo.name);
-
-  //
-  // If the incomplete function does not exist within the module, then don't
-  // do anything.
+  // Scan through all calls to incomplete run-time checks and record any
+  // checks on complete pointers.
   //
-  if (!Incomplete)
-    return;
+  std::vector<RuntimeCheckRegistry::CheckCall> Calls;
+  Checks.findCalls (Calls);
 
-  //
-  // If the complete version of the function does not exist, then create it.
-  //
-  if (!Complete) {
-    FunctionType * FT = Incomplete->getFunctionType();
-    Complete=cast<Function>(M.getOrInsertFunction (CheckInfo.completeName, FT));
-  }
+  std::vector<RuntimeCheckRegistry::CheckCall> toChange;
+  for (unsigned index = 0; index < Calls.size(); ++index) {
+    CallInst * CI = Calls[index].first;
+    const CheckInfo & Info = *(Calls[index].second);
+    if (Info.isComplete)
+      continue;
 
-  //
-  // Scan through all uses of the run-time check and record any checks on
-  // complete pointers.
-  //
-  std::vector <CallInst *> toChange;
-  Value::use_iterator UI = Incomplete->use_begin();
-  Value::use_iterator  E = Incomplete->use_end();
-  for (; UI != E; ++UI) {
-    if (CallInst * CI = dyn_cast<CallInst>(*UI)) {
-      if (CI->getCalledValue()->stripPointerCasts() == Incomplete) {
-        //
-        // Get the pointer that is checked by this run-time check.
-        //
-        Value * CheckPtr = CheckInfo.getCheckedPointer (CI);
+    //
+    // Get the pointer that is checked by this run-time check.
+    //
+    Value * CheckPtr = Info.getCheckedPointer (CI);
 
-        //
-        // If the pointer is complete, then change the check.
-        //
-        Function * F = CI->getParent()->getParent();
-        if (DSNode * N = getDSNodeHandle (CheckPtr, F).getNode()) {
-          if (!(N->isExternalNode() ||
-                N->isIncompleteNode() ||
-                N->isUnknownNode() ||
-                N->isIntToPtrNode() ||
-                N->isPtrToIntNode())) {
-            toChange.push_back (CI);
-          }
-        }
+    //
+    // If the pointer is complete, then change the check.
+    //
+    Function * F = CI->getParent()->getParent();
+    if (DSNode * N = getDSNodeHandle (CheckPtr, F).getNode()) {
+      if (!(N->isExternalNode() ||
+            N->isIncompleteNode() ||
+            N->isUnknownNode() ||
+            N->isIntToPtrNode() ||
+            N->isPtrToIntNode())) {
+        toChange.push_back (Calls[index]);
       }
     }
   }
@@ -320,10 +322,28 @@ CompleteChecks::makeComplete (Module & M, const struct CheckInfo & CheckInfo) {
 
   //
   // Now iterate through all of the call sites and transform them to be
-  // complete.
+  // complete.  The complete version of each kind of check is found once.
   //
+  const CheckInfo * CompleteVersions[numChecks] = {0};
   for (unsigned index = 0; index < toChange.size(); ++index) {
-    toChange[index]->setCalledFunction (Complete);
+    CallInst * CI = toChange[index].first;
+    const CheckInfo & Info = *(toChange[index].second);
+    const CheckInfo *& Version = CompleteVersions[&Info - RuntimeChecks];
+    if (!Version)
+      Version = &findCompleteCheck (Info);
+    const CheckInfo & CompleteInfo = *Version;
+
+    //
+    // If the complete version of the function does not exist, then create it.
+    //
+    Function * Complete = Checks.getFunction (CompleteInfo);
+    if (!Complete) {
+      FunctionType * FT = Checks.getFunction (Info)->getFunctionType();
+      Complete = cast<Function>(M.getOrInsertFunction (CompleteInfo.name, FT));
+      Checks.add (Complete, CompleteInfo);
+    }
+
+    CI->setCalledFunction (Complete);
   }
 
   return;
@@ -616,22 +636,11 @@ CompleteChecks::fixupCFIChecks (Module & M, std::string name) {
 bool
 CompleteChecks::runOnModule (Module & M) {
   //
-  // For every run-time check, go and see if it can be converted into a
-  // complete check.
+  // Find the run-time checks in the module and convert the ones on complete
+  // pointers into complete checks.
   //
-  for (unsigned index = 0; index < numChecks; ++index) {
-    //
-    // Skip this run-time check if it is the complete version.
-    //
-    if (RuntimeChecks[index].isComplete)
-      continue;
-
-    //
-    // Get a pointer to the complete and incomplete versions of the run-time
-    // check.
-    //
-    makeComplete (M, RuntimeChecks[index]);
-  }
+  RuntimeCheckRegistry Checks (M);
+  makeComplete (M, Checks);
 
   //
   // Iterate over the CStdLib functions whose entries are known to DSA.
@@ -659,6 +668,25 @@ CompleteChecks::runOnModule (Module & M) {
     }
   }
 
+  //
+  // Do the same for the CStdLib functions that poolalloc does not know about.
+  //
+  const unsigned NumLocalEntries =
+    sizeof(LocalCStdLibEntries) / sizeof(LocalCStdLibEntries[0]);
+
+  for (unsigned EntryIndex = 0; EntryIndex < NumLocalEntries; ++EntryIndex) {
+    unsigned PoolArgc = LocalCStdLibEntries[EntryIndex].PoolArgc;
+    std::string FuncName = LocalCStdLibEntries[EntryIndex].Function;
+
+    if (Function * F = M.getFunction(FuncName)) {
+      makeCStdLibCallsComplete(F, PoolArgc, false);
+    }
+
+    if (Function * F = M.getFunction(FuncName + "_debug")) {
+      makeCStdLibCallsComplete(F, PoolArgc, true);
+    }
+  }
+
   //
   // For every call to sc.fsparameter, fill in the relevant completeness
   // information about its pointer argument.
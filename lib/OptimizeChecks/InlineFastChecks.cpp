@@ -375,6 +375,17 @@ llvm::InlineFastChecks::createBodyFor (Function * F) {
                                         "and",
                                         entryBB);
 
+  //
+  // Accesses of zero bytes (e.g., by memcpy() and memset()) always pass, just
+  // as they do in the run-time.
+  //
+  Value * Empty = new ICmpInst (*entryBB,
+                                CmpInst::ICMP_EQ,
+                                MemSize,
+                                ConstantInt::get (MemSize->getType(), 0),
+                                "empty");
+  Sum = BinaryOperator::Create (Instruction::Or, Sum, Empty, "or", entryBB);
+
 
   //
   // Create the branch instruction.
@@ -470,6 +481,17 @@ llvm::InlineFastChecks::createDebugBodyFor (Function * F) {
                                         "and",
                                         entryBB);
 
+  //
+  // Accesses of zero bytes (e.g., by memcpy() and memset()) always pass, just
+  // as they do in the run-time.
+  //
+  Value * Empty = new ICmpInst (*entryBB,
+                                CmpInst::ICMP_EQ,
+                                MemSize,
+                                ConstantInt::get (MemSize->getType(), 0),
+                                "empty");
+  Sum = BinaryOperator::Create (Instruction::Or, Sum, Empty, "or", entryBB);
+
   //
   // Create the branch instruction.  Both comparisons must return true for the
   // pointer to be within bounds.
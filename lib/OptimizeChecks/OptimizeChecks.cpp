@@ -113,12 +113,9 @@ OptimizeChecks::onlyUsedInCompares (Value * Val) {
       }
 
       // Calls to run-time functions are okay; others are not.
-      if (CallInst * CI = dyn_cast<CallInst>(*U)) {
-        Value * CV = CI->getCalledValue()->stripPointerCasts();
-        if (Function * F = dyn_cast<Function>(CV)) {
-          if (isRuntimeCheck (F)) {
-            continue;
-          }
+      if (Instruction * I = dyn_cast<Instruction>(*U)) {
+        if (Checks.findCall (I)) {
+          continue;
         }
       }
 
@@ -136,66 +133,56 @@ OptimizeChecks::onlyUsedInCompares (Value * Val) {
 }
 
 //
-// Method: processFunction()
+// Method: runOnModule()
 //
 // Description:
-//  Look for calls of the specified function (which is a SAFECode run-time
-//  check), determine whether the call can be eliminated, and eliminate it
-//  if possible.
-//
-// Inputs:
-//  M    - A reference to the LLVM module.
-//  Info - Information about the SAFECode run-time check.
+//  Look for calls to the SAFECode run-time GEP checks, determine whether each
+//  call can be eliminated, and eliminate it if possible.  All of the checks
+//  are examined in a single walk over the calls to run-time checks.
 //
 // Return value:
 //  false - No modifications were made to the Module.
 //  true  - One or more modifications were made to the module.
 //
 bool
-OptimizeChecks::processFunction (Module & M, const CheckInfo & Info) {
+OptimizeChecks::runOnModule (Module & M) {
   //
-  // Get the runtime function in the code.  If no calls to the run-time
-  // function were added to the code, do nothing.
+  // Find the run-time checks in the module.  If no calls to run-time checks
+  // were added to the code, do nothing.
   //
-  Function * F = M.getFunction (Info.name);
-  if (!F)
-    return false;
+  Checks.build (M);
+  std::vector<RuntimeCheckRegistry::CheckCall> Calls;
+  Checks.findCalls (Calls);
 
   //
-  // Iterate though all calls to the function and search for pointers that are
-  // checked but only used in comparisons.  If so, then schedule the check
+  // Iterate though all calls to the GEP checks and search for pointers that
+  // are checked but only used in comparisons.  If so, then schedule the check
   // (i.e., the call) for removal.
   //
-  bool modified = false;
   std::vector<Instruction *> CallsToDelete;
-  for (Value::use_iterator FU = F->use_begin(); FU != F->use_end(); ++FU) {
+  for (unsigned index = 0; index < Calls.size(); ++index) {
+    CallInst * CI = Calls[index].first;
+    const CheckInfo & Info = *(Calls[index].second);
+    if (!Info.isGEPCheck())
+      continue;
+
     //
-    // We are only concerned about call instructions; any other use is of
-    // no interest to the organization.
+    // If the call instruction has any uses, we cannot remove it.
     //
-    if (CallInst * CI = dyn_cast<CallInst>(*FU)) {
-      //
-      // If the call instruction has any uses, we cannot remove it.
-      //
-      if (CI->use_begin() != CI->use_end()) continue;
+    if (CI->use_begin() != CI->use_end()) continue;
 
-      //
-      // Get the operand that needs to be replaced as well as the operand
-      // with all of the casts peeled away.  Increment the operand index by
-      // one because a call instruction's first operand is the function to
-      // call.
-      //
-      Value * Operand = Info.getCheckedPointer (CI)->stripPointerCasts();
+    //
+    // Get the operand that needs to be replaced with all of the casts peeled
+    // away.
+    //
+    Value * Operand = Info.getCheckedPointer (CI)->stripPointerCasts();
 
-      //
-      // If the operand is only used in comparisons, mark the run-time check
-      // for removal.
-      //
-      if (onlyUsedInCompares (Operand)) {
-        CallsToDelete.push_back (CI);
-        modified = true;
-      }
-    }
+    //
+    // If the operand is only used in comparisons, mark the run-time check
+    // for removal.
+    //
+    if (onlyUsedInCompares (Operand))
+      CallsToDelete.push_back (CI);
   }
 
   //
@@ -211,26 +198,7 @@ OptimizeChecks::processFunction (Module & M, const CheckInfo & Info) {
     CallsToDelete[index]->eraseFromParent();
   }
 
-  return modified;
-}
-
-bool
-OptimizeChecks::runOnModule (Module & M) {
-  //
-  // Optimize all of the run-time GEP checks.
-  //
-  bool modified = false;
-  for (unsigned index = 0; index < numChecks; ++index) {
-    if (RuntimeChecks[index].checkType == gepcheck) {
-      //
-      // Analyze calls to this run-time check and remove them if possible.
-      //
-      modified |= processFunction (M, RuntimeChecks[index]);
-    }
-  }
-
-  return modified;
+  return !CallsToDelete.empty();
 }
 
 }
-
@@ -0,0 +1,506 @@
+//===- ReuseObjectBounds.cpp - Reuse object bounds in dominated checks ---- --//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass reduces the number of object lookups performed by the load/store
+// and bounds checks.  Each such check searches for the memory object to which
+// its pointer points, and checks on pointers derived from the same base
+// pointer find the same object again.  This pass looks up the bounds of the
+// object once, before the first check in a dominance region, and replaces the
+// checks in the region with inline comparisons against the bounds.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "reuse-bounds"
+
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/CFG.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "safecode/OptimizeChecks.h"
+#include "safecode/Utility.h"
+
+#include <utility>
+#include <vector>
+
+char llvm::ReuseObjectBounds::ID = 0;
+
+namespace {
+  STATISTIC (Lookups,  "Number of object bounds lookups inserted");
+  STATISTIC (Replaced, "Number of checks using previously found bounds");
+}
+
+//
+// The run-time checks that look up the object to which a pointer points.
+// Incomplete load/store checks in production mode do nothing, so they are not
+// listed.
+//
+static const char * LookupChecks[] = {
+  "poolcheck",
+  "poolcheck_debug",
+  "poolcheckui_debug",
+  "boundscheck",
+  "boundscheckui",
+  "boundscheck_debug",
+  "boundscheckui_debug"
+};
+
+//
+// Function: findLookupCheck()
+//
+// Description:
+//  Determine whether the call is a run-time check that performs an object
+//  lookup.
+//
+// Return value:
+//  NULL - This is not a call to a check that performs an object lookup.
+//  Otherwise, a pointer to the description of the check is returned.
+//
+static const struct CheckInfo *
+findLookupCheck (CallInst * CI) {
+  Function * F = CI->getCalledFunction();
+  if (!F) return 0;
+
+  for (unsigned index = 0;
+       index < sizeof (LookupChecks) / sizeof (LookupChecks[0]);
+       ++index) {
+    if (F->getName() == LookupChecks[index])
+      return findRuntimeCheck (F);
+  }
+
+  return 0;
+}
+
+//
+// Function: getBasePointer()
+//
+// Description:
+//  Find the pointer from which the specified pointer is derived by indexing
+//  and casting.  Bounds checks return their result pointer (or a rewritten
+//  pointer that is not within any object), so a checked result pointer is
+//  derived from the source pointer of the check.
+//
+static Value *
+getBasePointer (Value * V) {
+  while (true) {
+    V = V->stripPointerCasts();
+    if (GEPOperator * GEP = dyn_cast<GEPOperator>(V)) {
+      V = GEP->getPointerOperand();
+      continue;
+    }
+
+    if (CallInst * CI = dyn_cast<CallInst>(V)) {
+      if (Function * F = CI->getCalledFunction()) {
+        const struct CheckInfo * Info = findRuntimeCheck (F);
+        if (Info && Info->isGEPCheck() && Info->srcArg) {
+          V = Info->getSourcePointer (CI);
+          continue;
+        }
+      }
+    }
+
+    return V;
+  }
+}
+
+//
+// Function: mayFree()
+//
+// Description:
+//  Determine whether the instruction may free or unregister a memory object.
+//
+static bool
+mayFree (Instruction * I) {
+  CallSite CS (I);
+  if (!CS) return false;
+  if (isa<IntrinsicInst>(I)) return false;
+  if (CS.onlyReadsMemory()) return false;
+
+  //
+  // The run-time checks do not free memory.
+  //
+  if (Function * F = CS.getCalledFunction()) {
+    if (isRuntimeCheck (F) || (F->getName() == "pchk_getbounds"))
+      return false;
+  }
+
+  return true;
+}
+
+//
+// Function: mayFreeInRange()
+//
+// Description:
+//  Determine whether any instruction in the range [Begin, End) may free
+//  memory.
+//
+static bool
+mayFreeInRange (BasicBlock::iterator Begin, BasicBlock::iterator End) {
+  for (BasicBlock::iterator I = Begin; I != End; ++I) {
+    if (mayFree (I))
+      return true;
+  }
+
+  return false;
+}
+
+namespace llvm {
+
+static RegisterPass<ReuseObjectBounds>
+X ("reuse-bounds", "Reuse object bounds in dominated run-time checks");
+
+//
+// Method: mayFreeBetween()
+//
+// Description:
+//  Determine whether memory may be freed on some path from one instruction
+//  to another without passing through the first instruction again.
+//
+// Inputs:
+//  From - The first instruction.  It must dominate To.
+//  To   - The second instruction.
+//
+bool
+ReuseObjectBounds::mayFreeBetween (Instruction * From, Instruction * To) {
+  BasicBlock * FromBB = From->getParent();
+  BasicBlock * ToBB = To->getParent();
+
+  //
+  // If both instructions are in the same block, only the instructions in
+  // between can execute.
+  //
+  BasicBlock::iterator AfterFrom = From;
+  ++AfterFrom;
+  if (FromBB == ToBB)
+    return mayFreeInRange (AfterFrom, To);
+
+  if (mayFreeInRange (AfterFrom, FromBB->end()))
+    return true;
+  if (mayFreeInRange (ToBB->begin(), To))
+    return true;
+
+  //
+  // Scan every block that can execute between the end of From's block and
+  // the beginning of To's block.  Since From dominates To, walking backwards
+  // from To's block always ends at From's block.
+  //
+  SmallPtrSet<BasicBlock *, 16> Visited;
+  std::vector<BasicBlock *> Worklist (pred_begin (ToBB), pred_end (ToBB));
+  while (!Worklist.empty()) {
+    BasicBlock * BB = Worklist.back();
+    Worklist.pop_back();
+    if ((BB == FromBB) || !(Visited.insert (BB)))
+      continue;
+
+    if (mayFreeInRange (BB->begin(), BB->end()))
+      return true;
+    Worklist.insert (Worklist.end(), pred_begin (BB), pred_end (BB));
+  }
+
+  return false;
+}
+
+//
+// Method: getBoundedCheck()
+//
+// Description:
+//  Create an internal function that takes the arguments of the specified
+//  run-time check followed by the first and last byte of the object.  The
+//  function compares the checked pointers against the bounds and only calls
+//  the run-time check if they are not within them.
+//
+Function *
+ReuseObjectBounds::getBoundedCheck (Function * F,
+                                    const struct CheckInfo & Info) {
+  if (BoundedChecks.count (F))
+    return BoundedChecks[F];
+
+  LLVMContext & Context = F->getContext();
+  DataLayout & TD = getAnalysis<DataLayout>();
+  Type * VoidPtrTy = Type::getInt8PtrTy (Context);
+  Type * IntPtrTy = TD.getIntPtrType (Context);
+
+  std::vector<Type *> Params (F->getFunctionType()->param_begin(),
+                              F->getFunctionType()->param_end());
+  Params.push_back (VoidPtrTy);
+  Params.push_back (VoidPtrTy);
+  FunctionType * FTy = FunctionType::get (F->getReturnType(), Params, false);
+  Function * BoundedF = Function::Create (FTy,
+                                          GlobalValue::InternalLinkage,
+                                          F->getName() + ".bounds",
+                                          F->getParent());
+
+  BasicBlock * EntryBB = BasicBlock::Create (Context, "entry", BoundedF);
+  BasicBlock * PassBB  = BasicBlock::Create (Context, "pass",  BoundedF);
+  BasicBlock * SlowBB  = BasicBlock::Create (Context, "slow",  BoundedF);
+
+  std::vector<Value *> args;
+  for (Function::arg_iterator arg = BoundedF->arg_begin();
+       arg != BoundedF->arg_end();
+       ++arg) {
+    args.push_back (arg);
+  }
+  Value * ObjEnd = args.back();
+  args.pop_back();
+  Value * ObjStart = args.back();
+  args.pop_back();
+
+  //
+  // Find the first and last byte that must be within the object.  For a
+  // bounds check, both the source and result pointers must be within it; the
+  // run-time check finds the object using the source pointer.
+  //
+  IRBuilder<> Builder (EntryBB);
+  Value * Start = Builder.CreatePtrToInt (ObjStart, IntPtrTy, "obj.start");
+  Value * End = Builder.CreatePtrToInt (ObjEnd, IntPtrTy, "obj.end");
+  Value * First = 0;
+  Value * Last = 0;
+  Value * InBounds = 0;
+  if (Info.isGEPCheck()) {
+    First = Builder.CreatePtrToInt (args[Info.srcArg], IntPtrTy, "source");
+    Last  = Builder.CreatePtrToInt (args[Info.argno], IntPtrTy, "dest");
+    InBounds = Builder.CreateAnd (Builder.CreateICmpULE (Start, First),
+                                  Builder.CreateICmpULE (First, End));
+    InBounds = Builder.CreateAnd (InBounds,
+                                  Builder.CreateICmpULE (Start, Last));
+  } else {
+    First = Builder.CreatePtrToInt (args[Info.argno], IntPtrTy, "node");
+    Value * Length = Builder.CreateZExtOrBitCast (args[Info.lenArg],
+                                                  IntPtrTy,
+                                                  "len");
+    Last = Builder.CreateSub (Builder.CreateAdd (First, Length),
+                              ConstantInt::get (IntPtrTy, 1),
+                              "last");
+    InBounds = Builder.CreateAnd (Builder.CreateICmpULE (Start, First),
+                                  Builder.CreateICmpULE (First, Last));
+  }
+  InBounds = Builder.CreateAnd (InBounds, Builder.CreateICmpULE (Last, End));
+  MDNode * Likely = MDBuilder(Context).createBranchWeights (2000, 1);
+  Builder.CreateCondBr (InBounds, PassBB, SlowBB, Likely);
+
+  //
+  // The check passed.  A bounds check returns the result pointer unmodified.
+  //
+  Builder.SetInsertPoint (PassBB);
+  if (Info.isGEPCheck())
+    Builder.CreateRet (args[Info.argno]);
+  else
+    Builder.CreateRetVoid ();
+
+  //
+  // Let the run-time check decide what to do with the pointer.
+  //
+  Builder.SetInsertPoint (SlowBB);
+  CallInst * CI = Builder.CreateCall (F, args);
+  if (Info.isGEPCheck())
+    Builder.CreateRet (CI);
+  else
+    Builder.CreateRetVoid ();
+
+  return BoundedChecks[F] = BoundedF;
+}
+
+//
+// Method: processFunction()
+//
+// Description:
+//  Find the checks in the function that can reuse the bounds found by a
+//  dominating check and rewrite them.
+//
+// Return value:
+//  true  - The function was modified.
+//  false - The function was not modified.
+//
+bool
+ReuseObjectBounds::processFunction (Function & F) {
+  DominatorTree & DT = getAnalysis<DominatorTree>(F);
+
+  //
+  // Group the checks by their pool and base pointer.  Visit the blocks in
+  // dominator tree order so that a check is seen before the checks it
+  // dominates.
+  //
+  typedef std::pair<Value *, Value *> GroupKey;
+  std::map<GroupKey, std::vector<CallInst *> > Groups;
+  std::vector<GroupKey> GroupOrder;
+  for (df_iterator<DomTreeNode *> DI = df_begin (DT.getRootNode()),
+       DE = df_end (DT.getRootNode()); DI != DE; ++DI) {
+    BasicBlock * BB = DI->getBlock();
+    for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+      CallInst * CI = dyn_cast<CallInst>(I);
+      if (!CI) continue;
+      const struct CheckInfo * Info = findLookupCheck (CI);
+      if (!Info) continue;
+
+      Value * Pointer = Info->isGEPCheck() ? Info->getSourcePointer (CI)
+                                           : Info->getCheckedPointer (CI);
+      GroupKey Key (CI->getArgOperand(0)->stripPointerCasts(),
+                    getBasePointer (Pointer));
+      if (Groups[Key].empty())
+        GroupOrder.push_back (Key);
+      Groups[Key].push_back (CI);
+    }
+  }
+
+  //
+  // Within each group, a check is covered by an earlier check (a leader) if
+  // the leader dominates it and no memory may be freed in between.  Checks
+  // that are not covered become leaders themselves.
+  //
+  std::vector<std::pair<CallInst *, std::vector<CallInst *> > > Regions;
+  for (unsigned g = 0; g < GroupOrder.size(); ++g) {
+    std::vector<CallInst *> & Checks = Groups[GroupOrder[g]];
+    if (Checks.size() < 2) continue;
+
+    unsigned FirstRegion = Regions.size();
+    for (unsigned index = 0; index < Checks.size(); ++index) {
+      CallInst * CI = Checks[index];
+      bool covered = false;
+      for (unsigned r = FirstRegion; r < Regions.size(); ++r) {
+        CallInst * Leader = Regions[r].first;
+        if (DT.dominates (Leader, CI) && !mayFreeBetween (Leader, CI)) {
+          Regions[r].second.push_back (CI);
+          covered = true;
+          break;
+        }
+      }
+
+      if (!covered)
+        Regions.push_back (std::make_pair (CI, std::vector<CallInst *>()));
+    }
+  }
+
+  //
+  // Look up the bounds before each leader that covers other checks and make
+  // all of the checks in the region compare against them.
+  //
+  bool modified = false;
+  Type * VoidPtrTy = Type::getInt8PtrTy (F.getContext());
+  std::vector<CallInst *> CallsToInline;
+  for (unsigned r = 0; r < Regions.size(); ++r) {
+    if (Regions[r].second.empty()) continue;
+
+    CallInst * Leader = Regions[r].first;
+    const struct CheckInfo * Info = findLookupCheck (Leader);
+    Value * Pointer = Info->isGEPCheck() ? Info->getSourcePointer (Leader)
+                                         : Info->getCheckedPointer (Leader);
+    Value * args[] = {
+      castTo (Leader->getArgOperand(0), VoidPtrTy, Leader),
+      castTo (getBasePointer (Pointer), VoidPtrTy, Leader)
+    };
+    CallInst * Bounds = CallInst::Create (GetBounds, args, "bounds", Leader);
+    Value * ObjStart = ExtractValueInst::Create (Bounds, 0, "", Leader);
+    Value * ObjEnd = ExtractValueInst::Create (Bounds, 1, "", Leader);
+    ++Lookups;
+
+    std::vector<CallInst *> & Checks = Regions[r].second;
+    Checks.push_back (Leader);
+    for (unsigned index = 0; index < Checks.size(); ++index) {
+      CallInst * CI = Checks[index];
+      Function * Check = CI->getCalledFunction();
+      Function * BoundedF = getBoundedCheck (Check,
+                                             *(findLookupCheck (CI)));
+
+      std::vector<Value *> NewArgs (CI->op_begin(),
+                                    CI->op_begin() + CI->getNumArgOperands());
+      NewArgs.push_back (ObjStart);
+      NewArgs.push_back (ObjEnd);
+      CallInst * NewCI = CallInst::Create (BoundedF, NewArgs, "", CI);
+      NewCI->setDebugLoc (CI->getDebugLoc());
+      CI->replaceAllUsesWith (NewCI);
+      NewCI->takeName (CI);
+      CI->eraseFromParent();
+      CallsToInline.push_back (NewCI);
+      ++Replaced;
+    }
+
+    modified = true;
+  }
+
+  //
+  // Inline the comparisons.  This is done last because it changes the CFG.
+  //
+  DataLayout & TD = getAnalysis<DataLayout>();
+  InlineFunctionInfo IFI (0, &TD);
+  for (unsigned index = 0; index < CallsToInline.size(); ++index)
+    InlineFunction (CallsToInline[index], IFI);
+
+  return modified;
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Entry point for this LLVM pass.
+//
+// Return value:
+//  true  - The module was modified.
+//  false - The module was not modified.
+//
+bool
+ReuseObjectBounds::runOnModule (Module & M) {
+  //
+  // The run-time returns the bounds as a pair of pointers.  Only targets on
+  // which such a structure is returned in two registers are supported.
+  //
+  if (getAnalysis<DataLayout>().getPointerSizeInBits() != 64)
+    return false;
+
+  //
+  // Create a declaration of the run-time function that finds the bounds of
+  // an object.  It returns the first and last byte of the object.
+  //
+  Type * VoidPtrTy = Type::getInt8PtrTy (M.getContext());
+  Type * BoundsTy = StructType::get (VoidPtrTy, VoidPtrTy, NULL);
+  GetBounds = cast<Function>(M.getOrInsertFunction ("pchk_getbounds",
+                                                    BoundsTy,
+                                                    VoidPtrTy,
+                                                    VoidPtrTy,
+                                                    NULL));
+  BoundedChecks.clear();
+
+  bool modified = false;
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (F->isDeclaration()) continue;
+
+    //
+    // Do not process the inline versions of the checks created by this pass.
+    //
+    bool isBoundedCheck = false;
+    for (std::map<Function *, Function *>::iterator i = BoundedChecks.begin();
+         i != BoundedChecks.end(); ++i) {
+      if (i->second == &*F)
+        isBoundedCheck = true;
+    }
+    if (isBoundedCheck) continue;
+
+    modified |= processFunction (*F);
+  }
+
+  //
+  // Remove the inline versions of the checks now that they are inlined.
+  //
+  for (std::map<Function *, Function *>::iterator i = BoundedChecks.begin();
+       i != BoundedChecks.end(); ++i) {
+    if (i->second->use_empty())
+      i->second->eraseFromParent();
+  }
+
+  return modified;
+}
+
+}
@@ -0,0 +1,301 @@
+//===- SampleChecks.cpp - Run checks on a sample of function calls ------- --//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass trades the detection of memory safety errors for speed by running
+// the run-time checks on only some of the calls to each function.  Every
+// function containing checks is duplicated into a checked and an unchecked
+// version, in the spirit of the code duplication done for speculative
+// checking.  The entry of the original function becomes a dispatcher: a
+// per-thread countdown is decremented on each call, and when it reaches zero
+// the run-time decides whether the call runs the checked version.  All other
+// calls are forwarded to the unchecked version.
+//
+// Only the checks of memory accesses, indirect calls, and frees are removed
+// from the unchecked versions.  Object registrations are kept so that the
+// checked versions find every object, and the bounds checks of pointer
+// arithmetic are kept because they create the rewritten pointers that
+// -rewrite-oob relies on to tell out of bounds pointers apart.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "sample-checks"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "safecode/OptimizeChecks.h"
+#include "safecode/Utility.h"
+
+#include <vector>
+
+char llvm::SampleChecks::ID = 0;
+
+namespace {
+  STATISTIC (Sampled, "Number of functions whose checks are sampled");
+  STATISTIC (Removed, "Number of checks removed from unchecked versions");
+}
+
+//
+// Checks that are not described in CheckInfo.h but are removed from the
+// unchecked versions as well.
+//
+static const char * OtherCheckNames[] = {
+  "poolcheck_free",
+  "poolcheck_freeui",
+  "poolcheck_free_debug",
+  "poolcheck_freeui_debug"
+};
+
+namespace llvm {
+
+static RegisterPass<SampleChecks>
+X ("sample-checks", "Run SAFECode run-time checks on a sample of calls");
+
+//
+// Method: isSampledCheck()
+//
+// Description:
+//  Determine whether calls to the specified function are removed from the
+//  unchecked versions of functions.  These are the load/store, string, and
+//  indirect call checks and the checks on frees; bounds checks are kept.
+//
+bool
+SampleChecks::isSampledCheck (Function * F) {
+  if (!F)
+    return false;
+
+  if (const CheckInfo * Info = Checks.find (F))
+    return !(Info->isGEPCheck());
+  return OtherChecks.count (F);
+}
+
+//
+// Method: hasChecks()
+//
+// Description:
+//  Determine whether the function calls any run-time check that is removed
+//  from unchecked versions.
+//
+bool
+SampleChecks::hasChecks (Function & F) {
+  for (Function::iterator BB = F.begin(); BB != F.end(); ++BB) {
+    for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+      if (CallInst * CI = dyn_cast<CallInst>(I))
+        if (isSampledCheck (CI->getCalledFunction()))
+          return true;
+    }
+  }
+
+  return false;
+}
+
+//
+// Method: createUncheckedVersion()
+//
+// Description:
+//  Create a copy of the function without its sampled run-time checks.  Checks
+//  that return a pointer are replaced by the pointer that they check.
+//
+Function *
+SampleChecks::createUncheckedVersion (Function & F) {
+  ValueToValueMapTy VMap;
+  Function * Unchecked = CloneFunction (&F, VMap, false);
+  Unchecked->setName (F.getName() + ".unchecked");
+  Unchecked->setLinkage (GlobalValue::InternalLinkage);
+  Unchecked->setVisibility (GlobalValue::DefaultVisibility);
+  F.getParent()->getFunctionList().push_back (Unchecked);
+
+  std::vector<CallInst *> CheckCalls;
+  for (Function::iterator BB = Unchecked->begin();
+       BB != Unchecked->end();
+       ++BB) {
+    for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+      if (CallInst * CI = dyn_cast<CallInst>(I))
+        if (isSampledCheck (CI->getCalledFunction()))
+          CheckCalls.push_back (CI);
+    }
+  }
+
+  for (unsigned index = 0; index < CheckCalls.size(); ++index) {
+    CallInst * CI = CheckCalls[index];
+    if (!CI->use_empty()) {
+      const CheckInfo * Info = Checks.find (CI->getCalledFunction());
+      assert (Info && "Check without CheckInfo returns a value!\n");
+      Value * Ptr = Info->getCheckedPointer (CI);
+      CI->replaceAllUsesWith (castTo (Ptr, CI->getType(), "unchecked", CI));
+    }
+    CI->eraseFromParent();
+  }
+
+  Removed += CheckCalls.size();
+  return Unchecked;
+}
+
+//
+// Method: addDispatch()
+//
+// Description:
+//  Add code to the entry of the function that forwards the call to the
+//  unchecked version unless the call is sampled.  The code is:
+//
+//    entry:     countdown = __sc_sample_countdown
+//               if (countdown == 0) goto sample else goto skip
+//    skip:      __sc_sample_countdown = countdown - 1
+//               goto unchecked
+//    sample:    if (__sc_sample_hit()) goto <original entry>
+//               else goto unchecked
+//    unchecked: return Unchecked (arguments)
+//
+void
+SampleChecks::addDispatch (Function & F, Function * Unchecked) {
+  LLVMContext & Context = F.getContext();
+  BasicBlock * CheckedBB = &F.getEntryBlock();
+  BasicBlock * EntryBB = BasicBlock::Create (Context, "sample.entry", &F,
+                                             CheckedBB);
+  BasicBlock * SkipBB = BasicBlock::Create (Context, "sample.skip", &F,
+                                            CheckedBB);
+  BasicBlock * SampleBB = BasicBlock::Create (Context, "sample.hit", &F,
+                                              CheckedBB);
+  BasicBlock * UncheckedBB = BasicBlock::Create (Context, "sample.unchecked",
+                                                 &F, CheckedBB);
+
+  //
+  // Keep the fixed size allocas in the entry block so that they remain part
+  // of the stack frame instead of becoming dynamic allocations.
+  //
+  std::vector<AllocaInst *> Allocas;
+  for (BasicBlock::iterator I = CheckedBB->begin();
+       I != CheckedBB->end();
+       ++I) {
+    if (AllocaInst * AI = dyn_cast<AllocaInst>(I))
+      if (isa<Constant>(AI->getArraySize()))
+        Allocas.push_back (AI);
+  }
+  for (unsigned index = 0; index < Allocas.size(); ++index) {
+    Allocas[index]->removeFromParent();
+    EntryBB->getInstList().push_back (Allocas[index]);
+  }
+
+  //
+  // Nearly all calls skip the run-time function.
+  //
+  IRBuilder<> Builder (EntryBB);
+  Value * Count = Builder.CreateLoad (Countdown, "countdown");
+  Value * Zero = ConstantInt::get (Count->getType(), 0);
+  MDNode * Unlikely = MDBuilder(Context).createBranchWeights (1, 2000);
+  Builder.CreateCondBr (Builder.CreateICmpEQ (Count, Zero),
+                        SampleBB,
+                        SkipBB,
+                        Unlikely);
+
+  Builder.SetInsertPoint (SkipBB);
+  Builder.CreateStore (Builder.CreateSub (Count,
+                                          ConstantInt::get (Count->getType(),
+                                                            1)),
+                       Countdown);
+  Builder.CreateBr (UncheckedBB);
+
+  Builder.SetInsertPoint (SampleBB);
+  Value * Hit = Builder.CreateCall (SampleHit);
+  Builder.CreateCondBr (Builder.CreateICmpNE (Hit, Zero),
+                        CheckedBB,
+                        UncheckedBB);
+
+  //
+  // Forward the arguments, including their attributes (e.g., byval), to the
+  // unchecked version.
+  //
+  Builder.SetInsertPoint (UncheckedBB);
+  std::vector<Value *> args;
+  for (Function::arg_iterator A = F.arg_begin(); A != F.arg_end(); ++A)
+    args.push_back (A);
+  CallInst * CI = Builder.CreateCall (Unchecked, args);
+  CI->setCallingConv (Unchecked->getCallingConv());
+  CI->setAttributes (Unchecked->getAttributes());
+  CI->setTailCall ();
+  if (F.getReturnType()->isVoidTy())
+    Builder.CreateRetVoid ();
+  else
+    Builder.CreateRet (CI);
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Entry point for this LLVM pass.
+//
+// Return value:
+//  true  - The module was modified.
+//  false - The module was not modified.
+//
+bool
+SampleChecks::runOnModule (Module & M) {
+  //
+  // Find the check functions once so that calls can be classified by their
+  // callee.
+  //
+  Checks.build (M);
+  OtherChecks.clear ();
+  for (unsigned index = 0;
+       index < sizeof (OtherCheckNames) / sizeof (char *);
+       ++index) {
+    if (Function * F = M.getFunction (OtherCheckNames[index]))
+      OtherChecks.insert (F);
+  }
+
+  //
+  // Find the functions to duplicate before adding the unchecked versions to
+  // the module.  Functions with a variable number of arguments cannot forward
+  // them and are always checked.
+  //
+  std::vector<Function *> Worklist;
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (F->isDeclaration() || F->isVarArg())
+      continue;
+    if (hasChecks (*F))
+      Worklist.push_back (F);
+  }
+
+  if (Worklist.empty())
+    return false;
+
+  //
+  // Declare the run-time interface.
+  //
+  Type * Int32Type = IntegerType::getInt32Ty (M.getContext());
+  Countdown = M.getGlobalVariable ("__sc_sample_countdown");
+  if (!Countdown) {
+    Countdown = new GlobalVariable (M,
+                                    Int32Type,
+                                    false,
+                                    GlobalValue::ExternalLinkage,
+                                    0,
+                                    "__sc_sample_countdown",
+                                    0,
+                                    GlobalVariable::GeneralDynamicTLSModel);
+  }
+  SampleHit = cast<Function>(M.getOrInsertFunction ("__sc_sample_hit",
+                                                    Int32Type,
+                                                    NULL));
+
+  for (unsigned index = 0; index < Worklist.size(); ++index) {
+    Function * Unchecked = createUncheckedVersion (*Worklist[index]);
+    addDispatch (*Worklist[index], Unchecked);
+  }
+
+  Sampled += Worklist.size();
+  return true;
+}
+
+}
@@ -10,6 +10,13 @@
 // This pass performs necessary transformations to ensure that Out of Bound
 // pointer rewrites work correctly.
 //
+// Comparisons and pointer to integer casts must see the original value of a
+// rewritten pointer.  Since almost no pointer is ever rewritten, the pass
+// converts pointers with an inline test against the rewrite pointer range and
+// calls pchk_getActualValue() only for pointers within the range.  Pointers
+// that cannot be rewrite pointers and pointers that have already been
+// converted by a dominating test are not converted again.
+//
 // TODO:
 //  There are several optimizations which may improve performance:
 //
@@ -31,11 +38,16 @@
 #define DEBUG_TYPE "rewrite-OOB"
 
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/Support/InstIterator.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include "safecode/RewriteOOB.h"
 #include "safecode/Utility.h"
 
@@ -50,6 +62,8 @@ char RewriteOOB::ID = 0;
 // Statistics
 STATISTIC (Changes,    "Number of Bounds Checks Modified");
 STATISTIC (GetActuals, "Number of getActualValue() Calls Inserted");
+STATISTIC (Reused,     "Number of getActualValue() Results Reused");
+STATISTIC (NotNeeded,  "Number of Pointers Known Not To Be Rewritten");
 
 // Register the pass
 static RegisterPass<RewriteOOB> P ("oob-rewriter",
@@ -227,9 +241,19 @@ RewriteOOB::addGetActualValues (Module & M) {
   std::vector<Instruction *> Worklist;
   for (Module::iterator F = M.begin(); F != M.end(); ++F) {
     //
-    // Clear the worklist.
+    // Skip the inline version of getActualValue(); it is added to the end of
+    // the module while the module is being processed.
+    //
+    if (&*F == GetActualValueInline)
+      continue;
+
+    //
+    // Clear the worklist and forget the pointers converted in the previous
+    // function.
     //
     Worklist.clear();
+    Translated.clear();
+    DT = 0;
 
     //
     // Scan through all the instructions in the given function for those that
@@ -296,12 +320,180 @@ RewriteOOB::addGetActualValues (Module & M) {
         }
       }
     }
+
+    //
+    // Inline the tests that were added to the function.  This is done last
+    // so that the dominator tree stays valid while the tests are added.
+    //
+    InlineFunctionInfo IFI (0, TD);
+    std::map<Value *, std::vector<CallInst *> >::iterator T;
+    for (T = Translated.begin(); T != Translated.end(); ++T) {
+      for (unsigned index = 0; index < T->second.size(); ++index)
+        InlineFunction (T->second[index], IFI);
+    }
+  }
+
+  //
+  // Remove the inline version of getActualValue() now that all calls to it
+  // have been inlined.
+  //
+  if (GetActualValueInline && GetActualValueInline->use_empty()) {
+    GetActualValueInline->eraseFromParent();
+    GetActualValueInline = 0;
   }
 
   // Return whether we modified anything
   return modified;
 }
 
+//
+// Method: createInlineBodyFor()
+//
+// Description:
+//  Create an internal function with the same signature as getActualValue().
+//  The new function returns pointers outside of the rewrite pointer range
+//  unchanged and calls getActualValue() for pointers within the range.
+//
+// Inputs:
+//  GetActualValue - The getActualValue() run-time function.
+//
+// Return value:
+//  A pointer to the new function is returned.
+//
+Function *
+RewriteOOB::createInlineBodyFor (Function * GetActualValue) {
+  Module * M = GetActualValue->getParent();
+  LLVMContext & Context = M->getContext();
+  Function * InlineF = Function::Create (GetActualValue->getFunctionType(),
+                                         GlobalValue::InternalLinkage,
+                                         GetActualValue->getName() + ".inline",
+                                         M);
+
+  BasicBlock * EntryBB = BasicBlock::Create (Context, "entry", InlineF);
+  BasicBlock * PassBB  = BasicBlock::Create (Context, "pass",  InlineF);
+  BasicBlock * SlowBB  = BasicBlock::Create (Context, "slow",  InlineF);
+
+  std::vector<Value *> args;
+  for (Function::arg_iterator arg = InlineF->arg_begin();
+       arg != InlineF->arg_end();
+       ++arg) {
+    args.push_back (arg);
+  }
+
+  //
+  // Get the bounds of the rewrite pointer range from the run-time.  The range
+  // excludes both of its bounds.
+  //
+  Type * IntPtrTy = TD->getIntPtrType (Context);
+  Constant * Lower = M->getOrInsertGlobal ("InvalidLower", IntPtrTy);
+  Constant * Upper = M->getOrInsertGlobal ("InvalidUpper", IntPtrTy);
+  MDNode * Unlikely = MDBuilder(Context).createBranchWeights (1, 2000);
+
+  IRBuilder<> Builder (EntryBB);
+  Value * P = Builder.CreatePtrToInt (args[1], IntPtrTy, "p");
+  Value * Above = Builder.CreateICmpUGT (P, Builder.CreateLoad (Lower,
+                                                                "lower"));
+  Value * Below = Builder.CreateICmpULT (P, Builder.CreateLoad (Upper,
+                                                                "upper"));
+  Builder.CreateCondBr (Builder.CreateAnd (Above, Below),
+                        SlowBB,
+                        PassBB,
+                        Unlikely);
+
+  //
+  // The pointer is not a rewrite pointer; it is its own actual value.
+  //
+  Builder.SetInsertPoint (PassBB);
+  Builder.CreateRet (args[1]);
+
+  //
+  // The pointer may be a rewrite pointer.  Let the run-time look it up.
+  //
+  Builder.SetInsertPoint (SlowBB);
+  Builder.CreateRet (Builder.CreateCall (GetActualValue, args));
+
+  return InlineF;
+}
+
+//
+// Method: isKnownNotRewritten()
+//
+// Description:
+//  Determine whether the specified pointer can be a rewrite pointer.
+//
+//  Rewrite pointers are generated from calls to the SAFECode run-time checks.
+//  Therefore, constants, stack allocations, and return values from heap
+//  allocation functions are known to be the original value.  So are constant
+//  indexings of stack allocations that point to a byte of the allocation, as
+//  their bounds checks always pass.  A pointer one past the end of the
+//  allocation is always rewritten by the run-time, so it is not included.
+//
+// Return value:
+//  true  - The pointer is never a rewrite pointer.
+//  false - The pointer may be a rewrite pointer.
+//
+bool
+RewriteOOB::isKnownNotRewritten (Value * Ptr) {
+  Value * V = Ptr->stripPointerCasts();
+  if (isa<Constant>(V) || isa<AllocaInst>(V) || isNoAliasCall (V))
+    return true;
+
+  if (GEPOperator * GEP = dyn_cast<GEPOperator>(V)) {
+    AllocaInst * AI;
+    AI = dyn_cast<AllocaInst>(GEP->getPointerOperand()->stripPointerCasts());
+    if (!AI || AI->isArrayAllocation() || !GEP->isInBounds())
+      return false;
+
+    APInt Offset (TD->getPointerSizeInBits(), 0);
+    if (!GEP->accumulateConstantOffset (*TD, Offset))
+      return false;
+
+    uint64_t Size = TD->getTypeAllocSize (AI->getAllocatedType());
+    return !Offset.isNegative() && Offset.ult (Size);
+  }
+
+  return false;
+}
+
+//
+// Method: isAlreadyTranslated()
+//
+// Description:
+//  Determine whether the actual value of a pointer has already been computed
+//  by a test that dominates the specified instruction.
+//
+// Inputs:
+//  Ptr - The pointer with its casts stripped.
+//  I   - The instruction that needs the actual value of the pointer.
+//
+// Outputs:
+//  Actual - The actual value of the pointer if it was already computed.
+//
+// Return value:
+//  true  - The actual value was already computed.
+//  false - The actual value must be computed.
+//
+bool
+RewriteOOB::isAlreadyTranslated (Value * Ptr, Instruction * I,
+                                 Value *& Actual) {
+  std::map<Value *, std::vector<CallInst *> >::iterator T;
+  T = Translated.find (Ptr);
+  if (T == Translated.end())
+    return false;
+
+  if (!DT)
+    DT = &getAnalysis<DominatorTree>(*(I->getParent()->getParent()));
+
+  for (unsigned index = 0; index < T->second.size(); ++index) {
+    if (DT->dominates (T->second[index], I)) {
+      Actual = T->second[index];
+      return true;
+    }
+  }
+
+  return false;
+}
+
 //
 // Method: addGetActualValue()
 //
@@ -327,6 +519,8 @@ RewriteOOB::addGetActualValue (Instruction *SCI, unsigned operand) {
                                                 VoidPtrTy,
                                                 NULL);
   Function * GetActualValue = cast<Function>(GAVConst);
+  if (!GetActualValueInline)
+    GetActualValueInline = createInlineBodyFor (GetActualValue);
 
   //
   // Get the operand that needs to be replaced.
@@ -334,17 +528,27 @@ RewriteOOB::addGetActualValue (Instruction *SCI, unsigned operand) {
   Value * Operand = SCI->getOperand(operand);
 
   //
+  // Pointers that are never rewritten do not need to be converted back into
+  // their original values.
   //
-  // Rewrite pointers are generated from calls to the SAFECode run-time
-  // checks.  Therefore, constants and return values from allocation
-  // functions are known to be the original value and do not need to be
-  // rewritten back into their orignal values.
+  if (isKnownNotRewritten (Operand)) {
+    ++NotNeeded;
+    return;
+  }
+
   //
-  // FIXME:
-  //  Add a case for calls to heap allocation functions.
+  // If the pointer was already converted before this instruction, use the
+  // result of that conversion.
   //
   Value * PeeledOperand = Operand->stripPointerCasts();
-  if (isa<Constant>(PeeledOperand) || isa<AllocaInst>(PeeledOperand)) {
+  Value * Actual = 0;
+  if (isAlreadyTranslated (PeeledOperand, SCI, Actual)) {
+    ++Reused;
+    Value *CastBack = castTo (Actual,
+                              Operand->getType(),
+                              Operand->getName()+".castback",
+                              SCI);
+    SCI->setOperand (operand, CastBack);
     return;
   }
 
@@ -364,7 +568,8 @@ RewriteOOB::addGetActualValue (Instruction *SCI, unsigned operand) {
   ++GetActuals;
 
   //
-  // Insert the call to getActualValue()
+  // Insert the call to the inline getActualValue().  It is inlined once all
+  // of the function's pointers have been processed.
   //
   Type * VoidPtrType = getVoidPtrType(Operand->getContext());
   Value * OpVptr = castTo (Operand,
@@ -375,10 +580,11 @@ RewriteOOB::addGetActualValue (Instruction *SCI, unsigned operand) {
   std::vector<Value *> args;
   args.push_back (PH);
   args.push_back (OpVptr);
-  CallInst *CI = CallInst::Create (GetActualValue,
+  CallInst *CI = CallInst::Create (GetActualValueInline,
                                    args,
                                    "getval",
                                    SCI);
+  Translated[PeeledOperand].push_back (CI);
   Instruction *CastBack = castTo (CI,
                                   Operand->getType(),
                                   Operand->getName()+".castback",
@@ -399,6 +605,10 @@ RewriteOOB::addGetActualValue (Instruction *SCI, unsigned operand) {
 //
 bool
 RewriteOOB::runOnModule (Module & M) {
+  // Get prerequisite analysis results
+  TD = &getAnalysis<DataLayout>();
+  GetActualValueInline = 0;
+
   //
   // Insert calls so that comparison instructions convert Out of Bound pointers
   // back into their original values.  This should be done *before* rewriting
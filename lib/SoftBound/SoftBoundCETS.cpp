@@ -143,6 +143,12 @@ OPAQUECALLS
  cl::desc("consider all calls as opaque for func_dom_check_elimination"),
  cl::init(true));
 
+static cl::opt<bool>
+MAYFREESUMMARIES
+("softboundcets_may_free_summaries",
+ cl::desc("only consider calls that may free memory as opaque"),
+ cl::init(true));
+
 static cl::opt<bool>
 TEMPORALBOUNDSCHECKOPT
 ("softboundcets_temporal_bounds_check_opt",
@@ -167,6 +173,12 @@ BBDOMTEMPORALCHECKOPT
  cl::desc("eliminate redundant checks in the basic block"),
  cl::init(true));
 
+static cl::opt<bool>
+REGISTERMETADATA
+("softboundcets_register_metadata",
+ cl::desc("pass metadata in arguments and return values of internal functions"),
+ cl::init(true));
+
 static cl::opt<bool>
 unsafe_byval_opt
 ("unsafe_byval_opt",
@@ -328,8 +340,8 @@ void SoftBoundCETSPass::initializeSoftBoundVariables(Module& module) {
   assert(m_temporal_stack_memory_deallocation && 
          "__softboundcets_stack_memory_deallocation not defined?");
 
-  m_load_base_bound_func = module.getFunction("__softboundcets_metadata_load");
-  assert(m_load_base_bound_func && "__softboundcets_metadata_load null?");
+  m_metadata_entry_func = module.getFunction("__softboundcets_metadata_entry");
+  assert(m_metadata_entry_func && "__softboundcets_metadata_entry null?");
 
   m_store_base_bound_func = module.getFunction("__softboundcets_metadata_store");
   assert(m_store_base_bound_func && "__softboundcets_metadata_store null?");
@@ -816,6 +828,7 @@ bool SoftBoundCETSPass::isFuncDefSoftBound(const std::string &str) {
     m_func_def_softbound["__softboundcets_stack_memory_deallocation"] = true;
 
     m_func_def_softbound["__softboundcets_metadata_load"] = true;
+    m_func_def_softbound["__softboundcets_metadata_entry"] = true;
     m_func_def_softbound["__softboundcets_metadata_store"] = true;
     m_func_def_softbound["__hashProbeAddrOfPtr"] = true;
     m_func_def_softbound["__memcopyCheck"] = true;
@@ -942,6 +955,54 @@ void SoftBoundCETSPass::identifyFuncToTrans(Module& module) {
   }
 }
 
+//
+// Method: identifyRegisterMetadataFuncs
+//
+// Description: This function identifies the functions whose pointer
+// metadata can be passed in arguments and return values instead of
+// the shadow stack. All call sites of such a function must be known
+// and instrumented by us, so it must have local linkage, must not
+// have its address taken and must only be called from functions that
+// are transformed.
+//
+
+void SoftBoundCETSPass::identifyRegisterMetadataFuncs(Module& module) {
+
+  if(!REGISTERMETADATA)
+    return;
+
+  for(Module::iterator ff_begin = module.begin(), ff_end = module.end();
+      ff_begin != ff_end; ++ff_begin){
+    Function* func = dyn_cast<Function>(ff_begin);
+    assert(func && "Not a function??");
+
+    if(!func->hasLocalLinkage() || func->isVarArg() || 
+       func->hasAddressTaken())
+      continue;
+
+    if(!checkIfFunctionOfInterest(func) || !hasPtrArgRetType(func))
+      continue;
+
+    bool eligible = true;
+    for(Function::arg_iterator ib = func->arg_begin(), ie = func->arg_end();
+        ib != ie; ++ib) {
+      if(isa<PointerType>(ib->getType()) && ib->hasByValAttr())
+        eligible = false;
+    }
+
+    for(Value::use_iterator ui = func->use_begin(), ue = func->use_end();
+        ui != ue && eligible; ++ui){
+      CallInst* call_inst = dyn_cast<CallInst>(*ui);
+      if(!call_inst || 
+         !checkIfFunctionOfInterest(call_inst->getParent()->getParent()))
+        eligible = false;
+    }
+
+    if(eligible)
+      m_register_metadata_funcs.insert(func);
+  }
+}
+
 //
 // Method: introduceGlobalLockFunction()
 //
@@ -1548,6 +1609,54 @@ SoftBoundCETSPass::introduceShadowStackStores(Value* ptr_value,
   }    
 }
 
+//
+// Method: getMetadataOperands
+//
+// Description: This function collects the metadata of a pointer that
+// is passed to or returned from a function that receives its metadata
+// in arguments, in the order of those arguments.
+
+void 
+SoftBoundCETSPass::getMetadataOperands(Value* ptr_value, 
+                                       Instruction* insert_at,
+                                       SmallVectorImpl<Value*>& md){
+  if(spatial_safety){
+    Value* ptr_base = getAssociatedBase(ptr_value);
+    Value* ptr_bound = getAssociatedBound(ptr_value);
+    md.push_back(castToVoidPtr(ptr_base, insert_at));
+    md.push_back(castToVoidPtr(ptr_bound, insert_at));
+  }
+
+  if(temporal_safety){
+    Value* ptr_key = getAssociatedKey(ptr_value);    
+    Value* func_lock = getAssociatedFuncLock(insert_at);
+    md.push_back(ptr_key);
+    md.push_back(getAssociatedLock(ptr_value, func_lock));
+  }
+}
+
+//
+// Method: getMetadataPlaceholders
+//
+// Description: This function collects the shadow stack loads that
+// were introduced for a pointer whose metadata will instead arrive in
+// an argument or return value. They are replaced by
+// passMetadataInRegisters once all functions are transformed.
+
+void 
+SoftBoundCETSPass::getMetadataPlaceholders(Value* ptr_value, 
+                                           SmallVectorImpl<Value*>& md){
+  if(spatial_safety){
+    md.push_back(m_pointer_base[ptr_value]);
+    md.push_back(m_pointer_bound[ptr_value]);
+  }
+
+  if(temporal_safety){
+    md.push_back(m_pointer_key[ptr_value]);
+    md.push_back(m_pointer_lock[ptr_value]);
+  }
+}
+
 //
 // Method: introduceShadowStackDeallocation
 //
@@ -1905,6 +2014,11 @@ void SoftBoundCETSPass:: handleReturnInst(ReturnInst* ret){
     return;
   }
   if(isa<PointerType>(pointer->getType())){
+    Function* func = ret->getParent()->getParent();
+    if(m_register_metadata_funcs.count(func)){
+      getMetadataOperands(pointer, ret, m_register_metadata_rets[ret]);
+      return;
+    }
     introduceShadowStackStores(pointer, ret, 0);
   }
 }
@@ -2661,6 +2775,147 @@ optimizeGlobalAndStackVariableChecks(Instruction* load_store) {
   }
 }
 
+/* Library functions that neither free memory nor call back into the
+ * program
+ */
+static const char* const NoFreeFunctions[] = {
+  "malloc", "calloc", "memcmp", "memchr", "memcpy", "memmove", "memset",
+  "strlen", "strcmp", "strncmp", "strcpy", "strncpy", "strcat", "strncat",
+  "strchr", "strrchr", "strstr", "strspn", "strcspn", "strpbrk",
+  "atoi", "atol", "atof", "strtol", "strtoul", "strtod",
+  "abs", "labs", "fabs", "sqrt", "exp", "log", "log10", "pow", "floor",
+  "ceil", "fmod", "sin", "cos", "tan", "asin", "acos", "atan", "atan2",
+  "isalpha", "isdigit", "isalnum", "isspace", "isupper", "islower",
+  "toupper", "tolower", "__ctype_b_loc", "__ctype_toupper_loc",
+  "__ctype_tolower_loc", "__errno_location",
+  "printf", "fprintf", "sprintf", "snprintf", "puts", "fputs", "putchar",
+  "fputc", "putc", "fwrite", "fread", "fgets", "fgetc", "getc", "getchar",
+  "fflush", "rand", "srand", "drand48", "time", "clock",
+  NULL
+};
+
+//
+// Method: isKnownNoFree
+//
+// Description: This function returns true if the function is known
+// not to free memory regardless of its body: LLVM intrinsics, the
+// SoftBound/CETS run-time functions other than the ones that
+// deallocate locks, and the library functions listed above.
+
+bool SoftBoundCETSPass::isKnownNoFree(Function* func){
+
+  StringRef name = func->getName();
+  if(name.startswith("llvm."))
+    return true;
+
+  if(name.startswith("__softboundcets_"))
+    return (name != "__softboundcets_memory_deallocation" &&
+            name != "__softboundcets_stack_memory_deallocation");
+
+  if(!func->isDeclaration())
+    return false;
+
+  for(const char* const* lib_func = NoFreeFunctions; *lib_func; ++lib_func){
+    if(name == *lib_func)
+      return true;
+  }
+  return false;
+}
+
+//
+// Method: computeMayFreeSummaries
+//
+// Description: This function computes for each function in the
+// module whether it may free memory. External functions that are not
+// known to be free of deallocations, and functions making indirect
+// calls, may free. The property is then propagated bottom-up from
+// callees to their callers until a fixed point is reached, so
+// recursive functions that free nothing are found to be free of
+// deallocations.
+
+void SoftBoundCETSPass::computeMayFreeSummaries(Module& module){
+
+  if(!MAYFREESUMMARIES)
+    return;
+
+  std::map<Function*, std::vector<Function*> > callers;
+  std::queue<Function*> worklist;
+
+  for(Module::iterator ff_begin = module.begin(), ff_end = module.end();
+      ff_begin != ff_end; ++ff_begin){
+    Function* func = dyn_cast<Function>(ff_begin);
+    assert(func && "Not a function??");
+
+    if(isKnownNoFree(func)){
+      m_func_may_free[func] = false;
+      continue;
+    }
+
+    if(func->isDeclaration() || isFuncDefSoftBound(func->getName())){
+      m_func_may_free[func] = true;
+      worklist.push(func);
+      continue;
+    }
+
+    m_func_may_free[func] = false;
+    for(inst_iterator i = inst_begin(func), e = inst_end(func); i != e; ++i){
+      if(!isa<CallInst>(*i) && !isa<InvokeInst>(*i))
+        continue;
+
+      CallSite cs(&*i);
+      Value* called = cs.getCalledValue()->stripPointerCasts();
+      Function* callee = dyn_cast<Function>(called);
+      if(callee){
+        callers[callee].push_back(func);
+      } else if(!m_func_may_free[func]){
+        m_func_may_free[func] = true;
+        worklist.push(func);
+      }
+    }
+  }
+
+  while(!worklist.empty()){
+    Function* func = worklist.front();
+    worklist.pop();
+
+    std::vector<Function*>& func_callers = callers[func];
+    for(unsigned i = 0; i < func_callers.size(); ++i){
+      Function* caller = func_callers[i];
+      if(!m_func_may_free[caller]){
+        m_func_may_free[caller] = true;
+        worklist.push(caller);
+      }
+    }
+  }
+}
+
+//
+// Method: isTemporalCheckBarrier
+//
+// Description: This function returns true if the instruction is a
+// call that may free memory, after which temporal checks of earlier
+// dereferences do not make later ones redundant.
+
+bool SoftBoundCETSPass::isTemporalCheckBarrier(Instruction* inst){
+
+  CallInst* call_inst = dyn_cast<CallInst>(inst);
+  if(!call_inst || !OPAQUECALLS)
+    return false;
+
+  if(!MAYFREESUMMARIES)
+    return true;
+
+  Value* called = call_inst->getCalledValue()->stripPointerCasts();
+  Function* func = dyn_cast<Function>(called);
+  if(!func)
+    return true;
+
+  if(m_func_may_free.count(func))
+    return m_func_may_free[func];
+
+  return !isKnownNoFree(func);
+}
+
 //
 // Method: bbTemporalCheckElimination
 //
@@ -2705,7 +2960,7 @@ SoftBoundCETSPass::bbTemporalCheckElimination(Instruction* load_store,
   while((next_inst_bb == bb_curr) && 
         (next_inst != bb_curr->getTerminator())) {
 
-    if(isa<CallInst>(next_inst) && OPAQUECALLS)
+    if(isTemporalCheckBarrier(next_inst))
       break;
       
     if(checkLoadStoreSourceIsGEP(next_inst, gep_source)){
@@ -2847,7 +3102,7 @@ SoftBoundCETSPass::funcTemporalCheckElimination(Instruction* load_store,
       while((next_inst_bb == bb_curr) && 
             (next_inst != bb_curr->getTerminator())) {
 
-        if(isa<CallInst>(next_inst) && OPAQUECALLS){
+        if(isTemporalCheckBarrier(next_inst)){
           break_flag = true;
           break;
         }
@@ -2864,7 +3119,7 @@ SoftBoundCETSPass::funcTemporalCheckElimination(Instruction* load_store,
     } else {
       for(BasicBlock::iterator i = bb->begin(), ie = bb->end(); i != ie; ++i){
         Instruction* new_inst = dyn_cast<Instruction>(i);
-        if(isa<CallInst>(new_inst) && OPAQUECALLS){
+        if(isTemporalCheckBarrier(new_inst)){
           break_flag = true;
           break;
         }
@@ -3283,6 +3538,199 @@ void SoftBoundCETSPass:: renameFunctionName(Function* func,
   func->eraseFromParent();
 }
 
+//
+// Function: keepOriginalAttributes
+//
+// Description: Returns the attributes of the function or call
+// attributes pal that still apply once the metadata arguments are
+// appended to its num_params original parameters. The parameter and
+// function attributes keep their indices. The return attributes are
+// kept only if the return type is unchanged.
+//
+
+static AttributeSet keepOriginalAttributes(LLVMContext& context,
+                                           const AttributeSet& pal,
+                                           unsigned num_params,
+                                           bool keep_ret){
+  AttributeSet attrs;
+  if(keep_ret && pal.hasAttributes(AttributeSet::ReturnIndex))
+    attrs = attrs.addAttributes(context, AttributeSet::ReturnIndex,
+                                pal.getRetAttributes());
+
+  for(unsigned arg_index = 1; arg_index <= num_params; arg_index++){
+    if(pal.hasAttributes(arg_index))
+      attrs = attrs.addAttributes(context, arg_index,
+                                  pal.getParamAttributes(arg_index));
+  }
+
+  if(pal.hasAttributes(AttributeSet::FunctionIndex))
+    attrs = attrs.addAttributes(context, AttributeSet::FunctionIndex,
+                                pal.getFnAttributes());
+  return attrs;
+}
+
+//
+// Method: passMetadataInRegisters
+//
+// Description: This function rewrites a function identified by
+// identifyRegisterMetadataFuncs and all of its call sites once the
+// transformation is complete. The metadata of each pointer argument
+// is appended to the arguments and a returned pointer is returned in
+// a structure along with its metadata. The shadow stack loads that
+// stood in for this metadata are replaced by the new arguments and
+// return values.
+//
+
+void SoftBoundCETSPass::passMetadataInRegisters(Function* func){
+
+  Type* ret_type = func->getReturnType();
+  bool ptr_ret = isa<PointerType>(ret_type);
+  FunctionType* fty = func->getFunctionType();
+
+  std::vector<Type*> md_types;
+  if(spatial_safety){
+    md_types.push_back(m_shadow_stack_base_load->getReturnType());
+    md_types.push_back(m_shadow_stack_bound_load->getReturnType());
+  }
+  if(temporal_safety){
+    md_types.push_back(m_shadow_stack_key_load->getReturnType());
+    md_types.push_back(m_shadow_stack_lock_load->getReturnType());
+  }
+
+  std::vector<Type*> params(fty->param_begin(), fty->param_end());
+  for(Function::arg_iterator i = func->arg_begin(), e = func->arg_end();
+      i != e; ++i) {
+    if(isa<PointerType>(i->getType()))
+      params.insert(params.end(), md_types.begin(), md_types.end());
+  }
+
+  Type* new_ret_type = ret_type;
+  if(ptr_ret){
+    std::vector<Type*> fields;
+    fields.push_back(ret_type);
+    fields.insert(fields.end(), md_types.begin(), md_types.end());
+    new_ret_type = StructType::get(func->getContext(), fields);
+  }
+
+  FunctionType* nfty = FunctionType::get(new_ret_type, params, false);
+  Function* new_func = Function::Create(nfty, func->getLinkage());
+  new_func->copyAttributesFrom(func);
+  new_func->setAttributes(keepOriginalAttributes(func->getContext(),
+                                                 func->getAttributes(),
+                                                 fty->getNumParams(),
+                                                 !ptr_ret));
+  func->getParent()->getFunctionList().insert(func, new_func);
+  new_func->takeName(func);
+  new_func->getBasicBlockList().splice(new_func->begin(), 
+                                       func->getBasicBlockList());
+
+  Function::arg_iterator arg_i2 = new_func->arg_begin();      
+  for(Function::arg_iterator arg_i = func->arg_begin(), 
+        arg_e = func->arg_end(); arg_i != arg_e; ++arg_i) {
+    arg_i->replaceAllUsesWith(arg_i2);
+    arg_i2->takeName(arg_i);        
+    ++arg_i2;
+  }
+
+  /* The metadata arguments replace the shadow stack loads in the
+   * entry block
+   */
+  SmallVector<Value*, 8>& arg_md = m_register_metadata_args[func];
+  assert(arg_md.size() == params.size() - fty->getNumParams() &&
+         "metadata missing for a pointer argument?");
+  for(unsigned i = 0; i < arg_md.size(); ++i, ++arg_i2){
+    Instruction* placeholder = cast<Instruction>(arg_md[i]);
+    placeholder->replaceAllUsesWith(arg_i2);
+    placeholder->eraseFromParent();
+  }
+  m_register_metadata_args.erase(func);
+
+  /* Return the metadata along with the pointer. Returns that were not
+   * visited are unreachable and return null metadata.
+   */
+  if(ptr_ret){
+    for(Function::iterator bb = new_func->begin(), be = new_func->end(); 
+        bb != be; ++bb){
+      ReturnInst* ret = dyn_cast<ReturnInst>(bb->getTerminator());
+      if(!ret)
+        continue;
+
+      SmallVector<Value*, 4> md;
+      if(m_register_metadata_rets.count(ret)){
+        md = m_register_metadata_rets[ret];
+        m_register_metadata_rets.erase(ret);
+      } else {
+        for(unsigned i = 0; i < md_types.size(); ++i)
+          md.push_back(Constant::getNullValue(md_types[i]));
+      }
+
+      Value* ret_value = UndefValue::get(new_ret_type);
+      ret_value = InsertValueInst::Create(ret_value, ret->getReturnValue(), 
+                                          0, "", ret);
+      for(unsigned i = 0; i < md.size(); ++i){
+        ret_value = InsertValueInst::Create(ret_value, md[i], i + 1, "", ret);
+      }
+      ReturnInst::Create(func->getContext(), ret_value, ret);
+      ret->eraseFromParent();
+    }
+  }
+
+  /* Rewrite the call sites. Calls that were not visited are
+   * unreachable and pass null metadata.
+   */
+  std::vector<CallInst*> calls;
+  for(Value::use_iterator ui = func->use_begin(), ue = func->use_end();
+      ui != ue; ++ui){
+    calls.push_back(cast<CallInst>(*ui));
+  }
+
+  for(unsigned i = 0; i < calls.size(); ++i){
+    CallInst* call_inst = calls[i];
+    CallSite cs(call_inst);
+    SmallVector<Value*, 16> args(cs.arg_begin(), cs.arg_end());
+    if(m_register_metadata_calls.count(call_inst)){
+      SmallVector<Value*, 8>& md = m_register_metadata_calls[call_inst];
+      args.append(md.begin(), md.end());
+      m_register_metadata_calls.erase(call_inst);
+    } else {
+      while(args.size() < params.size())
+        args.push_back(Constant::getNullValue(params[args.size()]));
+    }
+
+    CallInst* new_call = CallInst::Create(new_func, args, "", call_inst);
+    new_call->setCallingConv(call_inst->getCallingConv());
+    new_call->setAttributes(keepOriginalAttributes(call_inst->getContext(),
+                                                   call_inst->getAttributes(),
+                                                   fty->getNumParams(),
+                                                   !ptr_ret));
+    new_call->setTailCall(call_inst->isTailCall());
+    new_call->setDebugLoc(call_inst->getDebugLoc());
+
+    Value* result = new_call;
+    if(ptr_ret){
+      result = ExtractValueInst::Create(new_call, 0, "", call_inst);
+      if(m_register_metadata_call_rets.count(call_inst)){
+        SmallVector<Value*, 4>& md = m_register_metadata_call_rets[call_inst];
+        for(unsigned j = 0; j < md.size(); ++j){
+          Value* md_value = 
+            ExtractValueInst::Create(new_call, j + 1, "", call_inst);
+          Instruction* placeholder = cast<Instruction>(md[j]);
+          placeholder->replaceAllUsesWith(md_value);
+          placeholder->eraseFromParent();
+        }
+        m_register_metadata_call_rets.erase(call_inst);
+      }
+    }
+    if(!call_inst->getType()->isVoidTy()){
+      result->takeName(call_inst);
+      call_inst->replaceAllUsesWith(result);
+    }
+    call_inst->eraseFromParent();
+  }
+
+  assert(func->use_empty() && "call to internal function not rewritten?");
+  func->eraseFromParent();
+}
 
 void SoftBoundCETSPass::handleAlloca (AllocaInst* alloca_inst,
                                             Value* alloca_key,
@@ -3619,6 +4067,26 @@ void SoftBoundCETSPass::handleCall(CallInst* call_inst) {
   Instruction* insert_at = getNextInstruction(call_inst);
   //  call_inst->setCallingConv(CallingConv::C);
 
+  /* Metadata of calls to internal functions is passed in registers,
+   * the call is rewritten by passMetadataInRegisters 
+   */
+  if(func && m_register_metadata_funcs.count(func)){
+    SmallVector<Value*, 8>& md = m_register_metadata_calls[call_inst];
+    CallSite cs(call_inst);
+    for(unsigned i = 0; i < cs.arg_size(); i++){
+      Value* arg_value = cs.getArgument(i);
+      if(isa<PointerType>(arg_value->getType()))
+        getMetadataOperands(arg_value, call_inst, md);
+    }
+
+    if(isa<PointerType>(mcall->getType())){
+      introduceShadowStackLoads(call_inst, insert_at, 0);
+      getMetadataPlaceholders(call_inst, 
+                              m_register_metadata_call_rets[call_inst]);
+    }
+    return;
+  }
+
   introduceShadowStackAllocation(call_inst);
   iterateCallSiteIntroduceShadowStackStores(call_inst);
     
@@ -3894,6 +4362,9 @@ void SoftBoundCETSPass::gatherBaseBoundPass1 (Function * func) {
     }
     else{
       introduceShadowStackLoads(ptr_argument_value, fst_inst, arg_count);
+      if(m_register_metadata_funcs.count(func))
+        getMetadataPlaceholders(ptr_argument_value, 
+                                m_register_metadata_args[func]);
       //      introspectMetadata(func, ptr_argument_value, fst_inst, arg_count);
     }
   }
@@ -4133,15 +4604,15 @@ bool SoftBoundCETSPass:: isByValDerived(Value* pointer_operand){
  * which is a global then inserts base and bound for that global
  * Also if the loaded value is a pointer then loads the base and
  * bound for for the pointer from the shadow space
+ *
+ * The metadata is read with plain loads from the trie entry returned
+ * by __softboundcets_metadata_entry, so base, bound, key and lock
+ * are SSA values that the optimizer can keep in registers, hoist and
+ * merge, rather than values passed back through stack slots.
  */
 
 void SoftBoundCETSPass::handleLoad(LoadInst* load_inst) { 
 
-  AllocaInst* base_alloca = 0;
-  AllocaInst* bound_alloca = 0;
-  AllocaInst* key_alloca = 0;
-  AllocaInst* lock_alloca = 0;
-
   SmallVector<Value*, 8> args;
 
   if(!isa<PointerType>(load_inst->getType()))
@@ -4169,44 +4640,55 @@ void SoftBoundCETSPass::handleLoad(LoadInst* load_inst) {
    * from the shadow space
    */
   Value* pointer_operand_bitcast =  castToVoidPtr(pointer_operand, insert_at);      
-  Instruction* first_inst_func = dyn_cast<Instruction>(load_inst->getParent()->getParent()->begin()->begin());
-  assert(first_inst_func && "function doesn't have any instruction and there is load???");
   
   /* address of pointer being pushed */
   args.push_back(pointer_operand_bitcast);
-    
 
-  if(spatial_safety){
-    
-    base_alloca = new AllocaInst(m_void_ptr_type, "base.alloca", first_inst_func);
-    bound_alloca = new AllocaInst(m_void_ptr_type, "bound.alloca", first_inst_func);
-  
-    /* base */
-    args.push_back(base_alloca);
-    /* bound */
-    args.push_back(bound_alloca);
-  }
-
-  if(temporal_safety){
-    
-    key_alloca = new AllocaInst(Type::getInt64Ty(load_inst->getType()->getContext()), "key.alloca", first_inst_func);
-    lock_alloca = new AllocaInst(m_void_ptr_type, "lock.alloca", first_inst_func);
+  /* The fields of a trie entry are pointer sized: base and bound
+   * come first when spatial safety is enabled, followed by key and
+   * lock when temporal safety is enabled.
+   */
+  CallInst* entry = CallInst::Create(m_metadata_entry_func, args, 
+                                     "metadata.entry", insert_at);
+  Value* fields = new BitCastInst(entry, 
+                                  PointerType::getUnqual(m_void_ptr_type),
+                                  "metadata.fields", insert_at);
+  LLVMContext& context = load_inst->getContext();
+  unsigned field = 0;
 
-    args.push_back(key_alloca);
-    args.push_back(lock_alloca);
-  }
-  
-  CallInst::Create(m_load_base_bound_func, args, "", insert_at);
-      
   if(spatial_safety){
-    Instruction* base_load = new LoadInst(base_alloca, "base.load", insert_at);
-    Instruction* bound_load = new LoadInst(bound_alloca, "bound.load", insert_at);
+    Value* base_addr = 
+      GetElementPtrInst::Create(fields, 
+                                ConstantInt::get(Type::getInt32Ty(context), 
+                                                 field++),
+                                "base.addr", insert_at);
+    Value* bound_addr = 
+      GetElementPtrInst::Create(fields, 
+                                ConstantInt::get(Type::getInt32Ty(context), 
+                                                 field++),
+                                "bound.addr", insert_at);
+    Instruction* base_load = new LoadInst(base_addr, "base.load", insert_at);
+    Instruction* bound_load = new LoadInst(bound_addr, "bound.load", insert_at);
     associateBaseBound(load_inst_value, base_load, bound_load);      
   }
 
   if(temporal_safety){
-    Instruction* key_load = new LoadInst(key_alloca, "key.load", insert_at);
-    Instruction* lock_load = new LoadInst(lock_alloca, "lock.load", insert_at);    
+    Value* key_addr = 
+      GetElementPtrInst::Create(fields, 
+                                ConstantInt::get(Type::getInt32Ty(context), 
+                                                 field++),
+                                "key.addr", insert_at);
+    key_addr = 
+      new BitCastInst(key_addr, 
+                      PointerType::getUnqual(Type::getInt64Ty(context)),
+                      "key.addr.cast", insert_at);
+    Value* lock_addr = 
+      GetElementPtrInst::Create(fields, 
+                                ConstantInt::get(Type::getInt32Ty(context), 
+                                                 field++),
+                                "lock.addr", insert_at);
+    Instruction* key_load = new LoadInst(key_addr, "key.load", insert_at);
+    Instruction* lock_load = new LoadInst(lock_addr, "lock.load", insert_at);    
     associateKeyLock(load_inst_value, key_load, lock_load);
   }
 }
@@ -4359,6 +4841,8 @@ bool SoftBoundCETSPass::runOnModule(Module& module) {
   transformMain(module);
 
   identifyFuncToTrans(module);
+  identifyRegisterMetadataFuncs(module);
+  computeMayFreeSummaries(module);
 
   identifyInitialGlobals(module);
   addBaseBoundGlobals(module);
@@ -4401,6 +4885,12 @@ bool SoftBoundCETSPass::runOnModule(Module& module) {
     addDereferenceChecks(func_ptr);            
   }
 
+  for(std::set<Function*>::iterator fi = m_register_metadata_funcs.begin(),
+        fe = m_register_metadata_funcs.end(); fi != fe; ++fi){
+    passMetadataInRegisters(*fi);
+  }
+  m_register_metadata_funcs.clear();
+
   renameFunctions(module);
   DEBUG(errs()<<"Done with SoftBoundCETSPass\n");
   
@@ -40,6 +40,11 @@ namespace {
   cl::opt<bool> EnableSVA("sva",
                           cl::init(false), 
                           cl::desc("Enable SVA-Kernel specific operations"));
+
+  cl::opt<bool>
+  BBTaggedPointers("baggy-tagged-pointers",
+                   cl::init(false),
+                   cl::desc("Keep baggy bounds sizes in pointer tag bits"));
 }
 
 namespace {
@@ -148,6 +153,23 @@ SAFECodeConfiguration::rewriteOOB() {
   return RewritePtrs;
 }
 
+//
+// Method: bbTaggedPointers()
+//
+// Description:
+//  Determines whether baggy bounds checking should record the size of each
+//  padded memory object in the upper bits of pointers to it instead of in the
+//  baggy bounds size table.
+//
+// Return value:
+//  true  - Pointers to padded memory objects are tagged with their size.
+//  false - Object sizes are only recorded in the baggy bounds size table.
+//
+bool
+SAFECodeConfiguration::bbTaggedPointers() {
+  return BBTaggedPointers;
+}
+
 //
 // Method: staticCheckType()
 //
@@ -50,6 +50,8 @@
 #include <stdio.h>
 
 #include "safecode/Runtime/BBMetaData.h"
+#include "safecode/Runtime/MetadataBudget.h"
+#include "safecode/Runtime/Telemetry.h"
 
 #define TAG unsigned tag
 
@@ -137,6 +139,16 @@ pool_init_runtime(unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
   ConfigData.StrictIndexing = !(RewriteOOB);
   StopOnError = Terminate;
 
+  //
+  // Enable the statistics counters if the user asked for them.
+  //
+  __sc_stats_init ("baggy");
+
+  //
+  // Start counting metadata if the user set any budgets for it.
+  //
+  __sc_md_init ();
+
   //
   // Allocate a range of memory for rewrite pointers.
   //
@@ -232,6 +244,8 @@ __internal_register(DebugPoolTy *Pool,
                     TAG,
                     const char* SourceFilep,
                     unsigned lineno) {
+  SC_STAT (SC_STAT_REGISTRATIONS);
+
   uintptr_t Source = (uintptr_t)allocaptr;
   unsigned char size= 0;
   //
@@ -533,6 +547,7 @@ __sc_bb_poolunregister_debug (DebugPoolTy *Pool,
   if(e == 0 ) {
     return;
   }
+  SC_STAT (SC_STAT_UNREGISTRATIONS);
   uintptr_t size = 1 << e;
   uintptr_t base = Source & ~(size -1);
   unsigned long index = base >> SLOT_SIZE;
@@ -560,6 +575,7 @@ __sc_bb_poolunregister_stack_debug (DebugPoolTy *Pool,
   if(e == 0 ) {
     return;
   }
+  SC_STAT (SC_STAT_UNREGISTRATIONS);
   uintptr_t size = 1 << e;
   uintptr_t base = Source & ~(size -1);
   unsigned long index = base >> SLOT_SIZE;
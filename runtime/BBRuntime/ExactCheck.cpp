@@ -20,6 +20,7 @@
 #include "safecode/Config/config.h"
 #include "safecode/Runtime/BBRuntime.h"
 #include "safecode/Runtime/BBMetaData.h"
+#include "safecode/Runtime/Telemetry.h"
 
 #include <stdint.h>
 
@@ -54,6 +55,8 @@ exactcheck_check (void *source, void * ObjStart, void * ObjEnd,
  */
 void *
 bb_exactcheck2 (char *source, char *base, char *result, unsigned size) {
+  SC_STAT (SC_STAT_EXACT_CHECKS);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
@@ -92,6 +95,8 @@ exactcheck2_debug (char *source,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
+  SC_STAT (SC_STAT_EXACT_CHECKS);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
@@ -0,0 +1,16 @@
+//===- MetadataBudget.cpp - Run-time metadata memory budgets --------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The baggy bounds run-time accounts for its metadata against the same
+// budgets as the debug run-time, so it builds the implementation in the
+// DebugRuntime directory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../DebugRuntime/MetadataBudget.cpp"
@@ -14,6 +14,7 @@
 
 #include "safecode/Runtime/Report.h"
 #include "safecode/Config/config.h"
+#include "safecode/Runtime/Telemetry.h"
 
 #include <iostream>
 #include <cstdlib>
@@ -99,6 +100,8 @@ ViolationInfo::print(std::ostream & OS) const {
 
 void
 ReportMemoryViolation(const ViolationInfo *v) {
+  SC_STAT (SC_STAT_VIOLATIONS);
+
   // Flag for whether to terminate when an error is detected.
   extern unsigned StopOnError;
 
@@ -16,6 +16,8 @@
 #include "RewritePtr.h"
 
 #include "safecode/Runtime/BBRuntime.h"
+#include "safecode/Runtime/MetadataBudget.h"
+#include "safecode/Runtime/Telemetry.h"
 #include "llvm/ADT/DenseMap.h"
 
 #include <cstdio>
@@ -36,6 +38,15 @@ std::map<const void *, const void *> RewrittenPointers;
 // Record from which object an OOB pointer originates
 llvm::DenseMap<void *, std::pair<void *, void * > > RewrittenObjs;
 
+// Approximate number of bytes added to the maps above by one rewrite: a node
+// of the std::map and an entry in each DenseMap, which keep at least half of
+// their buckets empty.  The OOB splay tree nodes are counted separately.
+static const size_t RewriteEntryBytes = 6 * sizeof (void *) +
+                                        2 * (3 * sizeof (void *) +
+                                             sizeof (const char *) +
+                                             sizeof (unsigned) +
+                                             2 * sizeof (void *));
+
 //
 // Function: rewrite_ptr()
 //
@@ -69,6 +80,14 @@ rewrite_ptr (DebugPoolTy * Pool,
   if (RewrittenPointers.find (p) != RewrittenPointers.end()) {
     return const_cast<void*>(RewrittenPointers[p]);
   }
+  SC_STAT (SC_STAT_REWRITES);
+
+  //
+  // If the rewrite maps have exceeded their budget, leave the pointer alone
+  // as we do when we run out of rewrite pointers.
+  //
+  if (sc_md_degraded (SC_MD_REWRITE_MAPS))
+    return const_cast<void*>(p);
 
   //
   // Calculate a new rewrite pointer.
@@ -116,6 +135,7 @@ rewrite_ptr (DebugPoolTy * Pool,
   RewriteLineno[invalidptr] = lineno;
   RewrittenPointers[p] = invalidptr;
   RewrittenObjs[invalidptr] = std::make_pair(ObjStart, ObjEnd);
+  sc_md_charge (SC_MD_REWRITE_MAPS, RewriteEntryBytes);
   return invalidptr;
 }
 
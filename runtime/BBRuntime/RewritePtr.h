@@ -35,8 +35,13 @@ NAMESPACE_SC_BEGIN
 //  o) Other platforms - We allocate a range of memory and disable read and
 //                       write permissions for the pages contained within it.
 //
-extern uintptr_t InvalidUpper;
-extern uintptr_t InvalidLower;
+// The bounds have C linkage because the compiler tests pointers against them
+// inline and only calls pchk_getActualValue() for pointers within the range.
+//
+extern "C" {
+  extern uintptr_t InvalidUpper;
+  extern uintptr_t InvalidLower;
+}
 
 // Map between rewrite pointer and source file information
 extern llvm::DenseMap<void *, const char*>  RewriteSourcefile;
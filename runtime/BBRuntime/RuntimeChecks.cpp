@@ -24,6 +24,7 @@
 
 #include "safecode/Runtime/BBMetaData.h"
 #include "safecode/Runtime/BBRuntime.h"
+#include "safecode/Runtime/Telemetry.h"
 
 #include "../include/CWE.h"
 
@@ -154,6 +155,8 @@ bb_poolcheck_debug (DebugPoolTy *Pool,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT (SC_STAT_LOADSTORE_CHECKS);
+
   // If the address being checked is errno, then the check can pass.
   unsigned char * errnoPtr = (unsigned char *) &errno;
   if ((unsigned char *)Node == errnoPtr) return;
@@ -211,6 +214,8 @@ bb_poolcheckui_debug (DebugPoolTy *Pool,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT (SC_STAT_LOADSTORE_CHECKS);
+
   // If the address being checked is errno, then the check can pass.
   unsigned char * errnoPtr = (unsigned char *) &errno;
   if ((unsigned char *)Node == errnoPtr) return;
@@ -332,6 +337,8 @@ bb_boundscheck_debug (DebugPoolTy * Pool,
                       void * Dest, TAG, 
                       const char * SourceFile, 
                       unsigned lineno) {
+  SC_STAT (SC_STAT_BOUNDS_CHECKS);
+
   if (!isRewritePtr((void *)Source) && (Source == Dest)) return Dest;
   return _barebone_boundscheck((uintptr_t)Source, (uintptr_t)Dest);
 }
@@ -357,6 +364,8 @@ bb_boundscheckui_debug (DebugPoolTy * Pool,
                      void * Dest, TAG,
                      const char * SourceFile,
                      unsigned int lineno) {
+  SC_STAT (SC_STAT_BOUNDS_CHECKS);
+
   return  _barebone_boundscheck((uintptr_t)Source, (uintptr_t)Dest);
 }
 
@@ -451,6 +460,8 @@ __sc_bb_funccheck (void *f,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT (SC_STAT_FUNC_CHECKS);
+
   unsigned index = 0;
   while (targets[index]) {
     if (f == targets[index])
@@ -490,6 +501,8 @@ fastlscheck_debug(const char *base, const char *result, unsigned size,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
+  SC_STAT (SC_STAT_EXACT_CHECKS);
+
   // If the address being checked is errno, then the check can pass.
   char * errnoPtr = (char *) &errno;
   if (result == errnoPtr) return;
@@ -0,0 +1,16 @@
+//===- Sampling.cpp - Sampled checking of duplicated functions ------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Code compiled with sampled checking may be linked with the baggy bounds
+// run-time as well, so it builds the implementation in the DebugRuntime
+// directory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../DebugRuntime/Sampling.cpp"
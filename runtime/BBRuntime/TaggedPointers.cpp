@@ -0,0 +1,313 @@
+//===- TaggedPointers.cpp - Baggy bounds checks using pointer tags --------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the tagged pointer mode of the baggy bounds run-time.
+// In this mode, the binary logarithm of the aligned size of a memory object
+// is stored in the upper bits of pointers to the object, so checks on tagged
+// pointers do not need to load from the baggy bounds size table.  Untagged
+// pointers (e.g., pointers returned by external code) are checked using the
+// size table as before.
+//
+//===----------------------------------------------------------------------===//
+// NOTES:
+//  1) The compiler strips the tags from pointers before they are dereferenced,
+//     compared, converted to integers, or passed to external code.  Only the
+//     functions in this file may be given tagged pointers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ConfigData.h"
+#include "DebugReport.h"
+#include "PoolAllocator.h"
+#include "RewritePtr.h"
+
+#include "safecode/Runtime/BBMetaData.h"
+#include "safecode/Runtime/BBRuntime.h"
+
+#include "../include/CWE.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <stdint.h>
+
+#if defined(__x86_64__)
+
+#define TAG unsigned tag
+
+extern unsigned SLOT_SIZE;
+
+using namespace NAMESPACE_SC;
+
+//
+// Function: getTaggedObject()
+//
+// Description:
+//  Find the bounds of the object to which a tagged pointer points.
+//
+// Inputs:
+//  p - The tagged pointer.  Its tag must be non-zero.
+//
+// Outputs:
+//  begin - The address of the first byte of the object.
+//  end   - The address of the first byte past the end of the object.
+//
+static inline void
+getTaggedObject (uintptr_t p, uintptr_t & begin, uintptr_t & end) {
+  uintptr_t size = ((uintptr_t) 1) << bb_tagof (p);
+  begin = bb_untag (p) & ~(size - 1);
+  BBMetaData * data = (BBMetaData *)(begin + size - sizeof (BBMetaData));
+  end = begin + data->size;
+}
+
+//
+// Function: _tagged_boundscheck()
+//
+// Description:
+//  Perform a bounds check using the tag of the source pointer.
+//
+// Return value:
+//  The dest pointer if it is in bounds, else an OOB pointer.
+//
+static inline void *
+_tagged_boundscheck (uintptr_t Source, uintptr_t Dest) {
+  //
+  // Untagged pointers are checked using the size table.  This includes
+  // rewritten OOB pointers; the table-based check finds their actual value.
+  //
+  if (bb_tagof (Source) == 0) {
+    if (!isRewritePtr ((void *) Source))
+      return bb_boundscheckui (NULL, (void *) Source, (void *) Dest);
+
+    //
+    // The actual value of a rewritten pointer may be tagged.  Compute the real
+    // result pointer and check it against the real source pointer.
+    //
+    uintptr_t RealSrc = (uintptr_t) pchk_getActualValue (NULL, (void *) Source);
+    if (bb_tagof (RealSrc) == 0)
+      return bb_boundscheckui (NULL, (void *) Source, (void *) Dest);
+    Dest = RealSrc + (Dest - Source);
+    Source = RealSrc;
+  }
+
+  //
+  // The result pointer is in bounds if it carries the same tag and lies
+  // within the object.
+  //
+  uintptr_t begin, end;
+  getTaggedObject (Source, begin, end);
+  if ((bb_tagof (Dest) == bb_tagof (Source)) &&
+      (begin <= bb_untag (Dest)) && (bb_untag (Dest) < end)) {
+    return (void *) Dest;
+  }
+
+  return rewrite_ptr (NULL, (void *) Dest, (void *) begin, (void *) (end - 1),
+                      NULL, 0);
+}
+
+//
+// Function: bb_tagged_boundscheck_debug()
+//
+// Description:
+//  Identical to bb_boundscheck_debug() but reads the object size from the
+//  pointer tag.
+//
+void *
+bb_tagged_boundscheck_debug (DebugPoolTy * Pool,
+                             void * Source,
+                             void * Dest, TAG,
+                             const char * SourceFile,
+                             unsigned lineno) {
+  return _tagged_boundscheck ((uintptr_t) Source, (uintptr_t) Dest);
+}
+
+void *
+bb_tagged_boundscheck (DebugPoolTy * Pool, void * Source, void * Dest) {
+  return _tagged_boundscheck ((uintptr_t) Source, (uintptr_t) Dest);
+}
+
+//
+// Function: bb_tagged_poolcheck_debug()
+//
+// Description:
+//  This function performs a load/store check using the tag of the pointer.
+//
+void
+bb_tagged_poolcheck_debug (DebugPoolTy *Pool,
+                           void *Node,
+                           unsigned length,
+                           TAG,
+                           const char * SourceFilep,
+                           unsigned lineno) {
+  //
+  // Untagged pointers are checked using the size table.
+  //
+  uintptr_t p = (uintptr_t) Node;
+  if (bb_tagof (p) == 0) {
+    bb_poolcheckui_debug (Pool, Node, length, tag, SourceFilep, lineno);
+    return;
+  }
+
+  //
+  // Check that the first and last bytes accessed are within the object.
+  //
+  uintptr_t begin, end;
+  getTaggedObject (p, begin, end);
+  uintptr_t NodeEnd = bb_untag (p) + length - 1;
+  if ((begin <= bb_untag (p)) && (NodeEnd < end))
+    return;
+
+  DebugViolationInfo v;
+  v.type = ViolationInfo::FAULT_LOAD_STORE,
+  v.faultPC = __builtin_return_address(0),
+  v.faultPtr = (void *) bb_untag (p),
+  v.CWE = CWEBufferOverflow,
+  v.SourceFile = SourceFilep,
+  v.lineNo = lineno;
+
+  ReportMemoryViolation(&v);
+  return;
+}
+
+void
+bb_tagged_poolcheck (DebugPoolTy *Pool, void *Node) {
+  bb_tagged_poolcheck_debug (Pool, Node, 1, 0, NULL, 0);
+}
+
+//===----------------------------------------------------------------------===//
+//
+//  Allocation functions
+//
+//===----------------------------------------------------------------------===//
+
+//
+// Function: __sc_bb_tagged_src_poolalloc()
+//
+// Description:
+//  Allocate a memory object padded to a power-of-two size, record its size in
+//  the metadata at the end of the allocation, and return a pointer tagged with
+//  the binary logarithm of the aligned size.  The object is allocated and
+//  registered in the size table in the same way as by the table-based
+//  allocation functions, so checks on untagged pointers to it find it.
+//
+void *
+__sc_bb_tagged_src_poolalloc (DebugPoolTy *Pool,
+                              unsigned NumBytes, TAG,
+                              const char * SourceFilep,
+                              unsigned lineno) {
+  unsigned e = SLOT_SIZE;
+  while ((((uintptr_t) 1) << e) < NumBytes + sizeof (BBMetaData))
+    ++e;
+  uintptr_t alloc = ((uintptr_t) 1) << e;
+
+  void * p = __sc_bb_src_poolalloc (Pool, alloc, tag, SourceFilep, lineno);
+  if (p == 0)
+    return 0;
+  __sc_bb_src_poolregister (Pool, p, NumBytes, tag, SourceFilep, lineno);
+
+  BBMetaData * data = (BBMetaData *)((uintptr_t) p + alloc - sizeof (BBMetaData));
+  data->size = NumBytes;
+  data->pool = Pool;
+  return (void *) bb_tag ((uintptr_t) p, e);
+}
+
+void *
+__sc_bb_tagged_poolalloc (DebugPoolTy *Pool, unsigned NumBytes) {
+  return __sc_bb_tagged_src_poolalloc (Pool, NumBytes, 0, "<unknown>", 0);
+}
+
+void *
+__sc_bb_tagged_src_poolcalloc (DebugPoolTy *Pool,
+                               unsigned Number,
+                               unsigned NumBytes, TAG,
+                               const char * SourceFilep,
+                               unsigned lineno) {
+  void * p = __sc_bb_tagged_src_poolalloc (Pool, Number * NumBytes, tag,
+                                           SourceFilep, lineno);
+  if (p)
+    memset ((void *) bb_untag ((uintptr_t) p), 0, Number * NumBytes);
+  return p;
+}
+
+void *
+__sc_bb_tagged_poolcalloc (DebugPoolTy *Pool,
+                           unsigned Number,
+                           unsigned NumBytes, TAG) {
+  return __sc_bb_tagged_src_poolcalloc (Pool, Number, NumBytes, 0,
+                                        "<unknown>", 0);
+}
+
+//
+// Function: __sc_bb_tagged_src_poolfree()
+//
+// Description:
+//  Free a memory object.  Untagged objects were allocated by the table-based
+//  allocation functions and are freed by them.  Tagged objects are removed
+//  from the size table before they are freed.
+//
+void
+__sc_bb_tagged_src_poolfree (DebugPoolTy *Pool,
+                             void *Node, TAG,
+                             const char * SourceFile,
+                             unsigned lineno) {
+  uintptr_t p = (uintptr_t) Node;
+  if (bb_tagof (p) == 0) {
+    __sc_bb_src_poolfree (Pool, Node, tag, SourceFile, lineno);
+    return;
+  }
+
+  void * Object = (void *) bb_untag (p);
+  __sc_bb_poolunregister_debug (Pool, Object, tag, SourceFile, lineno);
+  __sc_bb_src_poolfree (Pool, Object, tag, SourceFile, lineno);
+}
+
+void
+__sc_bb_tagged_poolfree (DebugPoolTy *Pool, void *Node) {
+  __sc_bb_tagged_src_poolfree (Pool, Node, 0, "<unknown>", 0);
+}
+
+void *
+__sc_bb_tagged_poolrealloc (DebugPoolTy *Pool, void *Node, unsigned NumBytes) {
+  if (Node == 0)
+    return __sc_bb_tagged_poolalloc (Pool, NumBytes);
+
+  if (NumBytes == 0) {
+    __sc_bb_tagged_poolfree (Pool, Node);
+    return 0;
+  }
+
+  uintptr_t p = (uintptr_t) Node;
+  if (bb_tagof (p) == 0)
+    return __sc_bb_poolrealloc (Pool, Node, NumBytes);
+
+  void * New = __sc_bb_tagged_poolalloc (Pool, NumBytes);
+  if (New == 0)
+    return 0;
+
+  uintptr_t begin, end;
+  getTaggedObject (p, begin, end);
+  uintptr_t size = end - begin;
+  if (size > NumBytes)
+    size = NumBytes;
+  memcpy ((void *) bb_untag ((uintptr_t) New), (void *) begin, size);
+  __sc_bb_tagged_poolfree (Pool, Node);
+  return New;
+}
+
+void *
+__sc_bb_tagged_poolrealloc_debug (DebugPoolTy *Pool,
+                                  void *Node,
+                                  unsigned NumBytes, TAG,
+                                  const char * SourceFilep,
+                                  unsigned lineno) {
+  return __sc_bb_tagged_poolrealloc (Pool, Node, NumBytes);
+}
+
+#endif
@@ -0,0 +1,15 @@
+//===- Telemetry.cpp - Run-time statistics counters -----------------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The baggy bounds run-time keeps the same statistics page as the debug
+// run-time, so it builds the implementation in the DebugRuntime directory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../DebugRuntime/Telemetry.cpp"
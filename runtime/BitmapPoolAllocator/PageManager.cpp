@@ -44,6 +44,10 @@ uintptr_t PageSize = 0;
 
 static unsigned poolmemusage = 0;
 
+// Bounds of the memory returned by GetPages()
+uintptr_t PagesBegin = ~(uintptr_t)0;
+uintptr_t PagesEnd = 0;
+
 // Physical page size
 uintptr_t PPageSize;
 
@@ -68,6 +72,26 @@ InitializePageManager() {
   if (!PageSize) PageSize =  PageMultiplier * PPageSize;
 }
 
+//
+// Function: NotePages()
+//
+// Description:
+//  Widen the bounds of the memory returned by GetPages() to include the
+//  specified memory.
+//
+static void
+NotePages (void * Addr, uintptr_t Size) {
+  uintptr_t Begin = (uintptr_t) Addr;
+  uintptr_t End = Begin + Size;
+  uintptr_t Old;
+  while ((Old = PagesBegin) > Begin)
+    if (__sync_bool_compare_and_swap (&PagesBegin, Old, Begin))
+      break;
+  while ((Old = PagesEnd) < End)
+    if (__sync_bool_compare_and_swap (&PagesEnd, Old, End))
+      break;
+}
+
 #if !USE_MEMALIGN
 void *GetPages(unsigned NumPages) {
 #if defined(i386) || defined(__i386__) || defined(__x86__) || defined(__x86_64__)
@@ -96,21 +120,37 @@ void *GetPages(unsigned NumPages) {
   //  void *pa = malloc(NumPages * PageSize);
   //  assert(Addr != MAP_FAILED && "MMAP FAILED!");
 #if defined(__linux__)
-  Addr = mmap(0, NumPages * PageSize, PROT_READ|PROT_WRITE,
-                                      MAP_SHARED |MAP_ANONYMOUS, -1, 0);
-  if (Addr == MAP_FAILED) {
+  //
+  // mmap() only aligns memory on physical page boundaries.  Map an extra
+  // page and unmap whatever lies outside of the aligned pages.
+  //
+  uintptr_t MapSize = NumPages * PageSize + PageSize;
+  char * Map = (char *) mmap(0, MapSize, PROT_READ|PROT_WRITE,
+                                         MAP_SHARED |MAP_ANONYMOUS, -1, 0);
+  if (Map == MAP_FAILED) {
      perror ("mmap:");
      fflush (stdout);
      fflush (stderr);
      assert(0 && "valloc failed\n");
   }
+  Addr = (void *)(((uintptr_t) Map + PageSize - 1) & ~(PageSize - 1));
+  uintptr_t Head = (char *) Addr - Map;
+  if (Head)
+    munmap (Map, Head);
+  if (MapSize - Head - NumPages * PageSize)
+    munmap ((char *) Addr + NumPages * PageSize,
+            MapSize - Head - NumPages * PageSize);
 #else
 #if POSIX_MEMALIGN
    if (posix_memalign(&Addr, PageSize, NumPages*PageSize) != 0){
      assert(0 && "memalign failed \n");
    }
 #else
-   if ((Addr = valloc (NumPages*PageSize)) == 0){
+   //
+   // valloc() only aligns memory on physical page boundaries, so allocate an
+   // extra page and round up.
+   //
+   if ((Addr = valloc (NumPages*PageSize + PageSize)) == 0){
      perror ("valloc:");
      fflush (stdout);
      fflush (stderr);
@@ -121,9 +161,11 @@ void *GetPages(unsigned NumPages) {
     fflush (stderr);
 #endif
    }
+   Addr = (void *)(((uintptr_t) Addr + PageSize - 1) & ~(PageSize - 1));
 #endif
 #endif
   poolmemusage += NumPages * PageSize;
+  NotePages (Addr, NumPages * PageSize);
 
   // Initialize the page to contain safe inital values
   memset(Addr, initvalue, NumPages *PageSize);
@@ -168,4 +210,19 @@ void FreePage(void *Page) {
   FPL.push_back(Page);
 }
 
+/// ReleasePages - Give the physical memory behind NumPages pages back to the
+/// operating system while keeping the pages mapped.  The pages read as zero
+/// when they are next touched.
+void ReleasePages(void *Addr, unsigned NumPages) {
+  size_t Size = NumPages * PageSize;
+#if defined(__linux__) && defined(MADV_REMOVE)
+  // The pages are a shared mapping, whose memory MADV_DONTNEED does not free
+  if (madvise (Addr, Size, MADV_REMOVE) == 0)
+    return;
+#endif
+#if defined(MADV_DONTNEED)
+  madvise (Addr, Size, MADV_DONTNEED);
+#endif
+}
+
 }
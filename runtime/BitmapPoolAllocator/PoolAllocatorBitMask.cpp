@@ -13,13 +13,16 @@
 // This uses the 'Ptr1' field to maintain a linked list of slabs that are either
 // empty or are partially allocated from.  The 'Ptr2' field of the BitmapPoolTy is
 // used to track a linked list of slabs which are full, ie, all elements have
-// been allocated from them.
+// been allocated from them.  Single nodes are normally allocated from and
+// freed to slabs owned by the calling thread (see ThreadCache.h); everything
+// else is done here with the back end locked.
 //
 //===----------------------------------------------------------------------===//
 
 #include "../include/BitmapAllocator.h"
 #include "../include/PageManager.h"
 #include "PoolSlab.h"
+#include "ThreadCache.h"
 
 #include <cassert>
 #include <cstdio>
@@ -35,6 +38,9 @@ using namespace llvm;
 static void *
 poolallocarray(BitmapPoolTy* Pool, unsigned Size);
 
+static void *
+poolallocsingle(BitmapPoolTy* Pool);
+
 static PoolSlab *
 SearchForContainingSlab(BitmapPoolTy *Pool, void *Node, unsigned &TheIndex);
 
@@ -60,6 +66,10 @@ poolinit(BitmapPoolTy *Pool, unsigned NodeSize) {
   // Initialize the splay tree
   Pool->Ptr1 = Pool->Ptr2 = 0;
   Pool->LargeArrays = 0;
+  for (unsigned i = 0; i < BitmapPoolTy::LargeArrayBins; ++i)
+    Pool->FreeLargeArrays[i] = 0;
+  Pool->HotLargeArrayPages = 0;
+  Pool->OwnedSlabs = 0;
   Pool->StackSlabs = Pool->FreeStackSlabs = 0;
   // For SAFECode, we set FreeablePool to 0 always
   //  Pool->FreeablePool = 0;
@@ -79,6 +89,11 @@ void
 pooldestroy(BitmapPoolTy *Pool) {
   assert(Pool && "Null pool pointer passed in to pooldestroy!\n");
 
+  LockBackEnd();
+
+  // The slabs owned by thread caches are destroyed with the others
+  ForgetPool(Pool);
+
   if (Pool->NumSlabs > BitmapPoolTy::AddrArrSize) {
     Pool->Slabs->clear();
     delete Pool->Slabs;
@@ -100,6 +115,14 @@ pooldestroy(BitmapPoolTy *Pool) {
     PS = Next;
   }
 
+  // Free the slabs owned by thread caches
+  PS = (PoolSlab*)Pool->OwnedSlabs;
+  while (PS) {
+    PoolSlab *Next = PS->Next;
+    PS->destroy();
+    PS = Next;
+  }
+
   // Free the large arrays
   PS = (PoolSlab*)Pool->LargeArrays;
   while (PS) {
@@ -108,6 +131,17 @@ pooldestroy(BitmapPoolTy *Pool) {
     PS = Next;
   }
 
+  // Free the cached free large arrays
+  for (unsigned i = 0; i < BitmapPoolTy::LargeArrayBins; ++i) {
+    PS = (PoolSlab*)Pool->FreeLargeArrays[i];
+    while (PS) {
+      PoolSlab *Next = PS->Next;
+      PS->destroy();
+      PS = Next;
+    }
+  }
+
+  UnlockBackEnd();
 }
 
 //
@@ -148,74 +182,23 @@ poolalloc(BitmapPoolTy *Pool, unsigned NumBytes) {
     //
     // Allocate the memory.
     //
+    LockBackEnd();
     retAddress = poolallocarray(Pool, NodesToAllocate);
+    UnlockBackEnd();
       
     assert (retAddress && "poolalloc(1): Returning NULL!\n");
     return retAddress;
   }
 
   // Special case the most common situation, where a single node is being
-  // allocated.
-  PoolSlab *PS = (PoolSlab*)Pool->Ptr1;
-
-  if (__builtin_expect(PS != 0, 1)) {
-    int Element = PS->allocateSingle();
-    if (__builtin_expect(Element != -1, 1)) {
-      // We allocated an element.  Check to see if this slab has been
-      // completely filled up.  If so, move it to the Ptr2 list.
-      if (__builtin_expect(PS->isFull(), false)) {
-        PS->unlinkFromList();
-        PS->addToList((PoolSlab**)&Pool->Ptr2);
-      }     
-      return PS->getElementAddress(Element, NodeSize);
-    }
-
-    // Loop through all of the slabs looking for one with an opening
-    for (PS = PS->Next; PS; PS = PS->Next) {
-      int Element = PS->allocateSingle();
-      if (Element != -1) {
-        // We allocated an element.  Check to see if this slab has been
-        // completely filled up.  If so, move it to the Ptr2 list.
-        if (PS->isFull()) {
-          PS->unlinkFromList();
-          PS->addToList((PoolSlab**)&Pool->Ptr2);
-        }
-        return PS->getElementAddress(Element, NodeSize);
-      }
-    }
-  }
-
-  // Otherwise we must allocate a new slab and add it to the list
-  PoolSlab *New = PoolSlab::create(Pool);
-
-  //
-  // Ensure that we're always allocating at least 1 byte.
-  //
-  if (NumBytes == 0)
-    NumBytes = 1;
-  
-  if (Pool->NumSlabs > BitmapPoolTy::AddrArrSize)
-    Pool->Slabs->insert((void *)New);
-  else if (Pool->NumSlabs == BitmapPoolTy::AddrArrSize) {
-    // Create the hash_set
-    Pool->Slabs = new std::set<void *>;
-    Pool->Slabs->insert((void *)New);
-    for (unsigned i = 0; i < BitmapPoolTy::AddrArrSize; ++i)
-      Pool->Slabs->insert((void *)Pool->SlabAddressArray[i]);
-  }
-  else {
-    // Insert it in the array
-    Pool->SlabAddressArray[Pool->NumSlabs] = (void*) New;
-  }
-  Pool->NumSlabs++;
+  // allocated.  The calling thread's own slabs are used if possible.
+  if (__builtin_expect((retAddress = CacheAlloc(Pool)) != 0, 1))
+    return retAddress;
 
-  int Idx = New->allocateSingle();
-  assert(Idx == 0 && "New allocation didn't return zero'th node?");
-  if (Idx) abort();
-  if (logregs) {
-    fprintf(stderr, " poolalloc:967: canonical page at 0x%p from underlying allocator\n", (void*)New);
-  }
-  return New->getElementAddress(0, 0);
+  LockBackEnd();
+  retAddress = poolallocsingle(Pool);
+  UnlockBackEnd();
+  return retAddress;
 }
 
 //
@@ -286,6 +269,60 @@ poolstrdup (BitmapPoolTy *Pool, void *Node) {
 /// 
 /////
 
+// Function: poolallocsingle()
+//
+// Description:
+//  This is a helper function used to implement poolalloc() when a single node
+//  must be allocated by the back end.  The back end must be locked.
+//
+// Inputs:
+//  Pool - A pointer to the pool from which to allocate.
+//
+
+static void *
+poolallocsingle(BitmapPoolTy* Pool) {
+  unsigned NodeSize = Pool->NodeSize;
+  PoolSlab *PS = (PoolSlab*)Pool->Ptr1;
+
+  if (__builtin_expect(PS != 0, 1)) {
+    int Element = PS->allocateSingle();
+    if (__builtin_expect(Element != -1, 1)) {
+      // We allocated an element.  Check to see if this slab has been
+      // completely filled up.  If so, move it to the Ptr2 list.
+      if (__builtin_expect(PS->isFull(), false)) {
+        PS->unlinkFromList();
+        PS->addToList((PoolSlab**)&Pool->Ptr2);
+      }     
+      return PS->getElementAddress(Element, NodeSize);
+    }
+
+    // Loop through all of the slabs looking for one with an opening
+    for (PS = PS->Next; PS; PS = PS->Next) {
+      int Element = PS->allocateSingle();
+      if (Element != -1) {
+        // We allocated an element.  Check to see if this slab has been
+        // completely filled up.  If so, move it to the Ptr2 list.
+        if (PS->isFull()) {
+          PS->unlinkFromList();
+          PS->addToList((PoolSlab**)&Pool->Ptr2);
+        }
+        return PS->getElementAddress(Element, NodeSize);
+      }
+    }
+  }
+
+  // Otherwise we must allocate a new slab and add it to the list
+  PoolSlab *New = CreateSlab(Pool);
+
+  int Idx = New->allocateSingle();
+  assert(Idx == 0 && "New allocation didn't return zero'th node?");
+  if (Idx) abort();
+  if (logregs) {
+    fprintf(stderr, " poolalloc:967: canonical page at 0x%p from underlying allocator\n", (void*)New);
+  }
+  return New->getElementAddress(0, 0);
+}
+
 // Function: poolallocarray()
 //
 // Description:
@@ -312,43 +349,42 @@ poolallocarray(BitmapPoolTy* Pool, unsigned Size) {
     return PoolSlab::createSingleArray(Pool, Size);
   }
  
-  PoolSlab *PS = (PoolSlab*)Pool->Ptr1;
-
-  // Loop through all of the slabs looking for one with an opening
-  for (; PS; PS = PS->Next) {
-    int Element = PS->allocateMultiple(Size);
-    if (Element != -1) {
-      //
-      // We allocated an element.  Check to see if this slab has been
-      // completely filled up.  If so, move it to the Ptr2 list.
-      //
-      if (PS->isFull()) {
-        PS->unlinkFromList();
-        PS->addToList((PoolSlab**)&Pool->Ptr2);
-      }
-      
-      return PS->getElementAddress(Element, Pool->NodeSize);
+  //
+  // Choose the slab whose best fitting run of free nodes leaves the fewest
+  // nodes over, so that arrays fill holes before splitting large runs.  Slabs
+  // with too few free nodes in total are skipped without searching them.
+  //
+  PoolSlab *Best = 0;
+  int BestElement = -1;
+  unsigned BestWaste = ~0U;
+  for (PoolSlab *PS = (PoolSlab*)Pool->Ptr1; PS; PS = PS->Next) {
+    unsigned Waste;
+    int Element = PS->findFreeRun(Size, Waste);
+    if ((Element != -1) && (Waste < BestWaste)) {
+      Best = PS;
+      BestElement = Element;
+      BestWaste = Waste;
+      if (!Waste) break;
     }
   }
-  
-  PoolSlab *New = PoolSlab::create(Pool);
-  //  printf("new slab created %x \n", New);
-  if (Pool->NumSlabs > BitmapPoolTy::AddrArrSize)
-    Pool->Slabs->insert((void *)New);
-  else if (Pool->NumSlabs == BitmapPoolTy::AddrArrSize) {
-    // Create the hash_set
-    Pool->Slabs = new std::set<void *>;
-    Pool->Slabs->insert((void *)New);
-    for (unsigned i = 0; i < BitmapPoolTy::AddrArrSize; ++i)
-      Pool->Slabs->insert((void *)Pool->SlabAddressArray[i]);
-  }
-  else {
-    // Insert it in the array
-    Pool->SlabAddressArray[Pool->NumSlabs] = New;
+
+  if (Best) {
+    Best->allocateRun(BestElement, Size);
+
+    //
+    // We allocated an element.  Check to see if this slab has been
+    // completely filled up.  If so, move it to the Ptr2 list.
+    //
+    if (Best->isFull()) {
+      Best->unlinkFromList();
+      Best->addToList((PoolSlab**)&Pool->Ptr2);
+    }
+
+    return Best->getElementAddress(BestElement, Pool->NodeSize);
   }
   
-  Pool->NumSlabs++;
-  
+  PoolSlab *New = CreateSlab(Pool);
+
   int Idx = New->allocateMultiple(Size);
   assert(Idx == 0 && "New allocation didn't return zero'th node?");
   if (Idx) abort();
@@ -389,9 +425,15 @@ poolfree(BitmapPoolTy *Pool, void *Node) {
   //
   if (Node == 0) return;
 
+  //
+  // Nodes of slabs owned by thread caches are freed without locking.
+  //
+  if (CacheFree(Pool, Node)) return;
+
   // Canonical pointer for the pointer we're freeing
   void * CanonNode = Node;
 
+  LockBackEnd();
   unsigned TheIndex;
   PS = SearchForContainingSlab(Pool, CanonNode, TheIndex);
   Idx = TheIndex;
@@ -400,28 +442,80 @@ poolfree(BitmapPoolTy *Pool, void *Node) {
   // If no slab can be found, then the pointer we were given is invalid.  Since
   // we want to tolerate invalid frees, go ahead and return.
   //
-  if (!PS) return;
-  assert (PS && "poolfree: No poolslab found for object!\n");
-  PS->freeElement(Idx);
+  if (PS) {
+    //
+    // Only the owner of a slab may change it, so hand the node to the owner.
+    // Nodes that are already pending are not pushed again.
+    //
+    if (PS->getOwner())
+      PS->pushRemoteFree(CanonNode, Idx);
+    else
+      FreeInSlab(Pool, PS, Idx);
+  }
+  UnlockBackEnd();
+}
+
+//
+// Function: CreateSlab()
+//
+// Description:
+//  Create a new slab for the pool, record it in the pool's set of slabs, and
+//  put it on the list of partially allocated slabs.  The back end must be
+//  locked.
+//
+PoolSlab *
+llvm::CreateSlab(BitmapPoolTy *Pool) {
+  PoolSlab *New = PoolSlab::create(Pool);
+  //  printf("new slab created %x \n", New);
+  if (Pool->NumSlabs > BitmapPoolTy::AddrArrSize)
+    Pool->Slabs->insert((void *)New);
+  else if (Pool->NumSlabs == BitmapPoolTy::AddrArrSize) {
+    // Create the hash_set
+    Pool->Slabs = new std::set<void *>;
+    Pool->Slabs->insert((void *)New);
+    for (unsigned i = 0; i < BitmapPoolTy::AddrArrSize; ++i)
+      Pool->Slabs->insert((void *)Pool->SlabAddressArray[i]);
+  }
+  else {
+    // Insert it in the array
+    Pool->SlabAddressArray[Pool->NumSlabs] = New;
+  }
+
+  Pool->NumSlabs++;
+  return New;
+}
 
+//
+// Function: FreeInSlab()
+//
+// Description:
+//  Free the node with the specified index in a slab that has no owner and
+//  move the slab to the list that matches its new state.  The back end must
+//  be locked.
+//
+void
+llvm::FreeInSlab(BitmapPoolTy *Pool, PoolSlab *PS, unsigned Idx) {
   //
-  // If we could not find the slab in which the node belongs, then we were
-  // passed an invalid pointer.  Simply ignore it.
+  // A large array is cached for reuse once it is freed.  Pointers into the
+  // middle of it are ignored.
   //
-  if (!PS) return;
-  
+  if (PS->isSingleArray) {
+    if (Idx == 0)
+      PS->releaseSingleArray();
+    return;
+  }
+
+  bool WasFull = PS->isFull();
+  PS->freeElement(Idx);
+
   // If PS was full, it must have been in list #2.  Unlink it and move it to
   // list #1.
-  if (PS->isFull()) {
+  if (WasFull) {
     // Now that we found the node, we are about to free an element from it.
     // This will make the slab no longer completely full, so we must move it to
     // the other list!
     PS->unlinkFromList(); // Remove it from the Ptr2 list.
 
-    //
-    // Do not re-use single array slabs.
-    //
-
     if (!(PS->isSingleArray)) {
       PoolSlab **InsertPosPtr = (PoolSlab**)&Pool->Ptr1;
 
@@ -457,8 +551,6 @@ poolfree(BitmapPoolTy *Pool, void *Node) {
     // efficiently.    
     PS->addToList((PoolSlab**)&Pool->Ptr1);
   }
-
-  return; 
 }
 
 
@@ -495,6 +587,16 @@ SearchForContainingSlab(BitmapPoolTy *Pool, void *Node, unsigned &TheIndex) {
     }
   }
   
+  // Otherwise, maybe it is in a slab owned by a thread cache
+  if (PS == 0) {
+    PS = (PoolSlab*)Pool->OwnedSlabs;
+    while (PS) {
+      Idx = PS->containsElement(Node, NodeSize);
+      if (Idx != -1) break;
+      PS = PS->Next;
+    }
+  }
+
   // Otherwise, maybe its a block within LargeArrays
   if(PS == 0) {
     PS = (PoolSlab*)Pool->LargeArrays;
@@ -532,10 +634,93 @@ __pa_bitmap_poolcheck (BitmapPoolTy * Pool, void * Node) {
   // Search for the object within the pool.
   //
   unsigned TheIndex;
+  void * Start = 0;
+  LockBackEnd();
   if (PoolSlab * PS = SearchForContainingSlab (Pool, Node, TheIndex)) {
-    return PS->getElementAddress(TheIndex, Pool->NodeSize);
+    Start = PS->getElementAddress(TheIndex, Pool->NodeSize);
   }
+  UnlockBackEnd();
+
+  return Start;
+}
+
+//
+// Function: __pa_bitmap_nodebounds()
+//
+// Description:
+//  Find the bounds of a single node of the pool from the address of any of
+//  its bytes.  Nodes in slabs are size-segregated, so the bounds follow from
+//  the address of the slab and the node size without searching or locking.
+//
+// Inputs:
+//  Pool - The pool in which the node should be found.
+//  Node - A pointer into the node.
+//
+// Outputs:
+//  Start - The address of the first byte of the node.
+//  End   - The address of the last byte of the node.
+//
+// Return value:
+//  0 - The pointer does not point into a node allocated on its own from a slab
+//      of the pool; small arrays, large arrays, and freed nodes, including
+//      nodes freed by other threads that are still pending, are rejected.
+//  1 - The pointer points into such a node, whose bounds are returned.
+//
+int
+__pa_bitmap_nodebounds (BitmapPoolTy * Pool, void * Node,
+                        void ** Start, void ** End) {
+  if (!Pool || !isSlabPage (Node))
+    return 0;
+
+  PoolSlab * PS = PoolSlab::getSlab (Node);
+  if ((PS->Pool != Pool) || PS->isSingleArray)
+    return 0;
+
+  unsigned NodeSize = Pool->NodeSize;
+  int Idx = PS->findNode (Node, NodeSize);
+  if ((Idx == -1) || !PS->isSingleNode (Idx))
+    return 0;
 
-  return 0;
+  *Start = PS->getElementAddress (Idx, NodeSize);
+  *End = (char *) *Start + NodeSize - 1;
+  return 1;
 }
 
+//
+// Function: __pa_bitmap_poolresize()
+//
+// Description:
+//  Try to resize a large array in place.  This succeeds if the new size still
+//  needs a large array and fits within the pages of the array, which may be
+//  more than were asked for if the array was reused from the cache of free
+//  large arrays.
+//
+// Inputs:
+//  Pool     - The pool in which the array was allocated.
+//  Node     - A pointer to the beginning of the array.
+//  NumBytes - The new size of the array in bytes.
+//
+// Return value:
+//  NULL - The array could not be resized in place; the caller must allocate
+//         a new object and copy the old one into it.
+//  Otherwise, Node is returned and the array now holds NumBytes bytes.
+//
+void *
+__pa_bitmap_poolresize (BitmapPoolTy * Pool, void * Node, unsigned NumBytes) {
+  if (!Pool || !Node || !isSlabPage (Node))
+    return 0;
+
+  void * Result = 0;
+  LockBackEnd();
+  PoolSlab * PS = PoolSlab::getSlab (Node);
+  if ((PS->Pool == Pool) && PS->isSingleArray &&
+      (PS->allocated == 0xffffffff) && (Node == PS->getElementAddress(0, 0))) {
+    unsigned Capacity = (char *) PS + PS->SizeOfSlab - (char *) Node;
+    unsigned SlabBytes = PoolSlab::getSlabSize (Pool) * Pool->NodeSize;
+    if ((NumBytes <= Capacity) && (NumBytes > SlabBytes))
+      Result = Node;
+  }
+  UnlockBackEnd();
+
+  return Result;
+}
@@ -17,15 +17,58 @@
 #include <cstdlib>
 #include <cstring>
 
+#include <sys/mman.h>
+
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
 namespace llvm {
 
+// Number of pages of free large arrays, not counting their first pages, that
+// each pool keeps resident.  The memory of other free large arrays is given
+// back to the operating system.
+static const unsigned MaxHotLargeArrayPages = 64;
+
+unsigned char * SlabMap[SlabMapRootSize];
+
+//
+// Function: markSlabPage()
+//
+// Description:
+//  Record whether the page is the first page of a slab.  Leaves of the slab
+//  map are mapped directly so that the map does not allocate from the heap
+//  that it describes.
+//
+void
+markSlabPage(void *Page, bool isSlab) {
+  uintptr_t PageNum = (uintptr_t)Page >> __builtin_ctzl(PageSize);
+  uintptr_t Root = PageNum >> SlabMapLeafBits;
+  if (Root >= SlabMapRootSize) return;
+
+  unsigned char *Leaf = __atomic_load_n(&SlabMap[Root], __ATOMIC_RELAXED);
+  if (!Leaf) {
+    if (!isSlab) return;
+    void *Map = mmap(0, 1u << SlabMapLeafBits, PROT_READ|PROT_WRITE,
+                     MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (Map == MAP_FAILED) return;
+    Leaf = (unsigned char *)Map;
+
+    // The leaf is read without the lock, so publish it once it is zeroed
+    __atomic_store_n(&SlabMap[Root], Leaf, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&Leaf[PageNum & ((1u << SlabMapLeafBits) - 1)],
+                   (unsigned char)isSlab, __ATOMIC_RELEASE);
+}
+
 // create - Create a new (empty) slab and add it to the end of the Pools list.
 PoolSlab *
 PoolSlab::create(BitmapPoolTy *Pool) {
   unsigned NodesPerSlab = getSlabSize(Pool);
 
 #ifndef NDEBUG
-  unsigned Size = sizeof(PoolSlab) + 4*((NodesPerSlab+15)/16) +
+  unsigned Size = sizeof(PoolSlab) - sizeof(uint64_t) +
+    3*sizeof(uint64_t)*((NodesPerSlab+63)/64) +
     Pool->NodeSize*getSlabSize(Pool);
   assert(Size <= PageSize && "Trying to allocate a slab larger than a page!");
 #endif
@@ -33,6 +76,7 @@ PoolSlab::create(BitmapPoolTy *Pool) {
 
   assert(PS && "Allocating a page failed!");
   memset(PS, 0, sizeof(PoolSlab));
+  PS->Pool = Pool;
   PS->NumNodesInSlab = NodesPerSlab;
   PS->isSingleArray = 0;  // Not a single array!
   PS->FirstUnused = 0;    // Nothing allocated.
@@ -40,11 +84,13 @@ PoolSlab::create(BitmapPoolTy *Pool) {
   PS->UsedEnd     = 0;    // Nothing allocated.
   PS->allocated   = 0;    // No bytes allocated.
 
-  for (unsigned i = 0; i < PS->getSlabSize(); ++i)
-    {
-      PS->markNodeFree(i);
-      PS->clearStartBit(i);
-    }
+  // Clear the bitmaps and mark the bits past the last node as allocated.
+  unsigned Words = PS->getFlagWords();
+  memset(PS->NodeFlagsVector, 0, 3 * Words * sizeof(uint64_t));
+  if (NodesPerSlab & 63)
+    PS->getAllocatedBits()[Words-1] = ~0ULL << (NodesPerSlab & 63);
+
+  markSlabPage(PS, true);
 
   // Add the slab to the list...
   PS->addToList((PoolSlab**)&Pool->Ptr1);
@@ -59,39 +105,120 @@ PoolSlab::createSingleArray(BitmapPoolTy *Pool, unsigned NumNodes) {
   assert(NumNodes > NodesPerSlab && "No need to create a single array!");
 
   unsigned NumPages = (NumNodes+NodesPerSlab-1)/NodesPerSlab;
-  PoolSlab *PS = (PoolSlab*)AllocateNPages(NumPages);
 
-  assert(PS && "poolalloc: Could not allocate memory!");
+  //
+  // Reuse a free large array if one is big enough without wasting more than
+  // the size of the new array.  Such an array is either in the bin for the
+  // number of pages needed or in the next one.
+  //
+  PoolSlab *PS = 0;
+  unsigned Bin = getLargeArrayBin(NumPages);
+  for (unsigned B = Bin; !PS && B <= Bin + 1; ++B) {
+    if (B == BitmapPoolTy::LargeArrayBins) break;
+    for (PoolSlab *Free = (PoolSlab*)Pool->FreeLargeArrays[B]; Free;
+         Free = Free->Next) {
+      unsigned Pages = Free->FirstUnused;
+      if (Pages >= NumPages && Pages <= 2 * NumPages) {
+        PS = Free;
+        break;
+      }
+    }
+  }
 
+  if (PS) {
+    PS->unlinkFromList();
+    if (!PS->isTrimmed)
+      Pool->HotLargeArrayPages -= PS->FirstUnused - 1;
+    NumPages = PS->FirstUnused;
+    PS->addToList((PoolSlab**)&Pool->LargeArrays);
+  } else {
+    PS = (PoolSlab*)AllocateNPages(NumPages);
+    assert(PS && "poolalloc: Could not allocate memory!");
+    PS->registerSingleArray(Pool);
+  }
+
+  PS->allocated   = 0xffffffff;    // No bytes allocated.
+  PS->Pool = Pool;
+  PS->setOwner(0);
+  __atomic_store_n(&PS->RemoteFrees, (void*)0, __ATOMIC_RELAXED);
+  PS->isSingleArray = 1;
+  PS->isTrimmed = 0;
+  PS->NumNodesInSlab = NodesPerSlab;
+  PS->SizeOfSlab     = (NumPages * PageSize);
+  PS->FirstUnused = NumPages;
+  return PS->getElementAddress(0, 0);
+}
+
+// registerSingleArray - Record a new single array slab in the pool's set of
+// slabs and on its list of large arrays.
+void
+PoolSlab::registerSingleArray(BitmapPoolTy *Pool) {
   if (Pool->NumSlabs > BitmapPoolTy::AddrArrSize)
-    Pool->Slabs->insert((void*)PS);
+    Pool->Slabs->insert((void*)this);
   else if (Pool->NumSlabs == BitmapPoolTy::AddrArrSize) {
     // Create the hash_set
     Pool->Slabs = new std::set<void *>;
-    Pool->Slabs->insert((void *)PS);
+    Pool->Slabs->insert((void *)this);
     for (unsigned i = 0; i < BitmapPoolTy::AddrArrSize; ++i)
       Pool->Slabs->insert((void *) Pool->SlabAddressArray[i]);
   } else {
     // Insert it in the array
-    Pool->SlabAddressArray[Pool->NumSlabs] = PS;
+    Pool->SlabAddressArray[Pool->NumSlabs] = this;
   }
   Pool->NumSlabs++;
 
-  PS->addToList((PoolSlab**)&Pool->LargeArrays);
+  markSlabPage(this, true);
+  addToList((PoolSlab**)&Pool->LargeArrays);
+}
 
-  PS->allocated   = 0xffffffff;    // No bytes allocated.
-  PS->isSingleArray = 1;
-  PS->NumNodesInSlab = NodesPerSlab;
-  PS->SizeOfSlab     = (NumPages * PageSize);
-  PS->FirstUnused = NumPages;
-  return PS->getElementAddress(0, 0);
+// releaseSingleArray - Move a freed single array slab to the pool's cache of
+// free large arrays, giving back the memory of idle cached arrays if too much
+// of it is resident.
+void
+PoolSlab::releaseSingleArray() {
+  assert(isSingleArray && "Releasing a slab that is not a single array!");
+  unsigned NumPages = FirstUnused;
+  unlinkFromList();
+  allocated = 0;
+  addToList((PoolSlab**)&Pool->FreeLargeArrays[getLargeArrayBin(NumPages)]);
+
+  //
+  // Trim the largest idle arrays first, and this one last since it is the
+  // most likely to be reused soon.  The first page of an array holds its
+  // header and is never trimmed.
+  //
+  unsigned Hot = Pool->HotLargeArrayPages + NumPages - 1;
+  for (unsigned B = BitmapPoolTy::LargeArrayBins;
+       B-- && Hot > MaxHotLargeArrayPages;) {
+    for (PoolSlab *PS = (PoolSlab*)Pool->FreeLargeArrays[B];
+         PS && Hot > MaxHotLargeArrayPages; PS = PS->Next) {
+      if (PS == this || PS->isTrimmed) continue;
+      ReleasePages((char*)PS + PageSize, PS->FirstUnused - 1);
+      PS->isTrimmed = 1;
+      Hot -= PS->FirstUnused - 1;
+    }
+  }
+
+  if (Hot > MaxHotLargeArrayPages) {
+    ReleasePages((char*)this + PageSize, NumPages - 1);
+    isTrimmed = 1;
+    Hot -= NumPages - 1;
+  } else {
+    isTrimmed = 0;
+  }
+  Pool->HotLargeArrayPages = Hot;
 }
 
 void
 PoolSlab::destroy() {
+  // Stale frees must not mistake the page for a slab of the pool
+  Pool = 0;
+  setOwner(0);
+
   if (isSingleArray)
     for (unsigned NumPages = FirstUnused; NumPages != 1;--NumPages)
       FreePage((char*)this + (NumPages-1)*PageSize);
+  markSlabPage(this, false);
 
   FreePage(this);
 }
@@ -110,7 +237,7 @@ PoolSlab::allocateSingle() {
   if (UsedEnd < SlabSize) {
     // Mark the returned entry used
     unsigned short UE = UsedEnd;
-    markNodeAllocated(UE);
+    setBits(&getAllocatedBits()[UE/64], 1ULL << (UE & 63));
     setStartBit(UE);
     
     // If we are allocating out the first unused field, bump its index also
@@ -134,16 +261,11 @@ PoolSlab::allocateSingle() {
   if (FirstUnused < SlabSize) {
     // Successfully allocate out the first unused node
     unsigned Idx = FirstUnused;
-    markNodeAllocated(Idx);
+    setBits(&getAllocatedBits()[Idx/64], 1ULL << (Idx & 63));
     setStartBit(Idx);
     
-    // Increment FirstUnused to point to the new first unused value...
-    // FIXME: this should be optimized
-    unsigned short FU = FirstUnused;
-    do {
-      ++FU;
-    } while ((FU != SlabSize) && (isNodeAllocated(FU)));
-    FirstUnused = FU;
+    // Advance FirstUnused to the next free node
+    FirstUnused = findBit(getAllocatedBits(), false, Idx + 1, SlabSize);
 
     // Updated the UsedBegin field if necessary
     if (UsedBegin > Idx) UsedBegin = Idx;
@@ -179,83 +301,158 @@ PoolSlab::allocateMultiple(unsigned Size) {
   // For small array allocation, check to see if there are empty entries at the
   // end of the slab...
   if (UsedEnd+Size <= getSlabSize()) {
-    // Mark the returned entry used and set the start bit
     unsigned UE = UsedEnd;
-    setStartBit(UE);
-    for (unsigned i = UE; i != UE+Size; ++i)
-      markNodeAllocated(i);
-    
-    // If we are allocating out the first unused field, bump its index also
-    if (FirstUnused == UE)
-      FirstUnused += Size;
-
-    // Updated the UsedBegin field if necessary
-    if (UsedBegin > UE) UsedBegin = UE;
-
-    // Increment UsedEnd
-    UsedEnd += Size;
-
-    // Return the entry
-    assertOkay();
-    allocated += Size;
+    allocateRun(UE, Size);
     return UE;
   }
 
   //
-  // If not, check to see if this node has a declared "FirstUnused" value
-  // starting which Size nodes can be allocated
+  // If not, look for the free run below UsedEnd that fits best.
   //
-  unsigned Idx = FirstUnused;
-  while (Idx+Size <= getSlabSize()) {
-    assert(!isNodeAllocated(Idx) && "FirstUsed is not accurate!");
-
-    // Check if there is a continuous array of Size nodes starting FirstUnused
-    unsigned LastUnused = Idx+1;
-    for (; (LastUnused != Idx+Size) && (!isNodeAllocated(LastUnused)); ++LastUnused)
-      /*empty*/;
-
-    // If we found an unused section of this pool which is large enough, USE IT!
-    if (LastUnused == Idx+Size) {
-      setStartBit(Idx);
-      // FIXME: this loop can be made more efficient!
-      for (unsigned i = Idx; i != Idx + Size; ++i)
-        markNodeAllocated(i);
-
-      // This should not be allocating on the end of the pool, so we don't need
-      // to bump the UsedEnd pointer.
-      assert(Idx != UsedEnd && "Shouldn't allocate at end of pool!");
-
-      // If we are allocating out the first unused field, bump its index also.
-      if (Idx == FirstUnused) {
-        unsigned SlabSize = getSlabSize();
-        unsigned i;
-        for (i = FirstUnused+Size; i < UsedEnd; ++i) {
-          if (!isNodeAllocated(i)) {
-            break;
-          }
-        }
-        FirstUnused = i;
-        if (isNodeAllocated(i))
-          FirstUnused = SlabSize;
-      }
-      
-      // Updated the UsedBegin field if necessary
-      if (UsedBegin > Idx) UsedBegin = Idx;
+  unsigned Waste;
+  int Idx = findFreeRun(Size, Waste);
+  if (Idx != -1)
+    allocateRun(Idx, Size);
+  assertOkay();
+  return Idx;
+}
 
-      // Return the entry
-      assertOkay();
-      allocated += Size;
-      return Idx;
+//
+// Method: allocateRun()
+//
+// Description:
+//  Allocate contiguous nodes as one allocation and update the cursors.
+//
+// Inputs:
+//  Idx  - The index of the first node, which must be followed by at least Num
+//         free nodes.
+//  Num  - The number of nodes to allocate.
+//
+void
+PoolSlab::allocateRun(unsigned Idx, unsigned Num) {
+  setStartBit(Idx);
+  markNodesAllocated(Idx, Idx + Num);
+
+  // If we are allocating out the first unused field, move it past the run.
+  if (Idx == FirstUnused)
+    FirstUnused = findBit(getAllocatedBits(), false, Idx + Num, getSlabSize());
+
+  // Updated the UsedBegin and UsedEnd fields if necessary
+  if (UsedBegin > Idx) UsedBegin = Idx;
+  if (UsedEnd < Idx + Num) UsedEnd = Idx + Num;
+
+  assertOkay();
+  allocated += Num;
+}
+
+//
+// Method: findFreeRun()
+//
+// Description:
+//  Find the smallest run of free nodes in this slab that can hold an
+//  allocation.  Runs are found a word of the bitmap at a time.
+//
+// Inputs:
+//  Num   - The number of nodes to allocate.
+//
+// Outputs:
+//  Waste - The number of free nodes of the run that the allocation would
+//          leave over.
+//
+// Return value:
+//  -1 - There is no run of Num free nodes in the slab.
+//  Otherwise, the index of the first node of the run is returned.
+//
+int
+PoolSlab::findFreeRun(unsigned Num, unsigned &Waste) const {
+  if (isSingleArray || (getFreeNodes() < Num)) return -1;
+
+  const uint64_t *Bits = getAllocatedBits();
+  unsigned SlabSize = getSlabSize();
+  int Best = -1;
+  Waste = ~0U;
+
+  unsigned Idx = FirstUnused;
+  while (Idx < SlabSize) {
+    unsigned End = findBit(Bits, true, Idx, SlabSize);
+    unsigned Length = End - Idx;
+    if ((Length >= Num) && (Length - Num < Waste)) {
+      Best = Idx;
+      Waste = Length - Num;
+      if (!Waste) break;
     }
+    Idx = findBit(Bits, false, End, SlabSize);
+  }
 
-    // Otherwise, try later in the pool.  Find the next unused entry.
-    Idx = LastUnused;
-    while (Idx+Size <= getSlabSize() && isNodeAllocated(Idx))
-      ++Idx;
+  return Best;
+}
+
+//
+// Method: markNodesAllocated()
+//
+// Description:
+//  Set the allocated bits of the nodes in [Begin, End).
+//
+void
+PoolSlab::markNodesAllocated(unsigned Begin, unsigned End) {
+  uint64_t *Bits = getAllocatedBits();
+  while (Begin < End) {
+    unsigned Word = Begin / 64;
+    unsigned Last = (End - 1) / 64 == Word ? End : (Word + 1) * 64;
+    uint64_t Mask = ~0ULL << (Begin & 63);
+    if (Last & 63)
+      Mask &= ~0ULL >> (64 - (Last & 63));
+    setBits(&Bits[Word], Mask);
+    Begin = Last;
   }
+}
 
-  assertOkay();
-  return -1;
+//
+// Method: markNodesFree()
+//
+// Description:
+//  Clear the allocated bits of the nodes in [Begin, End).
+//
+void
+PoolSlab::markNodesFree(unsigned Begin, unsigned End) {
+  uint64_t *Bits = getAllocatedBits();
+  while (Begin < End) {
+    unsigned Word = Begin / 64;
+    unsigned Last = (End - 1) / 64 == Word ? End : (Word + 1) * 64;
+    uint64_t Mask = ~0ULL << (Begin & 63);
+    if (Last & 63)
+      Mask &= ~0ULL >> (64 - (Last & 63));
+    clearBits(&Bits[Word], Mask);
+    Begin = Last;
+  }
+}
+
+//
+// Method: findBit()
+//
+// Description:
+//  Find the first node at or after Begin whose bit in a bitmap has the
+//  specified value.  Whole words are skipped at a time.
+//
+// Return value:
+//  The index of the node is returned, or End if there is no such node before
+//  End.
+//
+unsigned
+PoolSlab::findBit(const uint64_t *Bits, bool Value,
+                  unsigned Begin, unsigned End) {
+  if (Begin >= End) return End;
+
+  uint64_t Invert = Value ? 0 : ~0ULL;
+  unsigned Word = Begin / 64;
+  uint64_t Flags = (Bits[Word] ^ Invert) & (~0ULL << (Begin & 63));
+  while (!Flags) {
+    if (++Word * 64 >= End) return End;
+    Flags = Bits[Word] ^ Invert;
+  }
+
+  unsigned Idx = Word * 64 + __builtin_ctzll(Flags);
+  return Idx < End ? Idx : End;
 }
 
 // getSize
@@ -350,41 +547,24 @@ PoolSlab::freeElement(unsigned short ElementIdx) {
   if (!isNodeAllocated(ElementIdx)) return;
   //  assert(isNodeAllocated(ElementIdx) &&
   //         "poolfree: Attempt to free node that is already freed\n");
-#if 0
+  // Single arrays are released with releaseSingleArray() instead
   assert(!isSingleArray && "Cannot free an element from a single array!");
-#else
-#if 0
-  if (isSingleArray) {
-    this->addToList((PoolSlab**)&Pool->FreeLargeArrays);
-    return;
-  }
-#endif
-#endif
-
-  // Mark this element as being free!
-  markNodeFree(ElementIdx);
-  --allocated;
 
   // If this slab is not a SingleArray
   assert(isStartOfAllocation(ElementIdx) &&
          "poolfree: Attempt to free middle of allocated array\n");
   
-  // Free the first cell
-  clearStartBit(ElementIdx);
-  markNodeFree(ElementIdx);
-  
-  // Free all nodes if this was a small array allocation.
-  unsigned short ElementEndIdx = ElementIdx + 1;
-
-  // FIXME: This should use manual strength reduction to produce decent code.
+  // The allocation ends at the next free node or the start of the next
+  // allocation, whichever comes first.
   unsigned short UE = UsedEnd;
-  while (ElementEndIdx != UE &&
-         !isStartOfAllocation(ElementEndIdx) && 
-         isNodeAllocated(ElementEndIdx)) {
-    markNodeFree(ElementEndIdx);
-    --allocated;
-    ++ElementEndIdx;
-  }
+  unsigned EndIdx = findBit(getAllocatedBits(), false, ElementIdx + 1, UE);
+  EndIdx = findBit(getStartBits(), true, ElementIdx + 1, EndIdx);
+  unsigned short ElementEndIdx = EndIdx;
+
+  // Free the first cell and all nodes if this was a small array allocation.
+  clearStartBit(ElementIdx);
+  markNodesFree(ElementIdx, ElementEndIdx);
+  allocated -= ElementEndIdx - ElementIdx;
   
   // Update the first free field if this node is below the free node line
   if (ElementIdx < FirstUnused) FirstUnused = ElementIdx;
@@ -426,53 +606,21 @@ PoolSlab::freeElement(unsigned short ElementIdx) {
 
 unsigned
 PoolSlab::lastNodeAllocated(unsigned ScanIdx) {
-  // Check the last few nodes in the current word of flags...
-  unsigned CurWord = ScanIdx/16;
-  unsigned short Flags = NodeFlagsVector[CurWord] & 0xFFFF;
-  if (Flags) {
-    // Mask off nodes above this one
-    Flags &= (1 << ((ScanIdx & 15)+1))-1;
-    if (Flags) {
-      // If there is still something in the flags vector, then there is a node
-      // allocated in this part.  The goto is a hack to get the uncommonly
-      // executed code away from the common code path.
-      //printf("A: ");
-      goto ContainsAllocatedNode;
-    }
-  }
-
-  // Ok, the top word doesn't contain anything, scan the whole flag words now.
-  --CurWord;
-  while (CurWord != ~0U) {
-    Flags = NodeFlagsVector[CurWord] & 0xFFFF;
-    if (Flags) {
-      // There must be a node allocated in this word!
-      //printf("B: ");
-      goto ContainsAllocatedNode;
-    }
-    CurWord--;
+  // Check the nodes up to ScanIdx in the current word of flags, and then the
+  // whole words below it.
+  const uint64_t *Bits = getAllocatedBits();
+  unsigned CurWord = ScanIdx/64;
+  uint64_t Flags = Bits[CurWord];
+  if ((ScanIdx & 63) != 63)
+    Flags &= (1ULL << ((ScanIdx & 63)+1))-1;
+
+  while (!Flags) {
+    if (CurWord == 0) return 0;
+    Flags = Bits[--CurWord];
   }
-  return 0;
-
- ContainsAllocatedNode:
-  // Figure out exactly which node is allocated in this word now.  The node
-  // allocated is the one with the highest bit set in 'Flags'.
-  //
-  // This should use __builtin_clz to get the value, but this builtin is only
-  // available with GCC 3.4 and above.  :(
-  assert(Flags && "Should have allocated node!");
-  
-  unsigned short MSB;
-#if GCC3_4_EVENTUALLY
-  MSB = 16 - ::__builtin_clz(Flags);
-#else
-  for (MSB = 15; (Flags & (1U << MSB)) == 0; --MSB)
-    /*empty*/;
-#endif
 
-  assert((1U << MSB) & Flags);   // The bit should be set
-  assert((~(1U << MSB) & Flags) < Flags);// Removing it should make flag smaller
-  ScanIdx = CurWord*16 + MSB;
+  // The node allocated is the one with the highest bit set in 'Flags'.
+  ScanIdx = CurWord*64 + 63 - __builtin_clzll(Flags);
   assert(isNodeAllocated(ScanIdx));
   return (ScanIdx+1);
 }
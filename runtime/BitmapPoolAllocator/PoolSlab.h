@@ -12,7 +12,8 @@
 // This uses the 'Ptr1' field to maintain a linked list of slabs that are either
 // empty or are partially allocated from.  The 'Ptr2' field of the PoolTy is
 // used to track a linked list of slabs which are full, ie, all elements have
-// been allocated from them.
+// been allocated from them.  Slabs owned by a thread cache are kept on the
+// 'OwnedSlabs' list (see ThreadCache.h).
 //
 //===----------------------------------------------------------------------===//
 
@@ -23,9 +24,47 @@
 #include "../include/PageManager.h"
 
 #include <cassert>
+#include <stdint.h>
 
 namespace llvm {
 
+//===----------------------------------------------------------------------===//
+//
+//  Slab map
+//
+//===----------------------------------------------------------------------===//
+
+// The slab map holds one byte for each page of the address space, which is set
+// if the page is the first page of a slab, including the slabs of large
+// arrays.  It lets the run-time find the slab of an arbitrary pointer without
+// reading memory that is not a slab header.  The map has two levels; a leaf covers
+// 2^SlabMapLeafBits pages and is allocated when the first slab within it is
+// created.  Pages are at least 64K (16 pages of 4K), so the root covers a
+// 48-bit address space on 64-bit machines.
+static const unsigned SlabMapLeafBits = 16;
+static const unsigned SlabMapRootSize =
+  1u << ((sizeof(void*) == 8 ? 48 : 32) - 16 - SlabMapLeafBits);
+
+// Leaves and their bytes are written with the back end locked and read
+// without the lock, so both are accessed atomically.
+extern unsigned char * SlabMap[SlabMapRootSize];
+
+// isSlabPage - Determine whether the page containing the address is the first
+// page of a slab.
+static inline bool isSlabPage(const void *Addr) {
+  if (!PageSize) return false;
+  uintptr_t Page = (uintptr_t)Addr >> __builtin_ctzl(PageSize);
+  uintptr_t Root = Page >> SlabMapLeafBits;
+  if (Root >= SlabMapRootSize) return false;
+  unsigned char *Leaf = __atomic_load_n(&SlabMap[Root], __ATOMIC_ACQUIRE);
+  return Leaf && __atomic_load_n(&Leaf[Page & ((1u << SlabMapLeafBits) - 1)],
+                                 __ATOMIC_ACQUIRE);
+}
+
+// markSlabPage - Record whether the page is the first page of a slab.  The back
+// end must be locked.
+void markSlabPage(void *Page, bool isSlab);
+
 //===----------------------------------------------------------------------===//
 //
 //  PoolSlab implementation
@@ -38,9 +77,25 @@ namespace llvm {
 struct PoolSlab {
   PoolSlab **PrevPtr, *Next;
   bool isSingleArray;   // If this slab is used for exactly one array
+  bool isTrimmed;       // If a free single array gave back its memory
   unsigned allocated; // Number of bytes allocated
   PoolSlab * Canonical; // For stack slabs, the canonical page
 
+  // Pool - The pool to which this slab belongs.
+  BitmapPoolTy * Pool;
+
+  // Owner - The thread cache entry that allocates from this slab, or null if
+  // the slab belongs to the shared back end.  Only the owner may change the
+  // node flags of an owned slab.  It is read without the lock, so it is only
+  // accessed through getOwner() and setOwner().
+  void *Owner;
+
+  // RemoteFrees - Nodes freed by threads other than the owner.  They are
+  // linked through their first word and returned to the slab by the owner, or
+  // by the back end once the slab has no owner.  Their pending bits are set
+  // until then.  Only accessed atomically.
+  void *RemoteFrees;
+
 private:
   // FirstUnused - First empty node in slab
   unsigned short FirstUnused;
@@ -63,41 +118,106 @@ public:
   unsigned int SizeOfSlab;
 
 private:
-  // NodeFlagsVector - This array contains two bits for each node in this pool
-  // slab.  The first (low address) bit indicates whether this node has been
-  // allocated, and the second (next higher) bit indicates whether this is the
-  // start of an allocation.
+  // NodeFlagsVector - This array holds three bitmaps with one bit for each
+  // node in this pool slab.  The first getFlagWords() words hold the allocated
+  // bits, which indicate whether each node has been allocated; the bits past
+  // the last node are set so that searches for free nodes stop there.  The
+  // next getFlagWords() words hold the start bits, which indicate whether each
+  // node is the start of an allocation.  The last getFlagWords() words hold
+  // the pending bits, which indicate whether each node is on the RemoteFrees
+  // list.  The nodes follow the bitmaps.
   //
-  // This is a variable sized array, which has 2*NumNodesInSlab bits (rounded up
-  // to 4 bytes).
-  unsigned NodeFlagsVector[1];
-  
-  bool isNodeAllocated(unsigned NodeNum) {
-    return NodeFlagsVector[NodeNum/16] & (1 << (NodeNum & 15));
+  // The allocated and start bits are only changed by the owner of the slab,
+  // or with the back end locked if it has no owner, but they are read by
+  // other threads, so they are accessed atomically.  The pending bits are set
+  // by other threads and so are changed with atomic read-modify-writes.
+  //
+  // This is a variable sized array.
+  uint64_t NodeFlagsVector[1];
+
+  unsigned getFlagWords() const {
+    return (NumNodesInSlab + 63) / 64;
+  }
+
+  uint64_t *getAllocatedBits() { return NodeFlagsVector; }
+  const uint64_t *getAllocatedBits() const { return NodeFlagsVector; }
+  uint64_t *getStartBits() { return NodeFlagsVector + getFlagWords(); }
+  const uint64_t *getStartBits() const {
+    return NodeFlagsVector + getFlagWords();
+  }
+  uint64_t *getPendingBits() { return NodeFlagsVector + 2*getFlagWords(); }
+  const uint64_t *getPendingBits() const {
+    return NodeFlagsVector + 2*getFlagWords();
+  }
+
+  // testBit - Read the bit of a node in one of the bitmaps.
+  static bool testBit(const uint64_t *Bits, unsigned NodeNum) {
+    uint64_t Word = __atomic_load_n(&Bits[NodeNum/64], __ATOMIC_ACQUIRE);
+    return (Word >> (NodeNum & 63)) & 1;
   }
 
-  void markNodeAllocated(unsigned NodeNum) {
-    NodeFlagsVector[NodeNum/16] |= 1 << (NodeNum & 15);
+  // setBits, clearBits - Change the bits of a word of the allocated or start
+  // bits.  Only one thread changes them at a time, so there is no need for a
+  // locked read-modify-write.
+  static void setBits(uint64_t *Word, uint64_t Mask) {
+    __atomic_store_n(Word, __atomic_load_n(Word, __ATOMIC_RELAXED) | Mask,
+                     __ATOMIC_RELEASE);
   }
 
-  void markNodeFree(unsigned NodeNum) {
-    NodeFlagsVector[NodeNum/16] &= ~(1 << (NodeNum & 15));
+  static void clearBits(uint64_t *Word, uint64_t Mask) {
+    __atomic_store_n(Word, __atomic_load_n(Word, __ATOMIC_RELAXED) & ~Mask,
+                     __ATOMIC_RELEASE);
+  }
+
+  bool isNodeAllocated(unsigned NodeNum) const {
+    return testBit(getAllocatedBits(), NodeNum);
   }
 
   void setStartBit(unsigned NodeNum) {
-    NodeFlagsVector[NodeNum/16] |= 1 << ((NodeNum & 15)+16);
+    setBits(&getStartBits()[NodeNum/64], 1ULL << (NodeNum & 63));
   }
 
 public:
-  bool isStartOfAllocation(unsigned NodeNum) {
-    return NodeFlagsVector[NodeNum/16] & (1 << ((NodeNum & 15)+16));
+  bool isStartOfAllocation(unsigned NodeNum) const {
+    return testBit(getStartBits(), NodeNum);
+  }
+
+  // isPendingFree - Determine whether the node was freed by a thread other
+  // than the owner and is waiting on the RemoteFrees list.
+  bool isPendingFree(unsigned NodeNum) const {
+    return testBit(getPendingBits(), NodeNum);
+  }
+
+  // isSingleNode - Determine whether the node is allocated on its own rather
+  // than as part of a small array, and has not been freed.
+  bool isSingleNode(unsigned NodeNum) const {
+    if (!isNodeAllocated(NodeNum) || !isStartOfAllocation(NodeNum) ||
+        isPendingFree(NodeNum))
+      return false;
+    unsigned Next = NodeNum + 1;
+    return (Next == getSlabSize()) || !isNodeAllocated(Next) ||
+           isStartOfAllocation(Next);
   }
   
 private:
   void clearStartBit(unsigned NodeNum) {
-    NodeFlagsVector[NodeNum/16] &= ~(1 << ((NodeNum & 15)+16));
+    clearBits(&getStartBits()[NodeNum/64], 1ULL << (NodeNum & 63));
   }
 
+  // markNodesAllocated, markNodesFree - Set or clear the allocated bits of the
+  // nodes in [Begin, End) a word at a time.
+  void markNodesAllocated(unsigned Begin, unsigned End);
+  void markNodesFree(unsigned Begin, unsigned End);
+
+  // findBit - Return the index of the first node at or after Begin whose bit
+  // in the bitmap is equal to Value, or End if there is none before End.
+  static unsigned findBit(const uint64_t *Bits, bool Value,
+                          unsigned Begin, unsigned End);
+
+  // registerSingleArray - Record a new single array slab in the pool's set of
+  // slabs and on its list of large arrays.
+  void registerSingleArray(BitmapPoolTy *Pool);
+
   void assertOkay (void) {
     assert (FirstUnused <= UsedEnd);
     assert ((UsedEnd == getSlabSize()) || (!isNodeAllocated(UsedEnd)));
@@ -111,20 +231,38 @@ public:
   // entries in it, returning the pointer into the pool directly.
   static void *createSingleArray(BitmapPoolTy  *Pool, unsigned NumNodes);
 
+  // releaseSingleArray - Move a freed single array slab to the pool's cache
+  // of free large arrays, giving back the memory of idle cached arrays if too
+  // much of it is resident.
+  void releaseSingleArray();
+
+  // getLargeArrayBin - Return the bin of the cache of free large arrays that
+  // holds arrays of NumPages pages.
+  static unsigned getLargeArrayBin(unsigned NumPages) {
+    unsigned Bin = 0;
+    while ((NumPages >>= 1) > 1 && Bin < BitmapPoolTy::LargeArrayBins - 1)
+      ++Bin;
+    return Bin;
+  }
+
+  // getSlab - Return the slab whose first page contains the specified address.
+  // The result is only meaningful if the address is within a slab.
+  static PoolSlab *getSlab(void *Node) {
+    return (PoolSlab*)((uintptr_t)Node & ~(PageSize-1));
+  }
+
   // getSlabSize - Return the number of nodes that each slab should contain.
   static unsigned getSlabSize(BitmapPoolTy  *Pool) {
-    // We need space for the header...
-    unsigned NumNodes = PageSize-sizeof(PoolSlab);
-    
-    // We need space for the NodeFlags...
-    // FIXME:
-    //  We unconditionally round up a byte.  We should only do that if
-    //  necessary.
-    unsigned NodeFlagsBytes = (NumNodes/Pool->NodeSize * 2 / 8) + 1;
-    NumNodes -= (NodeFlagsBytes+3) & ~3;  // Round up to int boundaries.
-
-    // Divide the remainder among the nodes!
-    return NumNodes / Pool->NodeSize;
+    // We need space for the header, which includes the first flag word...
+    unsigned Space = PageSize - sizeof(PoolSlab) + sizeof(uint64_t);
+
+    // ...and three bits of flags for each node, kept in whole words.  Divide
+    // the space among the nodes and then make room for the rounding.
+    unsigned NumNodes = (uint64_t)Space * 64 / (64 * Pool->NodeSize + 3);
+    while (3 * sizeof(uint64_t) * ((NumNodes + 63) / 64) +
+           NumNodes * Pool->NodeSize > Space)
+      --NumNodes;
+    return NumNodes;
   }
 
   void addToList(PoolSlab **PrevPtrPtr) {
@@ -163,15 +301,75 @@ public:
   // returning -1 if there is no space.
   int allocateMultiple(unsigned Num);
 
+  // getFreeNodes - Return the number of free nodes in this slab.
+  unsigned getFreeNodes() const {
+    return isSingleArray ? 0 : getSlabSize() - allocated;
+  }
+
+  // findFreeRun - Find the smallest run of free nodes that holds Num nodes,
+  // returning -1 if there is none.  Waste is set to the number of free nodes
+  // of the run that would be left over.
+  int findFreeRun(unsigned Num, unsigned &Waste) const;
+
+  // allocateRun - Allocate Num nodes starting at the free node Idx, such as
+  // the start of a run found by findFreeRun().
+  void allocateRun(unsigned Idx, unsigned Num);
+
+  // getOwner - Return the owner of the slab.  The load is ordered after any
+  // preceding pushRemoteFree() so that a node pushed while the owner gives the
+  // slab back is drained by one of the two threads.
+  void *getOwner() const {
+    return __atomic_load_n(&Owner, __ATOMIC_SEQ_CST);
+  }
+
+  // setOwner - Change the owner of the slab.  The back end must be locked.
+  void setOwner(void *NewOwner) {
+    __atomic_store_n(&Owner, NewOwner, __ATOMIC_SEQ_CST);
+  }
+
+  // pushRemoteFree - Record that a thread other than the owner freed the node
+  // with the specified index.  The node is marked as pending first, so that
+  // lookups no longer find it.  Returns false, without pushing the node, if
+  // it is not the start of an allocation or is already pending, as happens
+  // when it is freed twice.
+  bool pushRemoteFree(void *Node, unsigned NodeNum) {
+    if (!isNodeAllocated(NodeNum) || !isStartOfAllocation(NodeNum))
+      return false;
+    uint64_t Bit = 1ULL << (NodeNum & 63);
+    if (__atomic_fetch_or(&getPendingBits()[NodeNum/64], Bit,
+                          __ATOMIC_ACQ_REL) & Bit)
+      return false;
+
+    void *Head = __atomic_load_n(&RemoteFrees, __ATOMIC_RELAXED);
+    do {
+      *(void**)Node = Head;
+    } while (!__atomic_compare_exchange_n(&RemoteFrees, &Head, Node, true,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    return true;
+  }
+
+  // clearPendingBit - Record that a node taken from the RemoteFrees list has
+  // been freed.  Only the owner, or the back end if there is no owner, may
+  // call this, and only after freeing the node.
+  void clearPendingBit(unsigned NodeNum) {
+    __atomic_fetch_and(&getPendingBits()[NodeNum/64],
+                       ~(1ULL << (NodeNum & 63)), __ATOMIC_RELEASE);
+  }
+
+  // takeRemoteFrees - Remove and return the list of remotely freed nodes.
+  void *takeRemoteFrees() {
+    if (!__atomic_load_n(&RemoteFrees, __ATOMIC_RELAXED)) return 0;
+    return __atomic_exchange_n(&RemoteFrees, (void*)0, __ATOMIC_ACQUIRE);
+  }
+
   // getElementAddress - Return the address of the specified element.
   void *getElementAddress(unsigned ElementNum, unsigned ElementSize) {
-    char *Data = (char*)&NodeFlagsVector[((unsigned)NumNodesInSlab+15)/16];
+    char *Data = (char*)&NodeFlagsVector[3*getFlagWords()];
     return &Data[ElementNum*ElementSize];
   }
   
   const void *getElementAddress(unsigned ElementNum, unsigned ElementSize)const{
-    const char *Data =
-      (const char *)&NodeFlagsVector[(unsigned)(NumNodesInSlab+15)/16];
+    const char *Data = (const char *)&NodeFlagsVector[3*getFlagWords()];
     return &Data[ElementNum*ElementSize];
   }
 
@@ -179,6 +377,16 @@ public:
   // this slab.  If the address is not in slab, return -1.
   int containsElement(void *Ptr, unsigned ElementSize) const;
 
+  // findNode - Return the number of the node in which the address lies, which
+  // may be anywhere within the node, or -1 if it lies outside of the nodes of
+  // this slab.  Single array slabs are not supported.
+  int findNode(const void *Ptr, unsigned ElementSize) const {
+    const char *FirstElement = (const char *)getElementAddress(0, 0);
+    if ((const char *)Ptr < FirstElement) return -1;
+    uintptr_t Index = ((const char *)Ptr - FirstElement) / ElementSize;
+    return (Index < getSlabSize()) ? (int)Index : -1;
+  }
+
   // freeElement - Free the single node, small array, or entire array indicated.
   void freeElement(unsigned short ElementIdx);
   
@@ -0,0 +1,421 @@
+//===- ThreadCache.cpp - Per-thread front end of the bitmap allocator -----===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the thread caches of the bitmap pool allocator.  See
+// ThreadCache.h for how the caches and the shared back end divide the work.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ThreadCache.h"
+
+#include <pthread.h>
+
+#include <cstdlib>
+
+namespace llvm {
+
+// Number of entries of a thread cache searched for a pool
+static const unsigned CacheProbes = 4;
+
+// Lock protecting the lists of slabs of all pools, the page manager, and the
+// list of thread caches
+static pthread_mutex_t BackEndLock = PTHREAD_MUTEX_INITIALIZER;
+
+// List of the caches of all threads
+static ThreadCache * ThreadCaches = 0;
+
+// The cache of the calling thread
+static __thread ThreadCache * MyCache = 0;
+
+// Key whose destructor gives the slabs of exiting threads back to the pools
+static pthread_key_t CacheKey;
+static pthread_once_t CacheKeyOnce = PTHREAD_ONCE_INIT;
+
+void
+LockBackEnd() {
+  pthread_mutex_lock (&BackEndLock);
+}
+
+void
+UnlockBackEnd() {
+  pthread_mutex_unlock (&BackEndLock);
+}
+
+//
+// Function: DrainRemoteFrees()
+//
+// Description:
+//  Free the nodes of a slab that were freed by threads other than its former
+//  owner.  The back end must be locked.
+//
+void
+DrainRemoteFrees (BitmapPoolTy * Pool, PoolSlab * PS) {
+  //
+  // The pending bits keep a node from being pushed twice, but never follow
+  // more links than there are nodes in the slab all the same.
+  //
+  void * Node = PS->takeRemoteFrees();
+  for (unsigned Count = 0; Node && Count <= PS->getSlabSize(); ++Count) {
+    void * Next = *(void **) Node;
+    int Idx = PS->containsElement (Node, Pool->NodeSize);
+    if (Idx != -1) {
+      FreeInSlab (Pool, PS, Idx);
+      PS->clearPendingBit (Idx);
+    }
+    Node = Next;
+  }
+}
+
+//
+// Function: DrainOwnedSlab()
+//
+// Description:
+//  Free the nodes of a slab owned by the calling thread that were freed by
+//  other threads.  No locking is needed.
+//
+static void
+DrainOwnedSlab (BitmapPoolTy * Pool, PoolSlab * PS) {
+  void * Node = PS->takeRemoteFrees();
+  for (unsigned Count = 0; Node && Count <= PS->getSlabSize(); ++Count) {
+    void * Next = *(void **) Node;
+    int Idx = PS->containsElement (Node, Pool->NodeSize);
+    if (Idx != -1) {
+      PS->freeElement (Idx);
+      PS->clearPendingBit (Idx);
+    }
+    Node = Next;
+  }
+}
+
+//
+// Function: ReleaseSlab()
+//
+// Description:
+//  Give an owned slab back to the pool.  The back end must be locked.
+//
+static void
+ReleaseSlab (BitmapPoolTy * Pool, PoolSlab * PS) {
+  //
+  // Clear the owner before draining the remote frees.  A thread that pushes a
+  // node after the drain will then see that the slab has no owner and drain
+  // the slab itself.
+  //
+  PS->setOwner (0);
+
+  PS->unlinkFromList();
+  if (PS->isFull())
+    PS->addToList((PoolSlab**)&Pool->Ptr2);
+  else
+    PS->addToList((PoolSlab**)&Pool->Ptr1);
+
+  DrainRemoteFrees (Pool, PS);
+}
+
+//
+// Function: ReleaseEntry()
+//
+// Description:
+//  Give all of the slabs of a thread cache entry back to the pool and free the
+//  entry.  The back end must be locked.
+//
+static void
+ReleaseEntry (PoolCache * PC) {
+  for (unsigned i = 0; i < PC->NumSlabs; ++i)
+    ReleaseSlab (PC->Pool, PC->Slabs[i]);
+  PC->Pool = 0;
+  PC->NumSlabs = PC->Current = PC->Victim = 0;
+}
+
+//
+// Function: AcquireSlab()
+//
+// Description:
+//  Take a slab with free nodes from the pool, or create one, and make it the
+//  current slab of a thread cache entry.  If the entry already owns as many
+//  slabs as it may, one of them is given back.  The back end must be locked.
+//
+static PoolSlab *
+AcquireSlab (BitmapPoolTy * Pool, PoolCache * PC) {
+  PoolSlab * PS = (PoolSlab *) Pool->Ptr1;
+  if (!PS)
+    PS = CreateSlab (Pool);
+
+  PS->unlinkFromList();
+  PS->addToList((PoolSlab**)&Pool->OwnedSlabs);
+  PS->setOwner (PC);
+
+  if (PC->NumSlabs < MagazineSlabs) {
+    PC->Current = PC->NumSlabs++;
+  } else {
+    ReleaseSlab (Pool, PC->Slabs[PC->Victim]);
+    PC->Current = PC->Victim;
+    PC->Victim = (PC->Victim + 1) % MagazineSlabs;
+  }
+  PC->Slabs[PC->Current] = PS;
+  return PS;
+}
+
+//
+// Function: DestroyThreadCache()
+//
+// Description:
+//  Give the slabs of an exiting thread back to their pools and free its cache.
+//
+static void
+DestroyThreadCache (void * Arg) {
+  ThreadCache * TC = (ThreadCache *) Arg;
+
+  LockBackEnd();
+  for (unsigned i = 0; i < CachedPools; ++i)
+    if (TC->Pools[i].Pool)
+      ReleaseEntry (&TC->Pools[i]);
+
+  if (TC->Next) TC->Next->Prev = TC->Prev;
+  if (TC->Prev)
+    TC->Prev->Next = TC->Next;
+  else
+    ThreadCaches = TC->Next;
+  UnlockBackEnd();
+
+  MyCache = 0;
+  free (TC);
+}
+
+static void
+CreateCacheKey (void) {
+  pthread_key_create (&CacheKey, DestroyThreadCache);
+}
+
+//
+// Function: GetThreadCache()
+//
+// Description:
+//  Return the cache of the calling thread, creating it if necessary.
+//
+static ThreadCache *
+GetThreadCache (void) {
+  if (MyCache)
+    return MyCache;
+
+  pthread_once (&CacheKeyOnce, CreateCacheKey);
+  ThreadCache * TC = (ThreadCache *) calloc (1, sizeof (ThreadCache));
+  if (!TC)
+    return 0;
+
+  LockBackEnd();
+  TC->Next = ThreadCaches;
+  if (ThreadCaches) ThreadCaches->Prev = TC;
+  ThreadCaches = TC;
+  UnlockBackEnd();
+
+  pthread_setspecific (CacheKey, TC);
+  MyCache = TC;
+  return TC;
+}
+
+//
+// Function: FindPool()
+//
+// Description:
+//  Find the entry of a thread cache for the specified pool.
+//
+static inline PoolCache *
+FindPool (ThreadCache * TC, BitmapPoolTy * Pool) {
+  unsigned Hash = (uintptr_t) Pool >> 4;
+  for (unsigned i = 0; i < CacheProbes; ++i) {
+    PoolCache * PC = &TC->Pools[(Hash + i) & (CachedPools - 1)];
+    if (PC->Pool == Pool)
+      return PC;
+  }
+  return 0;
+}
+
+//
+// Function: BindPool()
+//
+// Description:
+//  Assign an entry of a thread cache to the specified pool, evicting another
+//  pool if all of the entries that may hold it are in use.  The back end must
+//  be locked.
+//
+static PoolCache *
+BindPool (ThreadCache * TC, BitmapPoolTy * Pool) {
+  unsigned Hash = (uintptr_t) Pool >> 4;
+  PoolCache * PC = &TC->Pools[Hash & (CachedPools - 1)];
+  for (unsigned i = 0; i < CacheProbes; ++i) {
+    PoolCache * Entry = &TC->Pools[(Hash + i) & (CachedPools - 1)];
+    if (!Entry->Pool) {
+      PC = Entry;
+      break;
+    }
+  }
+
+  if (PC->Pool)
+    ReleaseEntry (PC);
+  PC->Pool = Pool;
+  return PC;
+}
+
+//
+// Function: RefillCache()
+//
+// Description:
+//  Allocate a node when the current slab of the calling thread is full.  The
+//  other owned slabs are tried first; then a slab is taken from the back end.
+//
+static void * __attribute__((noinline))
+RefillCache (BitmapPoolTy * Pool) {
+  ThreadCache * TC = GetThreadCache();
+  if (!TC)
+    return 0;
+
+  PoolCache * PC = FindPool (TC, Pool);
+  if (PC) {
+    for (unsigned i = 0; i < PC->NumSlabs; ++i) {
+      unsigned Index = (PC->Current + i) % PC->NumSlabs;
+      PoolSlab * PS = PC->Slabs[Index];
+      DrainOwnedSlab (Pool, PS);
+      int Element = PS->allocateSingle();
+      if (Element != -1) {
+        PC->Current = Index;
+        return PS->getElementAddress(Element, Pool->NodeSize);
+      }
+    }
+  }
+
+  LockBackEnd();
+  if (!PC)
+    PC = BindPool (TC, Pool);
+  PoolSlab * PS;
+  int Element;
+  do {
+    PS = AcquireSlab (Pool, PC);
+    Element = PS->allocateSingle();
+  } while (Element == -1);
+  UnlockBackEnd();
+
+  return PS->getElementAddress(Element, Pool->NodeSize);
+}
+
+//
+// Function: CacheAlloc()
+//
+// Description:
+//  Allocate a single node from a slab owned by the calling thread.
+//
+// Return value:
+//  NULL - The pool is not cached; the back end must allocate the node.
+//  Otherwise, a pointer to the node is returned.
+//
+void *
+CacheAlloc (BitmapPoolTy * Pool) {
+  //
+  // Remote frees are linked through the nodes, so they must hold a pointer.
+  //
+  if (Pool->NodeSize < sizeof (void *))
+    return 0;
+
+  if (ThreadCache * TC = MyCache) {
+    if (PoolCache * PC = FindPool (TC, Pool)) {
+      PoolSlab * PS = PC->Slabs[PC->Current];
+      int Element = PS->allocateSingle();
+      if (__builtin_expect (Element != -1, 1))
+        return PS->getElementAddress(Element, Pool->NodeSize);
+    }
+  }
+
+  return RefillCache (Pool);
+}
+
+//
+// Function: CacheFree()
+//
+// Description:
+//  Free a node that lies within a slab owned by a thread cache.  Nodes of the
+//  calling thread's slabs are freed immediately; others are handed to the
+//  owner of their slab.
+//
+// Return value:
+//  true  - The node was freed or handed to the owner of its slab.
+//  false - The node is not within an owned slab; the back end must free it.
+//
+bool
+CacheFree (BitmapPoolTy * Pool, void * Node) {
+  //
+  // Only read the header of the page if the slab map says that the page
+  // starts a slab; the page manager's range also holds other mappings,
+  // including inaccessible ones.
+  //
+  if ((Pool->NodeSize < sizeof (void *)) || !isSlabPage (Node))
+    return false;
+
+  PoolSlab * PS = PoolSlab::getSlab (Node);
+  if ((PS->Pool != Pool) || PS->isSingleArray)
+    return false;
+
+  void * Owner = PS->getOwner();
+  if (!Owner)
+    return false;
+
+  //
+  // Ignore pointers that are not to a node of the slab.
+  //
+  int Idx = PS->containsElement (Node, Pool->NodeSize);
+  if (Idx == -1)
+    return true;
+
+  //
+  // A node that another thread has already freed is left to the drain of the
+  // remote frees.
+  //
+  ThreadCache * TC = MyCache;
+  if (TC && TC->owns (Owner)) {
+    if (!PS->isPendingFree (Idx))
+      PS->freeElement (Idx);
+    return true;
+  }
+
+  //
+  // Nodes that are already free or pending, such as nodes freed twice, are
+  // ignored.  If the owner gave the slab back before seeing the node, drain
+  // the slab here.
+  //
+  if (!PS->pushRemoteFree (Node, Idx))
+    return true;
+  if (!PS->getOwner()) {
+    LockBackEnd();
+    if (!PS->getOwner())
+      DrainRemoteFrees (Pool, PS);
+    UnlockBackEnd();
+  }
+  return true;
+}
+
+//
+// Function: ForgetPool()
+//
+// Description:
+//  Drop the entries of all thread caches for a pool that is being destroyed.
+//  The slabs themselves are destroyed with the pool.  The back end must be
+//  locked.
+//
+void
+ForgetPool (BitmapPoolTy * Pool) {
+  for (ThreadCache * TC = ThreadCaches; TC; TC = TC->Next) {
+    for (unsigned i = 0; i < CachedPools; ++i) {
+      PoolCache * PC = &TC->Pools[i];
+      if (PC->Pool == Pool) {
+        PC->Pool = 0;
+        PC->NumSlabs = PC->Current = PC->Victim = 0;
+      }
+    }
+  }
+}
+
+}
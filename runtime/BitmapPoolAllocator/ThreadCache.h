@@ -0,0 +1,114 @@
+//===- ThreadCache.h - Per-thread front end of the bitmap allocator -*- C++ -*-//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the thread caches of the bitmap pool allocator.
+//
+// Each thread keeps a small table of the pools from which it allocates.  The
+// entry for a pool holds a magazine of up to MagazineSlabs slabs that the
+// thread owns.  Single nodes are allocated from, and freed to, owned slabs
+// without locking because no other thread changes their node flags.  Slabs
+// are found from a node by masking its address, which is why the page manager
+// aligns its pages.
+//
+// A node freed by a thread that does not own its slab is pushed onto the
+// slab's list of remote frees.  The owner returns those nodes to the slab when
+// it runs out of space; slabs without an owner are drained by the back end.
+//
+// Everything else, including arrays, pools of nodes smaller than a pointer,
+// and moving slabs between the thread caches and the pool's lists, goes to
+// the shared back end (the BitmapPoolTy lists and the page manager), which is
+// protected by a single lock.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _THREADCACHE_H_
+#define _THREADCACHE_H_
+
+#include "PoolSlab.h"
+
+namespace llvm {
+
+// Number of slabs that a thread may own for each pool
+static const unsigned MagazineSlabs = 4;
+
+// Number of pools for which each thread caches slabs
+static const unsigned CachedPools = 64;
+
+//
+// Structure: PoolCache
+//
+// Description:
+//  The slabs of one pool owned by a thread.  The owner field of these slabs
+//  points to this structure.
+//
+struct PoolCache {
+  // The pool to which the slabs belong, or null if the entry is free
+  BitmapPoolTy * Pool;
+
+  // The owned slabs
+  PoolSlab * Slabs[MagazineSlabs];
+  unsigned NumSlabs;
+
+  // The slab from which nodes are currently allocated
+  unsigned Current;
+
+  // The slab to give back to the back end when another one is needed
+  unsigned Victim;
+};
+
+//
+// Structure: ThreadCache
+//
+// Description:
+//  The cached slabs of all pools used by a thread.
+//
+struct ThreadCache {
+  PoolCache Pools[CachedPools];
+
+  // Links in the list of all thread caches
+  ThreadCache * Prev, * Next;
+
+  // Determine whether the specified entry belongs to this cache
+  bool owns(const void * Entry) const {
+    return (Entry >= (const void *) &Pools[0]) &&
+           (Entry < (const void *) &Pools[CachedPools]);
+  }
+};
+
+// Lock and unlock the shared back end
+void LockBackEnd();
+void UnlockBackEnd();
+
+// Create a slab, register it with the pool, and put it on the Ptr1 list.
+// The back end must be locked.  This is defined in PoolAllocatorBitMask.cpp.
+PoolSlab *CreateSlab(BitmapPoolTy *Pool);
+
+// Free a node of a slab that has no owner.  The back end must be locked.
+// This is defined in PoolAllocatorBitMask.cpp.
+void FreeInSlab(BitmapPoolTy *Pool, PoolSlab *PS, unsigned Idx);
+
+// Return the remotely freed nodes of a slab without an owner to the slab.
+// The back end must be locked.
+void DrainRemoteFrees(BitmapPoolTy *Pool, PoolSlab *PS);
+
+// Allocate a single node from the calling thread's cache.  Null is returned
+// if the pool is not cached.
+void *CacheAlloc(BitmapPoolTy *Pool);
+
+// Free a node of an owned slab.  False is returned if the node is not within
+// a slab owned by a thread cache, in which case the back end must free it.
+bool CacheFree(BitmapPoolTy *Pool, void *Node);
+
+// Drop the entries of all thread caches for a pool that is being destroyed.
+// The back end must be locked.
+void ForgetPool(BitmapPoolTy *Pool);
+
+}
+
+#endif
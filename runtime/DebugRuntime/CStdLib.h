@@ -184,8 +184,9 @@ pool_find(DebugPoolTy *pool, void *address, void *&poolBegin, void *&poolEnd) {
     return false;
 
   // Retrieve memory area's bounds from pool handle.
-  if ((pool && pool->Objects.find(address, poolBegin, poolEnd)) || 
-      ExternalObjects->find(address, poolBegin, poolEnd))
+  if ((pool && findPoolObject(pool, address, poolBegin, poolEnd)) ||
+      findExternalObject(address, poolBegin, poolEnd) ||
+      findExternalHeapObject(address, poolBegin, poolEnd))
     return true;
 
   return false;
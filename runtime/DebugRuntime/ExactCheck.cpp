@@ -17,6 +17,7 @@
 
 #include "../include/BitmapAllocator.h"
 #include "../include/CWE.h"
+#include "safecode/Runtime/Telemetry.h"
 
 
 #include "PoolAllocator.h"
@@ -78,6 +79,8 @@ failLSCheck (const char *base,
 void
 fastlscheck (const char *base, const char *result, unsigned size,
              unsigned lslen) {
+  SC_STAT (SC_STAT_EXACT_CHECKS);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
@@ -118,6 +121,8 @@ fastlscheck_debug (const char *base, const char *result, unsigned size,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
+  SC_STAT (SC_STAT_EXACT_CHECKS);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
@@ -159,6 +164,7 @@ fastlscheck_debug (const char *base, const char *result, unsigned size,
  */
 void *
 exactcheck2 (char * source, char *base, char *result, unsigned size) {
+  SC_STAT (SC_STAT_EXACT_CHECKS);
 
   /*
    * If the pointer is within the object, the check passes.  Return the checked
@@ -197,6 +203,8 @@ exactcheck2_debug (char *source,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
+  SC_STAT (SC_STAT_EXACT_CHECKS);
+
   /*
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
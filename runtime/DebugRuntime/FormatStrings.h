@@ -197,8 +197,11 @@ namespace
 
     if (p->ptr == 0)
       p->flags |= NULL_PTR;
-    else if ((pool && pool->Objects.find(p->ptr, p->bounds[0], p->bounds[1])) ||
-      ExternalObjects->find(p->ptr, p->bounds[0], p->bounds[1]))
+    else if ((pool &&
+              findPoolObject(pool, p->ptr, p->bounds[0], p->bounds[1])) ||
+      findExternalObject(p->ptr, p->bounds[0], p->bounds[1]) ||
+      (!(p->flags & ISCOMPLETE) &&
+       findExternalHeapObject(p->ptr, p->bounds[0], p->bounds[1])))
     {
       p->flags |= HAVEBOUNDS;
     }
@@ -11,6 +11,11 @@
 // by the system's original memory allocators.  This allows the SAFECode
 // compiler to work with external code.
 //
+// On systems using the GNU C library, the allocations are not recorded when
+// they are made.  Instead, the bounds of a heap object are discovered from the
+// malloc chunk headers the first time that a run-time check cannot find the
+// object.  The bounds are cached until the object is freed.
+//
 //===----------------------------------------------------------------------===//
 
 #include "../include/SplayTree.h"
@@ -19,6 +24,23 @@
 #include <malloc/malloc.h>
 #endif
 
+#if defined(__linux__) && defined(__GLIBC__)
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// The C library's deallocation functions, used when there is no dynamic
+// linker to find the real ones (e.g., in static programs)
+extern "C" void   __libc_free    (void *);
+extern "C" void * __libc_realloc (void *, size_t);
+#endif
+
 namespace llvm {
 
 // Splay tree for recording external allocations
@@ -146,11 +168,362 @@ track_free (malloc_zone_t * zone, void * p) {
   ExternalObjects->remove(p);
   return;
 }
+
+bool
+findExternalHeapObject (void * p, void *& start, void *& end) {
+  return false;
+}
+#elif defined(__linux__) && defined(__GLIBC__)
+
+// Splay tree of heap objects whose bounds were discovered from malloc chunks
+static RangeSplaySet<> * HeapObjects = 0;
+
+// Lock protecting HeapObjects; free() may be called from any thread
+static pthread_mutex_t HeapObjectsLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+// Lowest and highest start addresses of the objects ever put in HeapObjects.
+// These are written with HeapObjectsLock held and read without it so that
+// free() can reject pointers that cannot be in the cache without locking.
+static uintptr_t LowestObject = ~((uintptr_t) 0);
+static uintptr_t HighestObject = 0;
+
+// Start of the heap used by the main malloc arena (zero until it is found)
+static uintptr_t HeapStart = 0;
+
+// Size of the length field in the header of a malloc chunk
+static const uintptr_t SizeSize = sizeof (size_t);
+
+// Alignment of malloc chunks
+static const uintptr_t ChunkAlign = 2 * sizeof (size_t);
+
+// Flag bits in the length field of a malloc chunk
+static const size_t PrevInUse     = 0x1;
+static const size_t IsMapped      = 0x2;
+static const size_t NonMainArena  = 0x4;
+static const size_t ChunkFlags    = 0x7;
+
+// Maximum distance to search backwards from a pointer for a chunk header
+static const uintptr_t MaxChunkSearch = 64 * 1024;
+
+// Number of chunks following a candidate chunk that must be well formed
+static const unsigned ChunkLinks = 4;
+
+//
+// Function: findHeapStart()
+//
+// Description:
+//  Find the start of the heap managed by the main malloc arena.  The kernel
+//  reports it as the "[heap]" mapping; if there is no such mapping yet, the
+//  heap will start at the current program break.
+//
+// Notes:
+//  This function uses read() instead of stdio so that it does not allocate
+//  memory.
+//
+static uintptr_t
+findHeapStart (void) {
+  int fd = open ("/proc/self/maps", O_RDONLY);
+  if (fd != -1) {
+    char buf[4096];
+    char line[512];
+    unsigned len = 0;
+    ssize_t n;
+    while ((n = read (fd, buf, sizeof (buf))) > 0) {
+      for (ssize_t index = 0; index < n; ++index) {
+        if (buf[index] != '\n') {
+          if (len < sizeof (line) - 1)
+            line[len++] = buf[index];
+          continue;
+        }
+
+        line[len] = '\0';
+        len = 0;
+        if (strstr (line, "[heap]")) {
+          close (fd);
+          return strtoul (line, 0, 16);
+        }
+      }
+    }
+    close (fd);
+  }
+
+  return (uintptr_t) sbrk (0);
+}
+
+//
+// Function: isChunk()
+//
+// Description:
+//  Determine whether the specified address looks like the start of an in-use
+//  malloc chunk within the main heap.
+//
+// Inputs:
+//  mem - The address that would be returned by malloc() for the chunk.
+//  top - The current end of the heap.
+//
+// Outputs:
+//  size - The number of bytes in the chunk (including its header).
+//
+static inline bool
+isChunk (uintptr_t mem, uintptr_t top, uintptr_t & size) {
+  uintptr_t chunk = mem - ChunkAlign;
+  if (chunk < HeapStart)
+    return false;
+
+  //
+  // Chunks in the main heap are neither mmap()ed nor owned by another arena,
+  // and their sizes are multiples of the chunk alignment.
+  //
+  size_t header = *((size_t *)(mem - SizeSize));
+  if (header & (IsMapped | NonMainArena))
+    return false;
+  size = header & ~ChunkFlags;
+  if ((size < 2 * ChunkAlign) || (size % ChunkAlign))
+    return false;
+  if (chunk + size + ChunkAlign > top)
+    return false;
+
+  //
+  // The chunk is in use if the next chunk says that its predecessor is.
+  //
+  size_t next = *((size_t *)(chunk + size + SizeSize));
+  return (next & PrevInUse);
+}
+
+//
+// Function: isChunkChain()
+//
+// Description:
+//  Determine whether the chunk at the specified address is followed by a
+//  short chain of well formed chunks.  A word of user data that happens to
+//  look like a chunk header is unlikely to pass this test.
+//
+static inline bool
+isChunkChain (uintptr_t mem, uintptr_t size, uintptr_t top) {
+  for (unsigned link = 0; link < ChunkLinks; ++link) {
+    mem += size;
+    if (mem + ChunkAlign > top)
+      return true;
+
+    size_t header = *((size_t *)(mem - SizeSize));
+    if (header & (IsMapped | NonMainArena))
+      return false;
+    size = header & ~ChunkFlags;
+    if ((size < 2 * ChunkAlign) || (size % ChunkAlign))
+      return false;
+    if (mem - ChunkAlign + size > top)
+      return false;
+  }
+
+  return true;
+}
+
+void
+installAllocHooks (void) {
+  pthread_mutex_lock (&HeapObjectsLock);
+  if (!HeapObjects) {
+    HeapObjects = new RangeSplaySet<>;
+    HeapStart = findHeapStart ();
+  }
+  pthread_mutex_unlock (&HeapObjectsLock);
+  return;
+}
+
+//
+// Function: findExternalHeapObject()
+//
+// Description:
+//  Find the bounds of a heap object that was allocated by code outside of
+//  SAFECode's control.  The object is first looked up in the cache of objects
+//  found previously; if it is not there, the malloc chunk containing the
+//  pointer is found by searching backwards from the pointer for a chunk
+//  header.
+//
+// Inputs:
+//  p - The pointer for which to find the object.
+//
+// Outputs:
+//  start - The address of the first byte of the object.
+//  end   - The address of the last byte of the object.
+//
+// Return value:
+//  true  - The object was found.
+//  false - The pointer does not point into an in-use chunk of the main heap.
+//
+// Notes:
+//  The bounds reported for the object include the slack at the end of the
+//  chunk that malloc_usable_size() reports.  Chunks held in the allocator's
+//  thread caches and fast bins look like they are in use, so dangling
+//  pointers to them are not detected.
+//
+bool
+findExternalHeapObject (void * p, void *& start, void *& end) {
+  if (!HeapObjects)
+    installAllocHooks ();
+
+  //
+  // Only pointers into the main heap can be handled.  Other memory (such as
+  // mmap()ed chunks) may not be readable before the pointer.
+  //
+  uintptr_t addr = (uintptr_t) p;
+  uintptr_t top = (uintptr_t) sbrk (0);
+  if ((addr < HeapStart + ChunkAlign) || (addr >= top))
+    return false;
+
+  //
+  // Look for the object in the cache.  Memory can be freed without going
+  // through our free() (e.g., by the C library itself), so make sure that the
+  // chunk still looks the same before using the cached bounds.
+  //
+  pthread_mutex_lock (&HeapObjectsLock);
+  if (HeapObjects->find (p, start, end)) {
+    uintptr_t size;
+    uintptr_t mem = (uintptr_t) start;
+    if (isChunk (mem, top, size) &&
+        (malloc_usable_size (start) == (uintptr_t) end - mem + 1)) {
+      pthread_mutex_unlock (&HeapObjectsLock);
+      return true;
+    }
+    HeapObjects->remove (start);
+  }
+
+  //
+  // Search backwards for the nearest well formed chunk containing the
+  // pointer.
+  //
+  uintptr_t limit = (addr > MaxChunkSearch) ? addr - MaxChunkSearch : 0;
+  if (limit < HeapStart + ChunkAlign)
+    limit = HeapStart + ChunkAlign;
+
+  for (uintptr_t mem = addr & ~(ChunkAlign - 1); mem >= limit; mem -= ChunkAlign) {
+    uintptr_t size;
+    if (!isChunk (mem, top, size))
+      continue;
+
+    size_t usable = malloc_usable_size ((void *) mem);
+    if ((usable == 0) || (addr >= mem + usable))
+      continue;
+
+    if (!isChunkChain (mem, size, top))
+      continue;
+
+    start = (void *) mem;
+    end = (void *) (mem + usable - 1);
+    HeapObjects->insert (start, end);
+    if (mem < LowestObject)
+      __atomic_store_n (&LowestObject, mem, __ATOMIC_RELEASE);
+    if (mem > HighestObject)
+      __atomic_store_n (&HighestObject, mem, __ATOMIC_RELEASE);
+    pthread_mutex_unlock (&HeapObjectsLock);
+    return true;
+  }
+
+  pthread_mutex_unlock (&HeapObjectsLock);
+  return false;
+}
+
+//
+// Function: forgetHeapObject()
+//
+// Description:
+//  Remove a heap object that is being freed from the cache of discovered
+//  objects.  Most freed objects were never looked up, so pointers outside of
+//  the range of the cached objects are rejected without taking the lock.
+//
+void
+forgetHeapObject (void * p) {
+  uintptr_t addr = (uintptr_t) p;
+  if ((addr < __atomic_load_n (&LowestObject, __ATOMIC_ACQUIRE)) ||
+      (addr > __atomic_load_n (&HighestObject, __ATOMIC_ACQUIRE)))
+    return;
+
+  if (HeapObjects && p) {
+    pthread_mutex_lock (&HeapObjectsLock);
+    HeapObjects->remove (p);
+    pthread_mutex_unlock (&HeapObjectsLock);
+  }
+}
+
 #else
 void
 installAllocHooks (void) {
   return;
 }
+
+bool
+findExternalHeapObject (void * p, void *& start, void *& end) {
+  return false;
+}
 #endif
 
 }
+
+#if defined(__linux__) && defined(__GLIBC__)
+// The deallocation functions of the allocator that is really in use, which
+// may be a replacement for the C library's allocator
+static void   (*real_free)    (void *) = 0;
+static void * (*real_realloc) (void *, size_t) = 0;
+
+// Non-zero while the real functions are being looked up
+static __thread int FindingAllocator = 0;
+
+//
+// Function: findRealAllocator()
+//
+// Description:
+//  Find the next definitions of free() and realloc() after this one, so that
+//  freed memory is returned to whichever allocator made it.
+//
+// Return value:
+//  true  - The real functions were found.
+//  false - They are being looked up by this thread; dlsym() itself may free
+//          memory.
+//
+static bool
+findRealAllocator (void) {
+  if (real_free && real_realloc)
+    return true;
+  if (FindingAllocator)
+    return false;
+
+  FindingAllocator = 1;
+  void * f = dlsym (RTLD_NEXT, "free");
+  void * r = dlsym (RTLD_NEXT, "realloc");
+  if (!f || !r) {
+    f = (void *) __libc_free;
+    r = (void *) __libc_realloc;
+  }
+  __atomic_store_n (&real_realloc, (void * (*) (void *, size_t)) r,
+                    __ATOMIC_RELEASE);
+  __atomic_store_n (&real_free, (void (*) (void *)) f, __ATOMIC_RELEASE);
+  FindingAllocator = 0;
+  return real_free && real_realloc;
+}
+
+//
+// Functions: free(), realloc()
+//
+// Description:
+//  Interpose on the allocator's deallocation functions so that the bounds of
+//  discovered objects are invalidated when the objects are freed.
+//
+// Notes:
+//  Memory freed by dlsym() while the real functions are being looked up is
+//  leaked, as there is no free() to give it to yet.
+//
+extern "C" void
+free (void * p) throw () {
+  llvm::forgetHeapObject (p);
+  if (findRealAllocator ())
+    real_free (p);
+}
+
+extern "C" void *
+realloc (void * p, size_t size) throw () {
+  llvm::forgetHeapObject (p);
+  if (findRealAllocator ())
+    return real_realloc (p, size);
+  errno = ENOMEM;
+  return 0;
+}
+#endif
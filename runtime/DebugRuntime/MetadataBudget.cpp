@@ -0,0 +1,165 @@
+//===- MetadataBudget.cpp - Run-time metadata memory budgets --------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the accounting of run-time metadata.  See
+// safecode/Runtime/MetadataBudget.h for how budgets are set and what happens
+// when they are exceeded.
+//
+//===----------------------------------------------------------------------===//
+
+#include "safecode/Runtime/MetadataBudget.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int __sc_md_enabled = 0;
+long __sc_md_bytes[SC_MD_NUM_KINDS];
+long __sc_md_total = 0;
+long __sc_md_budget[SC_MD_NUM_KINDS];
+long __sc_md_total_budget = 0;
+volatile unsigned __sc_md_degraded = 0;
+
+// Names of the kinds of metadata as used in SAFECODE_METADATA_BUDGET
+static const char * const KindNames[SC_MD_NUM_KINDS] = {
+  "splay",
+  "debuginfo",
+  "shadow",
+  "rewrite"
+};
+
+// What the run-time stops doing when each kind of metadata is over budget
+static const char * const KindActions[SC_MD_NUM_KINDS] = {
+  "dangling pointer detection is disabled for new objects",
+  "dangling pointer detection is disabled for new objects",
+  "dangling pointer detection is disabled for new objects",
+  "out of bounds pointers are no longer rewritten"
+};
+
+//
+// Function: parseSize()
+//
+// Description:
+//  Parse a size in bytes with an optional K, M, or G suffix.
+//
+// Return value:
+//  The size in bytes, or zero if the size could not be parsed.
+//
+static long
+parseSize (const char * s, const char ** end) {
+  char * p;
+  long size = strtol (s, &p, 10);
+  if (p == s || size < 0)
+    size = 0;
+
+  switch (*p) {
+    case 'k': case 'K': size <<= 10; ++p; break;
+    case 'm': case 'M': size <<= 20; ++p; break;
+    case 'g': case 'G': size <<= 30; ++p; break;
+    default: break;
+  }
+
+  *end = p;
+  return size;
+}
+
+//
+// Function: __sc_md_init()
+//
+// Description:
+//  Read the SAFECODE_METADATA_BUDGET environment variable and, if it is set,
+//  start counting metadata.
+//
+void
+__sc_md_init (void) {
+  const char * budget = getenv ("SAFECODE_METADATA_BUDGET");
+  if (!budget || !*budget || __sc_md_enabled)
+    return;
+
+  const char * p = budget;
+  while (*p) {
+    //
+    // Find the kind of metadata to which this entry applies.  Entries that
+    // name a kind used by another run-time are skipped.
+    //
+    long * limit = &__sc_md_total_budget;
+    const char * equals = strchr (p, '=');
+    const char * comma = strchr (p, ',');
+    if (equals && (!comma || equals < comma)) {
+      size_t len = equals - p;
+      limit = 0;
+      if ((len == 5) && (strncmp (p, "total", 5) == 0))
+        limit = &__sc_md_total_budget;
+      for (unsigned kind = 0; kind < SC_MD_NUM_KINDS; ++kind) {
+        if ((strlen (KindNames[kind]) == len) &&
+            (strncmp (p, KindNames[kind], len) == 0))
+          limit = &__sc_md_budget[kind];
+      }
+      p = equals + 1;
+    }
+
+    long size = parseSize (p, &p);
+    if (limit)
+      *limit = size;
+
+    p = strchr (p, ',');
+    if (!p)
+      break;
+    ++p;
+  }
+
+  __sc_md_enabled = 1;
+}
+
+//
+// Function: __sc_md_exceeded()
+//
+// Description:
+//  Record that a budget has been exceeded so that the run-time degrades the
+//  handling of the affected kinds of metadata.  A message is printed the first
+//  time that each budget is exceeded.
+//
+// Inputs:
+//  kind - The kind of metadata whose allocation exceeded a budget.
+//
+void
+__sc_md_exceeded (enum SCMetadataKind kind) {
+  unsigned bits = 0;
+  const char * name = KindNames[kind];
+  const char * action = KindActions[kind];
+  long limit = __sc_md_budget[kind];
+
+  if (__sc_md_budget[kind] && (__sc_md_bytes[kind] > __sc_md_budget[kind]))
+    bits = 1u << kind;
+  if (__sc_md_total_budget && (__sc_md_total > __sc_md_total_budget)) {
+    bits = (1u << SC_MD_NUM_KINDS) - 1;
+    name = "total";
+    action = "all metadata is degraded";
+    limit = __sc_md_total_budget;
+  }
+
+  //
+  // Only report the budgets that have not been exceeded before.
+  //
+  unsigned old = __sync_fetch_and_or (&__sc_md_degraded, bits);
+  if ((old | bits) == old)
+    return;
+
+  //
+  // Use a stack buffer and write() so that no memory is allocated while the
+  // run-time is in the middle of updating its metadata.
+  //
+  char buf[160];
+  int len = snprintf (buf, sizeof (buf),
+                      "SAFECode: %s metadata exceeded its budget of %ld bytes;"
+                      " %s\n", name, limit, action);
+  if (len > 0)
+    write (2, buf, ((size_t) len < sizeof (buf)) ? len : sizeof (buf) - 1);
+}
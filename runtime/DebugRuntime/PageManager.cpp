@@ -21,6 +21,7 @@
 #include "../include/MMAPSupport.h"
 #include "../include/HashExtras.h"
 #include "../include/BitmapAllocator.h"
+#include "safecode/Runtime/MetadataBudget.h"
 
 #include <unistd.h>
 
@@ -150,6 +151,7 @@ RemapPages (void * va, unsigned length) {
     fprintf(stderr, " RemapPage:160: remap succeeded to addr 0x%08x\n", (unsigned)target_addr);
     fflush(stderr);
   }
+  sc_md_charge (SC_MD_SHADOW_PAGES, byteToMap);
   va = (void *) target_addr;
   return va;
  
@@ -196,6 +198,8 @@ fflush (stderr);
   target_addr = mremap (source_addr, 0, map_length, MREMAP_MAYMOVE);
   if (target_addr == MAP_FAILED) {
     perror ("RemapPage: Failed to create shadow page: ");
+  } else {
+    sc_md_charge (SC_MD_SHADOW_PAGES, map_length);
   }
 
 #if 0
@@ -318,6 +322,52 @@ RemapObject (void * va, unsigned length) {
   return p;
 }
 
+//
+// Function: shadowsDegraded()
+//
+// Description:
+//  Determine whether shadow pages should no longer be made because a metadata
+//  budget was exceeded.  The first time this happens, the cache of shadow
+//  pages made ahead of time is released.
+//
+bool
+shadowsDegraded (void) {
+  if (!(sc_md_degraded (SC_MD_SHADOW_PAGES) ||
+        sc_md_degraded (SC_MD_SPLAY_NODES) ||
+        sc_md_degraded (SC_MD_DEBUG_INFO)))
+    return false;
+
+  static bool released = false;
+  if (!released) {
+    released = true;
+    ReleaseShadowCache ();
+  }
+  return true;
+}
+
+//
+// Function: ReleaseShadowCache()
+//
+// Description:
+//  Unmap the shadow pages made ahead of time by AllocatePage() that are not
+//  in use and forget about the rest.  Shadow pages holding objects stay
+//  mapped.
+//
+void
+ReleaseShadowCache (void) {
+  hash_map<void *,std::vector<struct ShadowInfo> >::iterator i;
+  for (i = ShadowPages().begin(); i != ShadowPages().end(); ++i) {
+    std::vector<struct ShadowInfo> & Shadows = i->second;
+    for (unsigned j = 0; j < Shadows.size(); ++j) {
+      if (Shadows[j].ShadowStart && (Shadows[j].InUse == 0)) {
+        munmap (Shadows[j].ShadowStart, PageSize);
+        sc_md_release (SC_MD_SHADOW_PAGES, PageSize);
+      }
+    }
+  }
+  ShadowPages().clear();
+}
+
 /// AllocatePage - This function returns a chunk of memory with size and
 /// alignment specified by PageSize.
 void *AllocatePage() {
@@ -338,7 +388,7 @@ void *AllocatePage() {
   }
 
   // Create several shadow mappings of all the pages
-  if (ConfigData.RemapObjects) {
+  if (ConfigData.RemapObjects && !shadowsDegraded()) {
     char * NewShadows[NumShadows];
     for (unsigned i=0; i < NumShadows; ++i) {
       NewShadows[i] = (char *) RemapPages (Ptr, NumToAllocate * PageSize);
@@ -348,7 +398,7 @@ void *AllocatePage() {
     for (unsigned i = 0; i != NumToAllocate; ++i) {
       char * PagePtr = Ptr+i*PageSize;
       std::vector<struct ShadowInfo> & Shadows = ShadowPages()[(void*)PagePtr];
-      Shadows.reserve(NumShadows);
+      Shadows.resize(NumShadows);
       for (unsigned j=0; j < NumShadows; ++j) {
         Shadows[j].ShadowStart = NewShadows[j]+(i*PageSize);
         Shadows[j].InUse       = 0;
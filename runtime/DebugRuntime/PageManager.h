@@ -38,5 +38,13 @@ void ProtectShadowPage(void * beginPage, unsigned NumPPages);
 //                       resume execution
 void UnprotectShadowPage(void * beginPage, unsigned NumPPage);
 
+// shadowsDegraded - Returns true if a metadata budget was exceeded and shadow
+//                   pages should no longer be made for new objects
+bool shadowsDegraded(void);
+
+// ReleaseShadowCache - Unmaps the shadow pages that AllocatePage() made ahead
+//                      of time and that are not in use
+void ReleaseShadowCache(void);
+
 }
 #endif
@@ -28,6 +28,49 @@ extern DebugPoolTy dummyPool;
 // Splay tree of external objects
 extern RangeSplaySet<> * ExternalObjects;
 
+// Find the bounds of a heap object allocated by the system's allocator
+extern bool findExternalHeapObject (void * p, void *& start, void *& end);
+
+// Non-zero until the program's arguments and environment are registered
+extern int ArgvPending;
+
+// Register the program's arguments and environment if p may point into them
+extern bool registerArgvObjects (void * p);
+
+//
+// Function: findExternalObject()
+//
+// Description:
+//  Find the bounds of an object registered as an external object.  The
+//  strings of argv and environ are only registered when a pointer that may
+//  point into them is not found, so that programs that never look at them do
+//  not pay for registering them at startup.
+//
+static inline bool
+findExternalObject (void * p, void *& start, void *& end) {
+  if (ExternalObjects->find (p, start, end))
+    return true;
+  if (__builtin_expect (__atomic_load_n (&ArgvPending, __ATOMIC_RELAXED), 0) &&
+      registerArgvObjects (p))
+    return ExternalObjects->find (p, start, end);
+  return false;
+}
+
+//
+// Function: findPoolObject()
+//
+// Description:
+//  Find the bounds of an object registered with the pool.  Heap objects that
+//  are single nodes of the pool's slabs are not in the splay tree; their
+//  bounds are computed from their address instead.
+//
+static inline bool
+findPoolObject (DebugPoolTy * Pool, void * p, void *& start, void *& end) {
+  if (__pa_bitmap_nodebounds (Pool, p, &start, &end))
+    return true;
+  return Pool->Objects.find (p, start, end);
+}
+
 // Records Out of Bounds pointer rewrites; also used by OOB rewrites for
 // exactcheck() calls
 extern DebugPoolTy OOBPool;
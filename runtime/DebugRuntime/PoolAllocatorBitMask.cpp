@@ -42,6 +42,8 @@
 
 #include "../include/CWE.h"
 #include "../include/DebugRuntime.h"
+#include "safecode/Runtime/MetadataBudget.h"
+#include "safecode/Runtime/Telemetry.h"
 
 #include <cstring>
 #include <iostream>
@@ -67,6 +69,10 @@
 
 #include <pthread.h>
 
+#if defined(__linux__) && defined(__GLIBC__)
+#include <sys/auxv.h>
+#endif
+
 #define TAG unsigned tag
 
 #define DEBUG(x)
@@ -95,9 +101,20 @@ unsigned StopOnError = 0;
 
 using namespace llvm;
 
-// Map between call site tags and allocation sequence numbers
-std::map<unsigned,unsigned> * allocSeqMap;
-std::map<unsigned,unsigned> * freeSeqMap;
+// Maps between call site tags and allocation and deallocation sequence
+// numbers.  They are created on first use and never destroyed, since objects
+// may still be freed by destructors run at exit.
+static std::map<unsigned,unsigned> & allocSeqMap (void) {
+  static std::map<unsigned,unsigned> * realAllocSeqMap =
+    new std::map<unsigned,unsigned>;
+  return *realAllocSeqMap;
+}
+
+static std::map<unsigned,unsigned> & freeSeqMap (void) {
+  static std::map<unsigned,unsigned> * realFreeSeqMap =
+    new std::map<unsigned,unsigned>;
+  return *realFreeSeqMap;
+}
 
 /// UNUSED in production version
 FILE * ReportLog = 0;
@@ -134,6 +151,12 @@ static PDebugMetaData createPtrMetaData (unsigned,
 //  configures the various run-time options for SAFECode and performs other
 //  initialization tasks.
 //
+//  Only what is needed by every program is done here.  The range of memory
+//  for rewritten Out of Bounds pointers is reserved by the first rewrite, the
+//  sequence number maps are created by the first registration, and the argv
+//  and environ strings found by poolargvregister() are registered by the
+//  first lookup that may need them.
+//
 // Inputs:
 //  Dangling   - Set to non-zero to enable dangling pointer detection.
 //  RewriteOOB - Set to non-zero to enable Out-Of-Bounds pointer rewriting.
@@ -162,32 +185,6 @@ pool_init_runtime (unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
   ConfigData.StrictIndexing = !(RewriteOOB);
   StopOnError = Terminate;
 
-  //
-  // Allocate a range of memory for rewrite pointers.
-  //
-  const unsigned invalidsize = 1 * 1024 * 1024 * 1024;
-  void * Addr = mmap (0, invalidsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
-  if (Addr == MAP_FAILED) {
-     perror ("mmap:");
-     fflush (stdout);
-     fflush (stderr);
-     assert(0 && "valloc failed\n");
-  }
-  //memset (Addr, 0x00, invalidsize);
-#if !defined(__linux__)
-  madvise (Addr, invalidsize, MADV_FREE);
-#else
-  madvise (Addr, invalidsize, MADV_DONTNEED);
-#endif
-  InvalidLower = (uintptr_t) Addr;
-  InvalidUpper = (uintptr_t) Addr + invalidsize;
-
-  if (logregs) {
-    fprintf (stderr, "OOB Area: %p - %p\n", (void *) InvalidLower,
-                                            (void *) InvalidUpper);
-    fflush (stderr);
-  }
-
   //
   // Leave initialization of the Report logfile to the reporting routines.
   // The libc stdio functions may have not been initialized by this point, so
@@ -205,15 +202,19 @@ pool_init_runtime (unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
   }
 
   //
-  // Initialize the dummy pool.
+  // Enable the statistics counters if the user asked for them.
   //
-  __sc_dbg_poolinit(&dummyPool, 1, 0);
+  __sc_stats_init ("debug");
+
+  //
+  // Start counting metadata if the user set any budgets for it.
+  //
+  __sc_md_init ();
 
   //
-  // Initialize the sequence numbers used for debugging.
+  // Initialize the dummy pool.
   //
-  allocSeqMap = new std::map<unsigned,unsigned>;
-  freeSeqMap = new std::map<unsigned,unsigned>;
+  __sc_dbg_poolinit(&dummyPool, 1, 0);
 
   //
   // Initialize the signal handlers for catching errors.
@@ -322,11 +323,123 @@ __sc_dbg_pooldestroy(DebugPoolTy * Pool) {
 
 extern char ** environ;
 
+// The program's arguments and environment, which are registered as external
+// objects by the first lookup of a pointer that may point into them
+int llvm::ArgvPending = 0;
+
+static int ArgCount = 0;
+static char ** ArgVector = 0;
+static unsigned EnvCount = 0;
+static char ** EnvVector = 0;
+
+// Range of addresses that may hold the arguments, the environment, and the
+// arrays pointing to them
+static uintptr_t ArgvLower = 0;
+static uintptr_t ArgvUpper = 0;
+
+// Lock held while the arguments and environment are registered
+static pthread_mutex_t ArgvLock = PTHREAD_MUTEX_INITIALIZER;
+
+//
+// Function: getStackTop()
+//
+// Description:
+//  Find an address above the strings of the arguments and environment of the
+//  program without looking at the strings.
+//
+// Return value:
+//  The first address above the initial stack of the program if it can be
+//  found, and the highest address otherwise.
+//
+static uintptr_t
+getStackTop (void) {
+#if defined(__linux__) && defined(__GLIBC__)
+  //
+  // The kernel copies the name of the executable above the argv and environ
+  // strings, just below the top of the stack.
+  //
+  if (uintptr_t Name = getauxval (AT_EXECFN)) {
+    uintptr_t PageSize = getpagesize ();
+    return (Name + strlen ((char *) Name) + PageSize) & ~(PageSize - 1);
+  }
+#endif
+  return ~((uintptr_t) 0);
+}
+
+//
+// Function: registerArgvObjects()
+//
+// Description:
+//  Register the argv and environ strings, and the arrays that point to them,
+//  in the external object pool if they have not been registered yet and the
+//  specified pointer may point into one of them.
+//
+// Return value:
+//  true  - The objects were registered; the caller should look again.
+//  false - The pointer cannot point into the arguments or environment.
+//
+bool
+llvm::registerArgvObjects (void * p) {
+  if (!__atomic_load_n (&ArgvPending, __ATOMIC_ACQUIRE))
+    return false;
+
+  if (((uintptr_t) p < ArgvLower) || ((uintptr_t) p >= ArgvUpper))
+    return false;
+
+  //
+  // Another thread may be registering the objects; the lookups of other
+  // threads must not see ArgvPending cleared until all of them are inserted.
+  //
+  pthread_mutex_lock (&ArgvLock);
+  if (ArgvPending) {
+    for (unsigned index = 0; index < ArgCount + EnvCount; ++index) {
+      char * str = (index < (unsigned) ArgCount) ? ArgVector[index]
+                                                 : EnvVector[index - ArgCount];
+
+      //
+      // The environment may have been changed since the program started.
+      // Entries may have been removed or replaced by strings that do not
+      // belong to the initial stack.
+      //
+      if (!str)
+        continue;
+      if (((uintptr_t) str < ArgvLower) || ((uintptr_t) str >= ArgvUpper))
+        continue;
+
+      size_t len = strlen (str);
+      if (logregs) {
+        fprintf (stderr, "poolargvregister: %s%p %u: %s\n",
+                 (index < (unsigned) ArgCount) ? "" : "env: ", str,
+                 (unsigned) len, str);
+        fflush (stderr);
+      }
+      ExternalObjects->insert(str, str + len);
+    }
+
+    //
+    // Register the actual argv array as well.  Note that the transform can
+    // do this, but it's easier to implement it here, and I doubt accessing
+    // argv strings is performance critical.
+    //
+    // Note that the argv array is supposed to end with a NULL pointer element.
+    //
+    ExternalObjects->insert(ArgVector,
+                            ((unsigned char *)(&(ArgVector[ArgCount+1]))) - 1);
+    ExternalObjects->insert(EnvVector,
+                            ((unsigned char *)(&(EnvVector[EnvCount+1]))) - 1);
+    __atomic_store_n (&ArgvPending, 0, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock (&ArgvLock);
+  return true;
+}
+
 //
 // Function: poolargvregister()
 //
 // Description:
-//  Register all of the argv strings in the external object pool.
+//  Record where the argv and environ arrays are.  Their strings and the
+//  arrays themselves are registered in the external object pool by the first
+//  lookup that needs them.
 //
 void *
 poolargvregister (int argc, char ** argv) {
@@ -336,38 +449,23 @@ poolargvregister (int argc, char ** argv) {
     fflush (stderr);
   }
 
-  for (int index=0; index < argc; ++index) {
-    if (logregs) {
-      fprintf (stderr, "poolargvregister: %p %u: %s\n", argv[index],
-               (unsigned)strlen(argv[index]), argv[index]);
-      fflush (stderr);
-    }
-    ExternalObjects->insert(argv[index], argv[index] + strlen (argv[index]));
-  }
+  unsigned numEnvs = 0;
+  while (environ[numEnvs])
+    ++numEnvs;
 
-  //
-  // Register the actual argv array as well.  Note that the transform can
-  // do this, but it's easier to implement it here, and I doubt accessing argv
-  // strings is performance critical.
-  //
-  // Note that the argv array is supposed to end with a NULL pointer element.
-  //
-  ExternalObjects->insert(argv, ((unsigned char *)(&(argv[argc+1]))) - 1);
+  ArgCount = argc;
+  ArgVector = argv;
+  EnvCount = numEnvs;
+  EnvVector = environ;
 
   //
-  // Register the environment strings and the array that points to them.
+  // The strings lie between the arrays pointing to them and the top of the
+  // stack.
   //
-  unsigned numEnvs;
-  for (unsigned numEnvs = 0; environ[numEnvs]; ++numEnvs) {
-    char * envstr = environ[numEnvs];
-    if (logregs) {
-      fprintf (stderr, "poolargvregister: env: %p %u: %s\n", envstr,
-               (unsigned)strlen(envstr), envstr);
-      fflush (stderr);
-    }
-    ExternalObjects->insert(envstr, envstr + strlen (envstr));
-  }
-  ExternalObjects->insert(environ, ((unsigned char *)(environ + numEnvs)) - 1);
+  ArgvLower = ((uintptr_t) argv < (uintptr_t) environ) ? (uintptr_t) argv
+                                                       : (uintptr_t) environ;
+  ArgvUpper = getStackTop ();
+  __atomic_store_n (&ArgvPending, 1, __ATOMIC_RELEASE);
 
   //
   // Register errno for kicks and giggles.
@@ -378,6 +476,58 @@ poolargvregister (int argc, char ** argv) {
   return argv;
 }
 
+//
+// Function: flushObjectCache()
+//
+// Description:
+//  Remove the bounds of the object containing the specified pointer from the
+//  pool's cache of recently used objects.  This must be done whenever the
+//  bounds of an object change or the object is unregistered.
+//
+static inline void
+flushObjectCache (DebugPoolTy *Pool, void * ptr) {
+  if (!Pool)
+    return;
+
+  if ((Pool->objectCache[0].lower <= ptr) &&
+      (ptr <= Pool->objectCache[0].upper))
+    Pool->objectCache[0].lower = Pool->objectCache[0].upper = 0;
+
+  if ((Pool->objectCache[1].lower <= ptr) &&
+      (ptr <= Pool->objectCache[1].upper))
+    Pool->objectCache[1].lower = Pool->objectCache[1].upper = 0;
+}
+
+//
+// Function: _internal_poolresize()
+//
+// Description:
+//  Change the size of a registered heap object that did not move, such as one
+//  reallocated in place, without removing it from the splay trees and
+//  inserting it again.
+//
+// Return value:
+//  true  - The object was resized.
+//  false - No registered object starts at allocaptr, or the new bounds would
+//          overlap another object.  The caller must unregister the object and
+//          register it again.
+//
+static inline bool
+_internal_poolresize (DebugPoolTy *Pool, void * allocaptr, unsigned NumBytes) {
+  RangeSplaySet<> * SPTree = (Pool ? &(Pool->Objects) : ExternalObjects);
+  void * end = (char *) allocaptr + NumBytes - 1;
+  if (!SPTree->resize (allocaptr, end))
+    return false;
+
+  //
+  // Debug information is only recorded for objects registered with the debug
+  // functions, so it is fine if there is none.
+  //
+  dummyPool.DPTree.resize (allocaptr, end);
+  flushObjectCache (Pool, allocaptr);
+  return true;
+}
+
 //
 // Function: poolregister_debug()
 //
@@ -397,6 +547,8 @@ _internal_poolregister (DebugPoolTy *Pool,
                         const char * SourceFilep,
                         unsigned lineno,
                         allocType allocationType) {
+  SC_STAT (SC_STAT_REGISTRATIONS);
+
   // Do some initial casting for type goodness
   const char * SourceFile = (const char *)(SourceFilep);
 
@@ -437,6 +589,19 @@ _internal_poolregister (DebugPoolTy *Pool,
   if (!allocaptr)
     return;
 
+  //
+  // Heap objects that were allocated as a single node of one of the pool's
+  // slabs are found from their address by the checks (see
+  // __pa_bitmap_nodebounds()), so they are not added to the splay tree.
+  //
+  if ((allocationType == Heap) && Pool && (NumBytes <= Pool->NodeSize)) {
+    void * start;
+    void * end;
+    if (__pa_bitmap_nodebounds (Pool, allocaptr, &start, &end) &&
+        (start == allocaptr))
+      return;
+  }
+
   //
   // If there was no pool specified, use the splay tree associated with
   // externally allocated objects.
@@ -489,6 +654,11 @@ _internal_poolregister (DebugPoolTy *Pool,
       case Heap: {
         void * start;
         void * end;
+        // An object that starts at the same address can simply be resized
+        if (SPTree->resize (allocaptr, (char*) allocaptr + NumBytes - 1)) {
+          flushObjectCache (Pool, allocaptr);
+          break;
+        }
         SPTree->find (allocaptr, start, end);
         SPTree->remove (start);
         SPTree->insert(allocaptr, (char*) allocaptr + NumBytes - 1);
@@ -586,7 +756,7 @@ pool_register_debug (DebugPoolTy *Pool,
   // Generate a generation number for this object registration.  We only do
   // this for heap allocations.
   //
-  unsigned allocID = ((*allocSeqMap)[tag] += 1);
+  unsigned allocID = (allocSeqMap()[tag] += 1);
 
   //
   // Create the meta data object containing the debug information for this
@@ -630,6 +800,11 @@ pool_reregister (DebugPoolTy *Pool,
     // memory; treat it as such.
     //
     pool_unregister (Pool, oldptr);
+  } else if ((newptr == oldptr) &&
+             (_internal_poolresize (Pool, oldptr, NumBytes))) {
+    //
+    // The object was resized in place; its registration has been updated.
+    //
   } else {
     //
     // Otherwise, this is a true reallocation.  Unregister the old memory and
@@ -661,6 +836,12 @@ pool_reregister_debug (DebugPoolTy *Pool,
     // memory; treat it as such.
     //
     pool_unregister_debug (Pool, oldptr, tag, SourceFilep, lineno);
+  } else if ((newptr == oldptr) &&
+             (_internal_poolresize (Pool, oldptr, NumBytes))) {
+    //
+    // The object was resized in place; its registration and debug information
+    // have been updated.
+    //
   } else {
     //
     // Otherwise, this is a true reallocation.  Unregister the old memory and
@@ -1000,9 +1181,9 @@ poolcheck_free (DebugPoolTy *Pool, void * ptr) {
   void * ObjStart = 0;
   void * ObjEnd = 0;
   bool found = false;
-  if (Pool) found = Pool->Objects.find (ptr, ObjStart, ObjEnd);
+  if (Pool) found = findPoolObject (Pool, ptr, ObjStart, ObjEnd);
   if (!found)
-    found = ExternalObjects->find (ptr, ObjStart, ObjEnd);
+    found = findExternalObject (ptr, ObjStart, ObjEnd);
 
   //
   // This may be a singleton object, so search for it within the pool slabs
@@ -1074,9 +1255,9 @@ poolcheck_freeui (DebugPoolTy *Pool, void * ptr) {
   void * ObjStart = 0;
   void * ObjEnd = 0;
   bool found = false;
-  if (Pool) found = Pool->Objects.find (ptr, ObjStart, ObjEnd);
+  if (Pool) found = findPoolObject (Pool, ptr, ObjStart, ObjEnd);
   if (!found)
-    found = ExternalObjects->find (ptr, ObjStart, ObjEnd);
+    found = findExternalObject (ptr, ObjStart, ObjEnd);
 
   //
   // This may be a singleton object, so search for it within the pool slabs
@@ -1136,7 +1317,7 @@ updateMDOnFree (DebugPoolTy *Pool,
   //
   // Increment the ID number for this deallocation.
   //
-  unsigned freeID = ((*freeSeqMap)[tag] += 1);
+  unsigned freeID = (freeSeqMap()[tag] += 1);
 
   //
   // Ignore frees of NULL pointers.  These are okay.
@@ -1182,12 +1363,24 @@ updateMDOnFree (DebugPoolTy *Pool,
   //
   // Also, always remove stack objects.  Their virtual addresses are recycled,
   // and so we don't want to try to re-look up their old start and end values.
+  // The same goes for heap objects that were not given a shadow, which
+  // happens once a metadata budget has been exceeded.
   //
-  if ((Type == Stack) || (!(ConfigData.RemapObjects))) {
+  bool Shadowed = (debugmetadataptr->canonAddr != allocaptr);
+  if ((Type == Stack) || (!(ConfigData.RemapObjects)) || (!Shadowed)) {
     free (debugmetadataptr);
+    sc_md_release (SC_MD_DEBUG_INFO, sizeof (DebugMetaData));
     dummyPool.DPTree.remove (allocaptr);
   }
 
+  //
+  // The shadow of a freed object is never reused, and the object's canonical
+  // address is kept in its debug information, so the entry in the shadow map
+  // is no longer needed.
+  //
+  if (Shadowed)
+    ShadowMap().remove (allocaptr);
+
   return;
 }
 
@@ -1219,6 +1412,8 @@ _internal_poolunregister (DebugPoolTy *Pool,
                           unsigned tag,
                           const char * SourceFilep,
                           unsigned lineno) {
+  SC_STAT (SC_STAT_UNREGISTRATIONS);
+
   if (logregs) {
     fprintf (stderr, "pool_unregister: Start: %p: %s %d\n", allocaptr, SourceFilep, lineno);
     fflush (stderr);
@@ -1243,15 +1438,7 @@ _internal_poolunregister (DebugPoolTy *Pool,
   //
   // Eject the pointer from the pool's cache if necessary.
   //
-  if (Pool) {
-    if ((Pool->objectCache[0].lower <= allocaptr) &&
-        (allocaptr <= Pool->objectCache[0].upper))
-      Pool->objectCache[0].lower = Pool->objectCache[0].upper = 0;
-
-    if ((Pool->objectCache[1].lower <= allocaptr) &&
-        (allocaptr <= Pool->objectCache[1].upper))
-      Pool->objectCache[1].lower = Pool->objectCache[1].upper = 0;
-  }
+  flushObjectCache (Pool, allocaptr);
 
   //
   // Generate some debugging output.
@@ -1371,6 +1558,7 @@ createPtrMetaData (unsigned AllocID,
   //  allocation.  We need to use some internal allocation routine.
   //
   PDebugMetaData ret = (PDebugMetaData) malloc (sizeof(DebugMetaData));
+  sc_md_charge (SC_MD_DEBUG_INFO, sizeof (DebugMetaData));
   ret->allocID = AllocID;
   ret->freeID = FreeID;
   ret->allocPC = AllocPC;
@@ -1637,6 +1825,13 @@ getCanonicalPtr (void * ShadowPtr) {
 //
 void *
 pool_shadow (void * CanonPtr, unsigned NumBytes) {
+  //
+  // If a metadata budget has been exceeded, stop making shadows for new
+  // objects.
+  //
+  if (shadowsDegraded ())
+    return CanonPtr;
+
   //
   // Calculate the offset of the object from the beginning of the page.
   //
@@ -1706,6 +1901,14 @@ pool_unshadow (void * Node) {
     return Node;
   }
 
+  //
+  // If the object was allocated after shadows were disabled, it is its own
+  // canonical object and must not be protected.
+  //
+  if (debugmetadataptr->canonAddr == Node) {
+    return Node;
+  }
+
   if (logregs) {
     fprintf (stderr, "pool_unshadow: Start: %p\n", Node);
     fflush (stderr);
@@ -1822,10 +2025,17 @@ poolrealloc (DebugPoolTy *Pool, void *Node, unsigned NumBytes) {
   // simply fail the allocation.
   //
   void * S, * end;
-  if ((!(Pool->Objects.find (Node, S, end))) || (S != Node)) {
+  if ((!(findPoolObject (Pool, Node, S, end))) || (S != Node)) {
     return 0;
   }
 
+  //
+  // Large arrays can often grow or shrink within their pages.  The caller
+  // updates the registration of the object with pool_reregister().
+  //
+  if (__pa_bitmap_poolresize (Pool, Node, NumBytes))
+    return Node;
+
   //
   // Allocate a new object.  If we fail, return NULL.
   //
@@ -1892,10 +2102,19 @@ __sc_dbg_poolrealloc_debug (DebugPoolTy *Pool,
   // simply fail the allocation.
   //
   void * S, * end;
-  if ((!(Pool->Objects.find (Node, S, end))) || (S != Node)) {
+  if ((!(findPoolObject (Pool, Node, S, end))) || (S != Node)) {
     return 0;
   }
 
+  //
+  // Large arrays can often grow or shrink within their pages.  Shadowed
+  // objects cannot, since their shadow pages were sized for the old object.
+  //
+  if (!ConfigData.RemapObjects &&
+      __pa_bitmap_poolresize (Pool, Node, NumBytes) &&
+      _internal_poolresize (Pool, Node, NumBytes))
+    return Node;
+
   //
   // Allocate a new object.  If we fail, return NULL.
   //
@@ -593,6 +593,7 @@ internal_printf(const options_t options,
 #define MAXEXPDIG 32
   char expstr[MAXEXPDIG+2]; // buffer for exponent string: e+ZZZ
   char *dtoaresult = 0;
+  char fpbuf[48];   // digits from the allocation-free conversion
 #endif
 
   uintmax_t _umax;              // integer arguments %[diouxX]
@@ -1181,9 +1182,20 @@ fp_begin:
         prec = DEFPREC;
       if (dtoaresult)
         __freedtoa(dtoaresult);
+      dtoaresult = 0;
       if (flags & LONGDBL)
       {
         fparg.ldbl = GETARG(long double);
+        //
+        // Try the conversion that writes into fpbuf first; it handles most
+        // finite values without allocating memory.
+        //
+        if (__fast_ldtoa(&fparg.ldbl, expchar ? 2 : 3, prec, &expt, &signflag,
+                         fpbuf, sizeof (fpbuf), &dtoaend))
+        {
+          cp = fpbuf;
+          goto fp_common;
+        }
         cp = dtoaresult =
         __ldtoa(&fparg.ldbl, expchar ? 2 : 3, prec, &expt, &signflag, &dtoaend);
         if (dtoaresult == 0)
@@ -1195,6 +1207,12 @@ fp_begin:
       else
       {
         fparg.dbl = GETARG(double);
+        if (__fast_dtoa(fparg.dbl, expchar ? 2 : 3, prec, &expt, &signflag,
+                        fpbuf, sizeof (fpbuf), &dtoaend))
+        {
+          cp = fpbuf;
+          goto fp_common;
+        }
         //
         // There is very sparse documentation for this function call. I'll
         // attempt to explain what is going on.
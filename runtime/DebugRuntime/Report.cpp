@@ -13,6 +13,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "../include/Report.h"
+#include "safecode/Runtime/Telemetry.h"
 
 #include <iostream>
 #include <cstdlib>
@@ -110,6 +111,8 @@ ViolationInfo::print(std::ostream & OS) const {
 
 void
 ReportMemoryViolation(const ViolationInfo *v) {
+  SC_STAT (SC_STAT_VIOLATIONS);
+
   // Flag for whether to terminate when an error is detected.
   extern unsigned StopOnError;
 
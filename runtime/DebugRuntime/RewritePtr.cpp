@@ -19,10 +19,14 @@
 #include "llvm/ADT/DenseMap.h"
 
 #include "../include/DebugRuntime.h"
+#include "safecode/Runtime/MetadataBudget.h"
+#include "safecode/Runtime/Telemetry.h"
 
 #include <cstdio>
 #include <map>
 
+#include <sys/mman.h>
+
 extern FILE * ReportLog;
 using namespace llvm; 
 
@@ -59,6 +63,53 @@ llvm::DenseMap<void *, std::pair<void *, void * > > & RewrittenObjs (void) {
   return intRewrittenObjs;
 }
 
+// Approximate number of bytes added to the maps above by one rewrite: a node
+// of the std::map and an entry in each DenseMap, which keep at least half of
+// their buckets empty.  The OOB splay tree nodes are counted separately.
+static const size_t RewriteEntryBytes = 6 * sizeof (void *) +
+                                        2 * (3 * sizeof (void *) +
+                                             sizeof (const char *) +
+                                             sizeof (unsigned) +
+                                             2 * sizeof (void *));
+
+//
+// Function: reserveRewriteRange()
+//
+// Description:
+//  Reserve the range of addresses used for rewritten Out of Bounds pointers.
+//  This is done by the first rewrite so that programs that never rewrite a
+//  pointer do not pay for it.  The reservation is private and does not
+//  reserve swap, so it costs nothing until its pages are touched.
+//
+// Return value:
+//  true  - InvalidLower and InvalidUpper now describe the range.
+//  false - The range could not be reserved.
+//
+static bool
+reserveRewriteRange (void) {
+  const size_t invalidsize = 1 * 1024 * 1024 * 1024;
+  int flags = MAP_PRIVATE | MAP_ANON;
+#ifdef MAP_NORESERVE
+  flags |= MAP_NORESERVE;
+#endif
+  void * Addr = mmap (0, invalidsize, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (Addr == MAP_FAILED) {
+    perror ("mmap:");
+    fflush (stderr);
+    return false;
+  }
+
+  InvalidLower = (uintptr_t) Addr;
+  InvalidUpper = (uintptr_t) Addr + invalidsize;
+
+  if (logregs) {
+    fprintf (stderr, "OOB Area: %p - %p\n", (void *) InvalidLower,
+                                            (void *) InvalidUpper);
+    fflush (stderr);
+  }
+  return true;
+}
+
 //
 // Function: rewrite_ptr()
 //
@@ -93,10 +144,23 @@ rewrite_ptr (DebugPoolTy * Pool,
     return const_cast<void*>(RewrittenPointers()[p]);
   }
 
+  SC_STAT (SC_STAT_REWRITES);
+
+  //
+  // If the rewrite maps have exceeded their budget, leave the pointer alone
+  // as we do when we run out of rewrite pointers.
+  //
+  if (sc_md_degraded (SC_MD_REWRITE_MAPS))
+    return const_cast<void*>(p);
+
   //
   // Calculate a new rewrite pointer.
   //
-  if (invalidptr == 0) invalidptr = (unsigned char*)InvalidLower;
+  if (invalidptr == 0) {
+    if (!reserveRewriteRange ())
+      return const_cast<void*>(p);
+    invalidptr = (unsigned char*)InvalidLower;
+  }
   ++invalidptr;
 
   //
@@ -139,6 +203,7 @@ rewrite_ptr (DebugPoolTy * Pool,
   RewriteLineno()[invalidptr] = lineno;
   RewrittenPointers()[p] = invalidptr;
   RewrittenObjs()[invalidptr] = std::make_pair(ObjStart, ObjEnd);
+  sc_md_charge (SC_MD_REWRITE_MAPS, RewriteEntryBytes);
   return invalidptr;
 }
 
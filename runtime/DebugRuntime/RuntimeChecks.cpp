@@ -36,6 +36,7 @@
 
 #include "../include/CWE.h"
 #include "../include/DebugRuntime.h"
+#include "safecode/Runtime/Telemetry.h"
 
 #include <errno.h>
 
@@ -69,6 +70,22 @@ updateCache (DebugPoolTy * Pool, void * Start, void * End) {
   return;
 }
 
+//
+// Function: countSplayLookup()
+//
+// Description:
+//  Record a lookup of a pool's object cache that missed and went on to search
+//  the pool's splay tree.
+//
+static inline void
+countSplayLookup (DebugPoolTy * Pool) {
+  if (__builtin_expect (__sc_stats_enabled, 0)) {
+    sc_stat_add (SC_STAT_CACHE_MISSES, 1);
+    sc_stat_add (SC_STAT_SPLAY_LOOKUPS, 1);
+    sc_stat_add (SC_STAT_SPLAY_DEPTH, Pool->Objects.depth());
+  }
+}
+
 //
 // Provide dummy implementations of the common infrastructure run-time checks
 // to appease libLTO linking on Mac OS X.
@@ -137,11 +154,15 @@ _barebone_poolcheck (DebugPoolTy * Pool, void * Node, unsigned length,
   bool found = false;
   unsigned char index = isInCache (Pool, Node);
   if (index < 2) {
+    SC_STAT (SC_STAT_CACHE_HITS);
     found = true;
     ObjStart = Pool->objectCache[index].lower;
     ObjEnd = Pool->objectCache[index].upper; 
+  } else if (__pa_bitmap_nodebounds (Pool, Node, &ObjStart, &ObjEnd)) {
+    found = true;
   } else {
     found = Pool->Objects.find (Node, ObjStart, ObjEnd);
+    countSplayLookup (Pool);
   }
 
   //
@@ -184,6 +205,8 @@ poolcheck_debug (DebugPoolTy *Pool,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT (SC_STAT_LOADSTORE_CHECKS);
+
   //
   // If the memory access is zero bytes in length, don't report an error.
   // This can happen on memcpy() and memset() calls that are instrumented
@@ -218,7 +241,7 @@ poolcheck_debug (DebugPoolTy *Pool,
   //
   // Look for the object within the splay tree of external objects.
   //
-  if (ExternalObjects->find (Node, ObjStart, ObjEnd)) {
+  if (findExternalObject (Node, ObjStart, ObjEnd)) {
     if ((ObjStart <= Node) && (Node <= ObjEnd)) {
       if (!((ObjStart <= NodeEnd) && (NodeEnd <= ObjEnd))) {
         DebugViolationInfo v;
@@ -315,10 +338,11 @@ poolcheckalign_debug (DebugPoolTy *Pool, void *Node, unsigned Offset, TAG, const
   }
 
   //
-  // Look for the object in the splay of regular objects.
+  // Look for the object in the pool's slabs and then in the splay of regular
+  // objects.
   //
   if (!found)
-    found = Pool->Objects.find (Node, S, end);
+    found = findPoolObject (Pool, Node, S, end);
 
   //
   // If we can't find the object in the splay tree, try to find it in the pool
@@ -384,6 +408,8 @@ poolcheckui_debug (DebugPoolTy *Pool,
                    TAG,
                    const char * SourceFilep,
                    unsigned lineno) {
+  SC_STAT (SC_STAT_LOADSTORE_CHECKS);
+
   //
   // If the memory access is zero bytes in length, don't report an error.
   // This can happen on memcpy() and memset() calls that are instrumented
@@ -421,7 +447,8 @@ poolcheckui_debug (DebugPoolTy *Pool,
   // are stored in this splay tree.
   //
   int fs = 0;
-  if ((fs = ExternalObjects->find (Node, ObjStart, ObjEnd))) {
+  if ((fs = findExternalObject (Node, ObjStart, ObjEnd)) ||
+      (fs = findExternalHeapObject (Node, ObjStart, ObjEnd))) {
     if ((ObjStart <= Node) && (Node <= ObjEnd)) {
       if (!((ObjStart <= NodeEnd) && (NodeEnd <= ObjEnd))) {
         DebugViolationInfo v;
@@ -540,15 +567,23 @@ boundscheck_lookup (DebugPoolTy * Pool, void * & Source, void * & End ) {
     //
     unsigned char index = isInCache (Pool, Source);
     if (index < 2) {
+      SC_STAT (SC_STAT_CACHE_HITS);
       Source = Pool->objectCache[index].lower;
       End    = Pool->objectCache[index].upper;
       return true;
     }
 
     //
-    // Search the splay tree.  If we find the object, add it to the cache.
+    // Single nodes of the pool's slabs are found from their address.
+    // Otherwise, search the splay tree.  If we find the object, add it to the
+    // cache.
     //
-    if (Pool->Objects.find(Source, Source, End)) {
+    bool found = __pa_bitmap_nodebounds (Pool, Source, &Source, &End);
+    if (!found) {
+      found = Pool->Objects.find(Source, Source, End);
+      countSplayLookup (Pool);
+    }
+    if (found) {
       updateCache (Pool, Source, End);
       return true;
     }
@@ -743,11 +778,14 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
   // Attempt to look for the object in the external object splay tree.
   // Do this even if we're not tracking external allocations because a few
   // other objects without associated pools (e.g., argv pointers) may be
-  // registered in here.
+  // registered in here.  For incomplete checks, the pointer may also point
+  // into a heap object allocated by external code.
   //
   if (1) {
     void * S, * end;
-    bool fs = ExternalObjects->find(Source, S, end);
+    bool fs = findExternalObject (Source, S, end);
+    if (!fs && !CanFail)
+      fs = findExternalHeapObject (Source, S, end);
     if (fs) {
       if ((S <= Dest) && (Dest <= end)) {
         return Dest;
@@ -874,6 +912,8 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
 // the attribute should be taken once the bug is fixed.
 void * __attribute__((noinline))
 boundscheck_debug (DebugPoolTy * Pool, void * Source, void * Dest, TAG, const char * SourceFile, unsigned lineno) {
+  SC_STAT (SC_STAT_BOUNDS_CHECKS);
+
   // This code is inlined at all boundscheck() calls
 
   // Search the splay for Source and return the bounds of the object
@@ -920,6 +960,8 @@ boundscheckui_debug (DebugPoolTy * Pool,
                      void * Dest, TAG,
                      const char * SourceFile,
                      unsigned int lineno) {
+  SC_STAT (SC_STAT_BOUNDS_CHECKS);
+
   // This code is inlined at all boundscheckui calls
 
   // Search the splay for Source and return the bounds of the object
@@ -953,6 +995,46 @@ boundscheckui_debug (DebugPoolTy * Pool,
   }
 }
 
+//
+// Function: pchk_getbounds()
+//
+// Description:
+//  Find the memory object to which a pointer points and return its bounds.
+//  The compiler calls this function once for a base pointer and compares the
+//  pointers derived from it against the bounds inline, calling the regular
+//  run-time checks only when a pointer is not within them.
+//
+// Inputs:
+//  Pool - The pool in which the object should be found.
+//  Node - The pointer to the object.
+//
+// Return value:
+//  The addresses of the first and last bytes of the object are returned.  If
+//  no object is found, the start is greater than the end so that all
+//  comparisons against the bounds fail.
+//
+ObjectBounds
+pchk_getbounds (DebugPoolTy * Pool, void * Node) {
+  ObjectBounds Bounds;
+
+  //
+  // Look for the object in the pool just as the checks do, and then in the
+  // splay tree of external objects.
+  //
+  void * ObjStart = Node, * ObjEnd = 0;
+  if (boundscheck_lookup (Pool, ObjStart, ObjEnd) ||
+      ((findExternalObject (Node, ObjStart, ObjEnd)) &&
+       (ObjStart <= Node) && (Node <= ObjEnd))) {
+    Bounds.start = ObjStart;
+    Bounds.end = ObjEnd;
+    return Bounds;
+  }
+
+  Bounds.start = (void *) ~((uintptr_t) 0);
+  Bounds.end = 0;
+  return Bounds;
+}
+
 //
 // Function: funccheck()
 //
@@ -966,6 +1048,8 @@ boundscheckui_debug (DebugPoolTy * Pool,
 //
 void
 funccheck (void *f, void * targets[]) {
+  SC_STAT (SC_STAT_FUNC_CHECKS);
+
   unsigned index = 0;
   while (targets[index]) {
     if (f == targets[index])
@@ -1002,6 +1086,8 @@ funccheck_debug (void *f,
                  TAG,
                  const char * SourceFilep,
                  unsigned lineno) {
+  SC_STAT (SC_STAT_FUNC_CHECKS);
+
   unsigned index = 0;
   while (targets[index]) {
     if (f == targets[index])
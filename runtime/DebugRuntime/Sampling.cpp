@@ -0,0 +1,201 @@
+//===- Sampling.cpp - Sampled checking of duplicated functions ------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the choice between the checked and unchecked versions
+// of functions compiled with sampled checking.  See safecode/Runtime/Sampling.h
+// for how the choice is made and how the rate is set.
+//
+//===----------------------------------------------------------------------===//
+
+#include "safecode/Runtime/Sampling.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Fraction of calls checked when SAFECODE_SAMPLE_RATE is not set
+static const double DefaultRate = 0.01;
+
+// Largest period between checked calls.  This keeps the range of countdowns
+// within an unsigned int.
+static const unsigned MaxPeriod = 1u << 30;
+
+// Countdown used when sampling is off.  Threads come back to __sc_sample_hit()
+// this often so that they notice when sampling is turned on.
+static const unsigned OffCountdown = 1u << 16;
+
+__thread unsigned __sc_sample_countdown = 0;
+
+// State of the calling thread's random number generator
+static __thread uint32_t SampleSeed = 0;
+
+// The fraction of calls that are checked and the mean number of calls from one
+// checked call to the next; a period of zero means that sampling is off
+static double SampleRate = DefaultRate;
+static volatile unsigned SamplePeriod = 100;
+
+// Number of calls that ran the checked version
+static volatile unsigned long SampleHits = 0;
+
+// Non-zero once SAFECODE_SAMPLE_RATE has been read
+static volatile int SampleInitialized = 0;
+
+//
+// Function: parseRate()
+//
+// Description:
+//  Parse a rate written as a decimal or as a ratio of two numbers.
+//
+// Return value:
+//  The rate, or a negative number if the rate could not be parsed.
+//
+static double
+parseRate (const char * s) {
+  char * p;
+  double rate = strtod (s, &p);
+  if (p == s)
+    return -1;
+
+  if (*p == '/') {
+    const char * q = p + 1;
+    double denominator = strtod (q, &p);
+    if ((p == q) || (denominator <= 0))
+      return -1;
+    rate /= denominator;
+  }
+
+  return (*p == '\0') ? rate : -1;
+}
+
+//
+// Function: nextRandom()
+//
+// Description:
+//  Return the next number of the calling thread's xorshift generator.  Each
+//  thread seeds its generator with the address of its own state.
+//
+static inline uint32_t
+nextRandom (void) {
+  uint32_t x = SampleSeed;
+  if (!x)
+    x = (uint32_t) ((uintptr_t) &SampleSeed >> 4) | 1;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  SampleSeed = x;
+  return x;
+}
+
+//
+// Function: initSampling()
+//
+// Description:
+//  Read the SAFECODE_SAMPLE_RATE environment variable.  Threads may race to
+//  do this, but they all set the same rate.
+//
+static void
+initSampling (void) {
+  const char * env = getenv ("SAFECODE_SAMPLE_RATE");
+  double rate = DefaultRate;
+  if (env && *env) {
+    double parsed = parseRate (env);
+    if (parsed >= 0)
+      rate = parsed;
+  }
+
+  __sc_sample_set_rate (rate);
+}
+
+//
+// Function: __sc_sample_hit()
+//
+// Description:
+//  Decide whether the current call runs the checked version of its function
+//  and pick how many calls run unchecked before the next decision.  The
+//  countdown is drawn uniformly from [0, 2 * (period - 1)] so that, on
+//  average, one call in every period is checked.
+//
+// Return value:
+//  0 - The unchecked version should be run.
+//  1 - The checked version should be run.
+//
+unsigned
+__sc_sample_hit (void) {
+  if (__builtin_expect (!SampleInitialized, 0))
+    initSampling ();
+
+  unsigned period = SamplePeriod;
+  if (period == 0) {
+    __sc_sample_countdown = OffCountdown;
+    return 0;
+  }
+
+  if (period > 1)
+    __sc_sample_countdown = nextRandom () % (2 * (period - 1) + 1);
+  else
+    __sc_sample_countdown = 0;
+
+  __sync_fetch_and_add (&SampleHits, 1);
+  return 1;
+}
+
+//
+// Function: __sc_sample_set_rate()
+//
+// Description:
+//  Set the fraction of calls that are checked.  Other threads use the new rate
+//  from their next checked call on (or, if sampling was off, within
+//  OffCountdown calls).
+//
+void
+__sc_sample_set_rate (double rate) {
+  unsigned period;
+  if (rate >= 1) {
+    rate = 1;
+    period = 1;
+  } else if (rate > 1.0 / MaxPeriod) {
+    period = (unsigned) (1 / rate + 0.5);
+  } else {
+    rate = 0;
+    period = 0;
+  }
+
+  SampleRate = rate;
+  SamplePeriod = period;
+  SampleInitialized = 1;
+
+  //
+  // Let the calling thread use the new rate right away.
+  //
+  __sc_sample_countdown = 0;
+}
+
+//
+// Function: __sc_sample_get_rate()
+//
+// Description:
+//  Return the fraction of calls that are checked.
+//
+double
+__sc_sample_get_rate (void) {
+  if (!SampleInitialized)
+    initSampling ();
+  return SampleRate;
+}
+
+//
+// Function: __sc_sample_get_hits()
+//
+// Description:
+//  Return the number of calls that have run the checked version of their
+//  function in all threads.
+//
+unsigned long
+__sc_sample_get_hits (void) {
+  return SampleHits;
+}
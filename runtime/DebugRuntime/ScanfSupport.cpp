@@ -306,6 +306,7 @@ o_collect(int c,
 #ifdef FLOATING_POINT
 
 #include "ScanfTables.h"
+#include "../include/FloatConversion.h"
 
 //
 // f_collect()
@@ -795,6 +796,8 @@ internal_scanf(const options_t options,
 
 #ifdef FLOATING_POINT
   long double ld_val;
+  double d_val;
+  float f_val;
 #endif
 
   const char *format = fmt;
@@ -1224,13 +1227,36 @@ internal_scanf(const options_t options,
 
         if (!(flags & FL_NOASSIGN))
         {
-          ld_val = strtold(inp_buf, &tmp_string);
+          //
+          // Most numbers can be converted directly to the destination type
+          // with one correctly rounded operation; use strtold() for the rest.
+          //
           if (flags & FL_LONGDOUBLE)
+          {
+            if (!__fast_strtold(inp_buf, &ld_val))
+              ld_val = strtold(inp_buf, &tmp_string);
             _SAFEWRITE(ld_val, long double);
+          }
           else if (flags & FL_LONG)
-            _SAFEWRITE(ld_val, double);
+          {
+            if (__fast_strtod(inp_buf, &d_val))
+              _SAFEWRITE(d_val, double);
+            else
+            {
+              ld_val = strtold(inp_buf, &tmp_string);
+              _SAFEWRITE(ld_val, double);
+            }
+          }
           else
-            _SAFEWRITE(ld_val, float);
+          {
+            if (__fast_strtof(inp_buf, &f_val))
+              _SAFEWRITE(f_val, float);
+            else
+            {
+              ld_val = strtold(inp_buf, &tmp_string);
+              _SAFEWRITE(ld_val, float);
+            }
+          }
         }
         break;
 #endif
@@ -0,0 +1,240 @@
+//===- Telemetry.cpp - Run-time statistics counters -----------------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the statistics page of the SAFECode run-time.  See
+// safecode/Runtime/Telemetry.h for how the counters are enabled and read.
+//
+//===----------------------------------------------------------------------===//
+
+#include "safecode/Runtime/Telemetry.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int __sc_stats_enabled = 0;
+uint64_t * __sc_stats_shared_row = 0;
+__thread uint64_t * __sc_stats_thread_row = 0;
+
+// The statistics page
+static SCStatsPage * StatsPage = 0;
+
+// The name of the file holding the page, if any
+static char StatsFileName[256];
+
+//
+// Function: hasOption()
+//
+// Description:
+//  Determine whether the comma separated list contains the specified option.
+//
+static bool
+hasOption (const char * list, const char * option) {
+  size_t len = strlen (option);
+  while (*list) {
+    if ((strncmp (list, option, len) == 0) &&
+        ((list[len] == ',') || (list[len] == '\0')))
+      return true;
+    list = strchr (list, ',');
+    if (!list)
+      break;
+    ++list;
+  }
+  return false;
+}
+
+//
+// Function: writeString()
+//
+// Description:
+//  Write a string to a file descriptor.  This function is safe to call from a
+//  signal handler.
+//
+static void
+writeString (int fd, const char * s) {
+  size_t len = strlen (s);
+  while (len) {
+    ssize_t written = write (fd, s, len);
+    if (written <= 0)
+      return;
+    s += written;
+    len -= written;
+  }
+}
+
+//
+// Function: writeNumber()
+//
+// Description:
+//  Write an unsigned number in decimal to a file descriptor.  This function is
+//  safe to call from a signal handler.
+//
+static void
+writeNumber (int fd, uint64_t value) {
+  char buf[24];
+  char * p = buf + sizeof (buf) - 1;
+  *p = '\0';
+  do {
+    *--p = '0' + (value % 10);
+    value /= 10;
+  } while (value);
+  writeString (fd, p);
+}
+
+static void
+statsSignalHandler (int sig) {
+  __sc_stats_dump (2);
+}
+
+static void
+statsExitHandler (void) {
+  __sc_stats_dump (2);
+}
+
+static void
+statsUnlinkHandler (void) {
+  unlink (StatsFileName);
+}
+
+//
+// Function: __sc_stats_init()
+//
+// Description:
+//  Read the SAFECODE_STATS environment variable and, if it is set, allocate
+//  the statistics page and enable counting.
+//
+// Inputs:
+//  runtime - The name of the run-time, which is recorded in the page.
+//
+void
+__sc_stats_init (const char * runtime) {
+  const char * options = getenv ("SAFECODE_STATS");
+  if (!options || !*options || StatsPage)
+    return;
+
+  //
+  // Create the page in a file that other processes can map if requested.
+  // Otherwise, use private memory.
+  //
+  void * page = MAP_FAILED;
+  if (hasOption (options, "shm")) {
+    const char * dir = getenv ("SAFECODE_STATS_DIR");
+    snprintf (StatsFileName, sizeof (StatsFileName), SC_STATS_FILE_FORMAT,
+              dir ? dir : SC_STATS_DEFAULT_DIR, (int) getpid ());
+    int fd = open (StatsFileName, O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (fd != -1) {
+      if (ftruncate (fd, sizeof (SCStatsPage)) == 0)
+        page = mmap (0, sizeof (SCStatsPage), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+      close (fd);
+      if (page != MAP_FAILED)
+        atexit (statsUnlinkHandler);
+      else
+        unlink (StatsFileName);
+    }
+  }
+
+  if (page == MAP_FAILED)
+    page = mmap (0, sizeof (SCStatsPage), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (page == MAP_FAILED)
+    return;
+
+  StatsPage = (SCStatsPage *) page;
+  StatsPage->version = SC_STATS_VERSION;
+  StatsPage->numCounters = SC_STAT_NUM_COUNTERS;
+  StatsPage->numRows = SC_STATS_MAX_THREADS;
+  StatsPage->pid = getpid ();
+  __atomic_store_n (&StatsPage->rowsInUse, 1, __ATOMIC_RELAXED);
+  strncpy (StatsPage->runtime, runtime, sizeof (StatsPage->runtime) - 1);
+  __sc_stats_shared_row = StatsPage->counters[0];
+
+  //
+  // Publish the magic number last so that readers never see a partially
+  // initialized page.
+  //
+  __atomic_store_n (&StatsPage->magic, SC_STATS_MAGIC, __ATOMIC_RELEASE);
+
+  if (hasOption (options, "signal")) {
+    struct sigaction sa;
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = statsSignalHandler;
+    sa.sa_flags = SA_RESTART;
+    sigaction (SIGUSR2, &sa, 0);
+  }
+
+  if (hasOption (options, "exit"))
+    atexit (statsExitHandler);
+
+  __sc_stats_enabled = 1;
+}
+
+//
+// Function: __sc_stats_row()
+//
+// Description:
+//  Assign a row of counters to the calling thread.
+//
+// Return value:
+//  The row of counters that the calling thread should update is returned.
+//
+uint64_t *
+__sc_stats_row (void) {
+  if (!StatsPage)
+    return 0;
+
+  unsigned row = __atomic_fetch_add (&StatsPage->rowsInUse, 1,
+                                     __ATOMIC_RELAXED);
+  if (row < SC_STATS_MAX_THREADS)
+    __sc_stats_thread_row = StatsPage->counters[row];
+  else
+    __sc_stats_thread_row = __sc_stats_shared_row;
+  return __sc_stats_thread_row;
+}
+
+//
+// Function: __sc_stats_dump()
+//
+// Description:
+//  Add up the counters of all threads and print them.  This function is safe
+//  to call from a signal handler.
+//
+// Inputs:
+//  fd - The file descriptor to which to write the counters.
+//
+void
+__sc_stats_dump (int fd) {
+  if (!StatsPage)
+    return;
+
+  unsigned rows = __atomic_load_n (&StatsPage->rowsInUse, __ATOMIC_RELAXED);
+  if (rows > SC_STATS_MAX_THREADS)
+    rows = SC_STATS_MAX_THREADS;
+
+  writeString (fd, "SAFECode statistics (");
+  writeString (fd, StatsPage->runtime);
+  writeString (fd, ", pid ");
+  writeNumber (fd, StatsPage->pid);
+  writeString (fd, "):\n");
+  for (unsigned counter = 0; counter < SC_STAT_NUM_COUNTERS; ++counter) {
+    uint64_t total = 0;
+    for (unsigned row = 0; row < rows; ++row)
+      total += __atomic_load_n (&StatsPage->counters[row][counter],
+                                __ATOMIC_RELAXED);
+    writeString (fd, "  ");
+    writeString (fd, SCStatNames[counter]);
+    writeString (fd, " ");
+    writeNumber (fd, total);
+    writeString (fd, "\n");
+  }
+}
@@ -20,15 +20,8 @@
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
-#include <map>
-#include <set>
 #include <stdint.h>
 #include <syslog.h>
-#include <vector>
-
-using std::map;
-using std::vector;
-using std::set;
 
 // Declare SAFECode intrinsics as C functions.
 extern "C" uint32_t __sc_targetcheck(void *func);
@@ -37,105 +30,181 @@ extern "C" void __sc_vacopyregister(va_list dest, va_list src);
 extern "C" void __sc_vacallregister(void *func, uint32_t argc, ...);
 extern "C" void __sc_vacallunregister();
 
-typedef map<void *, unsigned> VaListToArgIndexMap;
-typedef set<void *> VaListSet;
-typedef struct {
-  VaListSet referrers;
-  vector<void *> pointerList;
-} ArgListEntry;
- 
-// Used for determining if the expected target of a vararg function call is the
-// actual target.
-static void *expectedTarget = 0;
-// This vector contains information about all registered va_lists in the
-// program.
-static vector<ArgListEntry> & argLists (void) {
-  static vector<ArgListEntry> realargLists;
-  return realargLists;
+// Maximum number of nested calls to variadic functions recorded per thread
+static const unsigned MaxVarargFrames = 32;
+
+// Maximum number of pointer arguments recorded for each call
+static const unsigned MaxVarargPointers = 16;
+
+// Maximum number of va_lists that may refer to the arguments of one call
+static const unsigned MaxFrameReferrers = 4;
+
+// Number of pointers in a frame whose pointer arguments did not all fit
+static const unsigned OverflowedFrame = ~0u;
+
+//
+// Structure: VarargFrame
+//
+// Description:
+//  The pointer arguments of one call to a variadic function and the va_lists
+//  that were registered with them.
+//
+struct VarargFrame {
+  unsigned numPointers;
+  unsigned numReferrers;
+  void *pointers[MaxVarargPointers];
+  void *referrers[MaxFrameReferrers];
+};
+
+//
+// Structure: VarargStack
+//
+// Description:
+//  The frames of the calls to variadic functions that are in progress in one
+//  thread.  Calls nested more deeply than MaxVarargFrames are counted but not
+//  recorded, and their va_lists are treated as unregistered.
+//
+struct VarargStack {
+  // Number of calls in progress, which may exceed MaxVarargFrames
+  unsigned depth;
+
+  // Used for determining if the expected target of a vararg function call is
+  // the actual target.
+  void *expectedTarget;
+
+  VarargFrame frames[MaxVarargFrames];
+};
+
+// The vararg calls of the calling thread.  The registry is per thread so that
+// registering a call costs a few stores, allocates nothing, and cannot race
+// with other threads.
+static __thread VarargStack varargStack;
+
+// Return the number of frames that are recorded.
+static inline unsigned recordedFrames(const VarargStack &stack) {
+  return (stack.depth < MaxVarargFrames) ? stack.depth : MaxVarargFrames;
 }
 
-// A map from a va_list to the index of its registered contents in the argLists
-// vector above.
-static VaListToArgIndexMap & vaListRegistrations (void) {
-  static VaListToArgIndexMap realvaListRegistrations;
-  return realvaListRegistrations;
+// Find the frame with which a va_list is registered.  The list is almost
+// always registered with the innermost call, which is searched first.
+// Returns the frame and the index of the va_list in its referrers, or NULL.
+static inline VarargFrame *findVaList(void *ap, unsigned &ref) {
+  VarargStack &stack = varargStack;
+  for (unsigned idx = recordedFrames(stack); idx > 0; --idx) {
+    VarargFrame &frame = stack.frames[idx - 1];
+    for (unsigned i = 0; i < frame.numReferrers; ++i) {
+      if (frame.referrers[i] == ap) {
+        ref = i;
+        return &frame;
+      }
+    }
+  }
+  return 0;
 }
 
-// Remove all references of a va_list from the internal data structures.
+// Remove all references of a va_list from the registry.
 static inline void clearVaList(va_list ap) {
-  if (!vaListRegistrations().count(ap))
+  unsigned ref;
+  VarargFrame *frame = findVaList(ap, ref);
+  if (!frame)
     return;
-  unsigned idx = vaListRegistrations()[ap];
-  vaListRegistrations().erase(ap);
-  argLists()[idx].referrers.erase(ap);
+  frame->referrers[ref] = frame->referrers[--frame->numReferrers];
+}
+
+// Register a va_list with the arguments of a frame.  If the frame already has
+// as many va_lists as it can hold, the va_list remains unregistered.
+static inline void addReferrer(VarargFrame &frame, void *ap) {
+  if (frame.numReferrers < MaxFrameReferrers)
+    frame.referrers[frame.numReferrers++] = ap;
 }
 
 // Check if the expected callee is the actual callee.
 // Returns a number under 0xffffffff if this is the case, and otherwise returns
 // 0xffffffff.
 uint32_t __sc_targetcheck(void *func) {
-  uint32_t id = (expectedTarget == func) ? argLists().size() - 1 : 0xffffffffu;
+  VarargStack &stack = varargStack;
+  uint32_t id = 0xffffffffu;
+  if ((stack.expectedTarget == func) && stack.depth &&
+      (stack.depth <= MaxVarargFrames))
+    id = stack.depth - 1;
   // Always reset the expected target to NULL.
   // This is needed for correctness, eg. in the case of recursive calls of the
   // same function from external code.
-  expectedTarget = 0;
+  stack.expectedTarget = 0;
   return id;
 }
 
 // Associate a va_list with an index returned from __sc_targetcheck.
 void __sc_varegister(va_list ap, uint32_t id) {
-  // Invalid index
-  if (id == 0xffffffffu)
+  // Invalid index, or a frame that has since been removed
+  if (id >= recordedFrames(varargStack))
     return;
   // Remove all prior references of this list.
   clearVaList(ap);
   // Insert the list into the appropriate place.
-  vaListRegistrations()[ap] = id;
-  argLists()[id].referrers.insert(ap);
+  addReferrer(varargStack.frames[id], ap);
 }
 
 // Associate one va_list with the information from another va_list.
 void __sc_vacopyregister(va_list dest, va_list src) {
   // If the source list is not registered, don't do anything.
-  if (!vaListRegistrations().count(src))
+  unsigned ref;
+  VarargFrame *frame = findVaList(src, ref);
+  if (!frame)
     return;
   // Remove all references of the destination list.
   clearVaList(dest);
   // Register the destination list with the same information as the source list.
-  unsigned idx = vaListRegistrations()[dest] = vaListRegistrations()[src];
-  argLists()[idx].referrers.insert(dest);
+  addReferrer(*frame, dest);
 }
 
 // Add a new entry to the lists of pointer arguments.
 void __sc_vacallregister(void *func, uint32_t argc, ...) {
-  argLists().push_back(ArgListEntry());
-  ArgListEntry &end = argLists().back();
-  // Find all the pointer arguments that were passed to this function and put
-  // them in the list.
-  va_list ap;
-  void *arg;
-  va_start(ap, argc);
-  for (arg = va_arg(ap, void *); arg != 0; arg = va_arg(ap, void *))
-    end.pointerList.push_back(arg);
-  va_end(ap);
+  VarargStack &stack = varargStack;
+  if (stack.depth < MaxVarargFrames) {
+    VarargFrame &frame = stack.frames[stack.depth];
+    frame.numPointers = 0;
+    frame.numReferrers = 0;
+    // Find all the pointer arguments that were passed to this function and put
+    // them in the list.
+    va_list ap;
+    void *arg;
+    va_start(ap, argc);
+    for (arg = va_arg(ap, void *); arg != 0; arg = va_arg(ap, void *)) {
+      if (frame.numPointers == MaxVarargPointers) {
+        frame.numPointers = OverflowedFrame;
+        break;
+      }
+      frame.pointers[frame.numPointers++] = arg;
+    }
+    va_end(ap);
+  }
+  ++stack.depth;
   // Set the value of the passed function pointer as the expected target.
-  expectedTarget = func;
+  stack.expectedTarget = func;
 }
 
-// Unregister the last pointer argument list.
+// Unregister the last pointer argument list.  The va_lists registered with it
+// are removed along with it.
 void __sc_vacallunregister() {
-  ArgListEntry &last = argLists().back();
-  VaListSet::iterator idx = last.referrers.begin();
-  VaListSet::iterator end = last.referrers.end();
-  // Remove each va_list associated with this list from the hash table.
-  for (; idx != end; ++idx)
-    vaListRegistrations().erase(*idx);
-  // Now remove the last entry altogether.
-  argLists().pop_back();
+  if (varargStack.depth)
+    --varargStack.depth;
 }
 
 //
-// Allocate a call_info structure that describes a call to a format string
+// Structure: CallInfoBuffer
+//
+// Description:
+//  Space for a call_info structure with the largest whitelist that the
+//  registry records, so that wrappers can build it on the stack.
+//
+struct CallInfoBuffer {
+  call_info info;
+  void *whitelist[MaxVarargPointers];
+};
+
+//
+// Initialize a call_info structure that describes a call to a format string
 // function. call_info is defined as:
 //
 // typedef struct {
@@ -147,58 +216,40 @@ void __sc_vacallunregister() {
 // } call_info;
 //
 // Inputs
-//   result   - a reference to a pointer that holds the location of the
-//              allocation
+//   buffer   - the space in which to build the structure
 //   ap       - the va_list associated with the function call
 //   TAG      - tag information for debugging purposes
 //   SRC_INFO - source and line number information for debugging purposes
 //
 // Returns
-//  On return, result points to allocated memory.
 //  This function returns true if the pointer list associated with the
 //  va_list argument was found, and false if the va_list was not
-//  recognized.
+//  recognized.  In the latter case, the whitelist is empty.
 //
 static inline bool
-build_call_info(call_info *&result, va_list ap, TAG, SRC_INFO) {
-  // Check if the list is registered.
-  VaListToArgIndexMap::iterator idx = vaListRegistrations().find(ap);
-  if (idx == vaListRegistrations().end()) {
-    // If not registered, return a call_info structure without the whitelist.
-    result = (call_info *) malloc(sizeof(call_info));
-    if (result != 0) {
-      // Don't limit the number of arguments to access.
-      result->vargc = 0xffffffffu;
-      result->tag = tag;
-      result->line_no = lineNo;
-      result->source_info = SourceFile;
-      result->whitelist[0] = 0;
-    }
+build_call_info(CallInfoBuffer &buffer, va_list ap, TAG, SRC_INFO) {
+  call_info *result = &buffer.info;
+  // Don't limit the number of arguments to access.
+  result->vargc = 0xffffffffu;
+  result->tag = tag;
+  result->line_no = lineNo;
+  result->source_info = SourceFile;
+  result->whitelist[0] = 0;
+
+  // Check if the list is registered.  The arguments of a call with more
+  // pointer arguments than were recorded are treated as unregistered.
+  unsigned ref;
+  VarargFrame *frame = findVaList(ap, ref);
+  if (!frame || frame->numPointers == OverflowedFrame)
     return false;
-  }
-  // Otherwise, allocate and populate a call_info structure with the pointer
-  // whitelist as specified in the corresponding index.
-  else {
-    const unsigned index = idx->second;
-    const vector<void *> &pointerList = argLists()[index].pointerList;
-    const size_t wl_size = pointerList.size();
-    // Allocate enough space so that the structure can hold the whitelist.
-    result =
-      (call_info *) malloc(sizeof(call_info) + wl_size * sizeof(void *));
-    if (result != 0) {
-      // Don't limit the number of arguments to access.
-      result->vargc = 0xffffffffu;
-      result->tag   = tag;
-      result->line_no = lineNo;
-      result->source_info = SourceFile;
-      // Copy over the pointer list for this registration into the whitelist.
-      for (unsigned i = 0; i < wl_size; ++i)
-        result->whitelist[i] = pointerList[i];
-      // End the whitelist with NULL.
-      result->whitelist[wl_size] = 0;
-    }
-    return true;
-  }
+
+  // Copy over the pointer list for this registration into the whitelist and
+  // end it with NULL.
+  const unsigned wl_size = frame->numPointers;
+  for (unsigned i = 0; i < wl_size; ++i)
+    result->whitelist[i] = frame->pointers[i];
+  result->whitelist[wl_size] = 0;
+  return true;
 }
 
 // Initialize a pointer_info structure around a pointer.
@@ -245,11 +296,9 @@ int pool_vprintf_debug(DebugPoolTy *fmtPool,
                        TAG,
                        SRC_INFO) {
   // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print without runtime checks.
-  if (cinfo == 0)
-    return vprintf(fmt, ap);
+  CallInfoBuffer cbuf;
+  call_info *cinfo = &cbuf.info;
+  bool vaListFound = build_call_info(cbuf, ap, tag, SRC_INFO_ARGS);
 
   // Tell the gprintf() function that a) pointers are unwrapped and b) we
   // don't track the size of the vararg list.
@@ -273,9 +322,6 @@ int pool_vprintf_debug(DebugPoolTy *fmtPool,
   int result = gprintf(options, p, *cinfo, fmt_info, ap);
   funlockfile(stdout);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -319,11 +365,9 @@ int pool_vfprintf_debug(DebugPoolTy *fPool,
                         TAG,
                         SRC_INFO) {
   // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print without runtime checks.
-  if (cinfo == 0)
-    return vfprintf((FILE *) fil, fmt, ap);
+  CallInfoBuffer cbuf;
+  call_info *cinfo = &cbuf.info;
+  bool vaListFound = build_call_info(cbuf, ap, tag, SRC_INFO_ARGS);
 
   // Tell the gprintf() function that a) pointers are unwrapped and b) we
   // don't track the size of the vararg list.
@@ -347,9 +391,6 @@ int pool_vfprintf_debug(DebugPoolTy *fPool,
   int result = gprintf(options, p, *cinfo, fmt_info, ap);
   funlockfile((FILE *) fil);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -393,11 +434,9 @@ int pool_vsprintf_debug(DebugPoolTy *strPool,
                         TAG,
                         SRC_INFO) {
   // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print with no runtime checks.
-  if (cinfo == 0)
-    return vsprintf(str, fmt, ap);
+  CallInfoBuffer cbuf;
+  call_info *cinfo = &cbuf.info;
+  bool vaListFound = build_call_info(cbuf, ap, tag, SRC_INFO_ARGS);
 
   // Tell the gprintf() function that a) pointers are unwrapped and b) we
   // don't track the size of the vararg list.
@@ -436,9 +475,6 @@ int pool_vsprintf_debug(DebugPoolTy *strPool,
   // Call the printing function.
   int result = gprintf(options, p, *cinfo, fmt_info, ap);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   // Add the terminator byte (internal_printf() doesn't do this automatically).
   p.output.string.string[p.output.string.pos] = '\0';
 
@@ -488,11 +524,9 @@ int pool_vsnprintf_debug(DebugPoolTy *strPool,
                          TAG,
                          SRC_INFO) {
   // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print with no runtime checks.
-  if (cinfo == 0)
-    return vsnprintf(str, n, fmt, ap);
+  CallInfoBuffer cbuf;
+  call_info *cinfo = &cbuf.info;
+  bool vaListFound = build_call_info(cbuf, ap, tag, SRC_INFO_ARGS);
 
   // Tell the gprintf() function that a) pointers are unwrapped and b) we
   // don't track the size of the vararg list.
@@ -532,9 +566,6 @@ int pool_vsnprintf_debug(DebugPoolTy *strPool,
   // Call the printing function.
   int result = gprintf(options, p, *cinfo, fmt_info, ap);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   // Add the terminator byte (internal_printf() doesn't do this automatically).
   // Only add it if n > 0. When n = 0, nothing is written.
   if (n > 0)
@@ -565,10 +596,9 @@ int pool_vscanf_debug(DebugPoolTy *fmtPool,
                       TAG,
                       SRC_INFO) {
   // Initialize the call_info structure.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  if (cinfo == 0) // Error creating the structure.
-    return vscanf(fmt, ap);
+  CallInfoBuffer cbuf;
+  call_info *cinfo = &cbuf.info;
+  bool vaListFound = build_call_info(cbuf, ap, tag, SRC_INFO_ARGS);
 
   // Create the options. Tell gscanf a) pointers will be unwrapped and
   // b) not to check for reading off the end of the va_list.
@@ -592,9 +622,6 @@ int pool_vscanf_debug(DebugPoolTy *fmtPool,
   int result = gscanf(options, input, *cinfo, fmt_info, ap);
   funlockfile(stdin);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -628,10 +655,9 @@ int pool_vsscanf_debug(DebugPoolTy *strPool,
   validStringCheck(str, strPool, strComplete, "vsscanf", SRC_INFO_ARGS);
 
   // Initialize the call_info structure.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  if (cinfo == 0) // Error creating the structure.
-    return vsscanf(str, fmt, ap);
+  CallInfoBuffer cbuf;
+  call_info *cinfo = &cbuf.info;
+  bool vaListFound = build_call_info(cbuf, ap, tag, SRC_INFO_ARGS);
 
   // Create the options. Tell gscanf() a) pointers will be unwrapped and
   // b) not to check for reading off the end of the va_list.
@@ -653,9 +679,6 @@ int pool_vsscanf_debug(DebugPoolTy *strPool,
 
   int result = gscanf(options, input, *cinfo, fmt_info, ap);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -685,10 +708,9 @@ int pool_vfscanf_debug(DebugPoolTy *filPool,
                        TAG,
                        SRC_INFO) {
   // Initialize the call_info structure.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  if (cinfo == 0) // Error creating the structure.
-    return vfscanf((FILE *) fil, fmt, ap);
+  CallInfoBuffer cbuf;
+  call_info *cinfo = &cbuf.info;
+  bool vaListFound = build_call_info(cbuf, ap, tag, SRC_INFO_ARGS);
 
   // Create the options. Tell gscanf a) pointers will be unwrapped and
   // b) not to check for reading off the end of the va_list.
@@ -712,9 +734,6 @@ int pool_vfscanf_debug(DebugPoolTy *filPool,
   int result = gscanf(options, input, *cinfo, fmt_info, ap);
   funlockfile((FILE *) fil);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -755,13 +774,9 @@ void pool_vsyslog_debug(DebugPoolTy *fmtPool,
                         TAG,
                         SRC_INFO) {
   // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print without runtime checks.
-  if (cinfo == 0) {
-    vsyslog(priority, fmt, ap);
-    return;
-  }
+  CallInfoBuffer cbuf;
+  call_info *cinfo = &cbuf.info;
+  bool vaListFound = build_call_info(cbuf, ap, tag, SRC_INFO_ARGS);
 
   // Tell the gprintf() function that a) pointers are unwrapped, b) we don't
   // track the size of the vararg list, and c) use the %m directive.
@@ -780,7 +795,6 @@ void pool_vsyslog_debug(DebugPoolTy *fmtPool,
   p.output.alloced_string.string = (char *) malloc(INITIAL_ALLOC_SIZE);
   // On malloc() error, attempt to print without runtime checks.
   if (p.output.alloced_string.string == 0) {
-    free(cinfo);
     vsyslog(priority, fmt, ap);
     return;
   }
@@ -792,9 +806,6 @@ void pool_vsyslog_debug(DebugPoolTy *fmtPool,
   // Call the printing function.
   int sz = gprintf(options, p, *cinfo, fmt_info, ap);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   // Print the resulting string using syslog(), if there was no error in making
   // it.
   if (sz < 0)
@@ -18,6 +18,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
 
 //
 // Function: pool_read()
@@ -382,3 +384,512 @@ pool_realpath (DebugPoolTy * PathPool,
                               Complete,
                               DEFAULTS);
 }
+
+//===----------------------------------------------------------------------===//
+//
+// Vectored and batched I/O
+//
+//===----------------------------------------------------------------------===//
+
+namespace {
+
+//
+// Structure: BufferCache
+//
+// Description:
+//  This structure records the bounds of the memory objects found while
+//  checking the buffers of an I/O vector or message array.  The buffers in
+//  such arrays are often carved out of a few large objects, so reusing the
+//  bounds avoids looking up the same object once per buffer.
+//
+struct BufferCache {
+  // Number of objects remembered
+  static const unsigned Size = 4;
+
+  // First and last valid bytes of the remembered objects
+  void * Start[Size];
+  void * End[Size];
+
+  // Number of valid entries and the next entry to replace
+  unsigned Used;
+  unsigned Next;
+
+  BufferCache () : Used (0), Next (0) { }
+
+  //
+  // Method: find()
+  //
+  // Description:
+  //  Find the bounds of the object containing the specified pointer, first in
+  //  the cache and then in the pool and the external objects.
+  //
+  bool find (DebugPoolTy * Pool, void * Buf, void *& BufStart, void *& BufEnd) {
+    for (unsigned index = 0; index < Used; ++index) {
+      if ((Start[index] <= Buf) && (Buf <= End[index])) {
+        BufStart = Start[index];
+        BufEnd = End[index];
+        return true;
+      }
+    }
+
+    if (!pool_find (Pool, Buf, BufStart, BufEnd))
+      return false;
+
+    Start[Next] = BufStart;
+    End[Next] = BufEnd;
+    Next = (Next + 1) % Size;
+    if (Used < Size)
+      ++Used;
+    return true;
+  }
+};
+
+}
+
+//
+// Function: bufferCheck()
+//
+// Description:
+//  Check that a buffer referenced from an I/O vector or message header is at
+//  least the specified size.  This is like minSizeCheck() but uses the bounds
+//  cache.
+//
+static inline void
+bufferCheck (BufferCache & Cache,
+             DebugPoolTy * Pool,
+             void * Buf,
+             bool Complete,
+             size_t MinSize,
+             SRC_INFO) {
+  if ((Buf == NULL) || (MinSize == 0))
+    return;
+
+  void * BufStart = 0, * BufEnd = 0;
+  if (!Cache.find (Pool, Buf, BufStart, BufEnd)) {
+    if (Complete)
+      LOAD_STORE_VIOLATION (Buf, Pool, SRC_INFO_ARGS);
+    return;
+  }
+
+  if (byte_range (Buf, BufEnd) < MinSize)
+    C_LIBRARY_VIOLATION (Buf, Pool, "", SRC_INFO_ARGS);
+}
+
+//
+// Function: iovecCheck()
+//
+// Description:
+//  Check an array of iovec structures and every buffer that it describes.
+//
+// Inputs:
+//   Cache    - The cache of object bounds shared by the checks of one call
+//   Pool     - The pool handle for the iovec array
+//   Iov      - The iovec array
+//   IovCnt   - The number of elements in the iovec array
+//   Complete - Whether the iovec array pointer is complete
+//   SRC_INFO - Source file and line number information for debugging purposes
+//
+// Notes:
+//  The buffers may belong to any pool, so their lookups are incomplete.
+//
+static void
+iovecCheck (BufferCache & Cache,
+            DebugPoolTy * Pool,
+            const struct iovec * Iov,
+            size_t IovCnt,
+            bool Complete,
+            SRC_INFO) {
+  if ((Iov == NULL) || (IovCnt == 0))
+    return;
+
+  bufferCheck (Cache, Pool, (void *) Iov, Complete,
+               IovCnt * sizeof (struct iovec), SRC_INFO_ARGS);
+  for (size_t index = 0; index < IovCnt; ++index) {
+    bufferCheck (Cache, Pool, Iov[index].iov_base, false,
+                 Iov[index].iov_len, SRC_INFO_ARGS);
+  }
+}
+
+//
+// Function: msghdrCheck()
+//
+// Description:
+//  Check a message header along with its address, I/O vector, and ancillary
+//  data buffers.
+//
+static void
+msghdrCheck (BufferCache & Cache,
+             DebugPoolTy * Pool,
+             const struct msghdr * Msg,
+             bool Complete,
+             SRC_INFO) {
+  bufferCheck (Cache, Pool, (void *) Msg, Complete,
+               sizeof (struct msghdr), SRC_INFO_ARGS);
+  if (Msg == NULL)
+    return;
+
+  bufferCheck (Cache, Pool, Msg->msg_name, false,
+               Msg->msg_namelen, SRC_INFO_ARGS);
+  iovecCheck (Cache, Pool, Msg->msg_iov, Msg->msg_iovlen, false,
+              SRC_INFO_ARGS);
+  bufferCheck (Cache, Pool, Msg->msg_control, false,
+               Msg->msg_controllen, SRC_INFO_ARGS);
+}
+
+//
+// Function: pool_readv()
+//
+// Description:
+//  This is a memory safe replacement for the readv() function.
+//
+// Inputs:
+//   Pool     - The pool handle for the iovec array
+//   Iov      - The iovec array describing the input buffers
+//   FD       - The file descriptor
+//   IovCnt   - The number of elements in the iovec array
+//   Complete - The Completeness bit vector
+//   TAG      - The Tag information for debugging purposes
+//   SRC_INFO - Source file and line number information for debugging purposes
+//
+ssize_t
+pool_readv_debug (DebugPoolTy * Pool,
+                  const struct iovec * Iov,
+                  int FD,
+                  int IovCnt,
+                  const uint8_t Complete,
+                  TAG,
+                  SRC_INFO) {
+  BufferCache Cache;
+  if (IovCnt > 0)
+    iovecCheck (Cache, Pool, Iov, IovCnt, ARG1_COMPLETE(Complete), SRC_INFO_ARGS);
+  return readv (FD, Iov, IovCnt);
+}
+
+ssize_t
+pool_readv (DebugPoolTy * Pool,
+            const struct iovec * Iov,
+            int FD,
+            int IovCnt,
+            const uint8_t Complete) {
+  return pool_readv_debug (Pool, Iov, FD, IovCnt, Complete, DEFAULTS);
+}
+
+//
+// Function: pool_writev()
+//
+// Description:
+//  This is a memory safe replacement for the writev() function.
+//
+// Inputs:
+//   Pool     - The pool handle for the iovec array
+//   Iov      - The iovec array describing the output buffers
+//   FD       - The file descriptor
+//   IovCnt   - The number of elements in the iovec array
+//   Complete - The Completeness bit vector
+//   TAG      - The Tag information for debugging purposes
+//   SRC_INFO - Source file and line number information for debugging purposes
+//
+ssize_t
+pool_writev_debug (DebugPoolTy * Pool,
+                   const struct iovec * Iov,
+                   int FD,
+                   int IovCnt,
+                   const uint8_t Complete,
+                   TAG,
+                   SRC_INFO) {
+  BufferCache Cache;
+  if (IovCnt > 0)
+    iovecCheck (Cache, Pool, Iov, IovCnt, ARG1_COMPLETE(Complete), SRC_INFO_ARGS);
+  return writev (FD, Iov, IovCnt);
+}
+
+ssize_t
+pool_writev (DebugPoolTy * Pool,
+             const struct iovec * Iov,
+             int FD,
+             int IovCnt,
+             const uint8_t Complete) {
+  return pool_writev_debug (Pool, Iov, FD, IovCnt, Complete, DEFAULTS);
+}
+
+//
+// Function: pool_preadv()
+//
+// Description:
+//  This is a memory safe replacement for the preadv() function.
+//
+// Inputs:
+//   Pool     - The pool handle for the iovec array
+//   Iov      - The iovec array describing the input buffers
+//   FD       - The file descriptor
+//   IovCnt   - The number of elements in the iovec array
+//   Offset   - The file offset at which to read
+//   Complete - The Completeness bit vector
+//   TAG      - The Tag information for debugging purposes
+//   SRC_INFO - Source file and line number information for debugging purposes
+//
+ssize_t
+pool_preadv_debug (DebugPoolTy * Pool,
+                   const struct iovec * Iov,
+                   int FD,
+                   int IovCnt,
+                   off_t Offset,
+                   const uint8_t Complete,
+                   TAG,
+                   SRC_INFO) {
+  BufferCache Cache;
+  if (IovCnt > 0)
+    iovecCheck (Cache, Pool, Iov, IovCnt, ARG1_COMPLETE(Complete), SRC_INFO_ARGS);
+  return preadv (FD, Iov, IovCnt, Offset);
+}
+
+ssize_t
+pool_preadv (DebugPoolTy * Pool,
+             const struct iovec * Iov,
+             int FD,
+             int IovCnt,
+             off_t Offset,
+             const uint8_t Complete) {
+  return pool_preadv_debug (Pool, Iov, FD, IovCnt, Offset, Complete, DEFAULTS);
+}
+
+//
+// Function: pool_pwritev()
+//
+// Description:
+//  This is a memory safe replacement for the pwritev() function.
+//
+// Inputs:
+//   Pool     - The pool handle for the iovec array
+//   Iov      - The iovec array describing the output buffers
+//   FD       - The file descriptor
+//   IovCnt   - The number of elements in the iovec array
+//   Offset   - The file offset at which to write
+//   Complete - The Completeness bit vector
+//   TAG      - The Tag information for debugging purposes
+//   SRC_INFO - Source file and line number information for debugging purposes
+//
+ssize_t
+pool_pwritev_debug (DebugPoolTy * Pool,
+                    const struct iovec * Iov,
+                    int FD,
+                    int IovCnt,
+                    off_t Offset,
+                    const uint8_t Complete,
+                    TAG,
+                    SRC_INFO) {
+  BufferCache Cache;
+  if (IovCnt > 0)
+    iovecCheck (Cache, Pool, Iov, IovCnt, ARG1_COMPLETE(Complete), SRC_INFO_ARGS);
+  return pwritev (FD, Iov, IovCnt, Offset);
+}
+
+ssize_t
+pool_pwritev (DebugPoolTy * Pool,
+              const struct iovec * Iov,
+              int FD,
+              int IovCnt,
+              off_t Offset,
+              const uint8_t Complete) {
+  return pool_pwritev_debug (Pool, Iov, FD, IovCnt, Offset, Complete, DEFAULTS);
+}
+
+//
+// Function: pool_recvmsg()
+//
+// Description:
+//  This is a memory safe replacement for the recvmsg() function.
+//
+// Inputs:
+//   Pool     - The pool handle for the message header
+//   Msg      - The message header describing the input buffers
+//   SockFD   - The socket file descriptor
+//   Flags    - Additional options
+//   Complete - The Completeness bit vector
+//   TAG      - The Tag information for debugging purposes
+//   SRC_INFO - Source file and line number information for debugging purposes
+//
+ssize_t
+pool_recvmsg_debug (DebugPoolTy * Pool,
+                    struct msghdr * Msg,
+                    int SockFD,
+                    int Flags,
+                    const uint8_t Complete,
+                    TAG,
+                    SRC_INFO) {
+  BufferCache Cache;
+  msghdrCheck (Cache, Pool, Msg, ARG1_COMPLETE(Complete), SRC_INFO_ARGS);
+  return recvmsg (SockFD, Msg, Flags);
+}
+
+ssize_t
+pool_recvmsg (DebugPoolTy * Pool,
+              struct msghdr * Msg,
+              int SockFD,
+              int Flags,
+              const uint8_t Complete) {
+  return pool_recvmsg_debug (Pool, Msg, SockFD, Flags, Complete, DEFAULTS);
+}
+
+//
+// Function: pool_sendmsg()
+//
+// Description:
+//  This is a memory safe replacement for the sendmsg() function.
+//
+// Inputs:
+//   Pool     - The pool handle for the message header
+//   Msg      - The message header describing the output buffers
+//   SockFD   - The socket file descriptor
+//   Flags    - Additional options
+//   Complete - The Completeness bit vector
+//   TAG      - The Tag information for debugging purposes
+//   SRC_INFO - Source file and line number information for debugging purposes
+//
+ssize_t
+pool_sendmsg_debug (DebugPoolTy * Pool,
+                    const struct msghdr * Msg,
+                    int SockFD,
+                    int Flags,
+                    const uint8_t Complete,
+                    TAG,
+                    SRC_INFO) {
+  BufferCache Cache;
+  msghdrCheck (Cache, Pool, Msg, ARG1_COMPLETE(Complete), SRC_INFO_ARGS);
+  return sendmsg (SockFD, Msg, Flags);
+}
+
+ssize_t
+pool_sendmsg (DebugPoolTy * Pool,
+              const struct msghdr * Msg,
+              int SockFD,
+              int Flags,
+              const uint8_t Complete) {
+  return pool_sendmsg_debug (Pool, Msg, SockFD, Flags, Complete, DEFAULTS);
+}
+
+#if defined(__linux__)
+//
+// Function: mmsghdrCheck()
+//
+// Description:
+//  Check an array of mmsghdr structures along with all of the buffers that
+//  their message headers describe.  One bounds cache is used for the whole
+//  array.
+//
+static void
+mmsghdrCheck (BufferCache & Cache,
+              DebugPoolTy * Pool,
+              struct mmsghdr * MsgVec,
+              unsigned VLen,
+              bool Complete,
+              SRC_INFO) {
+  if (VLen == 0)
+    return;
+
+  bufferCheck (Cache, Pool, MsgVec, Complete,
+               VLen * sizeof (struct mmsghdr), SRC_INFO_ARGS);
+  if (MsgVec == NULL)
+    return;
+
+  for (unsigned index = 0; index < VLen; ++index) {
+    const struct msghdr * Msg = &(MsgVec[index].msg_hdr);
+    bufferCheck (Cache, Pool, Msg->msg_name, false,
+                 Msg->msg_namelen, SRC_INFO_ARGS);
+    iovecCheck (Cache, Pool, Msg->msg_iov, Msg->msg_iovlen, false,
+                SRC_INFO_ARGS);
+    bufferCheck (Cache, Pool, Msg->msg_control, false,
+                 Msg->msg_controllen, SRC_INFO_ARGS);
+  }
+}
+
+//
+// Function: pool_recvmmsg()
+//
+// Description:
+//  This is a memory safe replacement for the recvmmsg() function.
+//
+// Inputs:
+//   Pool     - The pool handle for the message array
+//   MsgVec   - The array of message headers describing the input buffers
+//   SockFD   - The socket file descriptor
+//   VLen     - The number of elements in the message array
+//   Flags    - Additional options
+//   Timeout  - The timeout for the receive operation (may be NULL)
+//   Complete - The Completeness bit vector
+//   TAG      - The Tag information for debugging purposes
+//   SRC_INFO - Source file and line number information for debugging purposes
+//
+int
+pool_recvmmsg_debug (DebugPoolTy * Pool,
+                     struct mmsghdr * MsgVec,
+                     int SockFD,
+                     unsigned int VLen,
+                     int Flags,
+                     struct timespec * Timeout,
+                     const uint8_t Complete,
+                     TAG,
+                     SRC_INFO) {
+  BufferCache Cache;
+  mmsghdrCheck (Cache, Pool, MsgVec, VLen, ARG1_COMPLETE(Complete),
+                SRC_INFO_ARGS);
+  bufferCheck (Cache, Pool, Timeout, false, sizeof (struct timespec),
+               SRC_INFO_ARGS);
+  return recvmmsg (SockFD, MsgVec, VLen, Flags, Timeout);
+}
+
+int
+pool_recvmmsg (DebugPoolTy * Pool,
+               struct mmsghdr * MsgVec,
+               int SockFD,
+               unsigned int VLen,
+               int Flags,
+               struct timespec * Timeout,
+               const uint8_t Complete) {
+  return pool_recvmmsg_debug (
+           Pool, MsgVec, SockFD, VLen, Flags, Timeout, Complete, DEFAULTS
+         );
+}
+
+//
+// Function: pool_sendmmsg()
+//
+// Description:
+//  This is a memory safe replacement for the sendmmsg() function.
+//
+// Inputs:
+//   Pool     - The pool handle for the message array
+//   MsgVec   - The array of message headers describing the output buffers
+//   SockFD   - The socket file descriptor
+//   VLen     - The number of elements in the message array
+//   Flags    - Additional options
+//   Complete - The Completeness bit vector
+//   TAG      - The Tag information for debugging purposes
+//   SRC_INFO - Source file and line number information for debugging purposes
+//
+int
+pool_sendmmsg_debug (DebugPoolTy * Pool,
+                     struct mmsghdr * MsgVec,
+                     int SockFD,
+                     unsigned int VLen,
+                     int Flags,
+                     const uint8_t Complete,
+                     TAG,
+                     SRC_INFO) {
+  BufferCache Cache;
+  mmsghdrCheck (Cache, Pool, MsgVec, VLen, ARG1_COMPLETE(Complete),
+                SRC_INFO_ARGS);
+  return sendmmsg (SockFD, MsgVec, VLen, Flags);
+}
+
+int
+pool_sendmmsg (DebugPoolTy * Pool,
+               struct mmsghdr * MsgVec,
+               int SockFD,
+               unsigned int VLen,
+               int Flags,
+               const uint8_t Complete) {
+  return pool_sendmmsg_debug (Pool, MsgVec, SockFD, VLen, Flags, Complete,
+                              DEFAULTS);
+}
+#endif
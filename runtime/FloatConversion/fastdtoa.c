@@ -0,0 +1,525 @@
+/*===- fastdtoa.c - Allocation-free float/decimal conversion fast paths ---===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This file implements fast paths for the conversions done by the format
+ * string wrappers.  They handle the common cases without allocating memory;
+ * when a fast path cannot produce an exact result it returns zero and the
+ * caller falls back to the gdtoa routines or to strtold().
+ *
+ * Binary to decimal: a finite value is m * 2^e with m < 2^64.  The decimal
+ * digits are found by computing m * 2^e * 10^s exactly as a fraction of two
+ * 128-bit integers and rounding the quotient half-to-even, which is what
+ * __dtoa() does in the default rounding mode.  This covers all precisions
+ * and magnitudes for which the fraction fits, which includes the values that
+ * programs usually print.
+ *
+ * Decimal to binary: a decimal number with at most 19 significant digits
+ * whose mantissa and power of ten are both exactly representable is
+ * converted with one correctly rounded multiplication or division (Clinger's
+ * fast path).
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SIZEOF_INT128__)
+
+typedef unsigned __int128 u128;
+
+/* Largest power of ten that fits in 128 bits */
+#define MAXPOW10 38
+
+/* Powers of ten up to 10^MAXPOW10 */
+#define E19 ((u128) 10000000000000000000ULL)
+static const u128 p10[MAXPOW10 + 1] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+  1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+  1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+  1000000000000000000ULL, 10000000000000000000ULL, E19 * 10ULL, E19 * 100ULL,
+  E19 * 1000ULL, E19 * 10000ULL, E19 * 100000ULL, E19 * 1000000ULL,
+  E19 * 10000000ULL, E19 * 100000000ULL, E19 * 1000000000ULL,
+  E19 * 10000000000ULL, E19 * 100000000000ULL, E19 * 1000000000000ULL,
+  E19 * 10000000000000ULL, E19 * 100000000000000ULL,
+  E19 * 1000000000000000ULL, E19 * 10000000000000000ULL,
+  E19 * 100000000000000000ULL, E19 * 1000000000000000000ULL,
+  E19 * 10000000000000000000ULL
+};
+#undef E19
+
+/*
+ * Function: scale()
+ *
+ * Description:
+ *  Compute m * 2^e * 10^s rounded to an integer.
+ *
+ * Outputs:
+ *  q     - The integer part of the product.
+ *  round - Set to 1 if the product must be rounded up (to nearest, with ties
+ *          to even) and 0 otherwise.
+ *
+ * Return value:
+ *  1 if the product could be computed exactly and 0 otherwise.
+ */
+static int
+scale (uint64_t m, int e, int s, u128 * q, int * round) {
+  u128 num = m;
+  u128 odd = 1;
+  u128 den, rem;
+  int shift;
+
+  if ((s > MAXPOW10) || (s < -MAXPOW10))
+    return 0;
+
+  /*
+   * Write the divisor as odd * 2^shift; 10^-s is 5^-s * 2^-s, so dividing by
+   * it is a division by a (small) odd number and a shift.
+   */
+  if (s >= 0) {
+    if (num > (~(u128) 0) / p10[s])
+      return 0;
+    num *= p10[s];
+    shift = -e;
+  } else {
+    odd = p10[-s] >> -s;
+    shift = -s - e;
+  }
+
+  if (shift < 0) {
+    if ((-shift >= 128) || (num > ((~(u128) 0) >> -shift)))
+      return 0;
+    num <<= -shift;
+    shift = 0;
+  }
+  if ((shift >= 128) || (odd > ((~(u128) 0) >> shift)))
+    return 0;
+  den = odd << shift;
+
+  /* Shift, then divide by the odd part using 64-bit division if possible */
+  *q = num >> shift;
+  rem = num & ((((u128) 1) << shift) - 1);
+  if (odd != 1) {
+    u128 r;
+    if ((*q >> 64) == 0) {
+      r = (uint64_t) *q % (uint64_t) odd;
+      *q = (uint64_t) *q / (uint64_t) odd;
+    } else {
+      r = *q % odd;
+      *q = *q / odd;
+    }
+    rem += r << shift;
+  }
+
+  *round = (rem > den - rem) || ((rem == den - rem) && (*q & 1));
+  return 1;
+}
+
+/*
+ * Function: putdigits()
+ *
+ * Description:
+ *  Write the decimal digits of q into buf, dropping trailing zeros.
+ *
+ * Return value:
+ *  The number of digits of q (including the dropped zeros).  The end of the
+ *  written digits is returned in *rve.
+ */
+static int
+putdigits (u128 q, char * buf, char ** rve) {
+  char tmp[40];
+  char * p = tmp + sizeof (tmp);
+  int n;
+
+  /* Convert in 64-bit chunks to avoid 128-bit division by ten */
+  while (q > UINT64_MAX) {
+    const uint64_t chunk = 10000000000000000000ULL; /* 10^19 */
+    uint64_t lo = (uint64_t) (q % chunk);
+    int i;
+    q /= chunk;
+    for (i = 0; i < 19; ++i) {
+      *--p = (char) ('0' + lo % 10);
+      lo /= 10;
+    }
+  }
+  {
+    uint64_t lo = (uint64_t) q;
+    do {
+      *--p = (char) ('0' + lo % 10);
+      lo /= 10;
+    } while (lo);
+  }
+
+  n = (int) (tmp + sizeof (tmp) - p);
+  memcpy (buf, p, n);
+  while ((n > 1) && (buf[n - 1] == '0'))
+    --n;
+  *rve = buf + n;
+  **rve = '\0';
+  return (int) (tmp + sizeof (tmp) - p);
+}
+
+/*
+ * Function: bitlength()
+ *
+ * Description:
+ *  Return the number of significant bits in a non-zero integer.
+ */
+static inline int
+bitlength (uint64_t m) {
+  return 64 - __builtin_clzll (m);
+}
+
+/*
+ * Function: fastdigits()
+ *
+ * Description:
+ *  Produce the digits of m * 2^e (m non-zero) as __dtoa() would for modes 2
+ *  and 3.
+ */
+static int
+fastdigits (uint64_t m, int e, int mode, int ndigits,
+            int * decpt, char * buf, size_t bufsize, char ** rve) {
+  u128 q;
+  int round;
+
+  if (bufsize < 41)
+    return 0;
+
+  if (mode == 3) {
+    /*
+     * Round to ndigits places after the decimal point.
+     */
+    int n;
+    if (ndigits < 0)
+      return 0;
+    if (!scale (m, e, ndigits, &q, &round))
+      return 0;
+    q += round;
+    if (q == 0) {
+      /* The value rounds to zero; __dtoa() returns no digits */
+      *decpt = -ndigits;
+      buf[0] = '\0';
+      *rve = buf;
+      return 1;
+    }
+    n = putdigits (q, buf, rve);
+    *decpt = n - ndigits;
+    return 1;
+  }
+
+  if (mode == 2) {
+    /*
+     * Round to ndigits significant digits.  Estimate the decimal exponent k
+     * (so that 10^(k-1) <= value < 10^k) from the binary exponent; the
+     * estimate is either exact or one too small.
+     */
+    int k;
+    if (ndigits <= 0)
+      ndigits = 1;
+    if (ndigits > MAXPOW10 - 1)
+      return 0;
+
+    k = (int) floor ((bitlength (m) - 1 + e) * 0.30102999566398119521) + 1;
+    if (!scale (m, e, ndigits - k, &q, &round))
+      return 0;
+    if (q >= p10[ndigits]) {
+      ++k;
+      if (!scale (m, e, ndigits - k, &q, &round))
+        return 0;
+    }
+
+    q += round;
+    if (q == p10[ndigits]) {
+      /* Rounding carried into a new digit */
+      q = p10[ndigits - 1];
+      ++k;
+    }
+
+    putdigits (q, buf, rve);
+    *decpt = k;
+    return 1;
+  }
+
+  return 0;
+}
+
+#endif /* __SIZEOF_INT128__ */
+
+/*
+ * Function: __fast_dtoa()
+ *
+ * Description:
+ *  Convert a double to decimal digits like __dtoa() in modes 2 and 3, writing
+ *  the digits into the caller's buffer.
+ *
+ * Inputs:
+ *  d       - The value to convert.
+ *  mode    - The __dtoa() mode (2 or 3).
+ *  ndigits - The number of significant digits (mode 2) or of digits after
+ *            the decimal point (mode 3).
+ *  buf     - The buffer for the digits.  It must hold at least 41 bytes.
+ *
+ * Outputs:
+ *  decpt - The position of the decimal point relative to the digits.
+ *  sign  - Non-zero if the value is negative.
+ *  rve   - The end of the digits.
+ *
+ * Return value:
+ *  1 if the conversion was done and 0 if the caller must use __dtoa().
+ *  Infinities and NaNs are never handled.
+ */
+int
+__fast_dtoa (double d, int mode, int ndigits, int * decpt, int * sign,
+             char * buf, size_t bufsize, char ** rve) {
+#if defined(__SIZEOF_INT128__) && (DBL_MANT_DIG == 53)
+  uint64_t bits;
+  uint64_t m;
+  int exp;
+
+  memcpy (&bits, &d, sizeof (bits));
+  m = bits & ((((uint64_t) 1) << 52) - 1);
+  exp = (int) ((bits >> 52) & 0x7ff);
+  if (exp == 0x7ff)
+    return 0;
+
+  if ((exp == 0) && (m == 0)) {
+    if (bufsize < 2)
+      return 0;
+    *sign = (int) (bits >> 63);
+    *decpt = 1;
+    buf[0] = '0';
+    buf[1] = '\0';
+    *rve = buf + 1;
+    return 1;
+  }
+
+  if (exp == 0) {
+    exp = -1074;
+  } else {
+    m |= ((uint64_t) 1) << 52;
+    exp -= 1075;
+  }
+
+  if (!fastdigits (m, exp, mode, ndigits, decpt, buf, bufsize, rve))
+    return 0;
+  *sign = (int) (bits >> 63);
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Function: __fast_ldtoa()
+ *
+ * Description:
+ *  Convert a long double to decimal digits like __ldtoa() in modes 2 and 3.
+ *  Only long double formats with at most 64 bits of mantissa are handled.
+ */
+int
+__fast_ldtoa (long double * ld, int mode, int ndigits, int * decpt, int * sign,
+              char * buf, size_t bufsize, char ** rve) {
+#if defined(__SIZEOF_INT128__) && (LDBL_MANT_DIG <= 64)
+  long double x = *ld;
+  long double frac;
+  uint64_t m;
+  int exp;
+
+  if (isnan (x) || isinf (x))
+    return 0;
+
+  if (x == 0) {
+    if (bufsize < 2)
+      return 0;
+    *sign = signbit (x) != 0;
+    *decpt = 1;
+    buf[0] = '0';
+    buf[1] = '\0';
+    *rve = buf + 1;
+    return 1;
+  }
+
+  /* The mantissa scaled by 2^64 is an exact integer below 2^64 */
+  frac = frexpl (fabsl (x), &exp);
+  m = (uint64_t) ldexpl (frac, 64);
+  exp -= 64;
+
+  /* Remove trailing zero bits to keep the products small */
+  while (!(m & 1)) {
+    m >>= 1;
+    ++exp;
+  }
+
+  if (!fastdigits (m, exp, mode, ndigits, decpt, buf, bufsize, rve))
+    return 0;
+  *sign = signbit (x) != 0;
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Function: parsedecimal()
+ *
+ * Description:
+ *  Parse a decimal floating point number of the form
+ *  [+-]digits[.digits][(e|E)[+-]digits] into a mantissa and a power of ten.
+ *
+ * Return value:
+ *  1 if the whole string was parsed and the mantissa fits in 64 bits, and 0
+ *  otherwise (including hexadecimal numbers, infinities, and NaNs).
+ */
+static int
+parsedecimal (const char * s, int * negative, uint64_t * mantissa, int * exp10) {
+  uint64_t m = 0;
+  int digits = 0;
+  int scale = 0;
+  int sawdigit = 0;
+
+  *negative = 0;
+  if ((*s == '+') || (*s == '-'))
+    *negative = (*s++ == '-');
+
+  for (; (*s >= '0') && (*s <= '9'); ++s) {
+    sawdigit = 1;
+    if ((m == 0) && (*s == '0'))
+      continue;
+    if (++digits > 19)
+      return 0;
+    m = m * 10 + (*s - '0');
+  }
+
+  if (*s == '.') {
+    for (++s; (*s >= '0') && (*s <= '9'); ++s) {
+      sawdigit = 1;
+      --scale;
+      if ((m == 0) && (*s == '0'))
+        continue;
+      if (++digits > 19)
+        return 0;
+      m = m * 10 + (*s - '0');
+    }
+  }
+
+  if (!sawdigit)
+    return 0;
+
+  if ((*s == 'e') || (*s == 'E')) {
+    int eneg = 0;
+    int e = 0;
+    ++s;
+    if ((*s == '+') || (*s == '-'))
+      eneg = (*s++ == '-');
+    if ((*s < '0') || (*s > '9'))
+      return 0;
+    for (; (*s >= '0') && (*s <= '9'); ++s) {
+      if (e < 100000)
+        e = e * 10 + (*s - '0');
+    }
+    scale += eneg ? -e : e;
+  }
+
+  if (*s != '\0')
+    return 0;
+
+  *mantissa = m;
+  *exp10 = scale;
+  return 1;
+}
+
+/*
+ * Functions: __fast_strtof(), __fast_strtod(), __fast_strtold()
+ *
+ * Description:
+ *  Convert a complete decimal string to a float, double, or long double when
+ *  the conversion needs only one correctly rounded operation.
+ *
+ * Return value:
+ *  1 if *result was set and 0 if the caller must use strtold().
+ */
+int
+__fast_strtof (const char * s, float * result) {
+#if FLT_EVAL_METHOD == 0
+  static const float tens[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+  };
+  int negative, e;
+  uint64_t m;
+  float f;
+
+  if (!parsedecimal (s, &negative, &m, &e))
+    return 0;
+  if ((m > (((uint64_t) 1) << FLT_MANT_DIG)) || (e < -10) || (e > 10))
+    return (m == 0) ? (*result = negative ? -0.0f : 0.0f, 1) : 0;
+
+  f = (float) m;
+  f = (e < 0) ? f / tens[-e] : f * tens[e];
+  *result = negative ? -f : f;
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+int
+__fast_strtod (const char * s, double * result) {
+#if FLT_EVAL_METHOD == 0
+  static const double tens[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  int negative, e;
+  uint64_t m;
+  double d;
+
+  if (!parsedecimal (s, &negative, &m, &e))
+    return 0;
+  if ((m > (((uint64_t) 1) << DBL_MANT_DIG)) || (e < -22) || (e > 22))
+    return (m == 0) ? (*result = negative ? -0.0 : 0.0, 1) : 0;
+
+  d = (double) m;
+  d = (e < 0) ? d / tens[-e] : d * tens[e];
+  *result = negative ? -d : d;
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+int
+__fast_strtold (const char * s, long double * result) {
+#if (LDBL_MANT_DIG == 64) && ((FLT_EVAL_METHOD == 0) || (FLT_EVAL_METHOD == 2))
+  int negative, e, i;
+  uint64_t m;
+  long double d;
+  long double p = 1;
+
+  if (!parsedecimal (s, &negative, &m, &e))
+    return 0;
+
+  /* 10^27 = 2^27 * 5^27 and 5^27 < 2^64, so these powers are exact */
+  if ((e < -27) || (e > 27))
+    return (m == 0) ? (*result = negative ? -0.0L : 0.0L, 1) : 0;
+
+  for (i = 0; i < ((e < 0) ? -e : e); ++i)
+    p *= 10;
+
+  d = (long double) m;
+  d = (e < 0) ? d / p : d * p;
+  *result = negative ? -d : d;
+  return 1;
+#else
+  return 0;
+#endif
+}
@@ -47,6 +47,7 @@
 #include <ctype.h>
 #include <stdarg.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #if !defined(__FreeBSD__)
 #include <execinfo.h>
 #endif
@@ -80,6 +81,17 @@ size_t __softboundcets_statistics_stack_deallocations = 0;
 size_t __softboundcets_deref_check_count = 0;
 size_t* __softboundcets_global_lock = 0;
 
+size_t __softboundcets_trie_bytes = 0;
+size_t __softboundcets_trie_budget = 0;
+int __softboundcets_trie_degraded = 0;
+
+__softboundcets_trie_entry_t __softboundcets_empty_trie_entry;
+__softboundcets_trie_entry_t __softboundcets_wild_trie_entry;
+
+__softboundcets_trie_entry_t* __softboundcets_linear_shadow = NULL;
+size_t __softboundcets_linear_begin = 0;
+size_t __softboundcets_linear_size = 0;
+
 size_t* __softboundcets_temporal_space_begin = 0;
 size_t* __softboundcets_stack_temporal_space_begin = NULL;
 
@@ -156,6 +168,101 @@ __SOFTBOUNDCETS_NORETURN void __softboundcets_abort()
 
 static int softboundcets_initialized = 0;
 
+/* Read the budget for the metadata trie from the SAFECODE_METADATA_BUDGET
+   environment variable. The variable is shared with the other SAFECode
+   run-times: it holds comma separated <kind>=<size> entries, where a size may
+   end in K, M, or G. The trie is limited by the "trie" entry and by the
+   "total" entry or a size without a kind, whichever is smaller. */
+static void __softboundcets_init_trie_budget(void) {
+
+  const char* p = getenv("SAFECODE_METADATA_BUDGET");
+  if(p == NULL)
+    return;
+
+  while(*p){
+    const char* equals = strchr(p, '=');
+    const char* comma = strchr(p, ',');
+    int applies = 1;
+    if(equals != NULL && (comma == NULL || equals < comma)){
+      size_t len = equals - p;
+      applies = (len == 4 && strncmp(p, "trie", 4) == 0) ||
+                (len == 5 && strncmp(p, "total", 5) == 0);
+      p = equals + 1;
+    }
+
+    char* end;
+    size_t size = strtoul(p, &end, 10);
+    switch(*end){
+    case 'k': case 'K': size <<= 10; break;
+    case 'm': case 'M': size <<= 20; break;
+    case 'g': case 'G': size <<= 30; break;
+    default: break;
+    }
+
+    if(applies && size != 0 &&
+       (__softboundcets_trie_budget == 0 || size < __softboundcets_trie_budget))
+      __softboundcets_trie_budget = size;
+
+    p = strchr(end, ',');
+    if(p == NULL)
+      break;
+    p++;
+  }
+}
+
+/* Called when a secondary table of the trie would exceed the budget */
+void __softboundcets_trie_budget_exceeded(void) {
+
+  if(__softboundcets_trie_degraded)
+    return;
+
+  /* Pointers stored in memory without a trie get unchecked metadata from
+     now on; see __softboundcets_metadata_load */
+#ifdef __SOFTBOUNDCETS_SPATIAL
+  __softboundcets_wild_trie_entry.bound = (void*)(281474976710656);
+#elif __SOFTBOUNDCETS_TEMPORAL
+  __softboundcets_wild_trie_entry.key = 1;
+  __softboundcets_wild_trie_entry.lock = __softboundcets_global_lock;
+#else
+  __softboundcets_wild_trie_entry.bound = (void*)(281474976710656);
+  __softboundcets_wild_trie_entry.key = 1;
+  __softboundcets_wild_trie_entry.lock = __softboundcets_global_lock;
+#endif
+  __softboundcets_trie_degraded = 1;
+  fprintf(stderr, "SoftBoundCETS: trie metadata exceeded its budget of %zu bytes; pointers stored in new memory regions are no longer checked\n", __softboundcets_trie_budget);
+}
+
+/* Reserve the linear shadow.  It covers __SOFTBOUNDCETS_LINEAR_SHADOW_SPAN
+   bytes starting 1GB below the start of the heap, which includes the globals
+   of the program and the memory that malloc gets with brk.  If the shadow
+   cannot be reserved, all metadata is kept in the trie. */
+static void __softboundcets_init_linear_shadow(void) {
+
+  size_t span = __SOFTBOUNDCETS_LINEAR_SHADOW_SPAN;
+  if(span == 0)
+    return;
+
+  size_t length = (span >> 3) * sizeof(__softboundcets_trie_entry_t);
+  void* shadow = mmap(0, length, PROT_READ| PROT_WRITE, 
+                      SOFTBOUNDCETS_MMAP_FLAGS, -1, 0);
+  if(shadow == MAP_FAILED)
+    return;
+
+  size_t gigabyte = (size_t) 1 << 30;
+  size_t begin = (size_t) sbrk(0) & ~(gigabyte - 1);
+  begin = begin > gigabyte ? begin - gigabyte : 0;
+
+  /* The shadow must not hold the metadata of its own pages */
+  if((size_t) shadow + length > begin && (size_t) shadow < begin + span){
+    munmap(shadow, length);
+    return;
+  }
+
+  __softboundcets_linear_shadow = shadow;
+  __softboundcets_linear_begin = begin;
+  __softboundcets_linear_size = span;
+}
+
 __NO_INLINE void __softboundcets_stub(void) {
   return;
 }
@@ -176,6 +283,8 @@ void __softboundcets_init( int is_trie)
   
   softboundcets_initialized = 1;
 
+  __softboundcets_init_trie_budget();
+
   if (__SOFTBOUNDCETS_DEBUG) {
     __softboundcets_printf("Initializing softboundcets metadata space\n");
   }
@@ -244,6 +353,9 @@ void __softboundcets_init( int is_trie)
                                               PROT_READ| PROT_WRITE, 
                                               SOFTBOUNDCETS_MMAP_FLAGS, -1, 0);
     assert(__softboundcets_trie_primary_table != (void *)-1);  
+
+    if(__SOFTBOUNDCETS_LINEAR_SHADOW)
+      __softboundcets_init_linear_shadow();
     
     int* temp = malloc(1);
     __softboundcets_allocation_secondary_trie_allocate_range(0, (size_t)temp);
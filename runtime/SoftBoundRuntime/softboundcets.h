@@ -188,6 +188,19 @@ static const int __SOFTBOUNDCETS_PREALLOCATE_TRIE = 1;
 static const int __SOFTBOUNDCETS_PREALLOCATE_TRIE = 0;
 #endif
 
+/* Keep the metadata of pointers stored in and near the heap in a linear
+   shadow: one region reserved at startup in which the entry of each pointer
+   slot is found with a subtraction, a shift and an add, instead of two
+   dependent loads through the trie.  Pointers stored elsewhere (stacks,
+   memory mapped blocks) keep using the trie.  The linear shadow is only
+   available on 64-bit systems and is not subject to the trie budget. */
+#ifdef __SOFTBOUNDCETS_LINEAR_SHADOW
+#undef __SOFTBOUNDCETS_LINEAR_SHADOW
+static const int __SOFTBOUNDCETS_LINEAR_SHADOW = 1;
+#else
+static const int __SOFTBOUNDCETS_LINEAR_SHADOW = 0;
+#endif
+
 #ifdef __SOFTBOUNDCETS_SPATIAL_TEMPORAL 
 #define __SOFTBOUNDCETS_FREE_MAP
 #endif
@@ -220,6 +233,9 @@ static const size_t __SOFTBOUNDCETS_N_FREE_MAP_ENTRIES = ((size_t) 32 * (size_t)
 // each secondary entry has 2^ 22 entries 
 static const size_t __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES = ((size_t) 4 * (size_t) 1024 * (size_t) 1024); 
 
+// the shadow for all of memory would not fit in the address space
+static const size_t __SOFTBOUNDCETS_LINEAR_SHADOW_SPAN = 0;
+
 #else
 
 static const size_t __SOFTBOUNDCETS_N_TEMPORAL_ENTRIES = ((size_t) 64*(size_t) 1024 * (size_t) 1024); 
@@ -238,6 +254,9 @@ static const size_t __SOFTBOUNDCETS_N_FREE_MAP_ENTRIES = ((size_t) 32 * (size_t)
 // each secondary entry has 2^ 22 entries 
 static const size_t __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES = ((size_t) 4 * (size_t) 1024 * (size_t) 1024); 
 
+// the linear shadow covers 4TB of memory with 2^39 entries (16TB reserved)
+static const size_t __SOFTBOUNDCETS_LINEAR_SHADOW_SPAN = ((size_t) 1 << 42);
+
 #endif
 
 
@@ -265,6 +284,27 @@ extern __SOFTBOUNDCETS_NORETURN void __softboundcets_abort();
 extern void __softboundcets_printf(const char* str, ...);
 extern size_t* __softboundcets_global_lock; 
 
+/* Bytes of trie secondary tables allocated and the budget for them (0 means
+   no budget), set from SAFECODE_METADATA_BUDGET */
+extern size_t __softboundcets_trie_bytes;
+extern size_t __softboundcets_trie_budget;
+
+/* Non-zero once the trie budget has been exceeded */
+extern int __softboundcets_trie_degraded;
+extern void __softboundcets_trie_budget_exceeded(void);
+
+/* Entries returned by __softboundcets_metadata_entry for pointers stored
+   where no part of the trie was allocated: metadata that fails every check,
+   and unchecked metadata once the trie budget has been exceeded */
+extern __softboundcets_trie_entry_t __softboundcets_empty_trie_entry;
+extern __softboundcets_trie_entry_t __softboundcets_wild_trie_entry;
+
+/* The linear shadow and the memory that it covers; the size is 0 if the
+   linear shadow is not used */
+extern __softboundcets_trie_entry_t* __softboundcets_linear_shadow;
+extern size_t __softboundcets_linear_begin;
+extern size_t __softboundcets_linear_size;
+
 void* __softboundcets_safe_calloc(size_t, size_t);
 void* __softboundcets_safe_malloc(size_t);
 void __softboundcets_safe_free(void*);
@@ -272,6 +312,7 @@ void __softboundcets_safe_free(void*);
 void * __softboundcets_safe_mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset);
 __WEAK_INLINE void __softboundcets_allocation_secondary_trie_allocate(void* addr_of_ptr);
 __WEAK_INLINE void __softboundcets_add_to_free_map(size_t ptr_key, void* ptr) ;
+__WEAK_INLINE __softboundcets_trie_entry_t* __softboundcets_metadata_entry(void* addr_of_ptr);
 
 /******************************************************************************/
 
@@ -444,12 +485,66 @@ __WEAK_INLINE __softboundcets_trie_entry_t* __softboundcets_trie_allocate(){
   
   __softboundcets_trie_entry_t* secondary_entry;
   size_t length = (__SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES) * sizeof(__softboundcets_trie_entry_t);
+
+  /* Secondary tables allocated on demand are subject to the metadata
+     budget. Once it is exceeded, no more tables are allocated: metadata
+     stores that would need one are dropped and loads of such metadata give
+     unchecked bounds. */
+  if(!__SOFTBOUNDCETS_PREALLOCATE_TRIE && __softboundcets_trie_budget &&
+     (__softboundcets_trie_bytes + length > __softboundcets_trie_budget)){
+    __softboundcets_trie_budget_exceeded();
+    return NULL;
+  }
+
   secondary_entry = __softboundcets_safe_mmap(0, length, PROT_READ| PROT_WRITE, SOFTBOUNDCETS_MMAP_FLAGS, -1, 0);
+  __softboundcets_trie_bytes += length;
   //assert(secondary_entry != (void*)-1); 
   //printf("snd trie table %p %lx\n", secondary_entry, length);
   return secondary_entry;
 }
 
+/* Return the entry of the linear shadow for the pointer stored at
+   addr_of_ptr, or NULL if its metadata is in the trie */
+__WEAK_INLINE __softboundcets_trie_entry_t* 
+__softboundcets_linear_entry(size_t addr_of_ptr){
+
+  size_t offset = addr_of_ptr - __softboundcets_linear_begin;
+  if(!__SOFTBOUNDCETS_LINEAR_SHADOW || offset >= __softboundcets_linear_size)
+    return NULL;
+
+  return &__softboundcets_linear_shadow[offset >> 3];
+}
+
+/* Return the entry into which the metadata of the pointer stored at
+   addr_of_ptr is written, allocating the secondary table of the trie that
+   holds it if necessary.  NULL is returned if the metadata budget does not
+   allow the table to be allocated. */
+__WEAK_INLINE __softboundcets_trie_entry_t* 
+__softboundcets_metadata_store_entry(size_t addr_of_ptr){
+
+  __softboundcets_trie_entry_t* entry_ptr = 
+    __softboundcets_linear_entry(addr_of_ptr);
+  if(entry_ptr != NULL)
+    return entry_ptr;
+
+  size_t primary_index = (addr_of_ptr >> 25);
+  __softboundcets_trie_entry_t* trie_secondary_table = 
+    __softboundcets_trie_primary_table[primary_index];
+
+  if(!__SOFTBOUNDCETS_PREALLOCATE_TRIE) {
+    if(trie_secondary_table == NULL){
+      trie_secondary_table =  __softboundcets_trie_allocate();
+      __softboundcets_trie_primary_table[primary_index] = trie_secondary_table;
+    }    
+    /* The metadata budget was exceeded; drop the metadata */
+    if(trie_secondary_table == NULL)
+      return NULL;
+  }
+
+  size_t secondary_index = ((addr_of_ptr >> 3) & 0x3fffff);
+  return &trie_secondary_table[secondary_index];
+}
+
 __WEAK_INLINE void __softboundcets_introspect_metadata(void* ptr, void* base, void* bound, int arg_no){
   
   printf("[introspect_metadata]ptr=%p, base=%p, bound=%p, arg_no=%d\n", ptr, base, bound, arg_no);
@@ -478,6 +573,37 @@ __METADATA_INLINE void __softboundcets_copy_metadata(void* dest, void* from, siz
 
   }
 
+  /* Copy the metadata slot by slot if either side is in the linear shadow,
+     and as one block if both are */
+  if(__SOFTBOUNDCETS_LINEAR_SHADOW && 
+     (__softboundcets_linear_entry(dest_ptr) || 
+      __softboundcets_linear_entry(from_ptr) ||
+      __softboundcets_linear_entry(dest_ptr_end - 1) ||
+      __softboundcets_linear_entry(from_ptr_end - 1))){
+
+    __softboundcets_trie_entry_t* dest_entry = 
+      __softboundcets_linear_entry(dest_ptr);
+    __softboundcets_trie_entry_t* from_entry = 
+      __softboundcets_linear_entry(from_ptr);
+
+    if(dest_entry && from_entry && 
+       __softboundcets_linear_entry(dest_ptr_end - 1) &&
+       __softboundcets_linear_entry(from_ptr_end - 1)){
+      memmove(dest_entry, from_entry, 
+              sizeof(__softboundcets_trie_entry_t) * (size >> 3));
+      return;
+    }
+
+    size_t index;
+    for(index = 0; index + 8 <= size; index = index + 8){
+      from_entry = __softboundcets_metadata_entry((void*)(from_ptr + index));
+      dest_entry = __softboundcets_metadata_store_entry(dest_ptr + index);
+      if(dest_entry != NULL)
+        *dest_entry = *from_entry;
+    }
+    return;
+  }
+
   //  printf("dest=%p, from=%p, size=%zx\n", dest, from, size);
   __softboundcets_trie_entry_t* trie_secondary_table_dest_begin;
   __softboundcets_trie_entry_t* trie_secondary_table_from_begin;
@@ -519,6 +645,9 @@ __METADATA_INLINE void __softboundcets_copy_metadata(void* dest, void* from, siz
         __softboundcets_trie_primary_table[temp_to_pindex] = temp_to_strie;
       }
 
+      if(temp_from_strie == NULL || temp_to_strie == NULL)
+        continue;
+
       void* dest_entry_ptr = &temp_to_strie[dest_secondary_index];
       void* from_entry_ptr = &temp_from_strie[from_secondary_index];
   
@@ -546,6 +675,8 @@ __METADATA_INLINE void __softboundcets_copy_metadata(void* dest, void* from, siz
     trie_secondary_table_dest_begin = __softboundcets_trie_allocate();
     __softboundcets_trie_primary_table[dest_primary_index_begin] = trie_secondary_table_dest_begin;
     //    printf("[copy_metadata] allocating secondary trie for dest_primary_index=%zx, orig_dest=%p, orig_from=%p\n", dest_primary_index_begin, dest, from);
+    if(trie_secondary_table_dest_begin == NULL)
+      return;
   }
 
   size_t dest_secondary_index = ((dest_ptr>> 3) & 0x3fffff);
@@ -722,27 +853,12 @@ __METADATA_INLINE void __softboundcets_metadata_store(void* addr_of_ptr, void* b
   }
 
    
-  size_t ptr = (size_t) addr_of_ptr;
-  size_t primary_index;
-  __softboundcets_trie_entry_t* trie_secondary_table;
-  //  __softboundcets_trie_entry_t** trie_primary_table = __softboundcets_trie_primary_table;
-  
-  
-  primary_index = (ptr >> 25);
-  trie_secondary_table = __softboundcets_trie_primary_table[primary_index];
- 
- 
-  if(!__SOFTBOUNDCETS_PREALLOCATE_TRIE) {
-    if(trie_secondary_table == NULL){
-      trie_secondary_table =  __softboundcets_trie_allocate();
-      __softboundcets_trie_primary_table[primary_index] = trie_secondary_table;
-    }    
-    //    __softboundcetswithss_printf("addr_of_ptr=%zx, primary_index =%zx, trie_secondary_table=%p\n", addr_of_ptr, primary_index, trie_secondary_table);
-    assert(trie_secondary_table != NULL);
-  }
-  
-  size_t secondary_index = ((ptr >> 3) & 0x3fffff);
-  __softboundcets_trie_entry_t* entry_ptr =&trie_secondary_table[secondary_index];
+  __softboundcets_trie_entry_t* entry_ptr = 
+    __softboundcets_metadata_store_entry((size_t) addr_of_ptr);
+
+  /* The metadata budget was exceeded; drop the metadata */
+  if(entry_ptr == NULL)
+    return;
 
   if(__SOFTBOUNDCETS_DEBUG){
     //    printf("[metadata_store] base=%p, bound=%p, key=%zx, lock=%p\n", base, bound, key, lock);
@@ -815,39 +931,45 @@ __METADATA_INLINE void __softboundcets_metadata_load(void* addr_of_ptr, void** b
     
     //assert(__softboundcetswithss_trie_primary_table[primary_index] == trie_secondary_table);
 
-    size_t primary_index = ( ptr >> 25);
-    trie_secondary_table = __softboundcets_trie_primary_table[primary_index];
+    __softboundcets_trie_entry_t* entry_ptr = __softboundcets_linear_entry(ptr);
+    if(entry_ptr == NULL){
+      size_t primary_index = ( ptr >> 25);
+      trie_secondary_table = __softboundcets_trie_primary_table[primary_index];
 
 
-    if(!__SOFTBOUNDCETS_PREALLOCATE_TRIE) {      
-      if(trie_secondary_table == NULL) {  
+      if(!__SOFTBOUNDCETS_PREALLOCATE_TRIE) {      
+        if(trie_secondary_table == NULL) {  
+          /* Once the metadata budget is exceeded, stores into this part of
+             memory may have been dropped, so give the pointer unchecked
+             metadata instead of metadata that fails every check. */
 #ifdef __SOFTBOUNDCETS_SPATIAL
-        *((void**) base) = 0;
-        *((void**) bound) = 0;
+          *((void**) base) = 0;
+          *((void**) bound) = __softboundcets_trie_degraded ? (void*)(281474976710656) : 0;
 #elif __SOFTBOUNDCETS_TEMPORAL
-        *((size_t*) key ) = 0;
-        *((size_t*) lock) = 0;        
+          *((size_t*) key ) = __softboundcets_trie_degraded ? 1 : 0;
+          *((size_t*) lock) = __softboundcets_trie_degraded ? (size_t) __softboundcets_global_lock : 0;
 
 #elif __SOFTBOUNDCETS_SPATIAL_TEMPORAL
 
-       *((void**) base) = 0;
-       *((void**) bound) = 0;
-       *((size_t*) key ) = 0;
-       *((size_t*) lock) = 0;        
+         *((void**) base) = 0;
+         *((void**) bound) = __softboundcets_trie_degraded ? (void*)(281474976710656) : 0;
+         *((size_t*) key ) = __softboundcets_trie_degraded ? 1 : 0;
+         *((size_t*) lock) = __softboundcets_trie_degraded ? (size_t) __softboundcets_global_lock : 0;
 
 #else
-       *((void**) base) = 0;
-       *((void**) bound) = 0;
-       *((size_t*) key ) = 0;
-       *((size_t*) lock) = 0;                
+         *((void**) base) = 0;
+         *((void**) bound) = __softboundcets_trie_degraded ? (void*)(281474976710656) : 0;
+         *((size_t*) key ) = __softboundcets_trie_degraded ? 1 : 0;
+         *((size_t*) lock) = __softboundcets_trie_degraded ? (size_t) __softboundcets_global_lock : 0;
 #endif 
-        return;
-      }
-    } /* PREALLOCATE_ENDS */
+          return;
+        }
+      } /* PREALLOCATE_ENDS */
 
-    /* MAIN SOFTBOUNDCETS LOAD WHICH RUNS ON THE NORMAL MACHINE */
-    size_t secondary_index = ((ptr >> 3) & 0x3fffff);
-    __softboundcets_trie_entry_t* entry_ptr = &trie_secondary_table[secondary_index];
+      /* MAIN SOFTBOUNDCETS LOAD WHICH RUNS ON THE NORMAL MACHINE */
+      size_t secondary_index = ((ptr >> 3) & 0x3fffff);
+      entry_ptr = &trie_secondary_table[secondary_index];
+    }
     
 #ifdef __SOFTBOUNDCETS_SPATIAL
       *((void**) base) = entry_ptr->base;
@@ -880,6 +1002,40 @@ __METADATA_INLINE void __softboundcets_metadata_load(void* addr_of_ptr, void** b
       return;
   }
 }
+
+/* Return the trie entry that holds the metadata of the pointer stored at
+   addr_of_ptr.  The pass loads the fields of the entry itself, so that the
+   metadata is never passed back through memory.  Pointers stored where no
+   part of the trie was allocated get an entry with the same metadata that
+   __softboundcets_metadata_load would give them. */
+__WEAK_INLINE __softboundcets_trie_entry_t* 
+__softboundcets_metadata_entry(void* addr_of_ptr){
+
+#ifdef __SOFTBOUNDCETS_STATISTICS_MODE
+  __softboundcets_statistics_metadata_loads++;
+#endif
+
+  if (__SOFTBOUNDCETS_DISABLE || !__SOFTBOUNDCETS_TRIE) {
+    return &__softboundcets_empty_trie_entry;
+  }
+
+  size_t ptr = (size_t) addr_of_ptr;
+  __softboundcets_trie_entry_t* entry_ptr = __softboundcets_linear_entry(ptr);
+  if(entry_ptr != NULL)
+    return entry_ptr;
+
+  size_t primary_index = ( ptr >> 25);
+  __softboundcets_trie_entry_t* trie_secondary_table = 
+    __softboundcets_trie_primary_table[primary_index];
+
+  if(!__SOFTBOUNDCETS_PREALLOCATE_TRIE && trie_secondary_table == NULL) {
+    return __softboundcets_trie_degraded ? &__softboundcets_wild_trie_entry : 
+                                           &__softboundcets_empty_trie_entry;
+  }
+
+  size_t secondary_index = ((ptr >> 3) & 0x3fffff);
+  return &trie_secondary_table[secondary_index];
+}
 /******************************************************************************/
 
 extern size_t __softboundcets_key_id_counter;
@@ -34,6 +34,7 @@ namespace llvm {
 /// never delete a BitmapPoolTy* directly!
 struct BitmapPoolTy {
   static const unsigned AddrArrSize = 2;
+  static const unsigned LargeArrayBins = 8;
   // Linked list of slabs used for stack allocations
   void * StackSlabs;
 
@@ -66,11 +67,17 @@ struct BitmapPoolTy {
   // NodeSize - Keep track of the object size tracked by this pool
   unsigned short NodeSize;
 
-  // Large arrays. In SAFECode, these are currently not freed or reused. 
-  // A better implementation could split them up into single slabs for reuse,
-  // upon being freed.
+  // Large arrays.  Freed large arrays are kept in FreeLargeArrays, binned by
+  // the power of two below their number of pages, and reused for later large
+  // arrays of a similar size.
   void *LargeArrays;
-  void *FreeLargeArrays;
+  void *FreeLargeArrays[LargeArrayBins];
+
+  // The number of pages of freed large arrays whose memory is still resident
+  unsigned HotLargeArrayPages;
+
+  // Linked list of slabs owned by thread caches
+  void *OwnedSlabs;
 };
 
 #if 0
@@ -124,6 +131,10 @@ extern "C" {
   void * poolstrdup(llvm::BitmapPoolTy *Pool, void *Node);
   void poolfree(llvm::BitmapPoolTy *Pool, void *Node);
   void * __pa_bitmap_poolcheck(llvm::BitmapPoolTy *Pool, void *Node);
+  int __pa_bitmap_nodebounds(llvm::BitmapPoolTy *Pool, void *Node,
+                             void **Start, void **End);
+  void * __pa_bitmap_poolresize(llvm::BitmapPoolTy *Pool, void *Node,
+                                unsigned NumBytes);
 }
 
 #endif
@@ -24,6 +24,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
 
 // Use macros so that I won't pollute the namespace
 
@@ -244,6 +246,34 @@ extern "C"
   ssize_t pool_sendto (PPOOL, void *, int, size_t, int, const struct sockaddr *, socklen_t, COMPLETE);
   ssize_t pool_sendto_debug (PPOOL, void *, int, size_t, int, const struct sockaddr *, socklen_t, COMPLETE, DEBUG_INFO);
 
+  // Vectored and batched I/O; the pool is that of the iovec/msghdr array
+
+  ssize_t pool_readv (PPOOL, const struct iovec *, int, int, COMPLETE);
+  ssize_t pool_readv_debug (PPOOL, const struct iovec *, int, int, COMPLETE, DEBUG_INFO);
+
+  ssize_t pool_writev (PPOOL, const struct iovec *, int, int, COMPLETE);
+  ssize_t pool_writev_debug (PPOOL, const struct iovec *, int, int, COMPLETE, DEBUG_INFO);
+
+  ssize_t pool_preadv (PPOOL, const struct iovec *, int, int, off_t, COMPLETE);
+  ssize_t pool_preadv_debug (PPOOL, const struct iovec *, int, int, off_t, COMPLETE, DEBUG_INFO);
+
+  ssize_t pool_pwritev (PPOOL, const struct iovec *, int, int, off_t, COMPLETE);
+  ssize_t pool_pwritev_debug (PPOOL, const struct iovec *, int, int, off_t, COMPLETE, DEBUG_INFO);
+
+  ssize_t pool_recvmsg (PPOOL, struct msghdr *, int, int, COMPLETE);
+  ssize_t pool_recvmsg_debug (PPOOL, struct msghdr *, int, int, COMPLETE, DEBUG_INFO);
+
+  ssize_t pool_sendmsg (PPOOL, const struct msghdr *, int, int, COMPLETE);
+  ssize_t pool_sendmsg_debug (PPOOL, const struct msghdr *, int, int, COMPLETE, DEBUG_INFO);
+
+#if defined(__linux__)
+  int pool_recvmmsg (PPOOL, struct mmsghdr *, int, unsigned int, int, struct timespec *, COMPLETE);
+  int pool_recvmmsg_debug (PPOOL, struct mmsghdr *, int, unsigned int, int, struct timespec *, COMPLETE, DEBUG_INFO);
+
+  int pool_sendmmsg (PPOOL, struct mmsghdr *, int, unsigned int, int, COMPLETE);
+  int pool_sendmmsg_debug (PPOOL, struct mmsghdr *, int, unsigned int, int, COMPLETE, DEBUG_INFO);
+#endif
+
   ssize_t pool_readlink (PPOOL, PPOOL, const char *path, char *buf, size_t bufsiz, COMPLETE);
   ssize_t pool_readlink_debug (PPOOL, PPOOL, const char *path, char *buf, size_t bufsiz, COMPLETE, DEBUG_INFO);
 
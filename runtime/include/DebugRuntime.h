@@ -97,6 +97,22 @@ struct DebugPoolTy : public BitmapPoolTy {
   unsigned char cacheIndex;
 };
 
+//
+// Structure: ObjectBounds
+//
+// Description:
+//  The bounds of a memory object as returned by pchk_getbounds().  The
+//  structure is returned in registers so that the compiler can keep the
+//  bounds in SSA values.
+//
+struct ObjectBounds {
+  // The address of the first valid byte of the object
+  void * start;
+
+  // The address of the last valid byte of the object
+  void * end;
+};
+
 void * rewrite_ptr (DebugPoolTy * Pool, const void * p, void * ObjStart,
 void * ObjEnd, const char * SourceFile, unsigned lineno);
 void installAllocHooks (void);
@@ -177,6 +193,7 @@ extern "C" {
                           unsigned lineno);
 
   void * pchk_getActualValue (PPOOL, void * src);
+  llvm::ObjectBounds pchk_getbounds (PPOOL, void * Node);
 
   // Indirect function call checks
   void funccheck   (void *f, void * targets[]);
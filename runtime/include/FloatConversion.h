@@ -8,7 +8,7 @@
 //===----------------------------------------------------------------------===//
 //
 // This file declares functions used by the runtime format string function
-// wrappers for converting floating point numbers into strings.
+// wrappers for converting floating point numbers into strings and back.
 //
 //===----------------------------------------------------------------------===//
 
@@ -16,6 +16,8 @@
 #ifndef _FLOAT_CONVERSION_H
 #define _FLOAT_CONVERSION_H
 
+#include <stddef.h>
+
 extern "C"
 {
   extern char *__dtoa(double, int, int, int *, int *, char **);
@@ -23,6 +25,16 @@ extern "C"
   extern char *__hdtoa(double, const char *, int, int *, int *, char **);
   extern char *__hldtoa(long double, const char *, int, int *, int *, char **);
   extern void  __freedtoa(char *);
+
+  // Allocation-free fast paths; these return 0 when the caller must fall back
+  // to the functions above (or to strtold()).
+  extern int __fast_dtoa(double, int, int, int *, int *,
+                         char *, size_t, char **);
+  extern int __fast_ldtoa(long double *, int, int, int *, int *,
+                          char *, size_t, char **);
+  extern int __fast_strtof(const char *, float *);
+  extern int __fast_strtod(const char *, double *);
+  extern int __fast_strtold(const char *, long double *);
 }
 
 #endif
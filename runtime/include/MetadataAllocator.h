@@ -0,0 +1,72 @@
+//===- MetadataAllocator.h - Allocator that accounts for metadata -*- C++ -*-=//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines MetadataAllocator, an STL compatible allocator that gets
+// memory from the default allocator and charges it to one of the metadata
+// budgets of the run-time.  Unlike std::allocator, it may be instantiated
+// with void and rebound to the real element type by the container.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_METADATAALLOCATOR_H_
+#define _SC_METADATAALLOCATOR_H_
+
+#include "safecode/Runtime/MetadataBudget.h"
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+template<typename T, SCMetadataKind Kind = SC_MD_SPLAY_NODES>
+struct MetadataAllocator {
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T value_type;
+  template <class U> struct rebind {
+    typedef MetadataAllocator<U, Kind> other;
+  };
+
+  template<typename R>
+  MetadataAllocator(const MetadataAllocator<R, Kind> &) {}
+  MetadataAllocator() {}
+
+  pointer allocate(size_t n, const void * hint = 0) {
+    sc_md_charge (Kind, n * sizeof(T));
+    return static_cast<pointer>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_t n) {
+    sc_md_release (Kind, n * sizeof(T));
+    ::operator delete(static_cast<void*>(p));
+  }
+
+  template<typename U>
+  void construct(U * p, const U &val) {
+    new(static_cast<void*>(p)) U(val);
+  }
+  template<typename U>
+  void destroy(U * p) {
+    p->~U();
+  }
+};
+
+template<typename T, SCMetadataKind Kind>
+inline bool operator==(const MetadataAllocator<T, Kind> &,
+                       const MetadataAllocator<T, Kind> &) {
+  return true;
+}
+template<typename T, SCMetadataKind Kind>
+inline bool operator!=(const MetadataAllocator<T, Kind> &,
+                       const MetadataAllocator<T, Kind> &) {
+  return false;
+}
+
+#endif
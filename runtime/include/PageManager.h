@@ -49,8 +49,23 @@ static const unsigned int NumShadows=4;
 /// 
 void InitializePageManager();
 
+/// GetPages - Allocates NumPages contiguous pages of size PageSize.  The
+/// memory is aligned on a PageSize boundary, so the page containing any
+/// address within it can be found by masking the address.
 void *GetPages(unsigned NumPages);
 
+/// PagesBegin, PagesEnd - The lowest address and one past the highest address
+/// of all of the memory returned by GetPages().  Addresses outside of this
+/// range were never allocated by the page manager.
+extern uintptr_t PagesBegin;
+extern uintptr_t PagesEnd;
+
+/// isPageManagerAddress - Determine whether the address may lie within memory
+/// returned by GetPages().
+static inline bool isPageManagerAddress(const void * Addr) {
+  return ((uintptr_t)Addr >= PagesBegin) && ((uintptr_t)Addr < PagesEnd);
+}
+
 /// PageSize - Contains the size of the unit of memory allocated by
 /// AllocatePage.  This is a value that is typically several kilobytes in size,
 /// and is guaranteed to be a power of two.
@@ -89,6 +104,10 @@ void UnprotectShadowPage(void * beginPage, unsigned NumPPage);
 /// future allocation.
 void FreePage(void *Page);
 
+/// ReleasePages - Give the physical memory behind NumPages pages back to the
+/// operating system.  The pages stay mapped and read as zero afterwards.
+void ReleasePages(void *Addr, unsigned NumPages);
+
 // The set of free memory pages we retrieved from the OS.
 typedef std::vector<void*> FreePagesListType;
 extern FreePagesListType FreePages;
@@ -17,6 +17,8 @@
 #ifndef SUPPORT_SPLAYTREE_H
 #define SUPPORT_SPLAYTREE_H
 
+#include "MetadataAllocator.h"
+
 template<typename dataTy>
 struct range_tree_node {
   range_tree_node(void* s, void* e) : left(0), right(0), start(s), end(e) {}
@@ -50,6 +52,9 @@ class RangeSplayTree {
   typename _Alloc::template rebind<tree_node >::other __node_alloc;
   
   tree_node* Tree;
+
+  // The number of nodes visited by the last splay operation
+  unsigned Depth;
     
   tree_node* rotate_right(tree_node* p) {
     tree_node* x = p->left;
@@ -72,6 +77,7 @@ class RangeSplayTree {
   /* This function by D. Sleator <sleator@cs.cmu.edu> */
   tree_node* splay (tree_node * t, void* key) {
     tree_node N, *l, *r, *y;
+    unsigned depth = 1;
     if (t == 0) return t;
     N.left = N.right = 0;
     l = r = &N;
@@ -89,6 +95,7 @@ class RangeSplayTree {
         r->left = t;                               /* link right */
         r = t;
         t = t->left;
+        ++depth;
       } else if (key_gt(key, t)) {
         if (t->right == 0) break;
         if (key_gt(key, t->right)) {
@@ -101,6 +108,7 @@ class RangeSplayTree {
         l->right = t;                              /* link left */
         l = t;
         t = t->right;
+        ++depth;
       } else {
         break;
       }
@@ -109,6 +117,7 @@ class RangeSplayTree {
     r->left = t->right;
     t->left = N.right;
     t->right = N.left;
+    Depth = depth;
     return t;
   }
 
@@ -164,7 +173,8 @@ class RangeSplayTree {
 
  public:
 
-  explicit RangeSplayTree(const _Alloc& a) :__node_alloc(a), Tree(0) {}
+  explicit RangeSplayTree(const _Alloc& a)
+    :__node_alloc(a), Tree(0), Depth(0) {}
   ~RangeSplayTree() { __clear(); }
   
   tree_node* __insert(void* start, void* end) {
@@ -210,10 +220,29 @@ class RangeSplayTree {
     return false; /* not there */
   }
 
+  // Change the end of the range that begins at start, provided that the new
+  // range does not overlap the next range
+  tree_node* __resize(void* start, void* end) {
+    tree_node* t = __find(start);
+    if (!t || t->start != start || end < start) return 0;
+    if (end > t->end) {
+      tree_node* next = t->right;
+      while (next && next->left)
+        next = next->left;
+      if (next && next->start <= end) return 0;
+    }
+    t->end = end;
+    return t;
+  }
+
   unsigned __count() {
     return count_internal(Tree);
   }
 
+  unsigned __depth() const {
+    return Depth;
+  }
+
   void __clear() {
     __clear_internal(Tree);
     Tree = 0;
@@ -235,7 +264,7 @@ class RangeSplayTree {
   }
 };
 
-template<class Allocator = std::allocator<void> >
+template<class Allocator = MetadataAllocator<void> >
 class RangeSplaySet 
 {
   RangeSplayTree<void, Allocator> Tree;
@@ -266,8 +295,27 @@ class RangeSplaySet
     return Tree.__remove(key);
   }
 
+  //
+  // Method: resize()
+  //
+  // Description:
+  //  Change the last valid address of the element that begins at the
+  //  specified address without removing and reinserting it.
+  //
+  // Return value:
+  //  true  - The element was resized.
+  //  false - No element begins at start or the new end would overlap the next
+  //          element.
+  //
+  bool resize(void* start, void* end) {
+    return 0 != Tree.__resize(start, end);
+  }
+
   unsigned count() { return Tree.__count(); }
 
+  // Number of nodes visited by the last insert, remove, or find
+  unsigned depth() const { return Tree.__depth(); }
+
   void clear() { Tree.__clear(); }
 
   template <class O>
@@ -287,7 +335,7 @@ class RangeSplaySet
   }
 };
 
-template<typename T, class Allocator = std::allocator<T> >
+template<typename T, class Allocator = MetadataAllocator<T> >
 class RangeSplayMap {
   RangeSplayTree<T, Allocator> Tree;
   
@@ -305,8 +353,16 @@ class RangeSplayMap {
   bool remove(void* key) {
     return Tree.__remove(key);
   }
+
+  // Change the end of the element that begins at start in place
+  bool resize(void* start, void* end) {
+    return 0 != Tree.__resize(start, end);
+  }
   
   unsigned count() { return Tree.__count(); }
+
+  // Number of nodes visited by the last insert, remove, or find
+  unsigned depth() const { return Tree.__depth(); }
   
   void clear() { Tree.__clear(); }
   
@@ -0,0 +1,147 @@
+/*===- bb-tagged.c - Compare tagged and table-based baggy bounds checks ---===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This benchmark measures the cost of the baggy bounds run-time checks when
+ * the object size is found in the size table and when it is found in the
+ * pointer tag.  Each check is measured both as a call into the run-time and
+ * as the inline code that the inline-bbchecks pass generates for it, which
+ * only calls the run-time when the inline comparison fails.  The objects are
+ * visited in a random order so that the size table lookups do not all hit in
+ * the cache.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+#include "safecode/Runtime/BBMetaData.h"
+
+#if defined(__x86_64__)
+
+#define NUM_OBJECTS (1 << 16)
+#define OBJECT_SIZE 48
+#define SLOT_SIZE 4
+
+/* The size of an object and its metadata rounded up to a power of two */
+#define ALLOC_SIZE 64
+
+extern void pool_init_runtime (unsigned, unsigned, unsigned);
+extern void * __sc_bb_poolalloc (void *, unsigned);
+extern void __sc_bb_poolregister (void *, void *, unsigned);
+extern void * __sc_bb_tagged_poolalloc (void *, unsigned);
+extern void bb_poolcheck (void *, void *);
+extern void bb_tagged_poolcheck (void *, void *);
+extern void * bb_boundscheck (void *, void *, void *);
+extern void * bb_tagged_boundscheck (void *, void *, void *);
+extern unsigned char * __baggybounds_size_table_begin;
+
+static char * TableObjects[NUM_OBJECTS];
+static char * TaggedObjects[NUM_OBJECTS];
+static unsigned Order[NUM_OBJECTS];
+
+/*
+ * Function: inline_check()
+ *
+ * Description:
+ *  Perform the same comparisons as the inline code generated by the
+ *  inline-bbchecks pass.  Return nonzero if the run-time must be called.
+ */
+static inline int
+inline_check (uintptr_t source, uintptr_t dest, int tagged) {
+  uintptr_t e, addr = source, destaddr = dest;
+  uintptr_t allocsize, begin, size;
+
+  if (tagged) {
+    e = source >> BB_TAG_SHIFT;
+    addr = bb_untag (source);
+    destaddr = bb_untag (dest);
+  } else {
+    e = __baggybounds_size_table_begin[source >> SLOT_SIZE];
+  }
+
+  if (__builtin_expect (((source ^ dest) >> e) != 0 || e == 0, 0))
+    return 1;
+
+  allocsize = ((uintptr_t) 1) << e;
+  begin = addr & -allocsize;
+  size = ((struct BBMetaData *) (begin + allocsize -
+                                 sizeof (struct BBMetaData)))->size;
+  return __builtin_expect (addr - begin >= size || destaddr - begin >= size,
+                           0);
+}
+
+static void
+run (const char * name, char ** objects, int tagged, int gep, int inlined,
+     unsigned long iterations) {
+  unsigned long i;
+  double start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    char * p = objects[Order[i % NUM_OBJECTS]];
+    char * q = gep ? p + OBJECT_SIZE - 1 : p;
+    if (inlined && !inline_check ((uintptr_t) p, (uintptr_t) q, tagged)) {
+      bench_sink = q;
+    } else if (gep) {
+      bench_sink = tagged ? bb_tagged_boundscheck (0, p, q)
+                          : bb_boundscheck (0, p, q);
+    } else if (tagged) {
+      bb_tagged_poolcheck (0, p);
+    } else {
+      bb_poolcheck (0, p);
+    }
+  }
+  bench_report ("bb-tagged", name, iterations, bench_now () - start);
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (20000000);
+  unsigned i;
+
+  pool_init_runtime (0, 1, 0);
+
+  for (i = 0; i < NUM_OBJECTS; ++i) {
+    struct BBMetaData * data;
+    TableObjects[i] = __sc_bb_poolalloc (0, OBJECT_SIZE);
+    __sc_bb_poolregister (0, TableObjects[i], OBJECT_SIZE);
+
+    /* The compiler records the size of each object at the end of its
+       allocation; the inline checks read it from there. */
+    data = (struct BBMetaData *) (TableObjects[i] + ALLOC_SIZE -
+                                  sizeof (*data));
+    data->size = OBJECT_SIZE;
+    TaggedObjects[i] = __sc_bb_tagged_poolalloc (0, OBJECT_SIZE);
+    Order[i] = i;
+  }
+
+  srand (1);
+  for (i = NUM_OBJECTS - 1; i > 0; --i) {
+    unsigned j = rand () % (i + 1);
+    unsigned t = Order[i];
+    Order[i] = Order[j];
+    Order[j] = t;
+  }
+
+  run ("poolcheck-table", TableObjects, 0, 0, 0, iterations);
+  run ("poolcheck-tagged", TaggedObjects, 1, 0, 0, iterations);
+  run ("boundscheck-table", TableObjects, 0, 1, 0, iterations);
+  run ("boundscheck-tagged", TaggedObjects, 1, 1, 0, iterations);
+  run ("poolcheck-table-inline", TableObjects, 0, 0, 1, iterations);
+  run ("poolcheck-tagged-inline", TaggedObjects, 1, 0, 1, iterations);
+  run ("boundscheck-table-inline", TableObjects, 0, 1, 1, iterations);
+  run ("boundscheck-tagged-inline", TaggedObjects, 1, 1, 1, iterations);
+  return 0;
+}
+
+#else
+
+int
+main (int argc, char ** argv) {
+  fprintf (stderr, "bb-tagged: tagged pointers are only supported on x86-64\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*===- bench.h - Support code for the SAFECode benchmarks -----------------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This file provides timing and reporting routines shared by the benchmarks
+ * in this directory.  Each measurement is printed as one JSON object per line
+ * so that results from several runs can be collected and compared by scripts.
+ *
+ * The number of iterations can be changed with the BENCH_ITERATIONS
+ * environment variable.  Programs that are built in more than one
+ * configuration (e.g., natively and with SAFECode) define BENCH_CONFIG to
+ * name the configuration; it is recorded in every measurement.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#ifndef _SC_BENCH_H_
+#define _SC_BENCH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef BENCH_CONFIG
+#define BENCH_CONFIG "native"
+#endif
+
+/*
+ * Function: bench_now()
+ *
+ * Description:
+ *  Return the current value of the monotonic clock in nanoseconds.
+ */
+static inline double
+bench_now (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Function: bench_iterations()
+ *
+ * Description:
+ *  Return the number of iterations to run, which is the value of the
+ *  BENCH_ITERATIONS environment variable if it is set and the specified
+ *  default otherwise.
+ */
+static inline unsigned long
+bench_iterations (unsigned long dflt) {
+  const char * env = getenv ("BENCH_ITERATIONS");
+  if (env && atol (env) > 0)
+    return (unsigned long) atol (env);
+  return dflt;
+}
+
+/*
+ * Function: bench_report()
+ *
+ * Description:
+ *  Print the result of one measurement as a JSON object.
+ *
+ * Inputs:
+ *  suite - The name of the benchmark program.
+ *  name  - The name of the measurement within the program.
+ *  ops   - The number of operations performed.
+ *  ns    - The elapsed time in nanoseconds.
+ */
+static inline void
+bench_report (const char * suite, const char * name,
+              unsigned long ops, double ns) {
+  printf ("{\"suite\": \"%s\", \"config\": \"%s\", \"name\": \"%s\", "
+          "\"ops\": %lu, \"ns\": %.0f, \"ns_per_op\": %.3f}\n",
+          suite, BENCH_CONFIG, name, ops, ns, ops ? ns / ops : 0.0);
+  fflush (stdout);
+}
+
+/*
+ * Macro: BENCH_LOOP()
+ *
+ * Description:
+ *  Run the specified statement the specified number of times and report the
+ *  elapsed time.  The statement may use bench_i, the iteration number.
+ */
+#define BENCH_LOOP(suite, name, iterations, stmt)                 \
+  do {                                                            \
+    unsigned long bench_n = (iterations);                         \
+    unsigned long bench_i;                                        \
+    double bench_start = bench_now ();                            \
+    for (bench_i = 0; bench_i < bench_n; ++bench_i) {             \
+      stmt;                                                       \
+    }                                                             \
+    bench_report ((suite), (name), bench_n, bench_now () - bench_start); \
+  } while (0)
+
+/*
+ * Function: bench_shuffle()
+ *
+ * Description:
+ *  Fill the array with a random permutation of the numbers 0 to count - 1.
+ *  The same seed is used on every run so that runs can be compared.
+ */
+static inline void
+bench_shuffle (unsigned * order, unsigned count) {
+  unsigned i;
+  for (i = 0; i < count; ++i)
+    order[i] = i;
+
+  srand (1);
+  for (i = count - 1; i > 0; --i) {
+    unsigned j = rand () % (i + 1);
+    unsigned t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+}
+
+/*
+ * Variable: bench_sink
+ *
+ * Description:
+ *  Benchmarks store results here so that the compiler cannot remove the
+ *  computation being measured.
+ */
+static void * volatile bench_sink;
+
+#endif
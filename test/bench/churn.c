@@ -0,0 +1,81 @@
+/*===- churn.c - Allocation churn workload --------------------------------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This workload keeps a window of live heap objects of varying sizes and
+ * repeatedly replaces a random object with a new one.  Each new object is
+ * filled and read back, so the workload measures the cost of object
+ * registration and the checks on freshly allocated memory.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#include <string.h>
+
+#define WINDOW 4096
+
+struct object {
+  unsigned size;
+  unsigned char * data;
+};
+
+static struct object Live[WINDOW];
+
+/*
+ * Function: next_size()
+ *
+ * Description:
+ *  Return the size of the next allocation.  Most allocations are small, with
+ *  an occasional large one, much like a typical C program.
+ */
+static unsigned
+next_size (unsigned long i) {
+  unsigned r = (unsigned) (i * 2654435761u);
+  if ((r & 63) == 0)
+    return 1024 + (r >> 20);
+  return 8 + ((r >> 8) & 127);
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (4000000);
+  unsigned long checksum = 0;
+  unsigned long i;
+  unsigned j;
+  double start;
+
+  for (j = 0; j < WINDOW; ++j) {
+    Live[j].size = next_size (j);
+    Live[j].data = malloc (Live[j].size);
+    memset (Live[j].data, 0, Live[j].size);
+  }
+
+  start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    struct object * obj = &Live[(i * 7919) % WINDOW];
+    unsigned size = next_size (i + WINDOW);
+
+    /* Read the old object before it is freed. */
+    checksum += obj->data[obj->size - 1] + obj->data[0];
+    free (obj->data);
+
+    obj->size = size;
+    obj->data = malloc (size);
+    for (j = 0; j < size; j += 8)
+      obj->data[j] = (unsigned char) (i + j);
+    obj->data[size - 1] = (unsigned char) i;
+  }
+  bench_report ("churn", "malloc-free-touch", iterations, bench_now () - start);
+
+  for (j = 0; j < WINDOW; ++j)
+    free (Live[j].data);
+
+  bench_sink = (void *) checksum;
+  return 0;
+}
@@ -0,0 +1,208 @@
+/*===- compile-time.c - Measure the time and memory used by a compile -----===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This program runs a compiler command and reports how long each pass took,
+ * how long the whole command took, and the peak memory used by the compiler.
+ * The command must print the LLVM -time-passes report on standard error,
+ * which clang does with -ftime-report and the LTO plugin does with
+ * -Wl,-plugin-opt=-time-passes.
+ *
+ * Usage: compile-time <suite> <config> <command> [arguments...]
+ *
+ * Results are printed in the same JSON format as the other benchmarks, one
+ * object per pass, followed by the total time and the peak resident set size
+ * of the largest process that the command ran.  Passes that appear in more
+ * than one timing report (e.g., in several pass managers) are summed.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+struct pass_time {
+  char * name;
+  double seconds;
+};
+
+static struct pass_time * Passes;
+static unsigned NumPasses;
+
+/*
+ * Function: add_pass_time()
+ *
+ * Description:
+ *  Add the time of a pass to its running total.
+ */
+static void
+add_pass_time (const char * name, double seconds) {
+  unsigned i;
+  for (i = 0; i < NumPasses; ++i) {
+    if (strcmp (Passes[i].name, name) == 0) {
+      Passes[i].seconds += seconds;
+      return;
+    }
+  }
+
+  Passes = realloc (Passes, (NumPasses + 1) * sizeof (struct pass_time));
+  Passes[NumPasses].name = strdup (name);
+  Passes[NumPasses].seconds = seconds;
+  ++NumPasses;
+}
+
+/*
+ * Function: parse_timing_line()
+ *
+ * Description:
+ *  Parse one line of a -time-passes report.  A line holds one or more columns
+ *  of the form "seconds (percent%)", of which the last is the wall time, an
+ *  optional column of memory used, and the name of the pass.
+ *
+ * Return value:
+ *  1 - The line held the time of a pass, which has been recorded.
+ *  0 - The line is not the time of a pass.
+ */
+static int
+parse_timing_line (char * line) {
+  double seconds = 0, column, percent;
+  unsigned columns = 0;
+  char * p = line;
+  int used;
+
+  while (sscanf (p, " %lf (%lf%%)%n", &column, &percent, &used) == 2) {
+    seconds = column;
+    p += used;
+    ++columns;
+  }
+  if (!columns)
+    return 0;
+
+  /* Skip the memory column, if there is one. */
+  used = 0;
+  sscanf (p, " %*d%n", &used);
+  p += used;
+
+  while (*p == ' ' || *p == '\t')
+    ++p;
+  p[strcspn (p, "\r\n")] = '\0';
+  if (!*p || strcmp (p, "Total") == 0)
+    return 0;
+
+  add_pass_time (p, seconds);
+  return 1;
+}
+
+/*
+ * Function: print_string()
+ *
+ * Description:
+ *  Print a string as a JSON string.
+ */
+static void
+print_string (const char * s) {
+  putchar ('"');
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\')
+      putchar ('\\');
+    putchar (*s);
+  }
+  putchar ('"');
+}
+
+/*
+ * Function: report()
+ *
+ * Description:
+ *  Print one measurement in the format used by bench_report().
+ */
+static void
+report (const char * suite, const char * config, const char * name,
+        double ns) {
+  printf ("{\"suite\": ");
+  print_string (suite);
+  printf (", \"config\": ");
+  print_string (config);
+  printf (", \"name\": ");
+  print_string (name);
+  printf (", \"ops\": 1, \"ns\": %.0f, \"ns_per_op\": %.3f}\n", ns, ns);
+}
+
+int
+main (int argc, char ** argv) {
+  char output[] = "/tmp/compile-time.XXXXXX";
+  struct rusage usage;
+  double start, elapsed;
+  char line[4096];
+  FILE * timings;
+  pid_t pid;
+  int status;
+  int fd;
+  unsigned i;
+
+  if (argc < 4) {
+    fprintf (stderr, "Usage: %s <suite> <config> <command> [arguments...]\n",
+             argv[0]);
+    return 1;
+  }
+
+  /*
+   * Run the command with its standard error sent to a temporary file.
+   */
+  if ((fd = mkstemp (output)) == -1) {
+    perror ("mkstemp");
+    return 1;
+  }
+  unlink (output);
+
+  start = bench_now ();
+  if ((pid = fork ()) == 0) {
+    dup2 (fd, 2);
+    execvp (argv[3], argv + 3);
+    perror (argv[3]);
+    _exit (127);
+  }
+  if (pid == -1) {
+    perror ("fork");
+    return 1;
+  }
+  waitpid (pid, &status, 0);
+  elapsed = bench_now () - start;
+  getrusage (RUSAGE_CHILDREN, &usage);
+
+  /*
+   * Read the timing reports.  If the command failed, show what it printed.
+   */
+  lseek (fd, 0, SEEK_SET);
+  timings = fdopen (fd, "r");
+  while (fgets (line, sizeof (line), timings)) {
+    if (!parse_timing_line (line) &&
+        (!WIFEXITED (status) || WEXITSTATUS (status)))
+      fputs (line, stderr);
+  }
+  fclose (timings);
+
+  if (!WIFEXITED (status) || WEXITSTATUS (status)) {
+    fprintf (stderr, "%s: %s failed\n", argv[0], argv[3]);
+    return 1;
+  }
+
+  for (i = 0; i < NumPasses; ++i)
+    report (argv[1], argv[2], Passes[i].name, Passes[i].seconds * 1e9);
+  report (argv[1], argv[2], "total", elapsed);
+
+  printf ("{\"suite\": ");
+  print_string (argv[1]);
+  printf (", \"config\": ");
+  print_string (argv[2]);
+  printf (", \"name\": \"peak-rss\", \"kb\": %ld}\n", usage.ru_maxrss);
+  return 0;
+}
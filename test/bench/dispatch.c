@@ -0,0 +1,99 @@
+/*===- dispatch.c - Indirect dispatch workload ----------------------------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This workload runs a small stack-based interpreter whose instructions are
+ * dispatched through a table of function pointers.  It measures the cost of
+ * the indirect call checks and of the checks on the interpreter's stack and
+ * program arrays.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#define STACK_SIZE 64
+
+struct machine {
+  long stack[STACK_SIZE];
+  unsigned sp;
+};
+
+typedef void (*handler) (struct machine *, long);
+
+static void op_push (struct machine * m, long arg) {
+  m->stack[m->sp++] = arg;
+}
+
+static void op_add (struct machine * m, long arg) {
+  --m->sp;
+  m->stack[m->sp - 1] += m->stack[m->sp];
+}
+
+static void op_mul (struct machine * m, long arg) {
+  --m->sp;
+  m->stack[m->sp - 1] *= m->stack[m->sp];
+}
+
+static void op_xor (struct machine * m, long arg) {
+  --m->sp;
+  m->stack[m->sp - 1] ^= m->stack[m->sp];
+}
+
+static void op_dup (struct machine * m, long arg) {
+  m->stack[m->sp] = m->stack[m->sp - 1];
+  ++m->sp;
+}
+
+static void op_pop (struct machine * m, long arg) {
+  --m->sp;
+}
+
+enum { PUSH, ADD, MUL, XOR, DUP, POP };
+
+static handler Handlers[] = { op_push, op_add, op_mul, op_xor, op_dup, op_pop };
+
+struct insn {
+  unsigned op;
+  long arg;
+};
+
+/*
+ * The program computes a hash and adds it to the value on top of the stack,
+ * leaving the stack depth unchanged.
+ */
+static const struct insn Program[] = {
+  {PUSH, 17}, {PUSH, 31}, {MUL, 0}, {DUP, 0}, {PUSH, 7}, {XOR, 0},
+  {ADD, 0}, {DUP, 0}, {PUSH, 3}, {MUL, 0}, {XOR, 0}, {PUSH, 5},
+  {ADD, 0}, {DUP, 0}, {POP, 0}, {ADD, 0}
+};
+
+#define PROGRAM_SIZE (sizeof (Program) / sizeof (Program[0]))
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (2000000);
+  struct machine * m = malloc (sizeof (struct machine));
+  unsigned long i;
+  unsigned pc;
+  double start;
+
+  m->sp = 1;
+  m->stack[0] = 0;
+
+  start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    for (pc = 0; pc < PROGRAM_SIZE; ++pc)
+      Handlers[Program[pc].op] (m, Program[pc].arg);
+  }
+  bench_report ("dispatch", "interpreter", iterations * PROGRAM_SIZE,
+                bench_now () - start);
+
+  bench_sink = (void *) m->stack[0];
+  free (m);
+  return 0;
+}
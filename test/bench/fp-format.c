@@ -0,0 +1,94 @@
+/*===- fp-format.c - Compare the float conversion fast paths with gdtoa ---===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This benchmark measures the floating point conversions used by the checked
+ * printf() and scanf() wrappers: the gdtoa routines, which allocate their
+ * result, and the allocation-free fast paths that are tried first.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_VALUES 4096
+
+extern char * __dtoa (double, int, int, int *, int *, char **);
+extern void __freedtoa (char *);
+extern int __fast_dtoa (double, int, int, int *, int *,
+                        char *, size_t, char **);
+extern int __fast_strtod (const char *, double *);
+
+static double Values[NUM_VALUES];
+static char Strings[NUM_VALUES][32];
+static volatile double Result;
+
+static void
+run_dtoa (const char * name, int mode, int ndigits, int fast,
+          unsigned long iterations) {
+  unsigned long i;
+  int decpt, sign;
+  char * end;
+  char buf[48];
+  double start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    double d = Values[i % NUM_VALUES];
+    if (fast && __fast_dtoa (d, mode, ndigits, &decpt, &sign,
+                             buf, sizeof (buf), &end)) {
+      bench_sink = end;
+    } else {
+      char * s = __dtoa (d, mode, ndigits, &decpt, &sign, &end);
+      bench_sink = end;
+      __freedtoa (s);
+    }
+  }
+  bench_report ("fp-format", name, iterations, bench_now () - start);
+}
+
+static void
+run_strtod (const char * name, int fast, unsigned long iterations) {
+  unsigned long i;
+  double start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    const char * s = Strings[i % NUM_VALUES];
+    double d;
+    if (!(fast && __fast_strtod (s, &d)))
+      d = (double) strtold (s, NULL);
+    Result = d;
+  }
+  bench_report ("fp-format", name, iterations, bench_now () - start);
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (2000000);
+  unsigned i;
+
+  /*
+   * Use values with a mix of magnitudes and precisions like those found in
+   * program output.
+   */
+  srand (1);
+  for (i = 0; i < NUM_VALUES; ++i) {
+    Values[i] = (rand () % 1000000) / (double) (1 + rand () % 1000);
+    if (rand () & 1)
+      Values[i] = -Values[i];
+    snprintf (Strings[i], sizeof (Strings[i]), "%.*g",
+              1 + rand () % 15, Values[i]);
+  }
+
+  run_dtoa ("dtoa-e6", 2, 7, 0, iterations);
+  run_dtoa ("fast-e6", 2, 7, 1, iterations);
+  run_dtoa ("dtoa-f6", 3, 6, 0, iterations);
+  run_dtoa ("fast-f6", 3, 6, 1, iterations);
+  run_strtod ("strtold", 0, iterations);
+  run_strtod ("fast-strtod", 1, iterations);
+  return 0;
+}
@@ -0,0 +1,175 @@
+/*===- gencorpus.c - Generate inputs for the compile-time benchmark -------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This program writes a C translation unit of the requested shape to standard
+ * output.  Each shape stresses a different part of the SAFECode pipeline:
+ *
+ *   callgraph - A deep call graph of small functions that pass pointers to
+ *               each other, which stresses the interprocedural analyses and
+ *               the number of functions instrumented.
+ *   bigfunc   - A single function with a very large number of loads, stores,
+ *               and branches, which stresses the per-function passes and the
+ *               check optimizations.
+ *   globals   - Many global arrays and structures, which stresses global
+ *               object registration.
+ *
+ * Usage: gencorpus <shape> [size]
+ *
+ * The output is the same on every run so that results can be compared.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Function: gen_callgraph()
+ *
+ * Description:
+ *  Write a call graph of the specified number of functions.  Each function
+ *  updates a local array through a pointer and calls the next function and
+ *  one further down the graph, so the graph is as deep as it is wide.
+ */
+static void
+gen_callgraph (unsigned size) {
+  unsigned i;
+
+  printf ("struct node { long value; long data[8]; struct node * next; };\n\n");
+  for (i = 0; i < size; ++i)
+    printf ("long f%u (struct node *, long *, unsigned);\n", i);
+  printf ("\n");
+
+  for (i = 0; i < size; ++i) {
+    printf ("long\nf%u (struct node * n, long * p, unsigned depth) {\n", i);
+    printf ("  long local[16];\n");
+    printf ("  unsigned i;\n");
+    printf ("  if (!n || !depth) return p[0];\n");
+    printf ("  for (i = 0; i < 16; ++i)\n");
+    printf ("    local[i] = n->data[i & 7] + p[i & 3] + %u;\n", i);
+    printf ("  n->value += local[depth & 15];\n");
+    if (i + 1 < size)
+      printf ("  n->value += f%u (n->next, local, depth - 1);\n", i + 1);
+    if (2 * i + 2 < size)
+      printf ("  n->value ^= f%u (n, local + 4, depth / 2);\n", 2 * i + 2);
+    printf ("  return n->value;\n}\n\n");
+  }
+
+  printf ("int\nmain (void) {\n");
+  printf ("  struct node n = {0, {0}, 0};\n");
+  printf ("  long p[4] = {1, 2, 3, 4};\n");
+  printf ("  return (int) f0 (&n, p, 8);\n}\n");
+}
+
+/*
+ * Function: gen_bigfunc()
+ *
+ * Description:
+ *  Write a single function with the specified number of statements.  The
+ *  statements index several arrays with computed indices and branch on the
+ *  values loaded so that the function has many basic blocks.
+ */
+static void
+gen_bigfunc (unsigned size) {
+  unsigned i;
+
+  printf ("long\nbig (long * a, long * b, char * s, unsigned n) {\n");
+  printf ("  long acc = 0;\n");
+  printf ("  unsigned i = n;\n");
+  for (i = 0; i < size; ++i) {
+    switch (i % 4) {
+      case 0:
+        printf ("  acc += a[(i + %u) %% n] * b[(i * %u) %% n];\n", i, i | 1);
+        break;
+      case 1:
+        printf ("  if (acc & %u) b[(acc + %u) %% n] = acc;\n",
+                1u << (i % 16), i);
+        printf ("  else acc -= a[i %% n];\n");
+        break;
+      case 2:
+        printf ("  s[(i + %u) %% n] = (char) (acc + s[(i + %u) %% n]);\n",
+                i, i + 1);
+        break;
+      case 3:
+        printf ("  i = (i * 33 + (unsigned) acc) %% n;\n");
+        break;
+    }
+  }
+  printf ("  return acc;\n}\n\n");
+
+  printf ("int\nmain (void) {\n");
+  printf ("  long a[64] = {0}, b[64] = {0};\n");
+  printf ("  char s[64] = {0};\n");
+  printf ("  return (int) big (a, b, s, 64);\n}\n");
+}
+
+/*
+ * Function: gen_globals()
+ *
+ * Description:
+ *  Write the specified number of initialized global arrays and structures
+ *  and a function that uses each of them, so that none can be removed.
+ */
+static void
+gen_globals (unsigned size) {
+  unsigned i;
+
+  printf ("struct record { int id; char name[12]; long values[4]; };\n\n");
+  for (i = 0; i < size; ++i) {
+    if (i % 2)
+      printf ("struct record g%u = {%u, \"r%u\", {%u, %u, %u, %u}};\n",
+              i, i, i, i, i + 1, i + 2, i + 3);
+    else
+      printf ("int g%u[%u] = {%u, %u};\n", i, 4 + i % 13, i, i + 1);
+  }
+  printf ("\n");
+
+  printf ("long\nuse_globals (unsigned k) {\n");
+  printf ("  long acc = 0;\n");
+  for (i = 0; i < size; ++i) {
+    if (i % 2)
+      printf ("  acc += g%u.values[k & 3] + g%u.name[k %% 12];\n", i, i);
+    else
+      printf ("  acc += g%u[k %% %u];\n", i, 4 + i % 13);
+  }
+  printf ("  return acc;\n}\n\n");
+
+  printf ("int\nmain (int argc, char ** argv) {\n");
+  printf ("  return (int) use_globals ((unsigned) argc);\n}\n");
+}
+
+int
+main (int argc, char ** argv) {
+  static const struct {
+    const char * name;
+    void (*generate) (unsigned);
+    unsigned size;
+  } shapes[] = {
+    {"callgraph", gen_callgraph, 2000},
+    {"bigfunc", gen_bigfunc, 20000},
+    {"globals", gen_globals, 10000}
+  };
+  unsigned i;
+
+  if (argc < 2) {
+    fprintf (stderr, "Usage: %s <callgraph|bigfunc|globals> [size]\n", argv[0]);
+    return 1;
+  }
+
+  for (i = 0; i < sizeof (shapes) / sizeof (shapes[0]); ++i) {
+    if (strcmp (argv[1], shapes[i].name) == 0) {
+      unsigned size = (argc > 2) ? (unsigned) atoi (argv[2]) : shapes[i].size;
+      shapes[i].generate (size ? size : shapes[i].size);
+      return 0;
+    }
+  }
+
+  fprintf (stderr, "%s: unknown shape %s\n", argv[0], argv[1]);
+  return 1;
+}
@@ -0,0 +1,115 @@
+/*===- ptrchase.c - Pointer chasing workload ------------------------------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This workload traverses a linked list whose nodes are scattered through the
+ * heap and searches a binary tree.  Every step loads a pointer from a heap
+ * object and dereferences it, which is the worst case for checks that look
+ * up object bounds.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#define NUM_NODES (1 << 16)
+
+struct list {
+  struct list * next;
+  long value;
+};
+
+struct tree {
+  struct tree * left;
+  struct tree * right;
+  unsigned key;
+};
+
+static unsigned Order[NUM_NODES];
+
+/*
+ * Function: insert()
+ *
+ * Description:
+ *  Insert a node with the specified key into the tree.
+ */
+static struct tree *
+insert (struct tree * root, unsigned key) {
+  struct tree ** link = &root;
+  while (*link)
+    link = (key < (*link)->key) ? &(*link)->left : &(*link)->right;
+
+  *link = malloc (sizeof (struct tree));
+  (*link)->left = (*link)->right = 0;
+  (*link)->key = key;
+  return root;
+}
+
+/*
+ * Function: find()
+ *
+ * Description:
+ *  Return the depth at which the key is found in the tree.
+ */
+static unsigned
+find (struct tree * root, unsigned key) {
+  unsigned depth = 0;
+  while (root && root->key != key) {
+    root = (key < root->key) ? root->left : root->right;
+    ++depth;
+  }
+  return depth;
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (64);
+  struct list ** nodes = malloc (NUM_NODES * sizeof (struct list *));
+  struct list * head;
+  struct tree * root = 0;
+  unsigned long total = 0;
+  unsigned long i;
+  unsigned j;
+  double start;
+
+  /*
+   * Link the list nodes in a random order so that consecutive nodes are not
+   * adjacent in memory.
+   */
+  bench_shuffle (Order, NUM_NODES);
+  for (j = 0; j < NUM_NODES; ++j) {
+    nodes[j] = malloc (sizeof (struct list));
+    nodes[j]->value = j;
+  }
+  for (j = 0; j < NUM_NODES - 1; ++j)
+    nodes[Order[j]]->next = nodes[Order[j + 1]];
+  nodes[Order[NUM_NODES - 1]]->next = 0;
+  head = nodes[Order[0]];
+
+  for (j = 0; j < NUM_NODES; ++j)
+    root = insert (root, Order[j]);
+
+  start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    struct list * node;
+    for (node = head; node; node = node->next)
+      total += node->value;
+  }
+  bench_report ("ptrchase", "list-walk", iterations * NUM_NODES,
+                bench_now () - start);
+
+  start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    for (j = 0; j < NUM_NODES; j += 4)
+      total += find (root, j);
+  }
+  bench_report ("ptrchase", "tree-find", iterations * (NUM_NODES / 4),
+                bench_now () - start);
+
+  bench_sink = (void *) total;
+  return 0;
+}
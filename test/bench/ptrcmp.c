@@ -0,0 +1,127 @@
+/*===- ptrcmp.c - Cost of converting rewritten pointers back --------------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This benchmark measures what out of bounds pointer rewriting costs code
+ * that compares pointers.  The oob-rewriter pass converts every pointer that
+ * is compared or cast to an integer back to its original value.  The same
+ * comparison-heavy loops (a list walk with NULL and sentinel tests, and a
+ * pointer difference scan) are run three ways:
+ *
+ *   native - Without any conversion.
+ *   call   - With a call to pchk_getActualValue() for every pointer, which is
+ *            what the pass used to emit.
+ *   inline - With the inline test against the rewrite pointer range that the
+ *            pass now emits; the run-time is only called for pointers within
+ *            the range.
+ *
+ * An out of bounds pointer is rewritten before the loops run so that the
+ * rewrite pointer range exists, as it does in a program that uses rewriting.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#include <stdint.h>
+
+#define NUM_NODES (1 << 12)
+
+extern void pool_init_runtime (unsigned, unsigned, unsigned);
+extern void pool_register (void *, void *, unsigned);
+extern void * boundscheckui (void *, void *, void *);
+extern void * pchk_getActualValue (void *, void *);
+
+/* Bounds of the rewrite pointer range in the debug run-time */
+extern uintptr_t InvalidLower;
+extern uintptr_t InvalidUpper;
+
+struct list {
+  struct list * next;
+  long value;
+};
+
+static unsigned Order[NUM_NODES];
+
+/*
+ * Convert a pointer in the way the oob-rewriter pass does.
+ */
+#define ACTUAL_NATIVE(p) (p)
+#define ACTUAL_CALL(p)   ((struct list *) pchk_getActualValue (0, (p)))
+#define ACTUAL_INLINE(p)                                                \
+  ((__builtin_expect (((uintptr_t) (p) > InvalidLower) &&               \
+                      ((uintptr_t) (p) < InvalidUpper), 0))             \
+   ? (struct list *) pchk_getActualValue (0, (p)) : (p))
+
+/*
+ * Walk the list, stopping at NULL or at the sentinel, and count the nodes
+ * that lie before the sentinel in memory.
+ */
+#define LIST_WALK(ACTUAL)                                               \
+  do {                                                                  \
+    struct list * node;                                                 \
+    for (node = head; ACTUAL (node) != 0; node = node->next) {          \
+      if (ACTUAL (node) == ACTUAL (sentinel))                           \
+        break;                                                          \
+      if ((uintptr_t) ACTUAL (node) < (uintptr_t) ACTUAL (sentinel))    \
+        ++total;                                                        \
+    }                                                                   \
+  } while (0)
+
+/*
+ * Sum the distances between consecutive nodes of the list.
+ */
+#define PTR_DIFF(ACTUAL)                                                \
+  do {                                                                  \
+    unsigned j;                                                         \
+    for (j = 0; j < NUM_NODES - 1; ++j)                                 \
+      total += (uintptr_t) ACTUAL (nodes[j + 1]) -                      \
+               (uintptr_t) ACTUAL (nodes[j]);                           \
+  } while (0)
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (2000);
+  struct list ** nodes = malloc (NUM_NODES * sizeof (struct list *));
+  struct list * head;
+  struct list * sentinel;
+  unsigned long total = 0;
+  char * obj;
+  unsigned j;
+
+  pool_init_runtime (0, 1, 0);
+
+  /*
+   * Rewrite one out of bounds pointer so that the rewrite pointer range is
+   * allocated.
+   */
+  obj = malloc (64);
+  pool_register (0, obj, 64);
+  bench_sink = boundscheckui (0, obj, obj + 128);
+
+  bench_shuffle (Order, NUM_NODES);
+  for (j = 0; j < NUM_NODES; ++j) {
+    nodes[j] = malloc (sizeof (struct list));
+    nodes[j]->value = j;
+  }
+  for (j = 0; j < NUM_NODES - 1; ++j)
+    nodes[Order[j]]->next = nodes[Order[j + 1]];
+  nodes[Order[NUM_NODES - 1]]->next = 0;
+  head = nodes[Order[0]];
+  sentinel = nodes[Order[NUM_NODES - 1]];
+
+  BENCH_LOOP ("ptrcmp", "list-walk-native", iterations, LIST_WALK (ACTUAL_NATIVE));
+  BENCH_LOOP ("ptrcmp", "list-walk-call", iterations, LIST_WALK (ACTUAL_CALL));
+  BENCH_LOOP ("ptrcmp", "list-walk-inline", iterations, LIST_WALK (ACTUAL_INLINE));
+
+  BENCH_LOOP ("ptrcmp", "ptr-diff-native", iterations, PTR_DIFF (ACTUAL_NATIVE));
+  BENCH_LOOP ("ptrcmp", "ptr-diff-call", iterations, PTR_DIFF (ACTUAL_CALL));
+  BENCH_LOOP ("ptrcmp", "ptr-diff-inline", iterations, PTR_DIFF (ACTUAL_INLINE));
+
+  bench_sink = (void *) total;
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*===- rt-bb.c - Microbenchmarks for the baggy bounds run-time ------------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This benchmark measures the cost of each run-time check, allocator entry
+ * point, and C standard library wrapper in the baggy bounds run-time
+ * (libsc_bb_rt).  Objects are visited in a random order so that the size
+ * table lookups do not all hit in the cache.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define NUM_OBJECTS (1 << 14)
+#define OBJECT_SIZE 64
+
+extern void pool_init_runtime (unsigned, unsigned, unsigned);
+extern void * __sc_bb_poolalloc (void *, unsigned);
+extern void __sc_bb_poolfree (void *, void *);
+extern void __sc_bb_poolregister (void *, void *, unsigned);
+extern void __sc_bb_poolunregister (void *, void *);
+extern void bb_poolcheck (void *, void *);
+extern void bb_poolcheckui (void *, void *);
+extern void * bb_boundscheck (void *, void *, void *);
+extern void * bb_boundscheckui (void *, void *, void *);
+extern void * bb_exactcheck2 (char *, char *, char *, unsigned);
+extern void fastlscheck_debug (const char *, const char *, unsigned, unsigned,
+                               unsigned, const char *, unsigned);
+extern void funccheck (void *, void **);
+extern size_t pool_strlen (void *, const char *, const uint8_t);
+extern char * pool_strcpy (void *, void *, char *, const char *, const uint8_t);
+extern void * pool_memcpy (void *, void *, void *, const void *, size_t,
+                           const uint8_t);
+extern int pool_strcmp (void *, void *, const char *, const char *,
+                        const uint8_t);
+
+static char * Objects[NUM_OBJECTS];
+static unsigned Order[NUM_OBJECTS];
+
+static void target0 (void) { }
+static void target1 (void) { }
+static void target2 (void) { }
+static void target3 (void) { }
+
+#define RANDOM_OBJECT(i) (Objects[Order[(i) % NUM_OBJECTS]])
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (20000000);
+  void * targets[] = {(void *) target0, (void *) target1,
+                      (void *) target2, (void *) target3, 0};
+  char * obj;
+  char * copy;
+  unsigned i;
+
+  pool_init_runtime (0, 1, 0);
+
+  for (i = 0; i < NUM_OBJECTS; ++i) {
+    Objects[i] = __sc_bb_poolalloc (0, OBJECT_SIZE);
+    __sc_bb_poolregister (0, Objects[i], OBJECT_SIZE);
+    memset (Objects[i], 'a', OBJECT_SIZE - 1);
+    Objects[i][OBJECT_SIZE - 1] = '\0';
+  }
+  bench_shuffle (Order, NUM_OBJECTS);
+
+  obj = Objects[0];
+  copy = Objects[1];
+
+  /*
+   * Load/store and bounds checks.
+   */
+  BENCH_LOOP ("rt-bb", "poolcheck-random", iterations,
+              bb_poolcheck (0, RANDOM_OBJECT (bench_i)));
+  BENCH_LOOP ("rt-bb", "poolcheckui-random", iterations,
+              bb_poolcheckui (0, RANDOM_OBJECT (bench_i)));
+  BENCH_LOOP ("rt-bb", "boundscheck-random", iterations,
+              bench_sink = bb_boundscheck (0, RANDOM_OBJECT (bench_i),
+                                           RANDOM_OBJECT (bench_i) + 32));
+  BENCH_LOOP ("rt-bb", "boundscheckui-random", iterations,
+              bench_sink = bb_boundscheckui (0, RANDOM_OBJECT (bench_i),
+                                             RANDOM_OBJECT (bench_i) + 32));
+  BENCH_LOOP ("rt-bb", "exactcheck2", iterations,
+              bench_sink = bb_exactcheck2 (obj, obj, obj + (bench_i & 63),
+                                           OBJECT_SIZE));
+  BENCH_LOOP ("rt-bb", "fastlscheck", iterations,
+              fastlscheck_debug (obj, obj + (bench_i & 31), OBJECT_SIZE, 4,
+                                 0, 0, 0));
+  BENCH_LOOP ("rt-bb", "funccheck", iterations,
+              funccheck ((void *) target3, targets));
+
+  /*
+   * Object registration and allocation.
+   */
+  BENCH_LOOP ("rt-bb", "register-unregister", iterations / 4,
+              (__sc_bb_poolunregister (0, RANDOM_OBJECT (bench_i)),
+               __sc_bb_poolregister (0, RANDOM_OBJECT (bench_i),
+                                     OBJECT_SIZE)));
+  BENCH_LOOP ("rt-bb", "alloc-free", iterations / 4,
+              (bench_sink = __sc_bb_poolalloc (0, OBJECT_SIZE),
+               __sc_bb_poolfree (0, bench_sink)));
+
+  /*
+   * C standard library wrappers with complete pointers.
+   */
+  BENCH_LOOP ("rt-bb", "pool_strlen", iterations,
+              bench_sink = (void *) pool_strlen (0, obj, 1));
+  BENCH_LOOP ("rt-bb", "pool_strcpy", iterations,
+              bench_sink = pool_strcpy (0, 0, copy, obj, 3));
+  BENCH_LOOP ("rt-bb", "pool_memcpy", iterations,
+              bench_sink = pool_memcpy (0, 0, copy, obj, OBJECT_SIZE, 3));
+  BENCH_LOOP ("rt-bb", "pool_strcmp", iterations,
+              bench_sink = (void *) (intptr_t) pool_strcmp (0, 0, copy, obj,
+                                                            3));
+  return 0;
+}
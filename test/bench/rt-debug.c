@@ -0,0 +1,139 @@
+/*===- rt-debug.c - Microbenchmarks for the debug run-time ----------------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This benchmark measures the cost of each run-time check and C standard
+ * library wrapper in the debug run-time (libsc_dbg_rt).  Checks on registered
+ * objects are run twice: once on the same object, which hits in the lookup
+ * cache, and once on objects visited in a random order, which exercises the
+ * splay tree.  Objects allocated as single nodes of a pool are not kept in the
+ * splay tree; the node measurements check such objects in a random order.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define NUM_OBJECTS (1 << 14)
+#define OBJECT_SIZE 64
+
+extern void pool_init_runtime (unsigned, unsigned, unsigned);
+extern void * __sc_dbg_newpool (unsigned);
+extern void * poolalloc (void *, unsigned);
+extern void pool_register (void *, void *, unsigned);
+extern void pool_unregister (void *, void *);
+extern void poolcheck (void *, void *, unsigned);
+extern void poolcheckui (void *, void *, unsigned);
+extern void * boundscheck (void *, void *, void *);
+extern void * boundscheckui (void *, void *, void *);
+extern void * exactcheck2 (char *, char *, char *, unsigned);
+extern void fastlscheck (const char *, const char *, unsigned, unsigned);
+extern void funccheck (void *, void **);
+extern size_t pool_strlen (void *, const char *, const uint8_t);
+extern char * pool_strcpy (void *, void *, char *, const char *, const uint8_t);
+extern void * pool_memcpy (void *, void *, void *, const void *, size_t,
+                           const uint8_t);
+extern int pool_strcmp (void *, void *, const char *, const char *,
+                        const uint8_t);
+
+static char * Objects[NUM_OBJECTS];
+static char * Nodes[NUM_OBJECTS];
+static unsigned Order[NUM_OBJECTS];
+
+static void target0 (void) { }
+static void target1 (void) { }
+static void target2 (void) { }
+static void target3 (void) { }
+
+#define RANDOM_OBJECT(i) (Objects[Order[(i) % NUM_OBJECTS]])
+#define RANDOM_NODE(i) (Nodes[Order[(i) % NUM_OBJECTS]])
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (10000000);
+  void * targets[] = {(void *) target0, (void *) target1,
+                      (void *) target2, (void *) target3, 0};
+  void * pool;
+  char * obj;
+  char * copy;
+  unsigned i;
+
+  pool_init_runtime (0, 0, 0);
+  pool = __sc_dbg_newpool (OBJECT_SIZE);
+
+  for (i = 0; i < NUM_OBJECTS; ++i) {
+    Objects[i] = malloc (OBJECT_SIZE);
+    memset (Objects[i], 'a', OBJECT_SIZE - 1);
+    Objects[i][OBJECT_SIZE - 1] = '\0';
+    pool_register (0, Objects[i], OBJECT_SIZE);
+
+    Nodes[i] = poolalloc (pool, OBJECT_SIZE);
+    pool_register (pool, Nodes[i], OBJECT_SIZE);
+  }
+  bench_shuffle (Order, NUM_OBJECTS);
+
+  obj = Objects[0];
+  copy = Objects[1];
+
+  /*
+   * Load/store and bounds checks.
+   */
+  BENCH_LOOP ("rt-debug", "poolcheck-same", iterations,
+              poolcheck (0, obj + (bench_i & 31), 4));
+  BENCH_LOOP ("rt-debug", "poolcheck-random", iterations,
+              poolcheck (0, RANDOM_OBJECT (bench_i), 4));
+  BENCH_LOOP ("rt-debug", "poolcheckui-random", iterations,
+              poolcheckui (0, RANDOM_OBJECT (bench_i), 4));
+  BENCH_LOOP ("rt-debug", "boundscheck-same", iterations,
+              bench_sink = boundscheck (0, obj, obj + (bench_i & 63)));
+  BENCH_LOOP ("rt-debug", "boundscheck-random", iterations,
+              bench_sink = boundscheck (0, RANDOM_OBJECT (bench_i),
+                                        RANDOM_OBJECT (bench_i) + 32));
+  BENCH_LOOP ("rt-debug", "boundscheckui-random", iterations,
+              bench_sink = boundscheckui (0, RANDOM_OBJECT (bench_i),
+                                          RANDOM_OBJECT (bench_i) + 32));
+  BENCH_LOOP ("rt-debug", "poolcheck-node-random", iterations,
+              poolcheck (pool, RANDOM_NODE (bench_i), 4));
+  BENCH_LOOP ("rt-debug", "boundscheck-node-random", iterations,
+              bench_sink = boundscheck (pool, RANDOM_NODE (bench_i),
+                                        RANDOM_NODE (bench_i) + 32));
+  BENCH_LOOP ("rt-debug", "exactcheck2", iterations,
+              bench_sink = exactcheck2 (obj, obj, obj + (bench_i & 63),
+                                        OBJECT_SIZE));
+  BENCH_LOOP ("rt-debug", "fastlscheck", iterations,
+              fastlscheck (obj, obj + (bench_i & 31), OBJECT_SIZE, 4));
+  BENCH_LOOP ("rt-debug", "funccheck", iterations,
+              funccheck ((void *) target3, targets));
+
+  /*
+   * Object registration.  Re-register an object that was just unregistered
+   * so that the splay tree keeps the same size.
+   */
+  BENCH_LOOP ("rt-debug", "register-unregister", iterations / 4,
+              (pool_unregister (0, RANDOM_OBJECT (bench_i)),
+               pool_register (0, RANDOM_OBJECT (bench_i), OBJECT_SIZE)));
+  BENCH_LOOP ("rt-debug", "register-unregister-node", iterations / 4,
+              (pool_unregister (pool, RANDOM_NODE (bench_i)),
+               pool_register (pool, RANDOM_NODE (bench_i), OBJECT_SIZE)));
+
+  /*
+   * C standard library wrappers with complete pointers.
+   */
+  BENCH_LOOP ("rt-debug", "pool_strlen", iterations,
+              bench_sink = (void *) pool_strlen (0, obj, 1));
+  BENCH_LOOP ("rt-debug", "pool_strcpy", iterations,
+              bench_sink = pool_strcpy (0, 0, copy, obj, 3));
+  BENCH_LOOP ("rt-debug", "pool_memcpy", iterations,
+              bench_sink = pool_memcpy (0, 0, copy, obj, OBJECT_SIZE, 3));
+  BENCH_LOOP ("rt-debug", "pool_strcmp", iterations,
+              bench_sink = (void *) (intptr_t) pool_strcmp (0, 0, copy, obj,
+                                                            3));
+  return 0;
+}
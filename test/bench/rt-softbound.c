@@ -0,0 +1,165 @@
+/*===- rt-softbound.c - Microbenchmarks for the SoftBound run-time --------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This benchmark measures the cost of the SoftBound+CETS metadata operations,
+ * dereference checks, and allocation and C standard library wrappers.  Most
+ * of the checks are inline functions in softboundcets.h, so this file must be
+ * compiled with the same configuration macros as libsoftbound_rt.
+ *
+ * The SoftBound run-time provides main(), which sets up the run-time and calls
+ * softboundcets_pseudo_main().
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+#include "softboundcets.h"
+
+#define NUM_OBJECTS (1 << 14)
+#define OBJECT_SIZE 64
+
+extern void * softboundcets_malloc (size_t);
+extern void softboundcets_free (void *);
+extern size_t softboundcets_strlen (const char *);
+extern char * softboundcets_strcpy (char *, char *);
+
+static char * Objects[NUM_OBJECTS];
+static size_t Keys[NUM_OBJECTS];
+static void * Locks[NUM_OBJECTS];
+static char * Slots[NUM_OBJECTS];
+static unsigned Order[NUM_OBJECTS];
+
+#define RANDOM(i) (Order[(i) % NUM_OBJECTS])
+
+/*
+ * Function: alloc()
+ *
+ * Description:
+ *  Allocate an object with the SoftBound malloc() wrapper, which returns the
+ *  metadata of the new object on the shadow stack.
+ */
+static char *
+alloc (size_t size, size_t * key, void ** lock) {
+  char * ptr;
+  __softboundcets_allocate_shadow_stack_space (1);
+  ptr = softboundcets_malloc (size);
+  *key = __softboundcets_load_key_shadow_stack (0);
+  *lock = __softboundcets_load_lock_shadow_stack (0);
+  __softboundcets_deallocate_shadow_stack_space ();
+  return ptr;
+}
+
+/*
+ * Function: release()
+ *
+ * Description:
+ *  Free an object with the SoftBound free() wrapper.
+ */
+static void
+release (char * ptr, size_t key, void * lock) {
+  __softboundcets_allocate_shadow_stack_space (2);
+  __softboundcets_store_base_shadow_stack (ptr, 1);
+  __softboundcets_store_bound_shadow_stack (ptr + OBJECT_SIZE, 1);
+  __softboundcets_store_key_shadow_stack (key, 1);
+  __softboundcets_store_lock_shadow_stack (lock, 1);
+  softboundcets_free (ptr);
+  __softboundcets_deallocate_shadow_stack_space ();
+}
+
+/*
+ * Function: copy()
+ *
+ * Description:
+ *  Copy a string with the SoftBound strcpy() wrapper.
+ */
+static char *
+copy (char * dst, char * src) {
+  char * ret;
+  __softboundcets_allocate_shadow_stack_space (3);
+  __softboundcets_store_base_shadow_stack (dst, 1);
+  __softboundcets_store_bound_shadow_stack (dst + OBJECT_SIZE, 1);
+  __softboundcets_store_base_shadow_stack (src, 2);
+  __softboundcets_store_bound_shadow_stack (src + OBJECT_SIZE, 2);
+  ret = softboundcets_strcpy (dst, src);
+  __softboundcets_deallocate_shadow_stack_space ();
+  return ret;
+}
+
+int
+softboundcets_pseudo_main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (20000000);
+  void * base;
+  void * bound;
+  size_t key;
+  void * lock;
+  char * obj;
+  unsigned i;
+
+  for (i = 0; i < NUM_OBJECTS; ++i) {
+    Objects[i] = alloc (OBJECT_SIZE, &Keys[i], &Locks[i]);
+    memset (Objects[i], 'a', OBJECT_SIZE - 1);
+    Objects[i][OBJECT_SIZE - 1] = '\0';
+    Slots[i] = Objects[i];
+    __softboundcets_metadata_store (&Slots[i], Objects[i],
+                                    Objects[i] + OBJECT_SIZE,
+                                    Keys[i], Locks[i]);
+  }
+  bench_shuffle (Order, NUM_OBJECTS);
+  obj = Objects[0];
+
+  /*
+   * Metadata operations on pointers stored in memory.
+   */
+  BENCH_LOOP ("rt-softbound", "metadata-load", iterations,
+              (__softboundcets_metadata_load (&Slots[RANDOM (bench_i)],
+                                              &base, &bound, &key, &lock),
+               bench_sink = bound));
+  BENCH_LOOP ("rt-softbound", "metadata-entry", iterations,
+              bench_sink =
+                __softboundcets_metadata_entry (&Slots[RANDOM (bench_i)])->bound);
+  BENCH_LOOP ("rt-softbound", "metadata-store", iterations,
+              __softboundcets_metadata_store (&Slots[RANDOM (bench_i)],
+                                              Objects[RANDOM (bench_i)],
+                                              Objects[RANDOM (bench_i)] +
+                                                OBJECT_SIZE,
+                                              Keys[RANDOM (bench_i)],
+                                              Locks[RANDOM (bench_i)]));
+
+  /*
+   * Dereference checks.
+   */
+  BENCH_LOOP ("rt-softbound", "spatial-load-check", iterations,
+              __softboundcets_spatial_load_dereference_check (
+                obj, obj + OBJECT_SIZE, obj + (bench_i & 31), 4));
+  BENCH_LOOP ("rt-softbound", "spatial-store-check", iterations,
+              __softboundcets_spatial_store_dereference_check (
+                obj, obj + OBJECT_SIZE, obj + (bench_i & 31), 4));
+  BENCH_LOOP ("rt-softbound", "temporal-load-check", iterations,
+              __softboundcets_temporal_load_dereference_check (
+                Locks[RANDOM (bench_i)], Keys[RANDOM (bench_i)], 0, 0));
+  BENCH_LOOP ("rt-softbound", "temporal-store-check", iterations,
+              __softboundcets_temporal_store_dereference_check (
+                Locks[RANDOM (bench_i)], Keys[RANDOM (bench_i)], 0, 0));
+  BENCH_LOOP ("rt-softbound", "memcopy-check", iterations,
+              __softboundcets_memcopy_check (Objects[1], Objects[1],
+                                             Objects[1] + OBJECT_SIZE,
+                                             obj, obj, obj + OBJECT_SIZE,
+                                             OBJECT_SIZE));
+
+  /*
+   * Allocation and C standard library wrappers.
+   */
+  BENCH_LOOP ("rt-softbound", "malloc-free", iterations / 4,
+              (bench_sink = alloc (OBJECT_SIZE, &key, &lock),
+               release (bench_sink, key, lock)));
+  BENCH_LOOP ("rt-softbound", "strlen", iterations,
+              bench_sink = (void *) softboundcets_strlen (obj));
+  BENCH_LOOP ("rt-softbound", "strcpy", iterations,
+              bench_sink = copy (Objects[1], obj));
+  return 0;
+}
@@ -0,0 +1,106 @@
+/*===- sample.c - Overhead of sampled checking at different rates ---------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This benchmark measures how the cost of a checked function falls with the
+ * fraction of calls that are checked.  The function sums the words of a
+ * registered object chosen at random.  Its checked version calls poolcheck()
+ * before each load; its entry chooses between the two versions in the same
+ * way as the code added by the sample-checks pass.
+ *
+ * Each rate is measured in turn, from every call (1) to none (0), after a
+ * baseline that always calls the unchecked version.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+#include "safecode/Runtime/Sampling.h"
+
+#include <string.h>
+
+#define NUM_OBJECTS (1 << 14)
+#define OBJECT_WORDS 16
+
+extern void pool_init_runtime (unsigned, unsigned, unsigned);
+extern void pool_register (void *, void *, unsigned);
+extern void poolcheck (void *, void *, unsigned);
+
+static long * Objects[NUM_OBJECTS];
+static unsigned Order[NUM_OBJECTS];
+
+/*
+ * Function: sum_unchecked()
+ *
+ * Description:
+ *  Return the sum of the words of an object without checking the loads.
+ */
+static long __attribute__((noinline))
+sum_unchecked (long * obj) {
+  long total = 0;
+  unsigned i;
+  for (i = 0; i < OBJECT_WORDS; ++i)
+    total += obj[i];
+  return total;
+}
+
+/*
+ * Function: sum()
+ *
+ * Description:
+ *  Return the sum of the words of an object, checking the loads if the call
+ *  is sampled.
+ */
+static long __attribute__((noinline))
+sum (long * obj) {
+  long total = 0;
+  unsigned i;
+
+  if (__sc_sample_countdown != 0) {
+    --__sc_sample_countdown;
+    return sum_unchecked (obj);
+  }
+  if (!__sc_sample_hit ())
+    return sum_unchecked (obj);
+
+  for (i = 0; i < OBJECT_WORDS; ++i) {
+    poolcheck (0, &obj[i], sizeof (long));
+    total += obj[i];
+  }
+  return total;
+}
+
+int
+main (int argc, char ** argv) {
+  static const char * names[] = {"rate-1", "rate-1/10", "rate-1/100",
+                                 "rate-1/1000", "rate-0"};
+  static const double rates[] = {1, 0.1, 0.01, 0.001, 0};
+  unsigned long iterations = bench_iterations (10000000);
+  unsigned long total = 0;
+  unsigned i;
+
+  pool_init_runtime (0, 0, 0);
+
+  for (i = 0; i < NUM_OBJECTS; ++i) {
+    Objects[i] = malloc (OBJECT_WORDS * sizeof (long));
+    memset (Objects[i], 0, OBJECT_WORDS * sizeof (long));
+    pool_register (0, Objects[i], OBJECT_WORDS * sizeof (long));
+  }
+  bench_shuffle (Order, NUM_OBJECTS);
+
+  BENCH_LOOP ("sample", "unchecked", iterations,
+              total += sum_unchecked (Objects[Order[bench_i % NUM_OBJECTS]]));
+
+  for (i = 0; i < sizeof (rates) / sizeof (rates[0]); ++i) {
+    __sc_sample_set_rate (rates[i]);
+    BENCH_LOOP ("sample", names[i], iterations,
+                total += sum (Objects[Order[bench_i % NUM_OBJECTS]]));
+  }
+
+  bench_sink = (void *) total;
+  return 0;
+}
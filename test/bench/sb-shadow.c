@@ -0,0 +1,165 @@
+/*===- sb-shadow.c - SoftBound metadata layouts on pointer chasing --------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This benchmark compares the trie and the linear shadow that the SoftBound
+ * run-time can use to hold the metadata of pointers stored in memory.  It
+ * walks a linked list and searches a binary tree whose nodes are scattered
+ * through the heap, doing what SoftBound instrumentation does for each step:
+ * the metadata of the loaded pointer is looked up and the next dereference is
+ * checked with it.  Building the structures stores the metadata of every link.
+ *
+ * The program is built twice with the run-time compiled in, once for each
+ * layout; BENCH_CONFIG names the layout in the results.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+#include "softboundcets.h"
+
+#define NUM_NODES (1 << 16)
+
+struct list {
+  struct list * next;
+  long value;
+};
+
+struct tree {
+  struct tree * left;
+  struct tree * right;
+  unsigned key;
+};
+
+static unsigned Order[NUM_NODES];
+
+/*
+ * Function: store_ptr()
+ *
+ * Description:
+ *  Store a pointer to an object and its metadata, as instrumented code does.
+ */
+static void
+store_ptr (void * slot, void * ptr, size_t size) {
+  *(void **) slot = ptr;
+  __softboundcets_metadata_store (slot, ptr, (char *) ptr + size, 1,
+                                  __softboundcets_global_lock);
+}
+
+/*
+ * Function: load_ptr()
+ *
+ * Description:
+ *  Load a pointer and check that an object of the specified size can be read
+ *  through it, as instrumented code does before dereferencing it.
+ */
+static inline void *
+load_ptr (void * slot, size_t size) {
+  void * ptr = *(void **) slot;
+  __softboundcets_trie_entry_t * entry = __softboundcets_metadata_entry (slot);
+  if (ptr)
+    __softboundcets_spatial_load_dereference_check (entry->base, entry->bound,
+                                                    ptr, size);
+  return ptr;
+}
+
+/*
+ * Function: insert()
+ *
+ * Description:
+ *  Insert a node with the specified key into the tree.
+ */
+static void
+insert (struct tree ** root, unsigned key) {
+  struct tree ** slot = root;
+  struct tree * node;
+  while ((node = load_ptr (slot, sizeof (struct tree))))
+    slot = (key < node->key) ? &node->left : &node->right;
+
+  node = malloc (sizeof (struct tree));
+  store_ptr (&node->left, 0, 0);
+  store_ptr (&node->right, 0, 0);
+  node->key = key;
+  store_ptr (slot, node, sizeof (struct tree));
+}
+
+/*
+ * Function: find()
+ *
+ * Description:
+ *  Return the depth at which the key is found in the tree.
+ */
+static unsigned
+find (struct tree ** root, unsigned key) {
+  unsigned depth = 0;
+  struct tree * node = load_ptr (root, sizeof (struct tree));
+  while (node && node->key != key) {
+    node = load_ptr ((key < node->key) ? &node->left : &node->right,
+                     sizeof (struct tree));
+    ++depth;
+  }
+  return depth;
+}
+
+int
+softboundcets_pseudo_main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (16);
+  struct list ** nodes = malloc (NUM_NODES * sizeof (struct list *));
+  struct list * head;
+  struct tree * root = 0;
+  unsigned long total = 0;
+  unsigned long i;
+  unsigned j;
+  double start;
+
+  /*
+   * Link the list nodes in a random order so that consecutive nodes are not
+   * adjacent in memory.
+   */
+  bench_shuffle (Order, NUM_NODES);
+  for (j = 0; j < NUM_NODES; ++j) {
+    nodes[j] = malloc (sizeof (struct list));
+    nodes[j]->value = j;
+  }
+
+  start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    for (j = 0; j < NUM_NODES - 1; ++j)
+      store_ptr (&nodes[Order[j]]->next, nodes[Order[j + 1]],
+                 sizeof (struct list));
+    store_ptr (&nodes[Order[NUM_NODES - 1]]->next, 0, 0);
+  }
+  bench_report ("sb-shadow", "list-link", iterations * NUM_NODES,
+                bench_now () - start);
+  store_ptr (&head, nodes[Order[0]], sizeof (struct list));
+
+  start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    struct list * node;
+    for (node = load_ptr (&head, sizeof (struct list)); node;
+         node = load_ptr (&node->next, sizeof (struct list)))
+      total += node->value;
+  }
+  bench_report ("sb-shadow", "list-walk", iterations * NUM_NODES,
+                bench_now () - start);
+
+  start = bench_now ();
+  for (j = 0; j < NUM_NODES; ++j)
+    insert (&root, Order[j]);
+  bench_report ("sb-shadow", "tree-insert", NUM_NODES, bench_now () - start);
+
+  start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    for (j = 0; j < NUM_NODES; j += 4)
+      total += find (&root, j);
+  }
+  bench_report ("sb-shadow", "tree-find", iterations * (NUM_NODES / 4),
+                bench_now () - start);
+
+  bench_sink = (void *) total;
+  return 0;
+}
@@ -0,0 +1,109 @@
+/*===- startup.c - Startup latency of the debug run-time ------------------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This benchmark measures how much the debug run-time adds to the time needed
+ * to start and exit a short-lived program.  It runs itself repeatedly with a
+ * large argument list and environment, as a command line tool started by a
+ * build system or a shell script would be, and times:
+ *
+ *   spawn-native - A child that exits immediately.
+ *   spawn-init   - A child that initializes the run-time and registers argv,
+ *                  as the code added by SAFECode to main() does.
+ *   spawn-lookup - Like spawn-init, but the child also checks a string of
+ *                  argv, which registers the arguments and environment.
+ *
+ * The cost of starting the run-time is the difference between the results.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#include <spawn.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#define NUM_ARGS 256
+#define NUM_ENVS 256
+
+extern void pool_init_runtime (unsigned, unsigned, unsigned);
+extern void * poolargvregister (int, char **);
+extern size_t pool_strlen (void *, const char *, const uint8_t);
+
+extern char ** environ;
+
+/*
+ * Function: spawn()
+ *
+ * Description:
+ *  Run this program in the specified mode the specified number of times and
+ *  report the elapsed time.
+ */
+static void
+spawn (const char * name, const char * mode, unsigned long iterations) {
+  static char argbuf[NUM_ARGS][32];
+  static char envbuf[NUM_ENVS][64];
+  char * args[NUM_ARGS + 3];
+  char * envs[NUM_ENVS + 1];
+  unsigned long i;
+  unsigned j;
+
+  args[0] = "startup";
+  args[1] = (char *) mode;
+  for (j = 0; j < NUM_ARGS; ++j) {
+    snprintf (argbuf[j], sizeof (argbuf[j]), "--argument-%u", j);
+    args[j + 2] = argbuf[j];
+  }
+  args[NUM_ARGS + 2] = 0;
+
+  for (j = 0; j < NUM_ENVS; ++j) {
+    snprintf (envbuf[j], sizeof (envbuf[j]),
+              "BENCH_VARIABLE_%u=/usr/local/share/benchmark/%u", j, j);
+    envs[j] = envbuf[j];
+  }
+  envs[NUM_ENVS] = 0;
+
+  double start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    pid_t pid;
+    int status;
+    if (posix_spawn (&pid, "/proc/self/exe", 0, 0, args, envs) != 0) {
+      perror ("posix_spawn");
+      exit (1);
+    }
+    waitpid (pid, &status, 0);
+  }
+  bench_report ("startup", name, iterations, bench_now () - start);
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (1000);
+
+  if (argc > 1 && strcmp (argv[1], "native") == 0)
+    return 0;
+
+  if (argc > 1 && strcmp (argv[1], "init") == 0) {
+    pool_init_runtime (0, 0, 0);
+    poolargvregister (argc, argv);
+    return 0;
+  }
+
+  if (argc > 1 && strcmp (argv[1], "lookup") == 0) {
+    pool_init_runtime (0, 0, 0);
+    poolargvregister (argc, argv);
+    bench_sink = (void *) pool_strlen (0, argv[argc - 1], 1);
+    return 0;
+  }
+
+  spawn ("spawn-native", "native", iterations);
+  spawn ("spawn-init", "init", iterations);
+  spawn ("spawn-lookup", "lookup", iterations);
+  return 0;
+}
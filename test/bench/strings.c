@@ -0,0 +1,77 @@
+/*===- strings.c - String processing workload -----------------------------===*
+ *
+ *                          The SAFECode Compiler
+ *
+ * This file was developed by the LLVM research group and is distributed under
+ * the University of Illinois Open Source License. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===*
+ *
+ * This workload builds records with the C string functions, splits them into
+ * fields, and sorts the fields.  Nearly every operation goes through one of
+ * the checked C standard library wrappers.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#include "bench.h"
+
+#include <string.h>
+
+#define NUM_FIELDS 8
+#define LINE_SIZE 256
+
+static const char * Words[] = {
+  "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+  "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa"
+};
+
+static int
+compare (const void * a, const void * b) {
+  return strcmp (*(char * const *) a, *(char * const *) b);
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned long iterations = bench_iterations (500000);
+  char * fields[NUM_FIELDS];
+  char line[LINE_SIZE];
+  char copy[LINE_SIZE];
+  unsigned long total = 0;
+  unsigned long i;
+  double start;
+
+  start = bench_now ();
+  for (i = 0; i < iterations; ++i) {
+    unsigned nfields = 0;
+    unsigned j;
+    char * p;
+
+    /* Build a comma separated record. */
+    strcpy (line, Words[i & 15]);
+    for (j = 1; j < NUM_FIELDS; ++j) {
+      strcat (line, ",");
+      strcat (line, Words[(i * 31 + j * 7) & 15]);
+    }
+
+    /* Split the record into fields. */
+    strncpy (copy, line, LINE_SIZE - 1);
+    copy[LINE_SIZE - 1] = '\0';
+    for (p = copy; p && nfields < NUM_FIELDS; ++nfields) {
+      fields[nfields] = p;
+      p = strchr (p, ',');
+      if (p)
+        *p++ = '\0';
+    }
+
+    /* Sort the fields and fold them into the checksum. */
+    qsort (fields, nfields, sizeof (fields[0]), compare);
+    for (j = 0; j < nfields; ++j)
+      total += strlen (fields[j]) * (j + 1);
+    total += memcmp (line, copy, strlen (line)) != 0;
+  }
+  bench_report ("strings", "build-split-sort", iterations,
+                bench_now () - start);
+
+  bench_sink = (void *) total;
+  return 0;
+}
@@ -0,0 +1,30 @@
+// RUN: test.sh -e -t %t %s
+//
+// TEST: extheap-001
+//
+// Description:
+//  Test that indexing past the end of a heap object allocated by the C
+//  library is detected.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+main (int argc, char ** argv) {
+  //
+  // The bounds of the object include the slack at the end of its malloc
+  // chunk, which is less than two words, so read past that as well.
+  //
+  char * str = strdup ("external heap object");
+  unsigned size = sizeof ("external heap object") + 2 * sizeof (size_t);
+  unsigned index;
+  int sum = 0;
+  for (index = 0; index < size; ++index) {
+    sum += str[index];
+  }
+
+  printf ("%d\n", sum);
+  return 0;
+}
@@ -0,0 +1,32 @@
+// RUN: test.sh -p -t %t %s
+//
+// TEST: extheap-002
+//
+// Description:
+//  Test that accessing a heap object allocated by the C library within its
+//  bounds, both before and after an unrelated object is freed, does not cause
+//  a problem.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+main (int argc, char ** argv) {
+  char * first = realpath ("/", NULL);
+  char * second;
+  int index;
+  int sum = 0;
+
+  for (index = 0; index < strlen (first); ++index)
+    sum += first[index];
+  free (first);
+
+  second = realpath ("/", NULL);
+  for (index = 0; index < strlen (second); ++index)
+    sum += second[index];
+
+  printf ("%d\n", sum);
+  return 0;
+}
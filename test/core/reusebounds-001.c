@@ -0,0 +1,36 @@
+// RUN: test.sh -p -t %t %s
+//
+// TEST: reusebounds-001
+//
+// Description:
+//  Test that several in-bounds accesses to the same heap object, some of
+//  which are checked against bounds found by an earlier check, do not cause
+//  a problem.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct point {
+  int x;
+  int y;
+  int z;
+};
+
+int
+main (int argc, char ** argv) {
+  struct point * p = malloc (sizeof (struct point) * 4);
+  int index;
+  int sum = 0;
+
+  for (index = 0; index < 4; ++index) {
+    p[index].x = index;
+    p[index].y = index * 2;
+    p[index].z = p[index].x + p[index].y;
+    sum += p[index].z;
+  }
+
+  free (p);
+  printf ("%d\n", sum);
+  return 0;
+}
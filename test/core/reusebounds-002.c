@@ -0,0 +1,26 @@
+// RUN: test.sh -e -t %t %s
+//
+// TEST: reusebounds-002
+//
+// Description:
+//  Test that an access past the end of a heap object is detected when an
+//  earlier access to the same object dominates it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+main (int argc, char ** argv) {
+  int * p = malloc (sizeof (int) * 4);
+  int sum;
+
+  p[0] = 1;
+  p[3] = 2;
+  sum = p[0] + p[3];
+  p[argc + 3] = sum;
+
+  printf ("%d\n", p[0]);
+  free (p);
+  return 0;
+}
@@ -0,0 +1,28 @@
+// RUN: test.sh -p -t %t %s
+
+#include <assert.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Ensure that a correct use of readv() is not flagged as an error.
+
+int main()
+{
+  int pipefd[2];
+  char buf[8];
+  struct iovec iov[2];
+
+  pipe(pipefd);
+  write(pipefd[1], "abcdefgh", 8);
+
+  // Read into two halves of the same buffer.
+  iov[0].iov_base = &buf[0];
+  iov[0].iov_len = 4;
+  iov[1].iov_base = &buf[4];
+  iov[1].iov_len = 4;
+  assert(readv(pipefd[0], iov, 2) == 8);
+  assert(memcmp(buf, "abcdefgh", 8) == 0);
+
+  return 0;
+}
@@ -0,0 +1,26 @@
+// RUN: test.sh -e -t %t %s
+// XFAIL: darwin
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+// A use of readv() whose second buffer overflows.
+
+int main()
+{
+  int pipefd[2];
+  char first[10];
+  char second[10];
+  struct iovec iov[2];
+
+  pipe(pipefd);
+  write(pipefd[1], "test", 4);
+
+  iov[0].iov_base = first;
+  iov[0].iov_len = sizeof(first);
+  iov[1].iov_base = &second[5];
+  iov[1].iov_len = 10;
+  readv(pipefd[0], iov, 2);
+
+  return 0;
+}
@@ -0,0 +1,34 @@
+// RUN: test.sh -p -t %t %s
+
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Ensure that correct uses of sendmsg() and recvmsg() are not flagged as
+// errors.
+
+int main()
+{
+  int sv[2];
+  char out[] = "hello";
+  char in[6];
+  struct iovec iov;
+  struct msghdr msg;
+
+  assert(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == 0);
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = out;
+  iov.iov_len = sizeof(out);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  assert(sendmsg(sv[0], &msg, 0) == sizeof(out));
+
+  iov.iov_base = in;
+  iov.iov_len = sizeof(in);
+  assert(recvmsg(sv[1], &msg, 0) == sizeof(in));
+  assert(strcmp(in, "hello") == 0);
+
+  return 0;
+}
@@ -0,0 +1,33 @@
+// RUN: test.sh -e -t %t %s
+// XFAIL: darwin
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// A use of sendmmsg() where the buffer of the second message overflows.
+
+int main()
+{
+  int sv[2];
+  char first[] = "first";
+  char second[] = "second";
+  struct iovec iov[2];
+  struct mmsghdr msgs[2];
+
+  socketpair(AF_UNIX, SOCK_DGRAM, 0, sv);
+
+  memset(msgs, 0, sizeof(msgs));
+  iov[0].iov_base = first;
+  iov[0].iov_len = sizeof(first);
+  iov[1].iov_base = second;
+  iov[1].iov_len = sizeof(second) + 16;
+  msgs[0].msg_hdr.msg_iov = &iov[0];
+  msgs[0].msg_hdr.msg_iovlen = 1;
+  msgs[1].msg_hdr.msg_iov = &iov[1];
+  msgs[1].msg_hdr.msg_iovlen = 1;
+  sendmmsg(sv[0], msgs, 2, 0);
+
+  return 0;
+}
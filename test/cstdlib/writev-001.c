@@ -0,0 +1,22 @@
+// RUN: test.sh -e -t %t %s
+// XFAIL: darwin
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+// A use of writev() with an iovec count larger than the iovec array.
+
+int main()
+{
+  int pipefd[2];
+  char buf[] = "test";
+  struct iovec iov[1];
+
+  pipe(pipefd);
+
+  iov[0].iov_base = buf;
+  iov[0].iov_len = 4;
+  writev(pipefd[1], iov, 2);
+
+  return 0;
+}
@@ -0,0 +1,172 @@
+//===-LTOCache.cpp - Cache of object files generated by LTO ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the cache of object files generated by the link time
+// optimizer.
+//
+// The SAFECode passes run over the whole merged module: CompleteChecks and
+// pool allocation use a whole-program points-to analysis, so a change to one
+// function can change the checks of any other.  Entries are therefore keyed
+// by the bitcode of the entire merged module rather than by single functions.
+//
+// Entries are written to a temporary file and renamed into place, so several
+// links may share a cache directory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "LTOCache.h"
+#include "llvm/Module.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/system_error.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+using namespace llvm;
+
+namespace {
+/// CacheHash - A 128-bit hash made of two independent 64-bit hashes of the
+/// same bytes.
+struct CacheHash {
+  uint64_t H1, H2;
+
+  CacheHash() : H1(14695981039346656037ULL), H2(0x2545F4914F6CDD1DULL) {}
+
+  void update(StringRef Data) {
+    for (StringRef::iterator I = Data.begin(), E = Data.end(); I != E; ++I) {
+      unsigned char C = *I;
+      H1 = (H1 ^ C) * 1099511628211ULL;
+      H2 = (H2 + C) * 0x9E3779B97F4A7C15ULL;
+      H2 ^= H2 >> 29;
+    }
+  }
+
+  std::string str() const {
+    char Buf[33];
+    snprintf(Buf, sizeof(Buf), "%016llx%016llx",
+             (unsigned long long) H1, (unsigned long long) H2);
+    return Buf;
+  }
+};
+
+/// CacheEntry - A file in the cache directory, for pruning.
+struct CacheEntry {
+  std::string Path;
+  uint64_t Size;
+  time_t LastUse;
+
+  bool operator<(const CacheEntry &RHS) const {
+    return LastUse < RHS.LastUse;
+  }
+};
+}
+
+std::string LTOCache::computeKey(const Module &M, StringRef Configuration) {
+  std::string Bitcode;
+  {
+    raw_string_ostream OS(Bitcode);
+    WriteBitcodeToFile(&M, OS);
+  }
+
+  CacheHash Hash;
+  Hash.update(Configuration);
+  Hash.update(StringRef("\0", 1));
+  Hash.update(Bitcode);
+  return Hash.str();
+}
+
+std::string LTOCache::getPath(const std::string &Key) const {
+  return _dir + "/" + Key + ".o";
+}
+
+bool LTOCache::lookup(const std::string &Key, raw_ostream &Out) {
+  std::string Path = getPath(Key);
+  OwningPtr<MemoryBuffer> Buffer;
+  if (MemoryBuffer::getFile(Path, Buffer, -1, false))
+    return false;
+
+  Out.write(Buffer->getBufferStart(), Buffer->getBufferSize());
+
+  // Mark the entry as recently used so that pruning keeps it.
+  utime(Path.c_str(), 0);
+  return true;
+}
+
+void LTOCache::insert(const std::string &Key, StringRef Object) {
+  bool Existed;
+  if (sys::fs::create_directories(_dir, Existed))
+    return;
+
+  std::string TempPath = _dir + "/tmp-XXXXXX";
+  int FD = mkstemp(&TempPath[0]);
+  if (FD == -1)
+    return;
+
+  bool Failed;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Object;
+    OS.close();
+    Failed = OS.has_error();
+    OS.clear_error();
+  }
+
+  if (Failed || rename(TempPath.c_str(), getPath(Key).c_str()) != 0) {
+    unlink(TempPath.c_str());
+    return;
+  }
+
+  prune();
+}
+
+/// prune - Remove the least recently used entries until the cache fits
+/// within its size limit.
+void LTOCache::prune() {
+  DIR *Dir = opendir(_dir.c_str());
+  if (!Dir)
+    return;
+
+  std::vector<CacheEntry> Entries;
+  uint64_t Total = 0;
+  while (struct dirent *D = readdir(Dir)) {
+    StringRef Name(D->d_name);
+    if (!Name.endswith(".o"))
+      continue;
+
+    CacheEntry Entry;
+    Entry.Path = _dir + "/" + Name.str();
+    struct stat Status;
+    if (stat(Entry.Path.c_str(), &Status) != 0)
+      continue;
+    Entry.Size = Status.st_size;
+    Entry.LastUse = Status.st_mtime;
+    Entries.push_back(Entry);
+    Total += Entry.Size;
+  }
+  closedir(Dir);
+
+  if (Total <= _maxBytes)
+    return;
+
+  std::sort(Entries.begin(), Entries.end());
+  for (unsigned i = 0, e = Entries.size(); i != e && Total > _maxBytes; ++i) {
+    if (unlink(Entries[i].Path.c_str()) == 0)
+      Total -= Entries[i].Size;
+  }
+}
@@ -0,0 +1,62 @@
+//===-LTOCache.h - Cache of object files generated by LTO -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the LTOCache class, which keeps the object files that
+// the link time optimizer generated for earlier links so that a link of the
+// same merged module does not run the SAFECode passes, the optimizer, and the
+// code generator again.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LTO_CACHE_H
+#define LTO_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/DataTypes.h"
+#include <string>
+
+namespace llvm {
+  class Module;
+  class raw_ostream;
+}
+
+//===----------------------------------------------------------------------===//
+/// LTOCache - A directory of object files named by a hash of the merged
+/// module they were generated from and of the options that affect code
+/// generation.  The least recently used files are removed when the directory
+/// grows beyond its size limit.
+///
+class LTOCache {
+public:
+  LTOCache(const std::string &Dir, uint64_t MaxBytes)
+    : _dir(Dir), _maxBytes(MaxBytes) {}
+
+  /// computeKey - Return the name of the cache entry for a module and a
+  /// description of everything else that affects the generated code.
+  static std::string computeKey(const llvm::Module &M,
+                                llvm::StringRef Configuration);
+
+  /// lookup - Write the cached object file for Key to Out.  Returns false if
+  /// there is no such entry.
+  bool lookup(const std::string &Key, llvm::raw_ostream &Out);
+
+  /// insert - Add an object file to the cache and remove old entries if the
+  /// cache is too large.  Errors are ignored; the cache is only an
+  /// optimization.
+  void insert(const std::string &Key, llvm::StringRef Object);
+
+private:
+  std::string getPath(const std::string &Key) const;
+  void prune();
+
+  std::string _dir;
+  uint64_t _maxBytes;
+};
+
+#endif // LTO_CACHE_H
@@ -13,6 +13,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "LTOCodeGenerator.h"
+#include "LTOCache.h"
 #include "LTOModule.h"
 #include "llvm/Constants.h"
 #include "llvm/DataLayout.h"
@@ -26,6 +27,7 @@
 #include "llvm/Analysis/Verifier.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Config/config.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/MC/MCAsmInfo.h"
 #include "llvm/MC/MCContext.h"
 #include "llvm/MC/SubtargetFeature.h"
@@ -35,6 +37,8 @@
 #include "llvm/Target/TargetRegisterInfo.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/MemoryBuffer.h"
@@ -43,8 +47,12 @@
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Program.h"
 #include "llvm/Support/system_error.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/ADT/OwningPtr.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "poolalloc/PoolAllocate.h"
 #include "poolalloc/Heuristic.h"
 #include "poolalloc/RunTimeAssociate.h"
@@ -65,6 +73,22 @@
 #include <iostream>
 #endif
 
+#include <algorithm>
+
+#if LLVM_ENABLE_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_DLFCN_H
+#include <dlfcn.h>
+#endif
+#include <sys/stat.h>
+
+// The revision of the SAFECode sources, which the Makefile provides
+#ifndef SAFECODE_BUILD_ID
+#define SAFECODE_BUILD_ID "unknown"
+#endif
+
 using namespace llvm;
 
 static cl::opt<bool>
@@ -75,6 +99,34 @@ static cl::opt<bool>
 DisableGVNLoadPRE("disable-gvn-loadpre", cl::init(false),
   cl::desc("Do not run the GVN load PRE pass"));
 
+static cl::opt<bool>
+DisableSCPostOpt("disable-sc-post-opt", cl::init(false),
+  cl::desc("Do not optimize the code after the SAFECode checks are final"));
+
+static cl::opt<bool>
+DisableReuseBounds("disable-sc-reuse-bounds", cl::init(false),
+  cl::desc("Do not reuse object bounds across the SAFECode checks "
+           "they dominate"));
+
+static cl::opt<bool>
+SampleChecksOpt("sc-sample-checks", cl::init(false),
+  cl::desc("Run the SAFECode checks on a sample of function calls "
+           "(rate set by $SAFECODE_SAMPLE_RATE)"));
+
+static cl::opt<unsigned>
+CodeGenPartitions("sc-codegen-partitions", cl::init(1),
+  cl::desc("Number of module partitions to generate code for in parallel"));
+
+static cl::opt<std::string>
+LTOCacheDir("sc-lto-cache-dir", cl::init(""),
+  cl::desc("Directory in which to cache generated object files "
+           "(default: $SAFECODE_LTO_CACHE)"));
+
+static cl::opt<unsigned>
+LTOCacheSizeMB("sc-lto-cache-size-mb", cl::init(1024),
+  cl::desc("Size in megabytes beyond which old cached object files "
+           "are removed"));
+
 const char* LTOCodeGenerator::getVersionString() {
 #ifdef LLVM_VERSION_INFO
   return PACKAGE_NAME " version " PACKAGE_VERSION ", " LLVM_VERSION_INFO;
@@ -399,6 +451,76 @@ bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
   // mark which symbols can not be internalized
   this->applyScopeRestrictions();
 
+  // Reuse the object file of an earlier link of the same module if there is
+  // a cache of object files.
+  std::string CacheDir = LTOCacheDir;
+  if (CacheDir.empty())
+    if (const char *Env = getenv("SAFECODE_LTO_CACHE"))
+      CacheDir = Env;
+  if (CacheDir.empty())
+    return this->optimizeAndGenerate(out, errMsg);
+
+  LTOCache Cache(CacheDir, (uint64_t) LTOCacheSizeMB << 20);
+  std::string Key = LTOCache::computeKey(*mergedModule,
+                                         this->getCacheConfiguration());
+  if (Cache.lookup(Key, out))
+    return false;
+
+  std::string Object;
+  {
+    raw_string_ostream ObjectOut(Object);
+    if (this->optimizeAndGenerate(ObjectOut, errMsg))
+      return true;
+  }
+
+  out << Object;
+  Cache.insert(Key, Object);
+  return false;
+}
+
+/// getBuildIdentity - Identify the build of SAFECode that generates code.
+/// This is the source revision recorded when the library was built and the
+/// size and modification time of the library itself, which change whenever
+/// it is relinked with different passes.
+static std::string getBuildIdentity() {
+  std::string Identity;
+  raw_string_ostream OS(Identity);
+  OS << SC_PACKAGE_VERSION << ' ' << SAFECODE_BUILD_ID;
+#ifdef HAVE_DLFCN_H
+  Dl_info Info;
+  struct stat Status;
+  if (dladdr((void *)&getBuildIdentity, &Info) && Info.dli_fname &&
+      stat(Info.dli_fname, &Status) == 0)
+    OS << ' ' << Info.dli_fname << ' ' << (uint64_t) Status.st_size << ' '
+       << (uint64_t) Status.st_mtime;
+#endif
+  return OS.str();
+}
+
+/// getCacheConfiguration - Describe everything other than the merged module
+/// that affects the object file generated for it.
+std::string LTOCodeGenerator::getCacheConfiguration() {
+  static const std::string BuildIdentity = getBuildIdentity();
+  std::string Config;
+  raw_string_ostream OS(Config);
+  OS << getVersionString() << '\n'
+     << BuildIdentity << '\n'
+     << _linker.getModule()->getTargetTriple() << '\n'
+     << _mCpu << '\n'
+     << _codeModel << ' ' << _emitDwarfDebugInfo << '\n';
+  for (unsigned i = 0, e = _codegenOptions.size(); i != e; ++i)
+    OS << _codegenOptions[i] << '\n';
+  OS << DisableInline << DisableGVNLoadPRE << DisableSCPostOpt
+     << DisableReuseBounds << SampleChecksOpt << ' ' << CodeGenPartitions;
+  return OS.str();
+}
+
+/// optimizeAndGenerate - Run the optimizer and the SAFECode passes on the
+/// merged module and generate code for it.
+bool LTOCodeGenerator::optimizeAndGenerate(raw_ostream &out,
+                                           std::string &errMsg) {
+  Module* mergedModule = _linker.getModule();
+
   // Instantiate the pass manager to organize the passes.
   PassManager passes;
 
@@ -482,6 +604,31 @@ bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
       passes.add(new LowerSafecodeIntrinsic(MapStart, MapEnd));
 #endif
 
+      // Split each checked function into checked and unchecked versions and
+      // choose between them on each call.  This must run after the checks are
+      // final and before they are rewritten into inline code.
+      if (SampleChecksOpt)
+        passes.add(new SampleChecks());
+
+      // Look up each object's bounds once for the checks it dominates.  This
+      // must run after the pool handles of the checks are final.
+      if (!DisableReuseBounds)
+        passes.add(new ReuseObjectBounds());
+
+      // Clean up now that the checks are final.  Inlining the fast checks
+      // turns them into plain comparisons that LICM can hoist out of loops
+      // and GVN can merge with the comparisons of other checks.
+      if (!DisableSCPostOpt) {
+        passes.add(createInlineFastChecksPass());
+        passes.add(createInstructionCombiningPass());
+        passes.add(createCFGSimplificationPass());
+        passes.add(createLICMPass());
+        passes.add(createGVNPass(DisableGVNLoadPRE));
+        passes.add(createInstructionCombiningPass());
+        passes.add(createCFGSimplificationPass());
+        passes.add(createGlobalDCEPass());
+      }
+
      // Run our queue of passes all at once now, efficiently.
      passes.run(*mergedModule);
 
@@ -506,6 +653,19 @@ bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
 #endif
    }
 
+  // Generate code for several partitions of the module in parallel if
+  // requested.  If that fails, say why and generate code for the whole
+  // module here.
+  if (CodeGenPartitions > 1) {
+    std::string PartitionErr;
+    if (!this->generatePartitions(out, CodeGenPartitions, PartitionErr)) {
+      delete codeGenPasses;
+      return false;
+    }
+    errs() << "warning: could not generate code for module partitions: "
+           << PartitionErr << "\n";
+  }
+
   // Run the code generator, and write assembly file
   codeGenPasses->doInitialization();
 
@@ -520,6 +680,279 @@ bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
   return false; // success
 }
 
+/// PartitionJob - The work of generating code for one partition of the merged
+/// module.  Each job parses its own copy of the module into its own context
+/// so that the jobs can run in parallel.
+namespace {
+struct PartitionJob {
+  const std::string *Bitcode;
+  const StringMap<unsigned> *FunctionPartition;
+  unsigned Index;
+  std::string ObjPath;
+  const Target *March;
+  std::string Triple;
+  std::string CPU;
+  std::string Features;
+  TargetOptions Options;
+  Reloc::Model RelocModel;
+  CodeModel::Model CMModel;
+  CodeGenOpt::Level OptLevel;
+  std::string ErrMsg;
+  bool Failed;
+};
+}
+
+/// promoteLocalSymbol - Give a symbol with local linkage a hidden external
+/// name so that it can be referenced from the other partitions.
+static void promoteLocalSymbol(GlobalValue &GV) {
+  if (!GV.hasLocalLinkage())
+    return;
+  GV.setName(GV.getName() + ".sc.part");
+  GV.setLinkage(GlobalValue::ExternalLinkage);
+  GV.setVisibility(GlobalValue::HiddenVisibility);
+}
+
+/// generatePartition - Generate an object file for the functions assigned to
+/// one partition.  Partition 0 also contains all global variables and
+/// module-level assembly.
+static void *generatePartition(void *Arg) {
+  PartitionJob &Job = *static_cast<PartitionJob *>(Arg);
+  Job.Failed = true;
+
+  LLVMContext Context;
+  MemoryBuffer *Buffer = MemoryBuffer::getMemBuffer(*Job.Bitcode, "", false);
+  OwningPtr<Module> M(ParseBitcodeFile(Buffer, Context, &Job.ErrMsg));
+  delete Buffer;
+  if (!M)
+    return 0;
+
+  // Drop the bodies of the functions that belong to other partitions.
+  for (Module::iterator F = M->begin(), E = M->end(); F != E; ++F) {
+    if (F->isDeclaration())
+      continue;
+    StringMap<unsigned>::const_iterator I =
+      Job.FunctionPartition->find(F->getName());
+    if (I == Job.FunctionPartition->end() || I->second != Job.Index)
+      F->deleteBody();
+  }
+
+  // Only partition 0 defines the global variables.
+  if (Job.Index != 0) {
+    for (Module::global_iterator G = M->global_begin(),
+           E = M->global_end(); G != E; ) {
+      GlobalVariable *GV = G++;
+      if (GV->isDeclaration())
+        continue;
+      if (GV->hasAppendingLinkage()) {
+        GV->eraseFromParent();
+        continue;
+      }
+      GV->setInitializer(0);
+      GV->setLinkage(GlobalValue::ExternalLinkage);
+    }
+    M->setModuleInlineAsm("");
+  }
+
+  OwningPtr<TargetMachine> TM(
+    Job.March->createTargetMachine(Job.Triple, Job.CPU, Job.Features,
+                                   Job.Options, Job.RelocModel, Job.CMModel,
+                                   Job.OptLevel));
+  if (!TM) {
+    Job.ErrMsg = "could not create target machine";
+    return 0;
+  }
+
+  tool_output_file Obj(Job.ObjPath.c_str(), Job.ErrMsg,
+                       raw_fd_ostream::F_Binary);
+  if (!Job.ErrMsg.empty())
+    return 0;
+
+  {
+    PassManager CodeGenPasses;
+    CodeGenPasses.add(new DataLayout(*TM->getDataLayout()));
+    formatted_raw_ostream Out(Obj.os());
+    if (TM->addPassesToEmitFile(CodeGenPasses, Out,
+                                TargetMachine::CGFT_ObjectFile)) {
+      Job.ErrMsg = "target file type not supported";
+      return 0;
+    }
+    CodeGenPasses.run(*M);
+  }
+
+  Obj.os().close();
+  if (Obj.os().has_error()) {
+    Obj.os().clear_error();
+    Job.ErrMsg = "could not write " + Job.ObjPath;
+    return 0;
+  }
+
+  Obj.keep();
+  Job.Failed = false;
+  return 0;
+}
+
+/// generatePartitions - Split the merged module into partitions, generate
+/// code for them in parallel, and combine the object files with a
+/// relocatable link.  Returns true on failure, in which case the caller
+/// should generate code for the whole module.
+bool LTOCodeGenerator::generatePartitions(raw_ostream &out,
+                                          unsigned NumPartitions,
+                                          std::string &errMsg) {
+  Module *mergedModule = _linker.getModule();
+
+  // An alias must be in the same object file as its aliasee.  Keep it simple
+  // and generate modules with aliases in one piece.
+  if (!mergedModule->alias_empty()) {
+    errMsg = "module contains aliases";
+    return true;
+  }
+
+  // Find the programs needed to combine the partitions before doing any work.
+  sys::Path Linker = sys::Program::FindProgramByName("ld");
+  if (Linker.isEmpty()) {
+    errMsg = "could not find ld";
+    return true;
+  }
+
+  // Make the symbols with local linkage visible to the other partitions.
+  // This is done on a copy of the module so that the merged module is left
+  // unchanged if a later step fails and the caller generates code for it.
+  OwningPtr<Module> PartitionModule(CloneModule(mergedModule));
+  for (Module::iterator F = PartitionModule->begin(),
+         E = PartitionModule->end(); F != E; ++F)
+    promoteLocalSymbol(*F);
+  for (Module::global_iterator G = PartitionModule->global_begin(),
+         E = PartitionModule->global_end(); G != E; ++G)
+    promoteLocalSymbol(*G);
+
+  // Assign the largest functions first, each to the partition with the
+  // fewest instructions so far.
+  std::vector<std::pair<unsigned, Function *> > Functions;
+  for (Module::iterator F = PartitionModule->begin(),
+         E = PartitionModule->end(); F != E; ++F) {
+    if (F->isDeclaration())
+      continue;
+    unsigned Size = 0;
+    for (Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB)
+      Size += BB->size();
+    Functions.push_back(std::make_pair(Size, &*F));
+  }
+  std::sort(Functions.begin(), Functions.end());
+
+  StringMap<unsigned> FunctionPartition;
+  std::vector<unsigned> PartitionSize(NumPartitions, 0);
+  for (unsigned i = Functions.size(); i > 0; --i) {
+    unsigned Smallest = 0;
+    for (unsigned p = 1; p < NumPartitions; ++p)
+      if (PartitionSize[p] < PartitionSize[Smallest])
+        Smallest = p;
+    PartitionSize[Smallest] += Functions[i - 1].first;
+    FunctionPartition[Functions[i - 1].second->getName()] = Smallest;
+  }
+
+  std::string Bitcode;
+  {
+    raw_string_ostream OS(Bitcode);
+    WriteBitcodeToFile(PartitionModule.get(), OS);
+  }
+  PartitionModule.reset();
+
+  // Create the jobs and a temporary object file for each one.
+  std::vector<PartitionJob> Jobs(NumPartitions);
+  std::vector<sys::Path> TempFiles;
+  bool Failed = false;
+  for (unsigned p = 0; p < NumPartitions && !Failed; ++p) {
+    sys::PathWithStatus ObjPath("lto-llvm-part.o");
+    if (ObjPath.createTemporaryFileOnDisk(false, &errMsg)) {
+      Failed = true;
+      break;
+    }
+    sys::RemoveFileOnSignal(ObjPath);
+    TempFiles.push_back(ObjPath);
+
+    PartitionJob &Job = Jobs[p];
+    Job.Bitcode = &Bitcode;
+    Job.FunctionPartition = &FunctionPartition;
+    Job.Index = p;
+    Job.ObjPath = ObjPath.str();
+    Job.March = &_target->getTarget();
+    Job.Triple = _target->getTargetTriple();
+    Job.CPU = _target->getTargetCPU();
+    Job.Features = _target->getTargetFeatureString();
+    Job.Options = _target->Options;
+    Job.RelocModel = _target->getRelocationModel();
+    Job.CMModel = _target->getCodeModel();
+    Job.OptLevel = _target->getOptLevel();
+    Job.Failed = true;
+  }
+
+  // Run the jobs.
+  if (!Failed) {
+#if LLVM_ENABLE_THREADS
+    llvm_start_multithreaded();
+    std::vector<pthread_t> Threads(NumPartitions);
+    std::vector<bool> Started(NumPartitions, false);
+    for (unsigned p = 0; p < NumPartitions; ++p)
+      Started[p] = !pthread_create(&Threads[p], 0, generatePartition, &Jobs[p]);
+    for (unsigned p = 0; p < NumPartitions; ++p) {
+      if (Started[p])
+        pthread_join(Threads[p], 0);
+      else
+        generatePartition(&Jobs[p]);
+    }
+#else
+    for (unsigned p = 0; p < NumPartitions; ++p)
+      generatePartition(&Jobs[p]);
+#endif
+
+    for (unsigned p = 0; p < NumPartitions && !Failed; ++p) {
+      if (Jobs[p].Failed) {
+        errMsg = Jobs[p].ErrMsg;
+        Failed = true;
+      }
+    }
+  }
+
+  // Combine the object files with a relocatable link.
+  sys::PathWithStatus Combined("lto-llvm.o");
+  if (!Failed && Combined.createTemporaryFileOnDisk(false, &errMsg))
+    Failed = true;
+
+  if (!Failed) {
+    sys::RemoveFileOnSignal(Combined);
+    TempFiles.push_back(Combined);
+
+    std::vector<const char *> Args;
+    Args.push_back(Linker.c_str());
+    Args.push_back("-r");
+    Args.push_back("-o");
+    Args.push_back(Combined.c_str());
+    for (unsigned p = 0; p < NumPartitions; ++p)
+      Args.push_back(Jobs[p].ObjPath.c_str());
+    Args.push_back(0);
+    if (sys::Program::ExecuteAndWait(Linker, &Args[0], 0, 0, 0, 0, &errMsg)) {
+      if (errMsg.empty())
+        errMsg = "relocatable link of the partitions failed";
+      Failed = true;
+    }
+  }
+
+  if (!Failed) {
+    OwningPtr<MemoryBuffer> Buffer;
+    if (error_code ec = MemoryBuffer::getFile(Combined.c_str(), Buffer)) {
+      errMsg = ec.message();
+      Failed = true;
+    } else {
+      out.write(Buffer->getBufferStart(), Buffer->getBufferSize());
+    }
+  }
+
+  for (unsigned i = 0; i < TempFiles.size(); ++i)
+    TempFiles[i].eraseFromDisk();
+
+  return Failed;
+}
+
 /// setCodeGenDebugOptions - Set codegen debugging options to aid in debugging
 /// LTO problems.
 void LTOCodeGenerator::setCodeGenDebugOptions(const char *options) {
@@ -56,6 +56,10 @@ struct LTOCodeGenerator {
 
 private:
   bool generateObjectFile(llvm::raw_ostream &out, std::string &errMsg);
+  bool optimizeAndGenerate(llvm::raw_ostream &out, std::string &errMsg);
+  std::string getCacheConfiguration();
+  bool generatePartitions(llvm::raw_ostream &out, unsigned NumPartitions,
+                          std::string &errMsg);
   void applyScopeRestrictions();
   void applyRestriction(llvm::GlobalValue &GV,
                         std::vector<const char*> &mustPreserveList,
@@ -0,0 +1,178 @@
+//===-- scstat - Run-time Statistics Reader -------------------------------===//
+//
+//                     The SAFECode Project
+//
+// This file was developed by the LLVM research group and is distributed
+// under the University of Illinois Open Source License. See LICENSE.TXT for
+// details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program prints the statistics counters of a running program that was
+// compiled with SAFECode and started with SAFECODE_STATS=shm.  The counters
+// are read from the statistics page that the run-time publishes; the program
+// being watched is not stopped or otherwise disturbed.
+//
+// Usage: scstat [-i seconds] <pid>
+//
+// With -i, the counters are printed again every interval until the program
+// exits.
+//
+//===----------------------------------------------------------------------===//
+
+#include "safecode/Runtime/Telemetry.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+//
+// Function: usage()
+//
+// Description:
+//  Print how to use this program and exit.
+//
+static void
+usage (const char * name) {
+  fprintf (stderr, "Usage: %s [-i seconds] <pid>\n", name);
+  exit (1);
+}
+
+//
+// Function: map_page()
+//
+// Description:
+//  Map the statistics page of the specified process into memory.
+//
+// Return value:
+//  0 - The page could not be found or is not a valid statistics page.
+//  Otherwise, a pointer to the page is returned.
+//
+static const SCStatsPage *
+map_page (int pid) {
+  //
+  // Find the file holding the page.
+  //
+  char filename[256];
+  const char * dir = getenv ("SAFECODE_STATS_DIR");
+  snprintf (filename, sizeof (filename), SC_STATS_FILE_FORMAT,
+            dir ? dir : SC_STATS_DEFAULT_DIR, pid);
+  int fd = open (filename, O_RDONLY);
+  if (fd == -1) {
+    perror (filename);
+    return 0;
+  }
+
+  void * page = mmap (0, sizeof (SCStatsPage), PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (page == MAP_FAILED) {
+    perror ("mmap");
+    return 0;
+  }
+
+  //
+  // Make sure that the page was written by a compatible run-time.
+  //
+  const SCStatsPage * Page = (const SCStatsPage *) page;
+  if ((__atomic_load_n (&Page->magic, __ATOMIC_ACQUIRE) != SC_STATS_MAGIC) ||
+      (Page->version != SC_STATS_VERSION) ||
+      (Page->numCounters != SC_STAT_NUM_COUNTERS)) {
+    fprintf (stderr, "%s: not a SAFECode statistics page\n", filename);
+    munmap (page, sizeof (SCStatsPage));
+    return 0;
+  }
+
+  return Page;
+}
+
+//
+// Function: print_page()
+//
+// Description:
+//  Add up the counters of all threads and print them along with the values
+//  derived from them.
+//
+static void
+print_page (const SCStatsPage * Page) {
+  uint64_t totals[SC_STAT_NUM_COUNTERS];
+  unsigned rows = __atomic_load_n (&Page->rowsInUse, __ATOMIC_RELAXED);
+  if (rows > Page->numRows)
+    rows = Page->numRows;
+
+  for (unsigned counter = 0; counter < SC_STAT_NUM_COUNTERS; ++counter) {
+    totals[counter] = 0;
+    for (unsigned row = 0; row < rows; ++row)
+      totals[counter] += __atomic_load_n (&Page->counters[row][counter],
+                                          __ATOMIC_RELAXED);
+  }
+
+  printf ("SAFECode statistics (%.16s, pid %d):\n", Page->runtime, Page->pid);
+  for (unsigned counter = 0; counter < SC_STAT_NUM_COUNTERS; ++counter)
+    printf ("  %-20s %llu\n", SCStatNames[counter],
+            (unsigned long long) totals[counter]);
+
+  //
+  // The counters are read one at a time while they change, so the derived
+  // values may be slightly off while the program is running.
+  //
+  uint64_t regs = totals[SC_STAT_REGISTRATIONS];
+  uint64_t unregs = totals[SC_STAT_UNREGISTRATIONS];
+  printf ("  %-20s %lld\n", "live_objects", (long long) (regs - unregs));
+
+  uint64_t lookups = totals[SC_STAT_CACHE_HITS] + totals[SC_STAT_CACHE_MISSES];
+  if (lookups)
+    printf ("  %-20s %.2f%%\n", "cache_hit_rate",
+            100.0 * totals[SC_STAT_CACHE_HITS] / lookups);
+
+  if (totals[SC_STAT_SPLAY_LOOKUPS])
+    printf ("  %-20s %.2f\n", "avg_splay_depth",
+            (double) totals[SC_STAT_SPLAY_DEPTH] /
+            totals[SC_STAT_SPLAY_LOOKUPS]);
+  fflush (stdout);
+}
+
+int
+main (int argc, char ** argv) {
+  unsigned interval = 0;
+  int pid = 0;
+
+  //
+  // Parse the command line arguments.
+  //
+  int arg = 1;
+  if ((arg < argc) && (strcmp (argv[arg], "-i") == 0)) {
+    if (arg + 1 >= argc)
+      usage (argv[0]);
+    interval = atoi (argv[arg + 1]);
+    arg += 2;
+  }
+  if (arg + 1 != argc)
+    usage (argv[0]);
+  pid = atoi (argv[arg]);
+  if (pid <= 0)
+    usage (argv[0]);
+
+  const SCStatsPage * Page = map_page (pid);
+  if (!Page)
+    return 1;
+
+  //
+  // Print the counters once or, if an interval was given, until the program
+  // exits.  The run-time removes the file when the program exits, but our
+  // mapping stays valid, so check whether the process is still alive.
+  //
+  print_page (Page);
+  while (interval && (kill (pid, 0) == 0)) {
+    sleep (interval);
+    print_page (Page);
+  }
+
+  return 0;
+}